@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "scene/Camera.hpp"
+#include "scene/FrustumCulling.hpp"
+#include "scene/GltfLoader.hpp"
+#include "scene/SceneBvh.hpp"
+
+
+// Lays copies of the instance bounds of a scene out on grids of growing size and compares
+// BVH builds and queries against brute force loops over all of the boxes, e.g.
+//   bvh_benchmark [scene.gltf...]
+// Queries and the camera are fixed, so runs on the same scene are comparable. Fails when
+// queries of the BVH disagree with brute force.
+
+// Milliseconds taken by the call, averaged over all iterations
+template <class Func>
+static double measure(std::size_t iterations, Func&& func)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i)
+    func();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+static BoxesSoa replicate(const BoxesSoa& boxes, std::uint32_t grid_side, glm::vec3 spacing)
+{
+  BoxesSoa result;
+  result.resize(boxes.count * grid_side * grid_side);
+
+  std::size_t k = 0;
+  for (std::uint32_t x = 0; x < grid_side; ++x)
+    for (std::uint32_t z = 0; z < grid_side; ++z)
+      for (std::size_t i = 0; i < boxes.count; ++i, ++k)
+      {
+        result.centerX[k] = boxes.centerX[i] + spacing.x * static_cast<float>(x);
+        result.centerY[k] = boxes.centerY[i];
+        result.centerZ[k] = boxes.centerZ[i] + spacing.z * static_cast<float>(z);
+        result.extentX[k] = boxes.extentX[i];
+        result.extentY[k] = boxes.extentY[i];
+        result.extentZ[k] = boxes.extentZ[i];
+      }
+
+  return result;
+}
+
+static bool overlaps_sphere(const Aabb& box, glm::vec3 center, float radius)
+{
+  const glm::vec3 offset = glm::clamp(center, box.min, box.max) - center;
+  return glm::dot(offset, offset) <= radius * radius;
+}
+
+// World space boxes of all instances, the same ones SceneManager culls
+static std::optional<BoxesSoa> load_instance_bounds(
+  GltfLoader& loader, const std::filesystem::path& path)
+{
+  auto loaded = loader.loadModel(path);
+  if (!loaded.has_value())
+    return std::nullopt;
+
+  const auto instances = loader.processInstances(loaded->model);
+  auto meshes = loader.processMeshes(*loaded);
+  loader.computeMeshBounds(meshes, GltfLoader::extractPositions(meshes));
+
+  BoxesSoa bounds;
+  bounds.resize(instances.matrices.size());
+  for (std::size_t i = 0; i < instances.matrices.size(); ++i)
+  {
+    const auto& mesh = meshes.meshes[instances.meshes[i]];
+    Aabb meshBox{
+      .min = glm::vec3(std::numeric_limits<float>::max()),
+      .max = glm::vec3(std::numeric_limits<float>::lowest()),
+    };
+    for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+    {
+      meshBox.min = glm::min(meshBox.min, meshes.relemBounds[mesh.firstRelem + j].min);
+      meshBox.max = glm::max(meshBox.max, meshes.relemBounds[mesh.firstRelem + j].max);
+    }
+    bounds.set(i, meshBox, instances.matrices[i]);
+  }
+  return bounds;
+}
+
+// Without workers, the parallel build is serial too
+static bool benchmark_scene(const BoxesSoa& scene_bounds, ThreadPool* workers)
+{
+  Aabb sceneBox{
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(std::numeric_limits<float>::lowest()),
+  };
+  for (std::size_t i = 0; i < scene_bounds.count; ++i)
+    if (scene_bounds.extentX[i] >= 0)
+    {
+      const auto box = get_box(scene_bounds, i);
+      sceneBox.min = glm::min(sceneBox.min, box.min);
+      sceneBox.max = glm::max(sceneBox.max, box.max);
+    }
+
+  if (!(sceneBox.min.x <= sceneBox.max.x))
+  {
+    spdlog::warn("BVH benchmark: the scene has no bounds to replicate");
+    return false;
+  }
+
+  const glm::vec3 sceneSize = sceneBox.max - sceneBox.min;
+  const glm::vec3 spacing = sceneSize * 1.1f;
+
+  constexpr std::size_t QUERY_COUNT = 256;
+  constexpr std::size_t CULL_ITERATIONS = 16;
+
+  bool success = true;
+  for (std::uint32_t side : {1u, 2u, 4u, 8u, 16u})
+  {
+    const auto boxes = replicate(scene_bounds, side, spacing);
+    const glm::vec3 gridMin = sceneBox.min;
+    const glm::vec3 gridMax =
+      sceneBox.min + glm::vec3(spacing.x * side, sceneSize.y, spacing.z * side);
+
+    // Standing above a corner of the grid and looking across it
+    Camera camera;
+    camera.zFar = 2.0f * glm::length(gridMax - gridMin);
+    camera.lookAt(
+      glm::vec3(gridMin.x, gridMax.y + sceneSize.y, gridMin.z),
+      (gridMin + gridMax) * 0.5f,
+      glm::vec3(0, 1, 0));
+    const Frustum frustum = extract_frustum(camera.projTm(16.0f / 9.0f) * camera.viewTm());
+
+    SceneBvh bvh;
+    const double serialBuild = measure(1, [&] { bvh.build(boxes, nullptr); });
+    const double parallelBuild = measure(1, [&] { bvh.build(boxes, workers); });
+    const double refit = measure(1, [&] { bvh.refit(boxes); });
+
+    std::vector<std::uint32_t> flatVisible;
+    std::vector<std::uint32_t> bvhVisible;
+    const double flatCull =
+      measure(CULL_ITERATIONS, [&] { cull_boxes(frustum, boxes, flatVisible); });
+    const double bvhCull = measure(CULL_ITERATIONS, [&] {
+      bvhVisible.clear();
+      bvh.cullFrustum(frustum, bvhVisible);
+    });
+
+    // A fixed seed, so that runs on the same scene are comparable
+    std::mt19937 rng{side};
+    std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+    std::uniform_real_distribution<float> signedUnit{-1.0f, 1.0f};
+    std::vector<glm::vec3> points(QUERY_COUNT);
+    std::vector<glm::vec3> directions(QUERY_COUNT);
+    for (std::size_t i = 0; i < QUERY_COUNT; ++i)
+    {
+      points[i] = gridMin + (gridMax - gridMin) * glm::vec3(unit(rng), unit(rng), unit(rng));
+      directions[i] = glm::normalize(glm::vec3(signedUnit(rng), -unit(rng), signedUnit(rng)));
+    }
+    const float radius = 0.05f * std::max(sceneSize.x, sceneSize.z);
+
+    std::vector<float> bruteDistances(QUERY_COUNT);
+    std::vector<float> bvhDistances(QUERY_COUNT);
+    const double bruteRays = measure(1, [&] {
+      for (std::size_t q = 0; q < QUERY_COUNT; ++q)
+      {
+        const glm::vec3 invDirection = 1.0f / directions[q];
+        float best = std::numeric_limits<float>::infinity();
+        for (std::size_t i = 0; i < boxes.count; ++i)
+        {
+          const auto distance = intersect_ray_box(points[q], invDirection, get_box(boxes, i), best);
+          if (distance.has_value())
+            best = *distance;
+        }
+        bruteDistances[q] = best;
+      }
+    });
+    const double bvhRays = measure(1, [&] {
+      for (std::size_t q = 0; q < QUERY_COUNT; ++q)
+      {
+        const auto hit =
+          bvh.raycast(SceneBvh::Ray{.origin = points[q], .direction = directions[q]});
+        bvhDistances[q] = hit.has_value() ? hit->distance : std::numeric_limits<float>::infinity();
+      }
+    });
+
+    // Both sides test the very same boxes in the same way, so results must match exactly.
+    // That's not the case for frustum culling, where SIMD and scalar math might disagree
+    // on boxes that touch the planes.
+    std::size_t mismatches = 0;
+    if (bruteDistances != bvhDistances)
+      ++mismatches;
+
+    std::size_t bruteOverlaps = 0;
+    std::size_t bvhOverlaps = 0;
+    std::vector<std::uint32_t> overlapping;
+    const double bruteSpheres = measure(1, [&] {
+      for (std::size_t q = 0; q < QUERY_COUNT; ++q)
+        for (std::size_t i = 0; i < boxes.count; ++i)
+          if (boxes.extentX[i] >= 0 && overlaps_sphere(get_box(boxes, i), points[q], radius))
+            ++bruteOverlaps;
+    });
+    const double bvhSpheres = measure(1, [&] {
+      for (std::size_t q = 0; q < QUERY_COUNT; ++q)
+      {
+        overlapping.clear();
+        bvh.overlapSphere(points[q], radius, overlapping);
+        bvhOverlaps += overlapping.size();
+      }
+    });
+    if (bruteOverlaps != bvhOverlaps)
+      ++mismatches;
+
+    spdlog::info(
+      "BVH benchmark: {} copies, {} boxes, {} nodes, build {:.2f} ms serial and {:.2f} ms "
+      "parallel, refit {:.2f} ms",
+      side * side,
+      boxes.count,
+      bvh.getNodes().size(),
+      serialBuild,
+      parallelBuild,
+      refit);
+    spdlog::info(
+      "BVH benchmark:   frustum culling {:.3f} ms flat SIMD vs {:.3f} ms BVH, {} vs {} visible",
+      flatCull,
+      bvhCull,
+      flatVisible.size(),
+      bvhVisible.size());
+    spdlog::info(
+      "BVH benchmark:   {} rays {:.3f} ms brute force vs {:.3f} ms BVH",
+      QUERY_COUNT,
+      bruteRays,
+      bvhRays);
+    spdlog::info(
+      "BVH benchmark:   {} spheres {:.3f} ms brute force vs {:.3f} ms BVH, {} overlaps",
+      QUERY_COUNT,
+      bruteSpheres,
+      bvhSpheres,
+      bvhOverlaps);
+    if (mismatches != 0)
+    {
+      spdlog::error("BVH benchmark: {} kinds of queries disagree with brute force", mismatches);
+      success = false;
+    }
+  }
+  return success;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::filesystem::path> scenes(argv + 1, argv + argc);
+  // Large enough to be interesting when replicated
+  if (scenes.empty())
+    scenes = {GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/lovely_town/scene.gltf"};
+
+  // Also used for the parallel builds, the main thread participates in both
+  GltfLoader loader{GltfLoader::CreateInfo{
+    .workerThreadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1,
+  }};
+
+  bool success = true;
+  for (const auto& scene : scenes)
+  {
+    spdlog::info("BVH benchmark: {}", scene.filename());
+    const auto bounds = load_instance_bounds(loader, scene);
+    success = bounds.has_value() && benchmark_scene(*bounds, loader.getWorkers()) && success;
+  }
+  return success ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <limits>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <etna/Etna.hpp>
+#include <glm/ext.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "scene/Camera.hpp"
+#include "scene/SceneManager.hpp"
+#include "occlusion/SoftwareOcclusion.hpp"
+
+
+// Flies the camera along a few fixed paths through every scene and culls its instances
+// with frustum culling alone and with software occlusion culling on top, e.g.
+//   occlusion_benchmark [scene.gltf...]
+// Reports how many instances each one leaves and how long it takes per frame, the latter
+// both with serial and parallel rasterization. Those two must come up with exactly the same
+// depth and visible instances, otherwise the benchmark fails. SceneManager needs Vulkan to
+// load scenes, but no window is opened, so software implementations like lavapipe work too.
+
+static constexpr std::size_t FRAME_COUNT = 256;
+static constexpr float ASPECT = 16.0f / 9.0f;
+
+struct CameraPose
+{
+  glm::vec3 from;
+  glm::vec3 to;
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+    .count();
+}
+
+static bool benchmark_scene(SceneManager& scene, ThreadPool& workers)
+{
+  const auto& bounds = scene.getInstanceBounds();
+
+  Aabb sceneBox{
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(std::numeric_limits<float>::lowest()),
+  };
+  for (std::size_t i = 0; i < bounds.count; ++i)
+    if (bounds.extentX[i] >= 0)
+    {
+      const auto box = get_box(bounds, i);
+      sceneBox.min = glm::min(sceneBox.min, box.min);
+      sceneBox.max = glm::max(sceneBox.max, box.max);
+    }
+
+  if (!(sceneBox.min.x <= sceneBox.max.x))
+  {
+    spdlog::warn("Occlusion benchmark: the scene has no bounds to fly through");
+    return false;
+  }
+
+  const glm::vec3 center = (sceneBox.min + sceneBox.max) * 0.5f;
+  const glm::vec3 size = sceneBox.max - sceneBox.min;
+  // Street level, where occlusion matters, and a bird's eye view, where it hardly does
+  const float eyeHeight = sceneBox.min.y + std::min(2.0f, size.y * 0.5f);
+  const float flightHeight = sceneBox.max.y + size.y * 0.5f;
+
+  // Poses are given for t in [0, 1) along the path, relative to the center
+  // and the size of the scene and at the height of the path
+  struct CameraPath
+  {
+    const char* name;
+    float height;
+    CameraPose (*pose)(float t, glm::vec3 center, glm::vec3 size, float height);
+  };
+  const CameraPath paths[] = {
+    {"walk around",
+     eyeHeight,
+     [](float t, glm::vec3 c, glm::vec3 s, float h) {
+       const float angle = t * glm::two_pi<float>();
+       const glm::vec3 from{
+         c.x + 0.35f * s.x * std::cos(angle), h, c.z + 0.35f * s.z * std::sin(angle)};
+       const glm::vec3 tangent{-s.x * std::sin(angle), 0.0f, s.z * std::cos(angle)};
+       return CameraPose{from, from + tangent};
+     }},
+    {"walk across",
+     eyeHeight,
+     [](float t, glm::vec3 c, glm::vec3 s, float h) {
+       const glm::vec3 from{c.x + (t - 0.5f) * s.x, h, c.z};
+       return CameraPose{from, from + glm::vec3(1, 0, 0)};
+     }},
+    {"fly over",
+     flightHeight,
+     [](float t, glm::vec3 c, glm::vec3 s, float h) {
+       const float angle = t * glm::two_pi<float>();
+       const glm::vec3 from{
+         c.x + 0.5f * s.x * std::cos(angle), h, c.z + 0.5f * s.z * std::sin(angle)};
+       return CameraPose{from, c};
+     }},
+  };
+
+  OcclusionRasterizer serialRasterizer({});
+  OcclusionRasterizer parallelRasterizer({.workers = &workers});
+
+  bool success = true;
+  for (const auto& path : paths)
+  {
+    double frustumMs = 0;
+    double serialMs = 0;
+    double parallelMs = 0;
+    std::size_t frustumVisible = 0;
+    SoftwareOcclusionStats total;
+    std::size_t mismatches = 0;
+
+    std::vector<std::uint32_t> frustumResult;
+    std::vector<std::uint32_t> serialVisible;
+    std::vector<std::uint32_t> parallelVisible;
+    for (std::size_t frame = 0; frame < FRAME_COUNT; ++frame)
+    {
+      const float t = static_cast<float>(frame) / static_cast<float>(FRAME_COUNT);
+      const auto pose = path.pose(t, center, size, path.height);
+
+      Camera camera;
+      camera.lookAt(pose.from, pose.to, glm::vec3(0, 1, 0));
+      const glm::mat4x4 viewProj = camera.projTm(ASPECT) * camera.viewTm();
+
+      // Occlusion off, this is all the renderer culls by default
+      auto start = std::chrono::steady_clock::now();
+      cull_boxes(extract_frustum(viewProj), bounds, frustumResult);
+      frustumMs += elapsed_ms(start);
+      frustumVisible += frustumResult.size();
+
+      // Occlusion on, frustum culling is repeated so that the time covers the whole path
+      start = std::chrono::steady_clock::now();
+      cull_boxes(extract_frustum(viewProj), bounds, serialVisible);
+      const auto stats =
+        cull_occluded_instances(serialRasterizer, scene, viewProj, pose.from, serialVisible);
+      serialMs += elapsed_ms(start);
+
+      start = std::chrono::steady_clock::now();
+      cull_boxes(extract_frustum(viewProj), bounds, parallelVisible);
+      cull_occluded_instances(parallelRasterizer, scene, viewProj, pose.from, parallelVisible);
+      parallelMs += elapsed_ms(start);
+
+      total.occluderCount += stats.occluderCount;
+      total.triangleCount += stats.triangleCount;
+      total.occludedCount += stats.occludedCount;
+
+      const auto serialDepth = serialRasterizer.getDepth();
+      const auto parallelDepth = parallelRasterizer.getDepth();
+      if (
+        serialVisible != parallelVisible ||
+        !std::equal(serialDepth.begin(), serialDepth.end(), parallelDepth.begin()))
+        ++mismatches;
+    }
+
+    const auto average = [](std::size_t sum) {
+      return static_cast<double>(sum) / static_cast<double>(FRAME_COUNT);
+    };
+    spdlog::info(
+      "Occlusion benchmark: {}, {} instances, {:.1f} occluders of {:.0f} triangles per frame",
+      path.name,
+      bounds.count,
+      average(total.occluderCount),
+      average(total.triangleCount));
+    spdlog::info(
+      "Occlusion benchmark:   occlusion off: {:.1f} visible, {:.1f} culled, {:.3f} ms",
+      average(frustumVisible),
+      static_cast<double>(bounds.count) - average(frustumVisible),
+      frustumMs / FRAME_COUNT);
+    spdlog::info(
+      "Occlusion benchmark:   occlusion on:  {:.1f} visible, {:.1f} culled, {:.3f} ms serial "
+      "vs {:.3f} ms with {} threads",
+      average(frustumVisible - total.occludedCount),
+      static_cast<double>(bounds.count) - average(frustumVisible - total.occludedCount),
+      serialMs / FRAME_COUNT,
+      parallelMs / FRAME_COUNT,
+      workers.getThreadCount() + 1);
+    if (mismatches != 0)
+    {
+      spdlog::error(
+        "Occlusion benchmark: {} of {} frames differ between serial and parallel rasterization",
+        mismatches,
+        FRAME_COUNT);
+      success = false;
+    }
+  }
+  return success;
+}
+
+static bool benchmark_scenes(std::span<const std::filesystem::path> scenes)
+{
+  // Same settings as the model bakery renderer, which culls with the same occluders
+  SceneManager sceneMgr{SceneManager::CreateInfo{
+    .workerThreadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1,
+    .generateLods = true,
+    .loadTextures = false,
+    .maxOccluderTriangles = 512,
+  }};
+  ThreadPool workers(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+
+  bool success = true;
+  for (const auto& scene : scenes)
+  {
+    spdlog::info("Occlusion benchmark: {}", scene.filename());
+    sceneMgr.selectScene(scene);
+    success = benchmark_scene(sceneMgr, workers) && success;
+  }
+  return success;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::filesystem::path> scenes(argv + 1, argv + argc);
+  // The streets of lovely_town hide a lot
+  if (scenes.empty())
+    scenes = {GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/lovely_town/scene.gltf"};
+
+  // No window, so no surface and no swapchain extensions either
+  etna::initialize(etna::InitParams{
+    .applicationName = "occlusion_benchmark",
+    .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
+  });
+
+  const bool success = benchmark_scenes(scenes);
+
+  etna::shutdown();
+  return success ? 0 : 1;
+}
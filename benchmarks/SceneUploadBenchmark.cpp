@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "render_utils/RingStagingUploader.hpp"
+#include "scene/SceneManager.hpp"
+
+
+// Measures how fast data gets to the GPU without opening a window, e.g.
+//   scene_upload_benchmark [scene.gltf...]
+// First, a large buffer is uploaded through staging rings of different sizes, where
+// a single segment is the old behaviour of waiting for every copy before the next one.
+// Then the scenes are loaded the same way the renderers load them, SceneManager reports
+// the throughput of their uploads by itself. Runs on software Vulkan implementations
+// like lavapipe too, pick one through VK_ICD_FILENAMES.
+
+static constexpr vk::DeviceSize UPLOAD_SIZE = 256 * 1024 * 1024;
+static constexpr int REPETITIONS = 3;
+
+struct StagingConfig
+{
+  vk::DeviceSize stagingSize;
+  std::uint32_t segmentCount;
+};
+
+static void benchmark_staging()
+{
+  auto& ctx = etna::get_context();
+  auto target = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = UPLOAD_SIZE,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "benchmark_target",
+  });
+
+  std::vector<std::byte> data(UPLOAD_SIZE);
+  for (std::size_t i = 0; i < data.size(); ++i)
+    data[i] = static_cast<std::byte>(i * 2654435761u >> 24);
+
+  constexpr vk::DeviceSize MIB = 1024 * 1024;
+  const std::array configs{
+    StagingConfig{16 * MIB, 1},
+    StagingConfig{16 * MIB, 4},
+    StagingConfig{64 * MIB, 1},
+    StagingConfig{64 * MIB, 4},
+    StagingConfig{64 * MIB, 8},
+  };
+
+  for (const auto& config : configs)
+  {
+    RingStagingUploader uploader{RingStagingUploader::CreateInfo{
+      .stagingSize = config.stagingSize,
+      .segmentCount = config.segmentCount,
+    }};
+
+    double best = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < REPETITIONS; ++i)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      uploader.uploadBuffer(target, 0, data);
+      uploader.wait();
+      best = std::min(
+        best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    spdlog::info(
+      "Staging {} MiB in {} segments: {:.1f} MB/s",
+      config.stagingSize / MIB,
+      config.segmentCount,
+      best > 0 ? static_cast<double>(UPLOAD_SIZE) / best / 1e6 : 0.0);
+  }
+}
+
+static void benchmark_scenes(std::span<const std::filesystem::path> scenes)
+{
+  SceneManager sceneMgr{SceneManager::CreateInfo{
+    .workerThreadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1,
+  }};
+
+  for (const auto& scene : scenes)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    sceneMgr.selectScene(scene);
+    const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("{}: loaded and uploaded in {:.2f} ms", scene.filename(), seconds * 1000.0);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::filesystem::path> scenes(argv + 1, argv + argc);
+  if (scenes.empty())
+    scenes = {
+      GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/lovely_town/scene.gltf",
+      GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf",
+    };
+
+  // No window, so no surface and no swapchain extensions either
+  etna::initialize(etna::InitParams{
+    .applicationName = "scene_upload_benchmark",
+    .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
+  });
+
+  benchmark_staging();
+  benchmark_scenes(scenes);
+
+  etna::shutdown();
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "scene/GltfLoader.hpp"
+#include "scene/VertexRepacking.hpp"
+
+
+// Repacks all vertices of a scene with the specialized and with the reference
+// implementation and compares their throughput, e.g.
+//   vertex_repacking_benchmark [scene.gltf...]
+// Both have to produce exactly the same bytes, otherwise the benchmark fails.
+
+static constexpr int REPETITIONS = 10;
+
+using RepackFunc = void (*)(const VertexAttributeStreams&, std::span<PackedVertex>);
+
+// Best of several runs, in seconds
+static double time_repacking(
+  std::span<const GltfLoader::PrimitiveStreams> primitives,
+  std::span<PackedVertex> out,
+  RepackFunc repack)
+{
+  double best = std::numeric_limits<double>::infinity();
+  for (int i = 0; i < REPETITIONS; ++i)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t offset = 0;
+    for (const auto& prim : primitives)
+    {
+      repack(prim.streams, out.subspan(offset, prim.vertexCount));
+      offset += prim.vertexCount;
+    }
+    best = std::min(
+      best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+static bool benchmark_scene(GltfLoader& loader, const std::filesystem::path& path)
+{
+  auto loaded = loader.loadModel(path);
+  if (!loaded.has_value())
+    return false;
+
+  const auto primitives = GltfLoader::getPrimitiveStreams(*loaded);
+  std::size_t vertexCount = 0;
+  for (const auto& prim : primitives)
+    vertexCount += prim.vertexCount;
+
+  std::vector<PackedVertex> reference(vertexCount);
+  std::vector<PackedVertex> specialized(vertexCount);
+
+  const double referenceTime = time_repacking(primitives, reference, &repack_vertices_reference);
+  const double specializedTime = time_repacking(primitives, specialized, &repack_vertices);
+
+  const auto mvertsPerSecond = [&](double seconds) {
+    return seconds > 0 ? static_cast<double>(vertexCount) / seconds / 1e6 : 0.0;
+  };
+  spdlog::info(
+    "{}: {} vertices in {} primitives, reference {:.1f} Mvertices/s, "
+    "specialized {:.1f} Mvertices/s, {:.2f}x",
+    path.filename(),
+    vertexCount,
+    primitives.size(),
+    mvertsPerSecond(referenceTime),
+    mvertsPerSecond(specializedTime),
+    specializedTime > 0 ? referenceTime / specializedTime : 0.0);
+
+  if (std::memcmp(reference.data(), specialized.data(), vertexCount * sizeof(PackedVertex)) != 0)
+  {
+    spdlog::error("{}: specialized repacking differs from the reference one", path.filename());
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::filesystem::path> scenes(argv + 1, argv + argc);
+  if (scenes.empty())
+    scenes = {
+      GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/lovely_town/scene.gltf",
+      GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf",
+    };
+
+  // Repacking is what's measured here, threads would only add noise
+  GltfLoader loader{GltfLoader::CreateInfo{}};
+
+  bool success = true;
+  for (const auto& scene : scenes)
+    success = benchmark_scene(loader, scene) && success;
+  return success ? 0 : 1;
+}
@@ -21,3 +21,15 @@ add_compile_definitions(
   GRAPHICS_COURSE_RESOURCES_ROOT="${PROJECT_SOURCE_DIR}/resources"
   GRAPHICS_COURSE_ROOT="${PROJECT_SOURCE_DIR}"
 )
+
+# NOTE: SSE2 is always available on x86-64, but AVX2 has to be opted into explicitly,
+# as the resulting binaries won't run on older CPUs. Hot loops like vertex repacking
+# select wider SIMD paths based on this.
+option(GRAPHICS_COURSE_USE_AVX2 "Compile our code with AVX2 and FMA instructions enabled" OFF)
+if(GRAPHICS_COURSE_USE_AVX2)
+  if(CMAKE_CXX_COMPILER_FRONTEND_VARIANT STREQUAL "MSVC")
+    add_compile_options(/arch:AVX2)
+  else()
+    add_compile_options(-mavx2 -mfma)
+  endif()
+endif()
@@ -0,0 +1,54 @@
+# Bakes glTF scenes with model_bakery_baker as a part of the build, the same way as
+# target_add_shaders compiles shaders. Scene paths are relative to the current source
+# directory, options are passed to the baker as is:
+#
+#   target_add_baked_scenes(my_app
+#     OPTIONS --quantize
+#     SCENES ${PROJECT_SOURCE_DIR}/resources/scenes/Avocado/Avocado.gltf
+#   )
+#
+# Baked scenes end up in "<scenes dir>/<scene file name>.baked" inside of
+# <TGT>_BAKED_SCENES_ROOT, e.g. "Avocado/Avocado.baked" for the example above.
+# External buffers and images of scenes are tracked through depfiles written by the baker.
+# Besides that, the baker keeps a content hash cache of its own, so scenes that were
+# touched but not changed, or a baker that was rebuilt but works the same way,
+# don't make anything rebake.
+function(target_add_baked_scenes tgt)
+  cmake_parse_arguments(PARSE_ARGV 1 arg "" "" "OPTIONS;SCENES")
+
+  set(baked_scenes_dir "${CMAKE_CURRENT_BINARY_DIR}/scenes/")
+
+  foreach(scene_path ${arg_SCENES})
+    cmake_path(ABSOLUTE_PATH scene_path BASE_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+      OUTPUT_VARIABLE input_path)
+    cmake_path(GET input_path PARENT_PATH scene_dir)
+    cmake_path(GET scene_dir FILENAME scene_dir_name)
+    cmake_path(GET input_path STEM scene_name)
+
+    set(output_path "${baked_scenes_dir}${scene_dir_name}/${scene_name}.baked")
+    add_custom_command(
+        OUTPUT ${output_path}
+        COMMAND model_bakery_baker
+          ${arg_OPTIONS}
+          --output=${output_path}
+          --depfile=${output_path}.d
+          ${input_path}
+        VERBATIM
+        COMMAND_EXPAND_LISTS
+        DEPENDS ${input_path} model_bakery_baker
+        DEPFILE "${output_path}.d"
+      )
+    list(APPEND BAKED_SCENE_FILES ${output_path})
+  endforeach(scene_path)
+
+  set(custom_target_name "${tgt}_baked_scenes")
+
+  if(TARGET ${custom_target_name})
+    message(FATAL_ERROR "target_add_baked_scenes can only be called once per target")
+  else()
+    add_custom_target(${custom_target_name} DEPENDS ${BAKED_SCENE_FILES})
+    add_dependencies(${tgt} ${custom_target_name})
+    target_compile_definitions(${tgt}
+      PRIVATE $<UPPER_CASE:${tgt}>_BAKED_SCENES_ROOT="${baked_scenes_dir}")
+  endif()
+endfunction()
@@ -0,0 +1,382 @@
+#include "OcclusionRasterizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <etna/Assert.hpp>
+#include <tracy/Tracy.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OCCLUSION_RASTER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_RASTER_SSE2 1
+#endif
+
+
+// Depth of every pixel in [x0, x1] of a row becomes the nearest of its own and the one of
+// the triangle, if the triangle covers the center of the pixel. `edges` are the edge
+// functions at the start of the row and `row_depth` is the depth there, both are linear
+// in x with the slopes `edge_slopes` and `depth_slope`. x0 is a multiple of LANE_COUNT.
+
+#if defined(OCCLUSION_RASTER_AVX2)
+
+static constexpr std::uint32_t LANE_COUNT = 8;
+
+static void rasterize_row(
+  float* row,
+  std::uint32_t x0,
+  std::uint32_t x1,
+  const float (&edge_slopes)[3],
+  const float (&edges)[3],
+  float depth_slope,
+  float row_depth)
+{
+  const __m256 laneOffsets = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 zero = _mm256_setzero_ps();
+
+  for (std::uint32_t x = x0; x <= x1; x += LANE_COUNT)
+  {
+    const __m256 xs = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+
+    __m256 covered = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int i = 0; i < 3; ++i)
+    {
+      const __m256 edge =
+        _mm256_add_ps(_mm256_mul_ps(xs, _mm256_set1_ps(edge_slopes[i])), _mm256_set1_ps(edges[i]));
+      covered = _mm256_and_ps(covered, _mm256_cmp_ps(edge, zero, _CMP_GE_OQ));
+    }
+    if (_mm256_movemask_ps(covered) == 0)
+      continue;
+
+    const __m256 depth =
+      _mm256_add_ps(_mm256_mul_ps(xs, _mm256_set1_ps(depth_slope)), _mm256_set1_ps(row_depth));
+    const __m256 old = _mm256_loadu_ps(row + x);
+    _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, depth), covered));
+  }
+}
+
+#elif defined(OCCLUSION_RASTER_SSE2)
+
+static constexpr std::uint32_t LANE_COUNT = 4;
+
+static void rasterize_row(
+  float* row,
+  std::uint32_t x0,
+  std::uint32_t x1,
+  const float (&edge_slopes)[3],
+  const float (&edges)[3],
+  float depth_slope,
+  float row_depth)
+{
+  const __m128 laneOffsets = _mm_setr_ps(0, 1, 2, 3);
+  const __m128 zero = _mm_setzero_ps();
+
+  for (std::uint32_t x = x0; x <= x1; x += LANE_COUNT)
+  {
+    const __m128 xs = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+
+    __m128 covered = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int i = 0; i < 3; ++i)
+    {
+      const __m128 edge =
+        _mm_add_ps(_mm_mul_ps(xs, _mm_set1_ps(edge_slopes[i])), _mm_set1_ps(edges[i]));
+      covered = _mm_and_ps(covered, _mm_cmpge_ps(edge, zero));
+    }
+    if (_mm_movemask_ps(covered) == 0)
+      continue;
+
+    const __m128 depth =
+      _mm_add_ps(_mm_mul_ps(xs, _mm_set1_ps(depth_slope)), _mm_set1_ps(row_depth));
+    const __m128 old = _mm_loadu_ps(row + x);
+    const __m128 nearest = _mm_min_ps(old, depth);
+    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(covered, nearest), _mm_andnot_ps(covered, old)));
+  }
+}
+
+#else
+
+static constexpr std::uint32_t LANE_COUNT = 1;
+
+static void rasterize_row(
+  float* row,
+  std::uint32_t x0,
+  std::uint32_t x1,
+  const float (&edge_slopes)[3],
+  const float (&edges)[3],
+  float depth_slope,
+  float row_depth)
+{
+  for (std::uint32_t x = x0; x <= x1; ++x)
+  {
+    const float xf = static_cast<float>(x);
+    if (
+      xf * edge_slopes[0] + edges[0] >= 0 && xf * edge_slopes[1] + edges[1] >= 0 &&
+      xf * edge_slopes[2] + edges[2] >= 0)
+      row[x] = std::min(row[x], xf * depth_slope + row_depth);
+  }
+}
+
+#endif
+
+static_assert(OcclusionRasterizer::TILE_WIDTH % LANE_COUNT == 0);
+
+OcclusionRasterizer::OcclusionRasterizer(CreateInfo info)
+  : width{info.width}
+  , height{info.height}
+  , tilesX{info.width / TILE_WIDTH}
+  , tilesY{info.height / TILE_HEIGHT}
+  , workers{info.workers}
+{
+  // Tiles never share pixels, which is what makes rasterizing them in parallel safe
+  ETNA_VERIFY(width > 0 && width % TILE_WIDTH == 0);
+  ETNA_VERIFY(height > 0 && height % TILE_HEIGHT == 0);
+
+  depth.assign(std::size_t{width} * height, 1.0f);
+  tileMaxDepth.assign(std::size_t{tilesX} * tilesY, 1.0f);
+  tileBins.resize(tileMaxDepth.size());
+}
+
+void OcclusionRasterizer::beginFrame(const glm::mat4x4& view_proj)
+{
+  viewProj = view_proj;
+
+  std::fill(depth.begin(), depth.end(), 1.0f);
+  std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.0f);
+  triangles.clear();
+  for (auto& bin : tileBins)
+    bin.clear();
+}
+
+void OcclusionRasterizer::addOccluder(
+  std::span<const glm::vec3> positions,
+  std::span<const std::uint32_t> indices,
+  const glm::mat4x4& model)
+{
+  const glm::mat4x4 modelViewProj = viewProj * model;
+  clipPositions.resize(positions.size());
+  for (std::size_t i = 0; i < positions.size(); ++i)
+    clipPositions[i] = modelViewProj * glm::vec4(positions[i], 1.0f);
+
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    const glm::vec4 vertices[3] = {
+      clipPositions[indices[i]],
+      clipPositions[indices[i + 1]],
+      clipPositions[indices[i + 2]],
+    };
+
+    const int inFront = (vertices[0].z >= 0) + (vertices[1].z >= 0) + (vertices[2].z >= 0);
+    if (inFront == 0)
+      continue;
+    if (inFront == 3)
+    {
+      binTriangle(vertices[0], vertices[1], vertices[2]);
+      continue;
+    }
+
+    // Sutherland-Hodgman against the near plane, which is z = 0 in clip space. Parts
+    // of occluders in front of it are not drawn on the GPU, so they can't hide anything.
+    glm::vec4 polygon[4];
+    std::size_t count = 0;
+    for (std::size_t j = 0; j < 3; ++j)
+    {
+      const glm::vec4& current = vertices[j];
+      const glm::vec4& next = vertices[(j + 1) % 3];
+      if (current.z >= 0)
+        polygon[count++] = current;
+      if ((current.z >= 0) != (next.z >= 0))
+        polygon[count++] = current + (next - current) * (current.z / (current.z - next.z));
+    }
+
+    binTriangle(polygon[0], polygon[1], polygon[2]);
+    if (count == 4)
+      binTriangle(polygon[0], polygon[2], polygon[3]);
+  }
+}
+
+void OcclusionRasterizer::binTriangle(
+  const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2)
+{
+  // Pixel coordinates shifted by half a pixel, so that functions evaluated
+  // at integer coordinates give their values at pixel centers
+  float x[3];
+  float y[3];
+  float z[3];
+  const glm::vec4* vertices[3] = {&v0, &v1, &v2};
+  for (int i = 0; i < 3; ++i)
+  {
+    const glm::vec4& v = *vertices[i];
+    x[i] = (v.x / v.w * 0.5f + 0.5f) * static_cast<float>(width) - 0.5f;
+    y[i] = (v.y / v.w * 0.5f + 0.5f) * static_cast<float>(height) - 0.5f;
+    z[i] = v.z / v.w;
+  }
+
+  // Nothing behind the far plane is visible anyway
+  if (std::min({z[0], z[1], z[2]}) > 1.0f)
+    return;
+
+  // Pixels whose centers are within the bounds, off screen parts are cut off.
+  // Comparisons are ordered, so that NaNs from degenerate vertices drop the triangle.
+  const float minX = std::ceil(std::min({x[0], x[1], x[2]}));
+  const float minY = std::ceil(std::min({y[0], y[1], y[2]}));
+  const float maxX = std::floor(std::max({x[0], x[1], x[2]}));
+  const float maxY = std::floor(std::max({y[0], y[1], y[2]}));
+  const float lastX = static_cast<float>(width - 1);
+  const float lastY = static_cast<float>(height - 1);
+  if (!(minX <= lastX && minY <= lastY && maxX >= 0 && maxY >= 0 && minX <= maxX && minY <= maxY))
+    return;
+
+  TriangleSetup setup{};
+  setup.minX = static_cast<std::uint32_t>(std::max(minX, 0.0f));
+  setup.minY = static_cast<std::uint32_t>(std::max(minY, 0.0f));
+  setup.maxX = static_cast<std::uint32_t>(std::min(maxX, lastX));
+  setup.maxY = static_cast<std::uint32_t>(std::min(maxY, lastY));
+
+  // Edge i goes from vertex i to the next one and is zero at both of them
+  for (int i = 0; i < 3; ++i)
+  {
+    const int j = (i + 1) % 3;
+    setup.edgeA[i] = y[i] - y[j];
+    setup.edgeB[i] = x[j] - x[i];
+    setup.edgeC[i] = x[i] * y[j] - y[i] * x[j];
+  }
+
+  const float doubleArea = setup.edgeA[0] * x[2] + setup.edgeB[0] * y[2] + setup.edgeC[0];
+  if (!(std::abs(doubleArea) > 1e-6f))
+    return;
+
+  // Barycentric weight of a vertex is the edge opposite to it over the area
+  const auto interpolate = [&](const float(&coefs)[3]) {
+    return (coefs[1] * z[0] + coefs[2] * z[1] + coefs[0] * z[2]) / doubleArea;
+  };
+  setup.depthA = interpolate(setup.edgeA);
+  setup.depthB = interpolate(setup.edgeB);
+  setup.depthC = interpolate(setup.edgeC);
+
+  // Either winding is fine, edges are flipped to be positive inside
+  if (doubleArea < 0)
+    for (int i = 0; i < 3; ++i)
+    {
+      setup.edgeA[i] = -setup.edgeA[i];
+      setup.edgeB[i] = -setup.edgeB[i];
+      setup.edgeC[i] = -setup.edgeC[i];
+    }
+
+  const auto index = static_cast<std::uint32_t>(triangles.size());
+  triangles.push_back(setup);
+  for (std::uint32_t ty = setup.minY / TILE_HEIGHT; ty <= setup.maxY / TILE_HEIGHT; ++ty)
+    for (std::uint32_t tx = setup.minX / TILE_WIDTH; tx <= setup.maxX / TILE_WIDTH; ++tx)
+      tileBins[ty * tilesX + tx].push_back(index);
+}
+
+void OcclusionRasterizer::rasterize()
+{
+  ZoneScoped;
+
+  if (workers == nullptr)
+    for (std::size_t i = 0; i < tileBins.size(); ++i)
+      rasterizeTile(i);
+  else
+    workers->parallelFor(tileBins.size(), [this](std::size_t i) { rasterizeTile(i); });
+}
+
+void OcclusionRasterizer::rasterizeTile(std::size_t tile)
+{
+  const std::uint32_t tileX = static_cast<std::uint32_t>(tile % tilesX) * TILE_WIDTH;
+  const std::uint32_t tileY = static_cast<std::uint32_t>(tile / tilesX) * TILE_HEIGHT;
+
+  for (auto index : tileBins[tile])
+  {
+    const auto& triangle = triangles[index];
+
+    // Whole batches of lanes are processed, but they never leave the tile
+    const std::uint32_t x0 = std::max(triangle.minX, tileX) / LANE_COUNT * LANE_COUNT;
+    const std::uint32_t x1 = std::min(triangle.maxX, tileX + TILE_WIDTH - 1);
+    const std::uint32_t y0 = std::max(triangle.minY, tileY);
+    const std::uint32_t y1 = std::min(triangle.maxY, tileY + TILE_HEIGHT - 1);
+
+    for (std::uint32_t y = y0; y <= y1; ++y)
+    {
+      const float yf = static_cast<float>(y);
+      const float edges[3] = {
+        triangle.edgeB[0] * yf + triangle.edgeC[0],
+        triangle.edgeB[1] * yf + triangle.edgeC[1],
+        triangle.edgeB[2] * yf + triangle.edgeC[2],
+      };
+      rasterize_row(
+        depth.data() + std::size_t{y} * width,
+        x0,
+        x1,
+        triangle.edgeA,
+        edges,
+        triangle.depthA,
+        triangle.depthB * yf + triangle.depthC);
+    }
+  }
+
+  float farthest = 0.0f;
+  for (std::uint32_t y = tileY; y < tileY + TILE_HEIGHT; ++y)
+  {
+    const float* row = depth.data() + std::size_t{y} * width;
+    farthest = std::max(farthest, *std::max_element(row + tileX, row + tileX + TILE_WIDTH));
+  }
+  tileMaxDepth[tile] = farthest;
+}
+
+bool OcclusionRasterizer::isBoxVisible(glm::vec3 box_min, glm::vec3 box_max) const
+{
+  glm::vec3 ndcMin{std::numeric_limits<float>::max()};
+  glm::vec3 ndcMax{std::numeric_limits<float>::lowest()};
+  for (int i = 0; i < 8; ++i)
+  {
+    const glm::vec4 corner{
+      (i & 1) == 0 ? box_min.x : box_max.x,
+      (i & 2) == 0 ? box_min.y : box_max.y,
+      (i & 4) == 0 ? box_min.z : box_max.z,
+      1.0f,
+    };
+    const glm::vec4 clip = viewProj * corner;
+    // Nothing sensible to project, and the camera might be inside of the box
+    if (!(clip.z >= 0))
+      return true;
+    const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    ndcMin = glm::min(ndcMin, ndc);
+    ndcMax = glm::max(ndcMax, ndc);
+  }
+
+  // Every pixel that the screen space bounds touch, not just the ones with covered centers
+  const float minX = std::floor((ndcMin.x * 0.5f + 0.5f) * static_cast<float>(width));
+  const float minY = std::floor((ndcMin.y * 0.5f + 0.5f) * static_cast<float>(height));
+  const float maxX = std::floor((ndcMax.x * 0.5f + 0.5f) * static_cast<float>(width));
+  const float maxY = std::floor((ndcMax.y * 0.5f + 0.5f) * static_cast<float>(height));
+  const float lastX = static_cast<float>(width - 1);
+  const float lastY = static_cast<float>(height - 1);
+  if (!(minX <= lastX && minY <= lastY && maxX >= 0 && maxY >= 0))
+    return false;
+
+  const auto x0 = static_cast<std::uint32_t>(std::max(minX, 0.0f));
+  const auto y0 = static_cast<std::uint32_t>(std::max(minY, 0.0f));
+  const auto x1 = static_cast<std::uint32_t>(std::min(maxX, lastX));
+  const auto y1 = static_cast<std::uint32_t>(std::min(maxY, lastY));
+  const float nearest = ndcMin.z;
+
+  // The box is hidden when every pixel under it is nearer than its nearest point
+  for (std::uint32_t ty = y0 / TILE_HEIGHT; ty <= y1 / TILE_HEIGHT; ++ty)
+    for (std::uint32_t tx = x0 / TILE_WIDTH; tx <= x1 / TILE_WIDTH; ++tx)
+    {
+      if (tileMaxDepth[ty * tilesX + tx] < nearest)
+        continue;
+
+      const std::uint32_t tileX1 = std::min(x1, (tx + 1) * TILE_WIDTH - 1);
+      const std::uint32_t tileY1 = std::min(y1, (ty + 1) * TILE_HEIGHT - 1);
+      for (std::uint32_t y = std::max(y0, ty * TILE_HEIGHT); y <= tileY1; ++y)
+        for (std::uint32_t x = std::max(x0, tx * TILE_WIDTH); x <= tileX1; ++x)
+          if (depth[std::size_t{y} * width + x] >= nearest)
+            return true;
+    }
+
+  return false;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "utils/ThreadPool.hpp"
+
+
+/**
+ * Software occlusion culling on the CPU. Triangles of a few large occluders are rasterized
+ * into a small depth buffer, against which bounding boxes of everything else are tested.
+ * Triangles are binned into screen tiles as they are added, tiles are then rasterized
+ * independently of each other, 8 pixels at a time with AVX2 (4 with SSE2), in parallel when
+ * there are workers. The result doesn't depend on the amount of threads, as every pixel
+ * keeps the nearest depth of the triangles covering its center, whatever their order is.
+ *
+ * Depth follows the [0, 1] clip space convention with 0 being the nearest, i.e. the view
+ * projection matrix is supposed to be made by perspectiveLH_ZO or a similar function.
+ */
+class OcclusionRasterizer
+{
+public:
+  // Must divide the resolution of the depth buffer
+  static constexpr std::uint32_t TILE_WIDTH = 32;
+  static constexpr std::uint32_t TILE_HEIGHT = 16;
+
+  struct CreateInfo
+  {
+    std::uint32_t width = 256;
+    std::uint32_t height = 128;
+    // Not owned. Without workers, tiles are rasterized on the calling thread.
+    ThreadPool* workers = nullptr;
+  };
+
+  explicit OcclusionRasterizer(CreateInfo info);
+
+  OcclusionRasterizer(const OcclusionRasterizer&) = delete;
+  OcclusionRasterizer& operator=(const OcclusionRasterizer&) = delete;
+
+  // Forgets all occluders of the previous frame
+  void beginFrame(const glm::mat4x4& view_proj);
+
+  // Bins the triangles of an occluder, `indices` is a triangle list into `positions`.
+  // Triangles are clipped by the near plane and drawn regardless of their winding.
+  void addOccluder(
+    std::span<const glm::vec3> positions,
+    std::span<const std::uint32_t> indices,
+    const glm::mat4x4& model);
+
+  // Rasterizes everything that was added since beginFrame, must be called before testing
+  void rasterize();
+
+  // Whether any part of the world space box might be visible over the occluders. Boxes
+  // crossing the near plane are always visible, boxes that are off screen never are.
+  bool isBoxVisible(glm::vec3 box_min, glm::vec3 box_max) const;
+
+  std::uint32_t getWidth() const { return width; }
+  std::uint32_t getHeight() const { return height; }
+
+  // Row-major, the first row is at the top of the screen, i.e. at NDC y = -1
+  std::span<const float> getDepth() const { return depth; }
+
+  // Triangles that survived clipping and culling since beginFrame
+  std::size_t getTriangleCount() const { return triangles.size(); }
+
+private:
+  // Edge functions and the depth plane of a triangle in pixel coordinates,
+  // evaluated at pixel centers. A pixel is covered when all edges are non-negative.
+  struct TriangleSetup
+  {
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    float depthA;
+    float depthB;
+    float depthC;
+    std::uint32_t minX;
+    std::uint32_t minY;
+    std::uint32_t maxX;
+    std::uint32_t maxY;
+  };
+
+  // Takes vertices in clip space that are all in front of the near plane
+  void binTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+  void rasterizeTile(std::size_t tile);
+
+private:
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t tilesX;
+  std::uint32_t tilesY;
+  ThreadPool* workers;
+
+  glm::mat4x4 viewProj{1.0f};
+
+  std::vector<float> depth;
+  // Farthest depth of every tile, lets box tests skip fully occluded tiles at once
+  std::vector<float> tileMaxDepth;
+
+  // Scratch space of addOccluder
+  std::vector<glm::vec4> clipPositions;
+
+  std::vector<TriangleSetup> triangles;
+  // Indices of triangles overlapping every tile, in the order they were added
+  std::vector<std::vector<std::uint32_t>> tileBins;
+};
@@ -0,0 +1,77 @@
+#include "SoftwareOcclusion.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include <tracy/Tracy.hpp>
+
+
+// Most of the occlusion usually comes from a handful of large objects close to the camera,
+// while rasterizing small ones costs about the same and hides next to nothing.
+static constexpr std::size_t MAX_OCCLUDERS = 32;
+// Radius of the bounds over the distance to them
+static constexpr float MIN_OCCLUDER_SCREEN_SIZE = 0.1f;
+
+SoftwareOcclusionStats cull_occluded_instances(
+  OcclusionRasterizer& rasterizer,
+  SceneManager& scene,
+  const glm::mat4x4& view_proj,
+  glm::vec3 camera_position,
+  std::vector<std::uint32_t>& visible)
+{
+  ZoneScoped;
+
+  const auto& bounds = scene.getInstanceBounds();
+  const auto occluders = scene.getMeshOccluders();
+  const auto instanceMeshes = scene.getInstanceMeshes();
+
+  // Sorted by size and then by index, so that the choice doesn't depend on the input order
+  std::vector<std::pair<float, std::uint32_t>> candidates;
+  for (auto instIdx : visible)
+  {
+    if (occluders[instanceMeshes[instIdx]].indexCount == 0)
+      continue;
+
+    const auto box = get_box(bounds, instIdx);
+    const glm::vec3 center = (box.min + box.max) * 0.5f;
+    const float radius = glm::length(box.max - box.min) * 0.5f;
+    const float distance = std::max(glm::length(center - camera_position), radius);
+    if (radius >= MIN_OCCLUDER_SCREEN_SIZE * distance)
+      candidates.emplace_back(radius / distance, instIdx);
+  }
+  const std::size_t occluderCount = std::min(candidates.size(), MAX_OCCLUDERS);
+  std::partial_sort(
+    candidates.begin(),
+    candidates.begin() + occluderCount,
+    candidates.end(),
+    [](const auto& a, const auto& b) {
+      return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+  rasterizer.beginFrame(view_proj);
+  const auto vertices = scene.getOccluderVertices();
+  const auto indices = scene.getOccluderIndices();
+  const auto matrices = scene.getInstanceMatrices();
+  for (std::size_t i = 0; i < occluderCount; ++i)
+  {
+    const auto instIdx = candidates[i].second;
+    const auto& occluder = occluders[instanceMeshes[instIdx]];
+    rasterizer.addOccluder(
+      vertices.subspan(occluder.firstVertex, occluder.vertexCount),
+      indices.subspan(occluder.firstIndex, occluder.indexCount),
+      matrices[instIdx]);
+  }
+  rasterizer.rasterize();
+
+  const std::size_t countBefore = visible.size();
+  std::erase_if(visible, [&](std::uint32_t instIdx) {
+    const auto box = get_box(bounds, instIdx);
+    return !rasterizer.isBoxVisible(box.min, box.max);
+  });
+
+  return SoftwareOcclusionStats{
+    .occluderCount = occluderCount,
+    .triangleCount = rasterizer.getTriangleCount(),
+    .occludedCount = countBefore - visible.size(),
+  };
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "OcclusionRasterizer.hpp"
+#include "scene/SceneManager.hpp"
+
+
+struct SoftwareOcclusionStats
+{
+  std::size_t occluderCount = 0;
+  std::size_t triangleCount = 0;
+  std::size_t occludedCount = 0;
+};
+
+// Rasterizes the instances from `visible` that are the largest on screen and have occluder
+// geometry, then removes the instances hidden behind them from `visible`, keeping the order.
+SoftwareOcclusionStats cull_occluded_instances(
+  OcclusionRasterizer& rasterizer,
+  SceneManager& scene,
+  const glm::mat4x4& view_proj,
+  glm::vec3 camera_position,
+  std::vector<std::uint32_t>& visible);
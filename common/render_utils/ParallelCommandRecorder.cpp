@@ -0,0 +1,187 @@
+#include "ParallelCommandRecorder.hpp"
+
+#include <algorithm>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+ParallelCommandRecorder::ParallelCommandRecorder(CreateInfo info)
+  : workers{info.workers}
+  , workerCount{info.workers == nullptr ? 1 : info.workers->getThreadCount() + 1}
+  , minItemsPerChunk{std::max<std::size_t>(info.minItemsPerChunk, 1)}
+{
+  ETNA_VERIFY(info.framesInFlight > 0 && info.passesPerFrame > 0);
+
+  auto& ctx = etna::get_context();
+  auto device = ctx.getDevice();
+
+  frames.resize(info.framesInFlight);
+  for (auto& frame : frames)
+  {
+    frame.resize(workerCount);
+    for (auto& worker : frame)
+    {
+      // Buffers are never reset one by one, the whole pool is reset every frame instead
+      worker.pool = etna::unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+      }));
+      worker.buffers =
+        etna::unwrap_vk_result(device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+          .commandPool = worker.pool.get(),
+          .level = vk::CommandBufferLevel::eSecondary,
+          .commandBufferCount = info.passesPerFrame,
+        }));
+    }
+  }
+
+  // The first beginFrame moves on to the frame 0
+  frameIndex = frames.size() - 1;
+}
+
+void ParallelCommandRecorder::beginFrame()
+{
+  frameIndex = (frameIndex + 1) % frames.size();
+  passIndex = 0;
+
+  auto device = etna::get_context().getDevice();
+  for (auto& worker : frames[frameIndex])
+    ETNA_CHECK_VK_RESULT(device.resetCommandPool(worker.pool.get()));
+}
+
+void ParallelCommandRecorder::recordChunk(
+  vk::CommandBuffer secondary,
+  const RenderTarget& target,
+  std::size_t first,
+  std::size_t count,
+  RecordFunc func) const
+{
+  std::vector<vk::Format> colorFormats;
+  colorFormats.reserve(target.colorAttachments.size());
+  for (const auto& attachment : target.colorAttachments)
+    colorFormats.push_back(attachment.format);
+
+  vk::CommandBufferInheritanceRenderingInfo renderingInfo{
+    .colorAttachmentCount = static_cast<std::uint32_t>(colorFormats.size()),
+    .pColorAttachmentFormats = colorFormats.data(),
+    .depthAttachmentFormat =
+      target.depthAttachment.has_value() ? target.depthAttachment->format : vk::Format::eUndefined,
+    .rasterizationSamples = vk::SampleCountFlagBits::e1,
+  };
+  vk::CommandBufferInheritanceInfo inheritanceInfo{.pNext = &renderingInfo};
+
+  ETNA_CHECK_VK_RESULT(secondary.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+      vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+    .pInheritanceInfo = &inheritanceInfo,
+  }));
+
+  // Dynamic state is not inherited from the primary buffer
+  secondary.setViewport(
+    0,
+    {vk::Viewport{
+      .x = static_cast<float>(target.area.offset.x),
+      .y = static_cast<float>(target.area.offset.y),
+      .width = static_cast<float>(target.area.extent.width),
+      .height = static_cast<float>(target.area.extent.height),
+      .minDepth = 0.0f,
+      .maxDepth = 1.0f,
+    }});
+  secondary.setScissor(0, {target.area});
+
+  func(secondary, first, count);
+
+  ETNA_CHECK_VK_RESULT(secondary.end());
+}
+
+void ParallelCommandRecorder::render(
+  vk::CommandBuffer cmd_buf, const RenderTarget& target, std::size_t item_count, RecordFunc func)
+{
+  ZoneScoped;
+
+  ETNA_VERIFY(passIndex < frames[frameIndex].front().buffers.size());
+  const std::size_t pass = passIndex++;
+
+  // Contiguous chunks keep the draws in the same order as a serial loop would record them,
+  // so state changes that depend on the order of items stay as rare as they were.
+  const std::size_t chunkCount = std::clamp<std::size_t>(
+    (item_count + minItemsPerChunk - 1) / minItemsPerChunk, 1, workerCount);
+  const std::size_t chunkSize = (item_count + chunkCount - 1) / chunkCount;
+
+  auto& frame = frames[frameIndex];
+  auto recordWorkerChunk = [&](std::size_t worker) {
+    ZoneScopedN("recordChunk");
+    const std::size_t first = std::min(worker * chunkSize, item_count);
+    const std::size_t count = std::min(chunkSize, item_count - first);
+    recordChunk(frame[worker].buffers[pass].get(), target, first, count, func);
+  };
+
+  // Every index is handed to exactly one thread, so the pool of the worker is never
+  // touched by two threads at once, whichever thread ends up recording the chunk.
+  if (workers == nullptr || chunkCount == 1)
+    for (std::size_t i = 0; i < chunkCount; ++i)
+      recordWorkerChunk(i);
+  else
+    workers->parallelFor(chunkCount, recordWorkerChunk);
+
+  std::vector<vk::RenderingAttachmentInfo> colorInfos;
+  colorInfos.reserve(target.colorAttachments.size());
+  for (const auto& attachment : target.colorAttachments)
+  {
+    etna::set_state(
+      cmd_buf,
+      attachment.image,
+      vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+      vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite,
+      vk::ImageLayout::eColorAttachmentOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    colorInfos.push_back(vk::RenderingAttachmentInfo{
+      .imageView = attachment.view,
+      .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+      .loadOp = attachment.loadOp,
+      .storeOp = attachment.storeOp,
+      .clearValue = vk::ClearValue{.color = attachment.clearColor},
+    });
+  }
+
+  vk::RenderingAttachmentInfo depthInfo{};
+  if (target.depthAttachment.has_value())
+  {
+    const auto& attachment = *target.depthAttachment;
+    etna::set_state(
+      cmd_buf,
+      attachment.image,
+      vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+        vk::PipelineStageFlagBits2::eLateFragmentTests,
+      vk::AccessFlagBits2::eDepthStencilAttachmentRead |
+        vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+      vk::ImageLayout::eDepthStencilAttachmentOptimal,
+      vk::ImageAspectFlagBits::eDepth);
+    depthInfo = vk::RenderingAttachmentInfo{
+      .imageView = attachment.view,
+      .imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+      .loadOp = attachment.loadOp,
+      .storeOp = attachment.storeOp,
+      .clearValue = vk::ClearValue{.depthStencil = attachment.clearDepthStencil},
+    };
+  }
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.beginRendering(vk::RenderingInfo{
+    .flags = vk::RenderingFlagBits::eContentsSecondaryCommandBuffers,
+    .renderArea = target.area,
+    .layerCount = 1,
+    .colorAttachmentCount = static_cast<std::uint32_t>(colorInfos.size()),
+    .pColorAttachments = colorInfos.data(),
+    .pDepthAttachment = target.depthAttachment.has_value() ? &depthInfo : nullptr,
+  });
+
+  std::vector<vk::CommandBuffer> secondaries(chunkCount);
+  for (std::size_t i = 0; i < chunkCount; ++i)
+    secondaries[i] = frame[i].buffers[pass].get();
+  cmd_buf.executeCommands(secondaries);
+
+  cmd_buf.endRendering();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <function2/function2.hpp>
+
+#include "utils/ThreadPool.hpp"
+
+
+/**
+ * Records the draws of a render pass on several threads at once. The items to draw are split
+ * into contiguous chunks, every chunk is recorded into a secondary command buffer by its own
+ * worker and the buffers are then executed from the primary one inside of the rendering scope.
+ * Command pools can't be used from several threads at once and can only be reset when the GPU
+ * is done with everything allocated from them, so there is one pool per worker per frame
+ * in flight.
+ */
+class ParallelCommandRecorder
+{
+public:
+  struct CreateInfo
+  {
+    // Not owned. Without workers, everything is recorded on the calling thread, but still
+    // into a secondary buffer, so that both paths go through exactly the same code.
+    ThreadPool* workers = nullptr;
+    std::uint32_t framesInFlight = 2;
+    // How many times `render` is going to be called per frame
+    std::uint32_t passesPerFrame = 1;
+    // Chunks smaller than this are not worth the overhead of a secondary buffer
+    std::size_t minItemsPerChunk = 64;
+  };
+
+  struct Attachment
+  {
+    vk::Image image;
+    vk::ImageView view;
+    vk::Format format = vk::Format::eUndefined;
+    vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear;
+    vk::AttachmentStoreOp storeOp = vk::AttachmentStoreOp::eStore;
+    vk::ClearColorValue clearColor = {};
+    vk::ClearDepthStencilValue clearDepthStencil = {1.0f, 0};
+  };
+
+  struct RenderTarget
+  {
+    vk::Rect2D area;
+    std::vector<Attachment> colorAttachments;
+    std::optional<Attachment> depthAttachment;
+  };
+
+  // Records the items [first, first + count) into the secondary buffer. Viewport and scissor
+  // are already set to the render area, everything else has to be bound by the function.
+  using RecordFunc =
+    fu2::function_view<void(vk::CommandBuffer cmd_buf, std::size_t first, std::size_t count)>;
+
+  explicit ParallelCommandRecorder(CreateInfo info);
+
+  ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+  ParallelCommandRecorder& operator=(const ParallelCommandRecorder&) = delete;
+
+  // Must be called once per frame before any `render`. Resets the pools of the frame,
+  // which must not be in flight anymore, i.e. the frame's primary buffer was waited for.
+  void beginFrame();
+
+  // Records `item_count` items in parallel and executes them on `cmd_buf` inside of
+  // a dynamic rendering scope for the target. Attachments are transitioned through etna's
+  // state tracking, just like etna::RenderTargetState does it, which can't be used here as
+  // it doesn't allow the contents of the scope to come from secondary buffers.
+  void render(
+    vk::CommandBuffer cmd_buf, const RenderTarget& target, std::size_t item_count, RecordFunc func);
+
+  std::size_t getWorkerCount() const { return workerCount; }
+
+private:
+  struct WorkerFrame
+  {
+    vk::UniqueCommandPool pool;
+    // One for every pass of the frame
+    std::vector<vk::UniqueCommandBuffer> buffers;
+  };
+
+  void recordChunk(
+    vk::CommandBuffer secondary,
+    const RenderTarget& target,
+    std::size_t first,
+    std::size_t count,
+    RecordFunc func) const;
+
+private:
+  ThreadPool* workers;
+  std::size_t workerCount;
+  std::size_t minItemsPerChunk;
+
+  // Indexed by frame, then by worker
+  std::vector<std::vector<WorkerFrame>> frames;
+  std::size_t frameIndex = 0;
+  std::size_t passIndex = 0;
+};
@@ -26,7 +26,8 @@ public:
     vk::Image target_image,
     vk::ImageView target_image_view,
     const etna::Image& tex_to_draw,
-    const etna::Sampler& sampler);
+    const etna::Sampler& sampler,
+    etna::Image::ViewParams view_params = {});
 
 private:
   etna::GraphicsPipeline pipeline;
@@ -0,0 +1,293 @@
+#include "RingStagingUploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <tracy/Tracy.hpp>
+
+
+RingStagingUploader::RingStagingUploader(CreateInfo info)
+  : segmentSize{info.stagingSize / info.segmentCount}
+{
+  ETNA_VERIFY(info.segmentCount > 0 && segmentSize > 0);
+
+  auto& ctx = etna::get_context();
+  auto device = ctx.getDevice();
+
+  staging = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = segmentSize * info.segmentCount,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "ring_staging_buffer",
+  });
+  stagingData = staging.map();
+
+  commandPool = etna::unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer |
+      vk::CommandPoolCreateFlagBits::eTransient,
+    .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+  }));
+
+  auto commandBuffers =
+    etna::unwrap_vk_result(device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+      .commandPool = commandPool.get(),
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = info.segmentCount,
+    }));
+
+  segments.reserve(info.segmentCount);
+  for (std::uint32_t i = 0; i < info.segmentCount; ++i)
+    segments.push_back(Segment{
+      .begin = segmentSize * i,
+      .commandBuffer = std::move(commandBuffers[i]),
+      .fence = etna::unwrap_vk_result(device.createFenceUnique(vk::FenceCreateInfo{})),
+    });
+}
+
+RingStagingUploader::~RingStagingUploader()
+{
+  wait();
+  staging.unmap();
+}
+
+void RingStagingUploader::acquire(Segment& segment)
+{
+  if (!segment.inFlight)
+    return;
+
+  ZoneScopedN("waitForStagingSegment");
+
+  auto device = etna::get_context().getDevice();
+  ETNA_CHECK_VK_RESULT(device.waitForFences(
+    {segment.fence.get()}, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+  ETNA_CHECK_VK_RESULT(device.resetFences({segment.fence.get()}));
+
+  segment.inFlight = false;
+  segment.used = 0;
+}
+
+void RingStagingUploader::beginRecording(Segment& segment)
+{
+  if (segment.recording)
+    return;
+
+  ETNA_CHECK_VK_RESULT(segment.commandBuffer->begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+  segment.recording = true;
+}
+
+void RingStagingUploader::submit(Segment& segment)
+{
+  if (!segment.recording)
+    return;
+
+  auto cmdBuf = segment.commandBuffer.get();
+
+  for (auto image : segment.images)
+    etna::set_state(
+      cmdBuf,
+      image,
+      vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderSampledRead,
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmdBuf);
+  segment.images.clear();
+
+  // Geometry uploaded here is consumed by later submissions on the same queue,
+  // so we make the copies available to any kind of read that follows.
+  cmdBuf.pipelineBarrier(
+    vk::PipelineStageFlagBits::eTransfer,
+    vk::PipelineStageFlagBits::eAllCommands,
+    {},
+    {vk::MemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = vk::AccessFlagBits::eMemoryRead,
+    }},
+    {},
+    {});
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+  vk::SubmitInfo submitInfo{
+    .commandBufferCount = 1,
+    .pCommandBuffers = &cmdBuf,
+  };
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit({submitInfo}, segment.fence.get()));
+
+  segment.recording = false;
+  segment.inFlight = true;
+}
+
+void RingStagingUploader::uploadBuffer(
+  const etna::Buffer& dst, vk::DeviceSize offset, std::span<const std::byte> src)
+{
+  ZoneScoped;
+
+  while (!src.empty())
+  {
+    auto& segment = segments[current];
+    acquire(segment);
+
+    if (segment.used == segmentSize)
+    {
+      submit(segment);
+      current = (current + 1) % segments.size();
+      continue;
+    }
+
+    const auto size = std::min<vk::DeviceSize>(src.size(), segmentSize - segment.used);
+    std::memcpy(stagingData + segment.begin + segment.used, src.data(), size);
+
+    beginRecording(segment);
+
+    segment.commandBuffer->copyBuffer(
+      staging.get(),
+      dst.get(),
+      {vk::BufferCopy{
+        .srcOffset = segment.begin + segment.used,
+        .dstOffset = offset,
+        .size = size,
+      }});
+
+    segment.used += size;
+    offset += size;
+    src = src.subspan(size);
+  }
+}
+
+void RingStagingUploader::updateBuffer(
+  const etna::Buffer& dst, vk::DeviceSize offset, std::span<const std::byte> src)
+{
+  auto& segment = segments[current];
+  acquire(segment);
+  beginRecording(segment);
+
+  // Barriers order against everything submitted before them, so the copies below
+  // don't overwrite data that earlier frames are still reading. The copies might end
+  // up in later segments, but those come after this barrier in submission order too.
+  segment.commandBuffer->pipelineBarrier(
+    vk::PipelineStageFlagBits::eAllCommands,
+    vk::PipelineStageFlagBits::eTransfer,
+    {},
+    {},
+    {},
+    {});
+
+  uploadBuffer(dst, offset, src);
+}
+
+void RingStagingUploader::uploadImage(
+  const etna::Image& dst,
+  std::uint32_t mip_level,
+  vk::Extent2D extent,
+  std::uint32_t block_extent,
+  std::span<const std::byte> src)
+{
+  ZoneScoped;
+
+  const std::uint32_t blockRows = (extent.height + block_extent - 1) / block_extent;
+  ETNA_VERIFY(blockRows > 0 && src.size() % blockRows == 0);
+  const std::size_t rowSize = src.size() / blockRows;
+  ETNA_VERIFY(rowSize <= segmentSize);
+
+  // Offsets into the staging buffer have to be multiples of the texel block size
+  static constexpr vk::DeviceSize OFFSET_ALIGNMENT = 16;
+
+  std::uint32_t row = 0;
+  while (row < blockRows)
+  {
+    auto& segment = segments[current];
+    acquire(segment);
+
+    const auto alignedUsed = std::min(
+      (segment.used + OFFSET_ALIGNMENT - 1) / OFFSET_ALIGNMENT * OFFSET_ALIGNMENT, segmentSize);
+    const auto rowCount = static_cast<std::uint32_t>(
+      std::min<vk::DeviceSize>(blockRows - row, (segmentSize - alignedUsed) / rowSize));
+    if (rowCount == 0)
+    {
+      submit(segment);
+      current = (current + 1) % segments.size();
+      continue;
+    }
+
+    const std::size_t size = rowCount * rowSize;
+    std::memcpy(stagingData + segment.begin + alignedUsed, src.data() + row * rowSize, size);
+
+    beginRecording(segment);
+    auto cmdBuf = segment.commandBuffer.get();
+
+    if (std::ranges::find(segment.images, dst.get()) == segment.images.end())
+    {
+      etna::set_state(
+        cmdBuf,
+        dst.get(),
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageAspectFlagBits::eColor);
+      etna::flush_barriers(cmdBuf);
+      segment.images.push_back(dst.get());
+    }
+
+    const std::uint32_t firstTexelRow = row * block_extent;
+    cmdBuf.copyBufferToImage(
+      staging.get(),
+      dst.get(),
+      vk::ImageLayout::eTransferDstOptimal,
+      {vk::BufferImageCopy{
+        .bufferOffset = segment.begin + alignedUsed,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
+          vk::ImageSubresourceLayers{
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .mipLevel = mip_level,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+          },
+        .imageOffset = vk::Offset3D{0, static_cast<std::int32_t>(firstTexelRow), 0},
+        .imageExtent =
+          vk::Extent3D{
+            extent.width,
+            std::min(rowCount * block_extent, extent.height - firstTexelRow),
+            1,
+          },
+      }});
+
+    segment.used = alignedUsed + size;
+    row += rowCount;
+  }
+}
+
+void RingStagingUploader::flush()
+{
+  auto& segment = segments[current];
+  if (!segment.recording)
+    return;
+
+  submit(segment);
+  current = (current + 1) % segments.size();
+}
+
+bool RingStagingUploader::isIdle()
+{
+  auto device = etna::get_context().getDevice();
+  return std::ranges::all_of(segments, [device](const Segment& segment) {
+    return !segment.recording &&
+      (!segment.inFlight || device.getFenceStatus(segment.fence.get()) == vk::Result::eSuccess);
+  });
+}
+
+void RingStagingUploader::wait()
+{
+  ZoneScoped;
+
+  flush();
+  for (auto& segment : segments)
+    acquire(segment);
+}
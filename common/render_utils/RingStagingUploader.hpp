@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+
+
+/**
+ * Uploads data to GPU-only buffers and images through a staging buffer that is split into
+ * several segments used in a ring. A segment is submitted as soon as it's full
+ * and gets its own fence, so copying the next piece of data into the following
+ * segment on the CPU overlaps with the GPU copying out of the previous one.
+ * The CPU only ever waits when it wraps around onto a segment that's still in flight.
+ */
+class RingStagingUploader
+{
+public:
+  struct CreateInfo
+  {
+    // Total size of the staging memory, split evenly between the segments
+    vk::DeviceSize stagingSize = 64 * 1024 * 1024;
+    std::uint32_t segmentCount = 4;
+  };
+
+  explicit RingStagingUploader(CreateInfo info);
+  ~RingStagingUploader();
+
+  RingStagingUploader(const RingStagingUploader&) = delete;
+  RingStagingUploader& operator=(const RingStagingUploader&) = delete;
+
+  // Schedules a copy of `src` into `dst` at `offset`. The copy is only guaranteed
+  // to be submitted after `flush` and to be finished after `wait` or once `isIdle`
+  // returns true. Writes are made visible to all subsequent commands on the queue.
+  void uploadBuffer(const etna::Buffer& dst, vk::DeviceSize offset, std::span<const std::byte> src);
+
+  // Same as uploadBuffer, but for buffers that previously submitted work might still be
+  // reading from, e.g. frames in flight. The copies wait for all such work to finish.
+  void updateBuffer(const etna::Buffer& dst, vk::DeviceSize offset, std::span<const std::byte> src);
+
+  // Schedules a copy of a whole mip level of a 2D image, with tightly packed rows of
+  // `block_extent` x `block_extent` texel blocks in `src` (4 for BCn, 1 for plain formats).
+  // Large levels are split between segments by rows of blocks. The image is left in the
+  // shader read-only layout, with the transitions going through etna's state tracking.
+  // Transitions are batched: every image written to by a segment is transitioned for
+  // sampling only once, with a single barrier for all of them when the segment is submitted.
+  void uploadImage(
+    const etna::Image& dst,
+    std::uint32_t mip_level,
+    vk::Extent2D extent,
+    std::uint32_t block_extent,
+    std::span<const std::byte> src);
+
+  // Submits the partially filled segment, if any
+  void flush();
+
+  // Returns true when all submitted copies have finished. Never blocks.
+  bool isIdle();
+
+  // Flushes and blocks until all copies have finished
+  void wait();
+
+private:
+  struct Segment
+  {
+    vk::DeviceSize begin;
+    vk::DeviceSize used = 0;
+    vk::UniqueCommandBuffer commandBuffer;
+    vk::UniqueFence fence;
+    bool recording = false;
+    bool inFlight = false;
+    // Images written to by the segment, to be made ready for sampling on submit
+    std::vector<vk::Image> images;
+  };
+
+  // Makes sure the segment can be written to, waiting for the GPU if needed
+  void acquire(Segment& segment);
+  void beginRecording(Segment& segment);
+  void submit(Segment& segment);
+
+private:
+  vk::DeviceSize segmentSize;
+  etna::Buffer staging;
+  std::byte* stagingData;
+
+  vk::UniqueCommandPool commandPool;
+  std::vector<Segment> segments;
+  std::size_t current = 0;
+};
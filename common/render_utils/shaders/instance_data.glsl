@@ -0,0 +1,42 @@
+#ifndef INSTANCE_DATA_GLSL_INCLUDED
+#define INSTANCE_DATA_GLSL_INCLUDED
+
+// Mirrors InstanceData of the scene manager, see pack_instances for how it's packed
+struct InstanceData
+{
+  vec4 modelRows[3];
+  uint normalColumns[3];
+  uint mesh;
+};
+
+vec3 instance_transform_point(InstanceData instance, vec3 point)
+{
+  const vec4 p = vec4(point, 1.0f);
+  return vec3(
+    dot(instance.modelRows[0], p), dot(instance.modelRows[1], p), dot(instance.modelRows[2], p));
+}
+
+mat4 instance_model_matrix(InstanceData instance)
+{
+  const mat4 rows =
+    mat4(instance.modelRows[0], instance.modelRows[1], instance.modelRows[2], vec4(0, 0, 0, 1));
+  return transpose(rows);
+}
+
+vec3 unpack_snorm10(uint packed)
+{
+  // Moves every component to the top, so that the arithmetic shift back extends the sign
+  const ivec3 bits = ivec3(uvec3(packed) << uvec3(22, 12, 2)) >> 22;
+  return max(vec3(bits) / 511.0f, -1.0f);
+}
+
+// Inverse transpose of the model matrix up to a positive scale, normals have to be renormalized
+mat3 instance_normal_matrix(InstanceData instance)
+{
+  return mat3(
+    unpack_snorm10(instance.normalColumns[0]),
+    unpack_snorm10(instance.normalColumns[1]),
+    unpack_snorm10(instance.normalColumns[2]));
+}
+
+#endif // INSTANCE_DATA_GLSL_INCLUDED
@@ -22,4 +22,14 @@ vec3 decode_normal(uint a_data)
   return vec3(x, y, z);
 }
 
+// Octahedral encoding, see https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec3 decode_octahedral(vec2 a_enc)
+{
+  vec3 n = vec3(a_enc.xy, 1.0f - abs(a_enc.x) - abs(a_enc.y));
+  const float t = max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize(n);
+}
+
 #endif // UNPACK_ATTRIBUTES_GLSL_INCLUDED
@@ -0,0 +1,305 @@
+#include "BakedScene.hpp"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <etna/Assert.hpp>
+
+
+static std::size_t align_up(std::size_t value, std::size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static constexpr std::size_t section_index(BakedSceneSection section)
+{
+  return static_cast<std::size_t>(section);
+}
+
+std::size_t get_vertex_size(VertexFormat format)
+{
+  switch (format)
+  {
+  case VertexFormat::Full:
+    return sizeof(PackedVertex);
+  case VertexFormat::Quantized:
+    return sizeof(QuantizedVertex);
+  }
+  return 0;
+}
+
+bool write_baked_scene(const std::filesystem::path& path, const BakedSceneView& scene)
+{
+  const std::array<std::span<const std::byte>, section_index(BakedSceneSection::Count)> sections{
+    scene.vertices,
+    std::as_bytes(scene.indices),
+    std::as_bytes(scene.indices16),
+    std::as_bytes(scene.relems),
+    std::as_bytes(scene.relemBounds),
+    std::as_bytes(scene.meshlets),
+    std::as_bytes(scene.meshes),
+    std::as_bytes(scene.lods),
+    std::as_bytes(scene.instanceMatrices),
+    std::as_bytes(scene.instanceMeshes),
+    std::as_bytes(scene.textures),
+    std::as_bytes(scene.strings),
+  };
+
+  BakedSceneHeader header{
+    .magic = BAKED_SCENE_MAGIC,
+    .version = BAKED_SCENE_VERSION,
+    .vertexFormat = scene.vertexFormat,
+    .vertexSize = static_cast<std::uint32_t>(get_vertex_size(scene.vertexFormat)),
+    .sectionCount = static_cast<std::uint32_t>(sections.size()),
+    .padding = 0,
+    .sections = {},
+  };
+
+  std::size_t offset = align_up(sizeof(header), BAKED_SCENE_ALIGNMENT);
+  for (std::size_t i = 0; i < sections.size(); ++i)
+  {
+    header.sections[i] = BakedSceneSectionEntry{.offset = offset, .size = sections[i].size()};
+    offset = align_up(offset + sections[i].size(), BAKED_SCENE_ALIGNMENT);
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    spdlog::error("Baked scene: unable to open '{}' for writing", path);
+    return false;
+  }
+
+  const auto writeBytes = [&out](std::span<const std::byte> bytes) {
+    out.write(
+      reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  };
+  const auto pad = [&out](std::size_t to) {
+    static constexpr std::array<char, BAKED_SCENE_ALIGNMENT> ZEROES{};
+    const auto current = static_cast<std::size_t>(out.tellp());
+    out.write(ZEROES.data(), static_cast<std::streamsize>(to - current));
+  };
+
+  writeBytes(std::as_bytes(std::span(&header, 1)));
+  for (std::size_t i = 0; i < sections.size(); ++i)
+  {
+    pad(header.sections[i].offset);
+    writeBytes(sections[i]);
+  }
+  pad(offset);
+
+  if (!out)
+  {
+    spdlog::error("Baked scene: failed writing '{}'", path);
+    return false;
+  }
+
+  return true;
+}
+
+template <class T>
+static std::optional<std::span<const T>> get_section(
+  std::span<const std::byte> file, const BakedSceneHeader& header, BakedSceneSection section)
+{
+  const auto& entry = header.sections[section_index(section)];
+
+  if (
+    entry.offset % BAKED_SCENE_ALIGNMENT != 0 || entry.offset > file.size() ||
+    entry.size > file.size() - entry.offset || entry.size % sizeof(T) != 0)
+  {
+    spdlog::error("Baked scene: section {} is corrupted", section_index(section));
+    return std::nullopt;
+  }
+
+  return std::span(
+    reinterpret_cast<const T*>(file.data() + entry.offset), entry.size / sizeof(T));
+}
+
+// Whether [first, first + count) lies within [0, size), without overflowing
+static bool is_range_valid(std::uint64_t first, std::uint64_t count, std::uint64_t size)
+{
+  return first <= size && count <= size - first;
+}
+
+std::optional<BakedSceneView> parse_baked_scene(std::span<const std::byte> file)
+{
+  BakedSceneHeader header;
+  if (file.size() < sizeof(header))
+  {
+    spdlog::error("Baked scene: file is too small");
+    return std::nullopt;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (header.magic != BAKED_SCENE_MAGIC)
+  {
+    spdlog::error("Baked scene: not a baked scene file");
+    return std::nullopt;
+  }
+
+  if (header.version != BAKED_SCENE_VERSION)
+  {
+    spdlog::error(
+      "Baked scene: file was baked with version {}, but we expect version {}. Re-bake it!",
+      header.version,
+      BAKED_SCENE_VERSION);
+    return std::nullopt;
+  }
+
+  if (get_vertex_size(header.vertexFormat) == 0)
+  {
+    spdlog::error(
+      "Baked scene: unknown vertex format {}", static_cast<std::uint32_t>(header.vertexFormat));
+    return std::nullopt;
+  }
+
+  if (header.vertexSize != get_vertex_size(header.vertexFormat))
+  {
+    spdlog::error(
+      "Baked scene: vertices are {} bytes, but we expect {} bytes for their format",
+      header.vertexSize,
+      get_vertex_size(header.vertexFormat));
+    return std::nullopt;
+  }
+
+  if (header.sectionCount != section_index(BakedSceneSection::Count))
+  {
+    spdlog::error(
+      "Baked scene: file has {} sections, but we expect {}",
+      header.sectionCount,
+      section_index(BakedSceneSection::Count));
+    return std::nullopt;
+  }
+
+  // The file start is expected to be page aligned when mapped
+  ETNA_VERIFY(reinterpret_cast<std::uintptr_t>(file.data()) % BAKED_SCENE_ALIGNMENT == 0);
+
+  auto vertices = get_section<std::byte>(file, header, BakedSceneSection::Vertices);
+  auto indices = get_section<std::uint32_t>(file, header, BakedSceneSection::Indices);
+  auto indices16 = get_section<std::uint16_t>(file, header, BakedSceneSection::Indices16);
+  auto relems = get_section<RenderElement>(file, header, BakedSceneSection::RenderElements);
+  auto relemBounds = get_section<Aabb>(file, header, BakedSceneSection::RenderElementBounds);
+  auto meshlets = get_section<Meshlet>(file, header, BakedSceneSection::Meshlets);
+  auto meshes = get_section<Mesh>(file, header, BakedSceneSection::Meshes);
+  auto lods = get_section<MeshLod>(file, header, BakedSceneSection::MeshLods);
+  auto instanceMatrices =
+    get_section<glm::mat4x4>(file, header, BakedSceneSection::InstanceMatrices);
+  auto instanceMeshes = get_section<std::uint32_t>(file, header, BakedSceneSection::InstanceMeshes);
+  auto textures = get_section<BakedTexture>(file, header, BakedSceneSection::Textures);
+  auto strings = get_section<char>(file, header, BakedSceneSection::Strings);
+
+  if (
+    !vertices.has_value() || !indices.has_value() || !indices16.has_value() ||
+    !relems.has_value() || !relemBounds.has_value() || !meshlets.has_value() ||
+    !meshes.has_value() || !lods.has_value() || !instanceMatrices.has_value() ||
+    !instanceMeshes.has_value() || !textures.has_value() || !strings.has_value())
+    return std::nullopt;
+
+  if (vertices->size() % header.vertexSize != 0)
+  {
+    spdlog::error("Baked scene: vertex section size is not a multiple of the vertex size");
+    return std::nullopt;
+  }
+
+  if (instanceMatrices->size() != instanceMeshes->size())
+  {
+    spdlog::error("Baked scene: instance tables have different sizes");
+    return std::nullopt;
+  }
+
+  if (relemBounds->size() != relems->size())
+  {
+    spdlog::error("Baked scene: relem bounds don't match relems");
+    return std::nullopt;
+  }
+
+  for (const auto& texture : *textures)
+    if (
+      texture.pathOffset > strings->size() ||
+      texture.pathLength > strings->size() - texture.pathOffset)
+    {
+      spdlog::error("Baked scene: texture path is out of bounds");
+      return std::nullopt;
+    }
+
+  // Everything below is used as an index by the renderers without any further checks.
+  // Indices themselves aren't checked against the vertex count though, as that would
+  // mean touching every single one of them, which defeats the point of mapping the file.
+  const std::size_t vertexCount = vertices->size() / header.vertexSize;
+  for (std::size_t i = 0; i < relems->size(); ++i)
+  {
+    const auto& relem = (*relems)[i];
+    const std::size_t formatIndexCount =
+      relem.indexFormat == IndexFormat::Uint16 ? indices16->size() : indices->size();
+    if (
+      (relem.indexFormat != IndexFormat::Uint32 && relem.indexFormat != IndexFormat::Uint16) ||
+      !is_range_valid(relem.indexOffset, relem.indexCount, formatIndexCount) ||
+      (relem.indexCount > 0 && relem.vertexOffset >= vertexCount) ||
+      !is_range_valid(relem.firstMeshlet, relem.meshletCount, meshlets->size()))
+    {
+      spdlog::error("Baked scene: relem {} is out of bounds", i);
+      return std::nullopt;
+    }
+  }
+
+  for (std::size_t i = 0; i < meshlets->size(); ++i)
+  {
+    const auto& meshlet = (*meshlets)[i];
+    if (
+      meshlet.relem >= relems->size() ||
+      !is_range_valid(meshlet.indexOffset, meshlet.indexCount, (*relems)[meshlet.relem].indexCount))
+    {
+      spdlog::error("Baked scene: meshlet {} is out of bounds", i);
+      return std::nullopt;
+    }
+  }
+
+  for (std::size_t i = 0; i < meshes->size(); ++i)
+  {
+    const auto& mesh = (*meshes)[i];
+    if (
+      !is_range_valid(mesh.firstRelem, mesh.relemCount, relems->size()) ||
+      !is_range_valid(mesh.firstLod, mesh.lodCount, lods->size()))
+    {
+      spdlog::error("Baked scene: mesh {} is out of bounds", i);
+      return std::nullopt;
+    }
+  }
+
+  for (std::size_t i = 0; i < lods->size(); ++i)
+    if (!is_range_valid((*lods)[i].firstRelem, (*lods)[i].relemCount, relems->size()))
+    {
+      spdlog::error("Baked scene: LOD {} is out of bounds", i);
+      return std::nullopt;
+    }
+
+  for (std::size_t i = 0; i < instanceMeshes->size(); ++i)
+    if ((*instanceMeshes)[i] >= meshes->size())
+    {
+      spdlog::error("Baked scene: instance {} references a missing mesh", i);
+      return std::nullopt;
+    }
+
+  return BakedSceneView{
+    .vertexFormat = header.vertexFormat,
+    .vertices = *vertices,
+    .indices = *indices,
+    .indices16 = *indices16,
+    .relems = *relems,
+    .relemBounds = *relemBounds,
+    .meshlets = *meshlets,
+    .meshes = *meshes,
+    .lods = *lods,
+    .instanceMatrices = *instanceMatrices,
+    .instanceMeshes = *instanceMeshes,
+    .textures = *textures,
+    .strings = *strings,
+  };
+}
+
+std::string_view get_texture_path(const BakedSceneView& scene, const BakedTexture& texture)
+{
+  return std::string_view(scene.strings.data() + texture.pathOffset, texture.pathLength);
+}
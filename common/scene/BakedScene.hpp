@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include <glm/glm.hpp>
+
+#include "SceneData.hpp"
+#include "VertexRepacking.hpp"
+#include "VertexQuantization.hpp"
+#include "TextureCompression.hpp"
+
+
+// Baked scenes are stored in a simple binary container: a header followed
+// by a bunch of sections containing arrays of POD structures exactly as the
+// renderer uses them. Every section starts at an offset that is aligned
+// to BAKED_SCENE_ALIGNMENT, so the file can be mapped into memory and its
+// sections can be used directly, without any parsing or conversion.
+
+inline constexpr std::uint32_t BAKED_SCENE_MAGIC = 0x4E435342; // "BSCN"
+// Increment on any change to the layout of the file or of the stored structures!
+inline constexpr std::uint32_t BAKED_SCENE_VERSION = 7;
+inline constexpr std::size_t BAKED_SCENE_ALIGNMENT = 64;
+inline constexpr const char* BAKED_SCENE_EXTENSION = ".baked";
+
+enum class BakedSceneSection : std::uint32_t
+{
+  Vertices,
+  Indices,
+  Indices16,
+  RenderElements,
+  RenderElementBounds,
+  Meshlets,
+  Meshes,
+  MeshLods,
+  InstanceMatrices,
+  InstanceMeshes,
+  Textures,
+  Strings,
+  Count,
+};
+
+struct BakedSceneSectionEntry
+{
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct BakedSceneHeader
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  VertexFormat vertexFormat;
+  // Catches changes to the vertex format that somebody forgot to bump the version for
+  std::uint32_t vertexSize;
+  std::uint32_t sectionCount;
+  std::uint32_t padding;
+  BakedSceneSectionEntry sections[static_cast<std::size_t>(BakedSceneSection::Count)];
+};
+
+// Textures are stored next to the baked scene as KTX2 files, one per glTF image
+struct BakedTexture
+{
+  // Path relative to the baked scene's directory, stored in the strings section.
+  // Empty if the image is not used by any material or couldn't be baked.
+  std::uint32_t pathOffset;
+  std::uint32_t pathLength;
+  TextureUsage usage;
+  std::uint32_t padding = 0;
+};
+
+// Non-owning view of all the data stored in a baked scene
+struct BakedSceneView
+{
+  VertexFormat vertexFormat;
+  // Either PackedVertex or QuantizedVertex array, depending on the format.
+  // For quantized scenes, instance matrices include the dequantization
+  // transforms of their meshes.
+  std::span<const std::byte> vertices;
+  std::span<const std::uint32_t> indices;
+  std::span<const std::uint16_t> indices16;
+  std::span<const RenderElement> relems;
+  std::span<const Aabb> relemBounds;
+  // Bounds are in the space of the stored vertices, so quantized ones for quantized scenes
+  std::span<const Meshlet> meshlets;
+  std::span<const Mesh> meshes;
+  std::span<const MeshLod> lods;
+  std::span<const glm::mat4x4> instanceMatrices;
+  std::span<const std::uint32_t> instanceMeshes;
+  // Indexed the same way as glTF images
+  std::span<const BakedTexture> textures;
+  std::span<const char> strings;
+};
+
+// Path of a texture relative to the baked scene's directory, empty if the texture is missing
+std::string_view get_texture_path(const BakedSceneView& scene, const BakedTexture& texture);
+
+std::size_t get_vertex_size(VertexFormat format);
+
+// Returns false and reports an error if the file couldn't be written
+bool write_baked_scene(const std::filesystem::path& path, const BakedSceneView& scene);
+
+// Validates the file contents and returns views into it. The data is not copied,
+// so the returned spans are only valid as long as the file's memory is.
+std::optional<BakedSceneView> parse_baked_scene(std::span<const std::byte> file);
@@ -0,0 +1,171 @@
+#include "FrustumCulling.hpp"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCENE_CULLING_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_CULLING_SSE2 1
+#endif
+
+
+Frustum extract_frustum(const glm::mat4x4& view_proj)
+{
+  const auto row = [&view_proj](int i) {
+    return glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+  };
+
+  Frustum result{{
+    row(3) + row(0),
+    row(3) - row(0),
+    row(3) + row(1),
+    row(3) - row(1),
+    row(2),
+    row(3) - row(2),
+  }};
+
+  for (auto& plane : result.planes)
+    plane /= glm::length(glm::vec3(plane));
+
+  return result;
+}
+
+void BoxesSoa::resize(std::size_t new_count)
+{
+  count = new_count;
+  const std::size_t padded = (count + BATCH_ALIGNMENT - 1) / BATCH_ALIGNMENT * BATCH_ALIGNMENT;
+  for (auto* array : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+    array->resize(padded, 0.0f);
+}
+
+void BoxesSoa::set(std::size_t i, const Aabb& box, const glm::mat4x4& transform)
+{
+  if (box.min.x > box.max.x)
+  {
+    // Fails every plane test, see cull_boxes
+    centerX[i] = centerY[i] = centerZ[i] = 0;
+    extentX[i] = extentY[i] = extentZ[i] = -std::numeric_limits<float>::infinity();
+    return;
+  }
+
+  // Arvo's method: the extent along an axis is the sum of the absolute
+  // values of the transformed half-extents along that axis.
+  const glm::vec3 center = glm::vec3(transform * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+  const glm::vec3 halfExtent = (box.max - box.min) * 0.5f;
+  const glm::vec3 extent = glm::abs(glm::vec3(transform[0])) * halfExtent.x +
+    glm::abs(glm::vec3(transform[1])) * halfExtent.y +
+    glm::abs(glm::vec3(transform[2])) * halfExtent.z;
+
+  centerX[i] = center.x;
+  centerY[i] = center.y;
+  centerZ[i] = center.z;
+  extentX[i] = extent.x;
+  extentY[i] = extent.y;
+  extentZ[i] = extent.z;
+}
+
+// A box is outside of a plane when even its corner that is furthest along the plane
+// normal is behind it: dot(n, c) + dot(abs(n), e) + w < 0. Comparisons are ordered,
+// so NaNs coming from empty boxes count as outside.
+
+#if defined(SCENE_CULLING_AVX2)
+
+static constexpr std::size_t BATCH_SIZE = 8;
+
+static std::uint32_t test_batch(const Frustum& frustum, const BoxesSoa& boxes, std::size_t first)
+{
+  const __m256 cx = _mm256_loadu_ps(&boxes.centerX[first]);
+  const __m256 cy = _mm256_loadu_ps(&boxes.centerY[first]);
+  const __m256 cz = _mm256_loadu_ps(&boxes.centerZ[first]);
+  const __m256 ex = _mm256_loadu_ps(&boxes.extentX[first]);
+  const __m256 ey = _mm256_loadu_ps(&boxes.extentY[first]);
+  const __m256 ez = _mm256_loadu_ps(&boxes.extentZ[first]);
+
+  __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for (const auto& plane : frustum.planes)
+  {
+    __m256 d = _mm256_set1_ps(plane.w);
+    d = _mm256_add_ps(d, _mm256_mul_ps(cx, _mm256_set1_ps(plane.x)));
+    d = _mm256_add_ps(d, _mm256_mul_ps(cy, _mm256_set1_ps(plane.y)));
+    d = _mm256_add_ps(d, _mm256_mul_ps(cz, _mm256_set1_ps(plane.z)));
+    d = _mm256_add_ps(d, _mm256_mul_ps(ex, _mm256_set1_ps(std::abs(plane.x))));
+    d = _mm256_add_ps(d, _mm256_mul_ps(ey, _mm256_set1_ps(std::abs(plane.y))));
+    d = _mm256_add_ps(d, _mm256_mul_ps(ez, _mm256_set1_ps(std::abs(plane.z))));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+  }
+
+  return static_cast<std::uint32_t>(_mm256_movemask_ps(inside));
+}
+
+#elif defined(SCENE_CULLING_SSE2)
+
+static constexpr std::size_t BATCH_SIZE = 4;
+
+static std::uint32_t test_batch(const Frustum& frustum, const BoxesSoa& boxes, std::size_t first)
+{
+  const __m128 cx = _mm_loadu_ps(&boxes.centerX[first]);
+  const __m128 cy = _mm_loadu_ps(&boxes.centerY[first]);
+  const __m128 cz = _mm_loadu_ps(&boxes.centerZ[first]);
+  const __m128 ex = _mm_loadu_ps(&boxes.extentX[first]);
+  const __m128 ey = _mm_loadu_ps(&boxes.extentY[first]);
+  const __m128 ez = _mm_loadu_ps(&boxes.extentZ[first]);
+
+  __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  for (const auto& plane : frustum.planes)
+  {
+    __m128 d = _mm_set1_ps(plane.w);
+    d = _mm_add_ps(d, _mm_mul_ps(cx, _mm_set1_ps(plane.x)));
+    d = _mm_add_ps(d, _mm_mul_ps(cy, _mm_set1_ps(plane.y)));
+    d = _mm_add_ps(d, _mm_mul_ps(cz, _mm_set1_ps(plane.z)));
+    d = _mm_add_ps(d, _mm_mul_ps(ex, _mm_set1_ps(std::abs(plane.x))));
+    d = _mm_add_ps(d, _mm_mul_ps(ey, _mm_set1_ps(std::abs(plane.y))));
+    d = _mm_add_ps(d, _mm_mul_ps(ez, _mm_set1_ps(std::abs(plane.z))));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+  }
+
+  return static_cast<std::uint32_t>(_mm_movemask_ps(inside));
+}
+
+#else
+
+static constexpr std::size_t BATCH_SIZE = 1;
+
+static std::uint32_t test_batch(const Frustum& frustum, const BoxesSoa& boxes, std::size_t first)
+{
+  for (const auto& plane : frustum.planes)
+  {
+    const float d = plane.w + boxes.centerX[first] * plane.x + boxes.centerY[first] * plane.y +
+      boxes.centerZ[first] * plane.z + boxes.extentX[first] * std::abs(plane.x) +
+      boxes.extentY[first] * std::abs(plane.y) + boxes.extentZ[first] * std::abs(plane.z);
+    if (!(d >= 0))
+      return 0;
+  }
+  return 1;
+}
+
+#endif
+
+static_assert(BoxesSoa::BATCH_ALIGNMENT % BATCH_SIZE == 0);
+
+void cull_boxes(const Frustum& frustum, const BoxesSoa& boxes, std::vector<std::uint32_t>& visible)
+{
+  visible.clear();
+
+  for (std::size_t first = 0; first < boxes.count; first += BATCH_SIZE)
+  {
+    // Padding boxes are zero-sized boxes at the origin, which might be visible
+    std::uint32_t mask = test_batch(frustum, boxes, first);
+    if (boxes.count - first < BATCH_SIZE)
+      mask &= (1u << (boxes.count - first)) - 1;
+
+    while (mask != 0)
+    {
+      visible.push_back(static_cast<std::uint32_t>(first + std::countr_zero(mask)));
+      mask &= mask - 1;
+    }
+  }
+}
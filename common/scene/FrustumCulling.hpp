@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "SceneData.hpp"
+
+
+// Planes with normals pointing inside: a point p is inside of a plane
+// when dot(plane.xyz, p) + plane.w >= 0. Normals are normalized.
+struct Frustum
+{
+  std::array<glm::vec4, 6> planes;
+};
+
+// Gribb-Hartmann plane extraction for a [0, 1] depth range
+Frustum extract_frustum(const glm::mat4x4& view_proj);
+
+// World space boxes stored as separate arrays of centers and half-extents, so that
+// they can be tested in SIMD batches. Arrays are padded to a multiple of the widest
+// batch, padding boxes are never reported as visible.
+struct BoxesSoa
+{
+  static constexpr std::size_t BATCH_ALIGNMENT = 8;
+
+  std::size_t count = 0;
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> extentX;
+  std::vector<float> extentY;
+  std::vector<float> extentZ;
+
+  void resize(std::size_t new_count);
+
+  // Stores a box enclosing `box` transformed by `transform`
+  void set(std::size_t i, const Aabb& box, const glm::mat4x4& transform);
+};
+
+// Replaces the contents of `visible` with the sorted indices of the boxes that
+// intersect the frustum or are inside of it. Uses AVX2 to test 8 boxes at a time
+// when compiled with it, SSE2 for 4 boxes at a time otherwise.
+void cull_boxes(const Frustum& frustum, const BoxesSoa& boxes, std::vector<std::uint32_t>& visible);
@@ -0,0 +1,1342 @@
+#include "GltfLoader.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <limits>
+#include <array>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <etna/Assert.hpp>
+#include <tracy/Tracy.hpp>
+#include <json.hpp>
+#include <stb_image.h>
+
+
+// Keeps the encoded image file instead of decoding it, see decodeImage
+static bool keep_encoded_image(
+  tinygltf::Image* image,
+  const int /*image_idx*/,
+  std::string* /*err*/,
+  std::string* /*warn*/,
+  int /*req_width*/,
+  int /*req_height*/,
+  const unsigned char* bytes,
+  int size,
+  void* /*user_data*/)
+{
+  image->image.assign(bytes, bytes + size);
+  image->width = -1;
+  image->height = -1;
+  image->component = -1;
+  image->bits = -1;
+  return true;
+}
+
+GltfLoader::GltfLoader(CreateInfo info)
+{
+  if (info.workerThreadCount > 0)
+    workers = std::make_unique<ThreadPool>(info.workerThreadCount);
+
+  if (info.deferImageDecoding)
+    loader.SetImageLoader(keep_encoded_image, nullptr);
+}
+
+static void report_loading_result(
+  const tinygltf::Model& model, bool success, const std::string& error, const std::string& warning)
+{
+  if (!success)
+  {
+    spdlog::error("glTF: Failed to load model!");
+    if (!error.empty())
+      spdlog::error("glTF: {}", error);
+    return;
+  }
+
+  if (!warning.empty())
+    spdlog::warn("glTF: {}", warning);
+
+  if (
+    !model.extensions.empty() || !model.extensionsRequired.empty() || !model.extensionsUsed.empty())
+    spdlog::warn("glTF: No glTF extensions are currently implemented!");
+}
+
+std::optional<GltfLoader::LoadedModel> GltfLoader::loadModel(std::filesystem::path path)
+{
+  auto ext = path.extension();
+  if (ext == ".glb")
+    return loadBinaryModel(path);
+
+  if (ext != ".gltf")
+  {
+    spdlog::error("glTF: Unknown glTF file extension: '{}'. Expected .gltf or .glb.", ext);
+    return std::nullopt;
+  }
+
+  LoadedModel result;
+
+  std::string error;
+  std::string warning;
+  bool success = loader.LoadASCIIFromFile(&result.model, &error, &warning, path.string());
+
+  report_loading_result(result.model, success, error, warning);
+  if (!success)
+    return std::nullopt;
+
+  result.directory = path.parent_path();
+  result.buffers.reserve(result.model.buffers.size());
+  for (const auto& buffer : result.model.buffers)
+    result.buffers.emplace_back(std::as_bytes(std::span(buffer.data)));
+
+  return result;
+}
+
+// See https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#binary-gltf-layout
+static constexpr std::uint32_t GLB_MAGIC = 0x46546C67;
+static constexpr std::uint32_t GLB_CHUNK_TYPE_JSON = 0x4E4F534A;
+static constexpr std::uint32_t GLB_CHUNK_TYPE_BIN = 0x004E4942;
+static constexpr std::size_t GLB_HEADER_SIZE = 12;
+static constexpr std::size_t GLB_CHUNK_HEADER_SIZE = 8;
+
+static std::uint32_t read_u32(std::span<const std::byte> bytes, std::size_t offset)
+{
+  std::uint32_t result;
+  std::memcpy(&result, bytes.data() + offset, sizeof(result));
+  return result;
+}
+
+std::optional<GltfLoader::LoadedModel> GltfLoader::loadBinaryModel(
+  const std::filesystem::path& path)
+{
+  ZoneScoped;
+
+  // tinygltf copies the whole BIN chunk of a .glb into a std::vector, which
+  // means reading the entire file into memory and then copying it once more.
+  // Instead, we map the file and only let tinygltf see the JSON chunk, while
+  // accessors are read in-place straight from the mapped BIN chunk.
+
+  auto mappedFile = MappedFile::open(path);
+  if (!mappedFile.has_value())
+  {
+    spdlog::error("glTF: Unable to open and map '{}'", path);
+    return std::nullopt;
+  }
+
+  const auto file = mappedFile->getData();
+
+  if (file.size() < GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE || read_u32(file, 0) != GLB_MAGIC)
+  {
+    spdlog::error("glTF: '{}' is not a valid .glb file", path);
+    return std::nullopt;
+  }
+
+  if (const auto version = read_u32(file, 4); version != 2)
+  {
+    spdlog::error("glTF: Unsupported .glb container version {}", version);
+    return std::nullopt;
+  }
+
+  const std::size_t totalLength = std::min<std::size_t>(read_u32(file, 8), file.size());
+
+  std::span<const std::byte> jsonChunk;
+  std::span<const std::byte> binChunk;
+  for (std::size_t offset = GLB_HEADER_SIZE; offset + GLB_CHUNK_HEADER_SIZE <= totalLength;)
+  {
+    const std::size_t chunkLength = read_u32(file, offset);
+    const std::uint32_t chunkType = read_u32(file, offset + 4);
+    offset += GLB_CHUNK_HEADER_SIZE;
+
+    if (chunkLength > totalLength - offset)
+    {
+      spdlog::error("glTF: '{}' has a truncated chunk", path);
+      return std::nullopt;
+    }
+
+    // Unknown chunks must be ignored as per the spec
+    if (chunkType == GLB_CHUNK_TYPE_JSON && jsonChunk.empty())
+      jsonChunk = file.subspan(offset, chunkLength);
+    else if (chunkType == GLB_CHUNK_TYPE_BIN && binChunk.empty())
+      binChunk = file.subspan(offset, chunkLength);
+
+    offset += chunkLength;
+  }
+
+  if (jsonChunk.empty())
+  {
+    spdlog::error("glTF: '{}' has no JSON chunk", path);
+    return std::nullopt;
+  }
+
+  auto json = nlohmann::json::parse(
+    reinterpret_cast<const char*>(jsonChunk.data()),
+    reinterpret_cast<const char*>(jsonChunk.data() + jsonChunk.size()),
+    nullptr,
+    false);
+  if (json.is_discarded() || !json.is_object())
+  {
+    spdlog::error("glTF: '{}' has a malformed JSON chunk", path);
+    return std::nullopt;
+  }
+
+  // The buffer without an URI is the one stored in the BIN chunk.
+  // We remove it from the JSON so that tinygltf doesn't copy it, all other
+  // (external) buffers are still loaded by tinygltf.
+  std::size_t bufferCount = 0;
+  std::optional<std::size_t> binBuffer;
+  if (auto it = json.find("buffers"); it != json.end() && it->is_array())
+  {
+    bufferCount = it->size();
+    for (std::size_t i = 0; i < bufferCount; ++i)
+      if (!(*it)[i].contains("uri"))
+      {
+        binBuffer = i;
+        break;
+      }
+    if (binBuffer.has_value())
+      it->erase(*binBuffer);
+  }
+
+  if (binBuffer.has_value() && binChunk.empty())
+  {
+    spdlog::error("glTF: '{}' references a BIN chunk but doesn't have one", path);
+    return std::nullopt;
+  }
+
+  // Images embedded into the BIN chunk would make tinygltf look into the buffer
+  // we've just removed, so we take images out of tinygltf's hands altogether
+  // and only record references to their data. Decoding them is the job of
+  // whoever needs the pixels.
+  nlohmann::json images = nlohmann::json::array();
+  if (auto it = json.find("images"); it != json.end())
+  {
+    images = std::move(*it);
+    json.erase(it);
+  }
+
+  LoadedModel result;
+
+  {
+    const auto jsonString = json.dump();
+
+    std::string error;
+    std::string warning;
+    const bool success = loader.LoadASCIIFromString(
+      &result.model,
+      &error,
+      &warning,
+      jsonString.c_str(),
+      static_cast<unsigned int>(jsonString.size()),
+      path.parent_path().string());
+
+    report_loading_result(result.model, success, error, warning);
+    if (!success)
+      return std::nullopt;
+  }
+
+  if (images.is_array())
+  {
+    result.model.images.reserve(images.size());
+    for (const auto& jsonImage : images)
+    {
+      auto& image = result.model.images.emplace_back();
+      image.name = jsonImage.value("name", "");
+      image.uri = jsonImage.value("uri", "");
+      image.mimeType = jsonImage.value("mimeType", "");
+      image.bufferView = jsonImage.value("bufferView", -1);
+    }
+  }
+
+  result.buffers.reserve(bufferCount);
+  for (std::size_t i = 0, loadedIdx = 0; i < bufferCount; ++i)
+  {
+    if (i == binBuffer)
+      result.buffers.push_back(binChunk);
+    else
+      result.buffers.emplace_back(std::as_bytes(std::span(result.model.buffers[loadedIdx++].data)));
+  }
+
+  spdlog::info(
+    "glTF: mapped '{}' ({:.1f} MiB), reading geometry in-place",
+    path,
+    static_cast<double>(file.size()) / (1 << 20));
+
+  result.mappedFile = std::move(mappedFile);
+  result.directory = path.parent_path();
+
+  return result;
+}
+
+static TransformHierarchy::LocalTransform get_local_transform(const tinygltf::Node& node)
+{
+  TransformHierarchy::LocalTransform result;
+
+  // glTF requires matrices to be decomposable into TRS
+  if (!node.matrix.empty())
+  {
+    glm::mat4x4 matrix;
+    for (int i = 0; i < 4; ++i)
+      for (int j = 0; j < 4; ++j)
+        matrix[i][j] = static_cast<float>(node.matrix[4 * i + j]);
+
+    const glm::mat3 linear(matrix);
+    result.translation = glm::vec3(matrix[3]);
+    result.scale =
+      glm::vec3(glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2]));
+    if (glm::determinant(linear) < 0)
+      result.scale.x = -result.scale.x;
+
+    glm::mat3 rotation = linear;
+    for (glm::length_t i = 0; i < 3; ++i)
+      if (result.scale[i] != 0)
+        rotation[i] /= result.scale[i];
+    result.rotation = glm::quat_cast(rotation);
+    return result;
+  }
+
+  if (!node.translation.empty())
+    result.translation = glm::vec3(
+      static_cast<float>(node.translation[0]),
+      static_cast<float>(node.translation[1]),
+      static_cast<float>(node.translation[2]));
+
+  if (!node.rotation.empty())
+    result.rotation = glm::quat(
+      static_cast<float>(node.rotation[3]),
+      static_cast<float>(node.rotation[0]),
+      static_cast<float>(node.rotation[1]),
+      static_cast<float>(node.rotation[2]));
+
+  if (!node.scale.empty())
+    result.scale = glm::vec3(
+      static_cast<float>(node.scale[0]),
+      static_cast<float>(node.scale[1]),
+      static_cast<float>(node.scale[2]));
+
+  return result;
+}
+
+GltfLoader::ProcessedInstances GltfLoader::processInstances(const tinygltf::Model& model) const
+{
+  ZoneScoped;
+
+  // Only the default scene is instanced, other scenes of the file are alternatives to it.
+  // Files without one get the first scene, which is what viewers usually show.
+  std::vector<std::uint32_t> roots;
+  const int scene = model.defaultScene >= 0 ? model.defaultScene : 0;
+  if (static_cast<std::size_t>(scene) < model.scenes.size())
+    for (auto node : model.scenes[scene].nodes)
+      roots.push_back(static_cast<std::uint32_t>(node));
+
+  // Depth-first preorder, as TransformHierarchy wants it
+  std::vector<std::uint32_t> order;
+  std::vector<std::uint32_t> parents;
+  order.reserve(model.nodes.size());
+  parents.reserve(model.nodes.size());
+  {
+    std::vector<bool> visited(model.nodes.size(), false);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack;
+    for (auto root : roots)
+    {
+      stack.emplace_back(root, TransformHierarchy::NO_PARENT);
+      while (!stack.empty())
+      {
+        const auto [gltfNode, parent] = stack.back();
+        stack.pop_back();
+
+        // Invalid files might reference a node several times
+        if (visited[gltfNode])
+          continue;
+        visited[gltfNode] = true;
+
+        const auto node = static_cast<std::uint32_t>(order.size());
+        order.push_back(gltfNode);
+        parents.push_back(parent);
+
+        const auto& children = model.nodes[gltfNode].children;
+        for (auto it = children.rbegin(); it != children.rend(); ++it)
+          stack.emplace_back(static_cast<std::uint32_t>(*it), node);
+      }
+    }
+  }
+
+  std::vector<TransformHierarchy::LocalTransform> locals;
+  locals.reserve(order.size());
+  for (auto gltfNode : order)
+    locals.push_back(get_local_transform(model.nodes[gltfNode]));
+
+  ProcessedInstances result;
+  result.hierarchy = TransformHierarchy(std::move(parents), locals);
+  result.gltfNodes = std::move(order);
+
+  // Don't overallocate matrices, they are pretty chonky.
+  {
+    std::size_t totalNodesWithMeshes = 0;
+    for (std::size_t i = 0; i < model.nodes.size(); ++i)
+      if (model.nodes[i].mesh >= 0)
+        ++totalNodesWithMeshes;
+    result.matrices.reserve(totalNodesWithMeshes);
+    result.meshes.reserve(totalNodesWithMeshes);
+    result.nodes.reserve(totalNodesWithMeshes);
+  }
+
+  const auto worldMatrices = result.hierarchy.getWorldMatrices();
+  for (std::uint32_t node = 0; node < result.gltfNodes.size(); ++node)
+    if (const int mesh = model.nodes[result.gltfNodes[node]].mesh; mesh >= 0)
+    {
+      result.matrices.push_back(worldMatrices[node]);
+      result.meshes.push_back(static_cast<std::uint32_t>(mesh));
+      result.nodes.push_back(node);
+    }
+
+  return result;
+}
+
+// Everything required to convert a single glTF primitive into our format.
+// Gathered during the counting pass of processMeshes.
+struct PrimitiveSource
+{
+  VertexAttributeStreams streams;
+  const std::byte* indices;
+  int indexComponentType;
+
+  std::size_t vertexCount;
+  std::size_t indexCount;
+
+  // Where the converted data goes in the final unified arrays
+  std::size_t firstVertex;
+  std::size_t firstIndex;
+};
+
+static const std::byte* get_accessor_data(
+  const tinygltf::Model& model,
+  std::span<const std::span<const std::byte>> buffers,
+  const tinygltf::Accessor& accessor)
+{
+  const auto& bufView = model.bufferViews[accessor.bufferView];
+  const auto buffer = buffers[bufView.buffer];
+  ETNA_VERIFY(bufView.byteOffset + bufView.byteLength <= buffer.size());
+  return buffer.data() + bufView.byteOffset + accessor.byteOffset;
+}
+
+static std::size_t get_accessor_stride(
+  const tinygltf::Model& model, const tinygltf::Accessor& accessor)
+{
+  const auto& bufView = model.bufferViews[accessor.bufferView];
+  return bufView.byteStride != 0
+    ? bufView.byteStride
+    : tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+      tinygltf::GetNumComponentsInType(accessor.type);
+}
+
+static PrimitiveSource get_primitive_source(
+  const tinygltf::Model& model,
+  std::span<const std::span<const std::byte>> buffers,
+  const tinygltf::Primitive& prim)
+{
+  const auto& indexAccessor = model.accessors[prim.indices];
+  const auto& positionAccessor = model.accessors[prim.attributes.at("POSITION")];
+
+  // Indices are guaranteed to have no stride
+  ETNA_VERIFY(model.bufferViews[indexAccessor.bufferView].byteStride == 0);
+
+  PrimitiveSource result{
+    .streams =
+      {
+        .position = get_accessor_data(model, buffers, positionAccessor),
+        .positionStride = get_accessor_stride(model, positionAccessor),
+      },
+    .indices = get_accessor_data(model, buffers, indexAccessor),
+    .indexComponentType = indexAccessor.componentType,
+    .vertexCount = positionAccessor.count,
+    .indexCount = indexAccessor.count,
+    .firstVertex = 0,
+    .firstIndex = 0,
+  };
+
+  // Fall back to 0 in case we don't have something.
+  // NOTE: if tangents are not available, one could use http://mikktspace.com/
+  // NOTE: if normals are not available, reconstructing them is possible but will look ugly
+  const auto attribute = [&](const char* name, const std::byte*& data, std::size_t& stride) {
+    if (auto it = prim.attributes.find(name); it != prim.attributes.end())
+    {
+      const auto& accessor = model.accessors[it->second];
+      data = get_accessor_data(model, buffers, accessor);
+      stride = get_accessor_stride(model, accessor);
+    }
+  };
+  attribute("NORMAL", result.streams.normal, result.streams.normalStride);
+  attribute("TANGENT", result.streams.tangent, result.streams.tangentStride);
+  attribute("TEXCOORD_0", result.streams.texcoord, result.streams.texcoordStride);
+
+  return result;
+}
+
+static void convert_indices(
+  const std::byte* src, int component_type, std::span<std::uint32_t> out)
+{
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    for (std::size_t i = 0; i < out.size(); ++i)
+      out[i] = static_cast<std::uint8_t>(src[i]);
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    for (std::size_t i = 0; i < out.size(); ++i)
+    {
+      std::uint16_t index;
+      std::memcpy(&index, src + i * sizeof(index), sizeof(index));
+      out[i] = index;
+    }
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    std::memcpy(out.data(), src, out.size_bytes());
+    break;
+  default:
+    ETNA_PANIC("glTF: invalid index component type {}", component_type);
+  }
+}
+
+GltfLoader::ProcessedMeshes GltfLoader::processMeshes(const LoadedModel& loaded) const
+{
+  ZoneScoped;
+
+  const auto& model = loaded.model;
+
+  // NOTE: glTF assets can have pretty wonky data layouts which are not appropriate
+  // for real-time rendering, so we have to press the data first. In serious engines
+  // this is mitigated by storing assets on the disc in an engine-specific format that
+  // is appropriate for GPU upload right after reading from disc.
+
+  ProcessedMeshes result;
+  std::vector<PrimitiveSource> primitives;
+
+  {
+    std::size_t totalPrimitives = 0;
+    for (const auto& mesh : model.meshes)
+      totalPrimitives += mesh.primitives.size();
+    result.relems.reserve(totalPrimitives);
+    primitives.reserve(totalPrimitives);
+  }
+
+  result.meshes.reserve(model.meshes.size());
+
+  // Counting pass: figure out where every primitive's data goes in the final arrays.
+  // The offsets are an exclusive prefix sum of the vertex and index counts, so they
+  // do not depend on the order in which primitives get converted afterwards.
+  std::size_t totalVertices = 0;
+  std::size_t totalIndices = 0;
+  for (const auto& mesh : model.meshes)
+  {
+    result.meshes.push_back(Mesh{
+      .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
+      .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
+    });
+
+    for (const auto& prim : mesh.primitives)
+    {
+      if (prim.mode != TINYGLTF_MODE_TRIANGLES)
+      {
+        spdlog::warn(
+          "Encountered a non-triangles primitive, these are not supported for now, skipping it!");
+        --result.meshes.back().relemCount;
+        continue;
+      }
+
+      auto& source = primitives.emplace_back(get_primitive_source(model, loaded.buffers, prim));
+      source.firstVertex = totalVertices;
+      source.firstIndex = totalIndices;
+
+      result.relems.push_back(RenderElement{
+        .vertexOffset = static_cast<std::uint32_t>(source.firstVertex),
+        .indexOffset = static_cast<std::uint32_t>(source.firstIndex),
+        .indexCount = static_cast<std::uint32_t>(source.indexCount),
+      });
+
+      totalVertices += source.vertexCount;
+      totalIndices += source.indexCount;
+    }
+  }
+
+  // Allocate everything up front so as not to hit the allocator on the hotpath
+  // and so that primitives can be converted straight into their final place.
+  result.vertices.resize(totalVertices);
+  result.indices.resize(totalIndices);
+
+  // Conversion pass. Vertex repacking dominates load times,
+  // so we keep an eye on its throughput.
+  const auto conversionStart = std::chrono::steady_clock::now();
+
+  if (workers == nullptr)
+  {
+    for (const auto& source : primitives)
+    {
+      repack_vertices(
+        source.streams,
+        std::span(result.vertices).subspan(source.firstVertex, source.vertexCount));
+      convert_indices(
+        source.indices,
+        source.indexComponentType,
+        std::span(result.indices).subspan(source.firstIndex, source.indexCount));
+    }
+  }
+  else
+  {
+    // Big primitives are split into chunks so that a single huge mesh
+    // doesn't end up being converted by a single thread.
+    constexpr std::size_t CHUNK_SIZE = 1 << 16;
+
+    struct Chunk
+    {
+      const PrimitiveSource* source;
+      bool indices;
+      std::size_t begin;
+      std::size_t end;
+    };
+
+    std::vector<Chunk> chunks;
+    for (const auto& source : primitives)
+    {
+      for (std::size_t begin = 0; begin < source.vertexCount; begin += CHUNK_SIZE)
+        chunks.push_back(Chunk{
+          .source = &source,
+          .indices = false,
+          .begin = begin,
+          .end = std::min(begin + CHUNK_SIZE, source.vertexCount),
+        });
+      for (std::size_t begin = 0; begin < source.indexCount; begin += CHUNK_SIZE)
+        chunks.push_back(Chunk{
+          .source = &source,
+          .indices = true,
+          .begin = begin,
+          .end = std::min(begin + CHUNK_SIZE, source.indexCount),
+        });
+    }
+
+    workers->parallelFor(chunks.size(), [&chunks, &result](std::size_t idx) {
+      ZoneScopedN("convertChunk");
+
+      const auto& chunk = chunks[idx];
+      const auto& source = *chunk.source;
+      const std::size_t count = chunk.end - chunk.begin;
+
+      if (chunk.indices)
+      {
+        convert_indices(
+          source.indices +
+            chunk.begin * tinygltf::GetComponentSizeInBytes(source.indexComponentType),
+          source.indexComponentType,
+          std::span(result.indices).subspan(source.firstIndex + chunk.begin, count));
+      }
+      else
+      {
+        VertexAttributeStreams streams = source.streams;
+        streams.position += chunk.begin * streams.positionStride;
+        if (streams.normal != nullptr)
+          streams.normal += chunk.begin * streams.normalStride;
+        if (streams.tangent != nullptr)
+          streams.tangent += chunk.begin * streams.tangentStride;
+        if (streams.texcoord != nullptr)
+          streams.texcoord += chunk.begin * streams.texcoordStride;
+
+        repack_vertices(
+          streams, std::span(result.vertices).subspan(source.firstVertex + chunk.begin, count));
+      }
+    });
+  }
+
+  {
+    const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - conversionStart).count();
+    spdlog::debug(
+      "glTF: converted {} vertices and {} indices in {:.2f} ms ({:.1f} Mvertices/s, {} threads)",
+      result.vertices.size(),
+      result.indices.size(),
+      seconds * 1000.0,
+      seconds > 0 ? static_cast<double>(result.vertices.size()) / seconds / 1e6 : 0.0,
+      workers == nullptr ? 1 : workers->getThreadCount() + 1);
+  }
+
+  return result;
+}
+
+std::vector<GltfLoader::PrimitiveStreams> GltfLoader::getPrimitiveStreams(
+  const LoadedModel& loaded)
+{
+  std::vector<PrimitiveStreams> result;
+  for (const auto& mesh : loaded.model.meshes)
+    for (const auto& prim : mesh.primitives)
+      if (prim.mode == TINYGLTF_MODE_TRIANGLES)
+      {
+        const auto source = get_primitive_source(loaded.model, loaded.buffers, prim);
+        result.push_back(PrimitiveStreams{
+          .streams = source.streams,
+          .vertexCount = source.vertexCount,
+        });
+      }
+  return result;
+}
+
+// Vertices of different relems never overlap, but we don't know
+// where exactly the relem's vertices end, so look at the indices.
+static std::size_t get_relem_vertex_count(
+  const RenderElement& relem, std::span<const std::uint32_t> indices)
+{
+  const auto relemIndices = indices.subspan(relem.indexOffset, relem.indexCount);
+  return relemIndices.empty() ? 0 : *std::ranges::max_element(relemIndices) + 1;
+}
+
+std::vector<GltfLoader::MeshOptimizationReport> GltfLoader::optimizeMeshes(
+  ProcessedMeshes& meshes) const
+{
+  ZoneScoped;
+
+  const auto optimizationStart = std::chrono::steady_clock::now();
+
+  std::vector<MeshOptimizationReport> relemReports(meshes.relems.size());
+
+  const auto optimizeRelem = [&meshes, &relemReports](std::size_t idx) {
+    ZoneScopedN("optimizeRelem");
+
+    const auto& relem = meshes.relems[idx];
+    const auto indices = std::span(meshes.indices).subspan(relem.indexOffset, relem.indexCount);
+    if (indices.empty())
+      return;
+
+    const std::size_t vertexCount = get_relem_vertex_count(relem, meshes.indices);
+    const auto vertices = std::span(meshes.vertices).subspan(relem.vertexOffset, vertexCount);
+
+    relemReports[idx].before = analyze_vertex_cache(indices, vertexCount);
+    optimize_mesh(indices, vertices);
+    relemReports[idx].after = analyze_vertex_cache(indices, vertexCount);
+  };
+
+  if (workers == nullptr)
+  {
+    for (std::size_t i = 0; i < meshes.relems.size(); ++i)
+      optimizeRelem(i);
+  }
+  else
+  {
+    workers->parallelFor(meshes.relems.size(), optimizeRelem);
+  }
+
+  std::vector<MeshOptimizationReport> result(meshes.meshes.size());
+  MeshOptimizationReport total;
+  for (std::size_t i = 0; i < meshes.meshes.size(); ++i)
+  {
+    const auto& mesh = meshes.meshes[i];
+    for (std::uint32_t j = mesh.firstRelem; j < mesh.firstRelem + mesh.relemCount; ++j)
+    {
+      result[i].before += relemReports[j].before;
+      result[i].after += relemReports[j].after;
+    }
+    total.before += result[i].before;
+    total.after += result[i].after;
+  }
+
+  const double seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - optimizationStart).count();
+  spdlog::info(
+    "glTF: optimized {} triangles in {:.2f} ms, ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+    total.after.triangles,
+    seconds * 1000.0,
+    total.before.acmr(),
+    total.after.acmr(),
+    total.before.atvr(),
+    total.after.atvr());
+
+  return result;
+}
+
+void GltfLoader::weldVertices(ProcessedMeshes& meshes) const
+{
+  ZoneScoped;
+
+  std::vector<std::size_t> uniqueCounts(meshes.relems.size());
+
+  const auto weldRelem = [&meshes, &uniqueCounts](std::size_t idx) {
+    ZoneScopedN("weldRelem");
+
+    const auto& relem = meshes.relems[idx];
+    const std::size_t vertexCount = get_relem_vertex_count(relem, meshes.indices);
+    uniqueCounts[idx] = weld_vertices(
+      std::span(meshes.indices).subspan(relem.indexOffset, relem.indexCount),
+      std::span(meshes.vertices).subspan(relem.vertexOffset, vertexCount));
+  };
+
+  if (workers == nullptr)
+  {
+    for (std::size_t i = 0; i < meshes.relems.size(); ++i)
+      weldRelem(i);
+  }
+  else
+  {
+    workers->parallelFor(meshes.relems.size(), weldRelem);
+  }
+
+  // Relems are laid out in the order of their vertices, so moving
+  // them to the left one by one never overwrites anything we need.
+  std::vector<std::size_t> order(meshes.relems.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::ranges::sort(order, [&meshes](std::size_t a, std::size_t b) {
+    return meshes.relems[a].vertexOffset < meshes.relems[b].vertexOffset;
+  });
+
+  const std::size_t vertexCountBefore = meshes.vertices.size();
+
+  std::size_t nextVertex = 0;
+  for (auto idx : order)
+  {
+    auto& relem = meshes.relems[idx];
+    std::copy_n(
+      meshes.vertices.begin() + relem.vertexOffset,
+      uniqueCounts[idx],
+      meshes.vertices.begin() + nextVertex);
+    relem.vertexOffset = static_cast<std::uint32_t>(nextVertex);
+    nextVertex += uniqueCounts[idx];
+  }
+  meshes.vertices.resize(nextVertex);
+  meshes.vertices.shrink_to_fit();
+
+  spdlog::info(
+    "glTF: welded {} vertices into {} ({:.1f}%)",
+    vertexCountBefore,
+    meshes.vertices.size(),
+    vertexCountBefore > 0
+      ? 100.0 * static_cast<double>(meshes.vertices.size()) / static_cast<double>(vertexCountBefore)
+      : 100.0);
+}
+
+std::vector<glm::vec3> GltfLoader::extractPositions(const ProcessedMeshes& meshes)
+{
+  std::vector<glm::vec3> positions(meshes.vertices.size());
+  for (std::size_t i = 0; i < positions.size(); ++i)
+    positions[i] = glm::vec3(meshes.vertices[i].positionAndNormal);
+  return positions;
+}
+
+// Bounding sphere of the vertices referenced by the full detail relems of a mesh
+static glm::vec4 compute_mesh_sphere(
+  const GltfLoader::ProcessedMeshes& meshes,
+  const Mesh& mesh,
+  std::span<const glm::vec3> positions)
+{
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+  for (std::uint32_t i = mesh.firstRelem; i < mesh.firstRelem + mesh.relemCount; ++i)
+  {
+    const auto& relem = meshes.relems[i];
+    for (auto index : std::span(meshes.indices).subspan(relem.indexOffset, relem.indexCount))
+    {
+      min = glm::min(min, positions[relem.vertexOffset + index]);
+      max = glm::max(max, positions[relem.vertexOffset + index]);
+    }
+  }
+
+  if (min.x > max.x)
+    return glm::vec4(0);
+
+  const glm::vec3 center = (min + max) * 0.5f;
+  float radius = 0;
+  for (std::uint32_t i = mesh.firstRelem; i < mesh.firstRelem + mesh.relemCount; ++i)
+  {
+    const auto& relem = meshes.relems[i];
+    for (auto index : std::span(meshes.indices).subspan(relem.indexOffset, relem.indexCount))
+      radius = std::max(radius, glm::length(positions[relem.vertexOffset + index] - center));
+  }
+
+  return glm::vec4(center, radius);
+}
+
+void GltfLoader::computeMeshBounds(
+  ProcessedMeshes& meshes, std::span<const glm::vec3> positions) const
+{
+  ZoneScoped;
+
+  for (auto& mesh : meshes.meshes)
+    mesh.sphere = compute_mesh_sphere(meshes, mesh, positions);
+
+  // glTF accessors do have min and max, but those don't account for quantization and LODs
+  meshes.relemBounds.resize(meshes.relems.size());
+  const auto computeRelemBounds = [&](std::size_t i) {
+    const auto& relem = meshes.relems[i];
+    Aabb bounds{
+      .min = glm::vec3(std::numeric_limits<float>::max()),
+      .max = glm::vec3(std::numeric_limits<float>::lowest()),
+    };
+    for (auto index : std::span(meshes.indices).subspan(relem.indexOffset, relem.indexCount))
+    {
+      bounds.min = glm::min(bounds.min, positions[relem.vertexOffset + index]);
+      bounds.max = glm::max(bounds.max, positions[relem.vertexOffset + index]);
+    }
+    meshes.relemBounds[i] = bounds;
+  };
+
+  if (workers == nullptr)
+    for (std::size_t i = 0; i < meshes.relems.size(); ++i)
+      computeRelemBounds(i);
+  else
+    workers->parallelFor(meshes.relems.size(), computeRelemBounds);
+}
+
+void GltfLoader::buildLods(
+  ProcessedMeshes& meshes, std::span<const glm::vec3> positions, const LodSettings& settings) const
+{
+  ZoneScoped;
+
+  const auto lodsStart = std::chrono::steady_clock::now();
+
+  struct LodLevel
+  {
+    // Indices of every full detail relem of the mesh
+    std::vector<std::vector<std::uint32_t>> relemIndices;
+    float error = 0;
+  };
+  std::vector<std::vector<LodLevel>> meshLods(meshes.meshes.size());
+
+  const auto buildMeshLods = [&](std::size_t idx) {
+    ZoneScopedN("buildMeshLods");
+
+    const auto& mesh = meshes.meshes[idx];
+    const float radius = compute_mesh_sphere(meshes, mesh, positions).w;
+    if (radius <= 0)
+      return;
+
+    std::size_t previousIndexCount = 0;
+    for (std::uint32_t i = mesh.firstRelem; i < mesh.firstRelem + mesh.relemCount; ++i)
+      previousIndexCount += meshes.relems[i].indexCount;
+
+    float targetRatio = 1;
+    for (float relativeError : settings.errors)
+    {
+      targetRatio *= settings.triangleRatio;
+
+      LodLevel level;
+      std::size_t indexCount = 0;
+      for (std::uint32_t i = mesh.firstRelem; i < mesh.firstRelem + mesh.relemCount; ++i)
+      {
+        const auto& relem = meshes.relems[i];
+        const auto relemIndices =
+          std::span(meshes.indices).subspan(relem.indexOffset, relem.indexCount);
+        const std::size_t vertexCount = get_relem_vertex_count(relem, meshes.indices);
+        const auto targetIndexCount =
+          static_cast<std::size_t>(static_cast<float>(relem.indexCount / 3) * targetRatio) * 3;
+
+        // Every level is simplified from the full detail mesh, so errors don't pile up
+        auto& lodIndices = level.relemIndices.emplace_back();
+        const float error = simplify_mesh(
+          relemIndices,
+          positions.subspan(relem.vertexOffset, vertexCount),
+          targetIndexCount,
+          relativeError * radius,
+          lodIndices);
+        optimize_vertex_cache(lodIndices, vertexCount);
+
+        level.error = std::max(level.error, error / radius);
+        indexCount += lodIndices.size();
+      }
+
+      // Not worth the memory and the draw calls
+      if (indexCount == 0 || indexCount > previousIndexCount * 9 / 10)
+        continue;
+
+      previousIndexCount = indexCount;
+      meshLods[idx].push_back(std::move(level));
+    }
+  };
+
+  if (workers == nullptr)
+  {
+    for (std::size_t i = 0; i < meshes.meshes.size(); ++i)
+      buildMeshLods(i);
+  }
+  else
+  {
+    workers->parallelFor(meshes.meshes.size(), buildMeshLods);
+  }
+
+  const std::size_t indexCountBefore = meshes.indices.size();
+
+  meshes.lods.clear();
+  for (std::size_t i = 0; i < meshes.meshes.size(); ++i)
+  {
+    auto& mesh = meshes.meshes[i];
+    mesh.firstLod = static_cast<std::uint32_t>(meshes.lods.size());
+    mesh.lodCount = static_cast<std::uint32_t>(meshLods[i].size());
+
+    for (const auto& level : meshLods[i])
+    {
+      meshes.lods.push_back(MeshLod{
+        .firstRelem = static_cast<std::uint32_t>(meshes.relems.size()),
+        .relemCount = mesh.relemCount,
+        .error = level.error,
+      });
+
+      for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+      {
+        const auto& lodIndices = level.relemIndices[j];
+        meshes.relems.push_back(RenderElement{
+          .vertexOffset = meshes.relems[mesh.firstRelem + j].vertexOffset,
+          .indexOffset = static_cast<std::uint32_t>(meshes.indices.size()),
+          .indexCount = static_cast<std::uint32_t>(lodIndices.size()),
+        });
+        meshes.indices.insert(meshes.indices.end(), lodIndices.begin(), lodIndices.end());
+      }
+    }
+  }
+
+  const double seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - lodsStart).count();
+  spdlog::info(
+    "glTF: built {} LODs for {} meshes in {:.2f} ms, index count {} -> {}",
+    meshes.lods.size(),
+    meshes.meshes.size(),
+    seconds * 1000.0,
+    indexCountBefore,
+    meshes.indices.size());
+}
+
+void GltfLoader::buildMeshlets(ProcessedMeshes& meshes, std::span<const glm::vec3> positions) const
+{
+  ZoneScoped;
+
+  std::vector<std::vector<Meshlet>> relemMeshlets(meshes.relems.size());
+
+  const auto buildRelem = [&meshes, &relemMeshlets, positions](std::size_t idx) {
+    ZoneScopedN("buildRelem");
+
+    const auto& relem = meshes.relems[idx];
+    const std::size_t vertexCount = get_relem_vertex_count(relem, meshes.indices);
+    build_meshlets(
+      std::span(meshes.indices).subspan(relem.indexOffset, relem.indexCount),
+      positions.subspan(relem.vertexOffset, vertexCount),
+      relemMeshlets[idx]);
+  };
+
+  if (workers == nullptr)
+  {
+    for (std::size_t i = 0; i < meshes.relems.size(); ++i)
+      buildRelem(i);
+  }
+  else
+  {
+    workers->parallelFor(meshes.relems.size(), buildRelem);
+  }
+
+  meshes.meshlets.clear();
+  for (std::size_t i = 0; i < meshes.relems.size(); ++i)
+  {
+    auto& relem = meshes.relems[i];
+    relem.firstMeshlet = static_cast<std::uint32_t>(meshes.meshlets.size());
+    relem.meshletCount = static_cast<std::uint32_t>(relemMeshlets[i].size());
+    for (auto& meshlet : relemMeshlets[i])
+    {
+      meshlet.relem = static_cast<std::uint32_t>(i);
+      meshes.meshlets.push_back(meshlet);
+    }
+  }
+
+  const std::size_t triangleCount = meshes.indices.size() / 3;
+  spdlog::info(
+    "glTF: split {} triangles into {} meshlets ({:.1f} triangles per meshlet)",
+    triangleCount,
+    meshes.meshlets.size(),
+    meshes.meshlets.empty()
+      ? 0.0
+      : static_cast<double>(triangleCount) / static_cast<double>(meshes.meshlets.size()));
+}
+
+void GltfLoader::packSmallIndices(ProcessedMeshes& meshes) const
+{
+  ZoneScoped;
+
+  std::vector<std::uint32_t> indices32;
+  std::vector<std::uint16_t> indices16;
+  indices32.reserve(meshes.indices.size());
+  indices16.reserve(meshes.indices.size());
+
+  for (auto& relem : meshes.relems)
+  {
+    ETNA_VERIFY(relem.indexFormat == IndexFormat::Uint32);
+
+    const auto relemIndices =
+      std::span(meshes.indices).subspan(relem.indexOffset, relem.indexCount);
+
+    if (get_relem_vertex_count(relem, meshes.indices) <= (1u << 16))
+    {
+      relem.indexFormat = IndexFormat::Uint16;
+      relem.indexOffset = static_cast<std::uint32_t>(indices16.size());
+      for (auto index : relemIndices)
+        indices16.push_back(static_cast<std::uint16_t>(index));
+    }
+    else
+    {
+      relem.indexOffset = static_cast<std::uint32_t>(indices32.size());
+      indices32.insert(indices32.end(), relemIndices.begin(), relemIndices.end());
+    }
+  }
+
+  spdlog::info(
+    "glTF: {} of {} indices fit into 16 bits, index data is {:.1f} MiB instead of {:.1f} MiB",
+    indices16.size(),
+    meshes.indices.size(),
+    static_cast<double>(std::span(indices32).size_bytes() + std::span(indices16).size_bytes()) /
+      (1 << 20),
+    static_cast<double>(std::span(meshes.indices).size_bytes()) / (1 << 20));
+
+  indices32.shrink_to_fit();
+  indices16.shrink_to_fit();
+  meshes.indices = std::move(indices32);
+  meshes.indices16 = std::move(indices16);
+}
+
+std::filesystem::path GltfLoader::resolveUri(const LoadedModel& loaded, std::string_view uri)
+{
+  if (uri.empty() || uri.starts_with("data:"))
+    return {};
+
+  // URIs are percent-encoded, see https://www.rfc-editor.org/rfc/rfc3986#section-2.1
+  const auto hexDigit = [](char c) -> int {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  };
+
+  std::u8string decoded;
+  decoded.reserve(uri.size());
+  for (std::size_t i = 0; i < uri.size(); ++i)
+  {
+    if (
+      uri[i] == '%' && i + 2 < uri.size() && hexDigit(uri[i + 1]) >= 0 &&
+      hexDigit(uri[i + 2]) >= 0)
+    {
+      decoded.push_back(static_cast<char8_t>(hexDigit(uri[i + 1]) * 16 + hexDigit(uri[i + 2])));
+      i += 2;
+    }
+    else
+    {
+      decoded.push_back(static_cast<char8_t>(uri[i]));
+    }
+  }
+
+  return loaded.directory / decoded;
+}
+
+static TextureImage convert_to_rgba8(const tinygltf::Image& image)
+{
+  TextureImage result{
+    .width = static_cast<std::uint32_t>(image.width),
+    .height = static_cast<std::uint32_t>(image.height),
+    .pixels = {},
+  };
+  result.pixels.resize(std::size_t{result.width} * result.height * 4);
+
+  // 16-bit channels are little endian, so the high byte is the second one
+  const std::size_t channelSize = image.bits == 16 ? 2 : 1;
+  const std::size_t component = static_cast<std::size_t>(image.component);
+  for (std::size_t i = 0; i < std::size_t{result.width} * result.height; ++i)
+  {
+    std::array<std::uint8_t, 4> channels{0, 0, 0, 255};
+    for (std::size_t c = 0; c < component; ++c)
+      channels[c] = image.image[(i * component + c) * channelSize + channelSize - 1];
+
+    // Grayscale images may come with alpha
+    if (component <= 2)
+    {
+      const std::uint8_t alpha = component == 2 ? channels[1] : 255;
+      channels = {channels[0], channels[0], channels[0], alpha};
+    }
+    std::memcpy(&result.pixels[i * 4], channels.data(), 4);
+  }
+
+  return result;
+}
+
+static std::optional<TextureImage> decode_image_file(std::span<const std::byte> file)
+{
+  int width = 0;
+  int height = 0;
+  int components = 0;
+  stbi_uc* pixels = stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc*>(file.data()),
+    static_cast<int>(file.size()),
+    &width,
+    &height,
+    &components,
+    4);
+  if (pixels == nullptr)
+    return std::nullopt;
+
+  TextureImage result{
+    .width = static_cast<std::uint32_t>(width),
+    .height = static_cast<std::uint32_t>(height),
+    .pixels = {pixels, pixels + std::size_t{4} * static_cast<std::size_t>(width * height)},
+  };
+  stbi_image_free(pixels);
+  return result;
+}
+
+std::optional<TextureImage> GltfLoader::decodeImage(const LoadedModel& loaded, std::size_t image)
+{
+  ZoneScoped;
+
+  const auto& gltfImage = loaded.model.images[image];
+
+  std::optional<TextureImage> result;
+  if (!gltfImage.image.empty() && gltfImage.width > 0 && gltfImage.height > 0)
+  {
+    result = convert_to_rgba8(gltfImage);
+  }
+  else if (!gltfImage.image.empty())
+  {
+    result = decode_image_file(std::as_bytes(std::span(gltfImage.image)));
+  }
+  else if (gltfImage.bufferView >= 0)
+  {
+    const auto& bufferView = loaded.model.bufferViews[gltfImage.bufferView];
+    const auto buffer = loaded.buffers[bufferView.buffer];
+    if (bufferView.byteOffset + bufferView.byteLength <= buffer.size())
+      result = decode_image_file(buffer.subspan(bufferView.byteOffset, bufferView.byteLength));
+  }
+  else if (const auto path = resolveUri(loaded, gltfImage.uri); !path.empty())
+  {
+    if (auto file = MappedFile::open(path))
+      result = decode_image_file(file->getData());
+  }
+
+  if (!result.has_value())
+    spdlog::error("glTF: unable to decode image {} '{}'", image, gltfImage.name);
+
+  return result;
+}
+
+// Usage of every image, by the first material slot that references it
+static std::vector<std::optional<TextureUsage>> find_image_usages(const tinygltf::Model& model)
+{
+  std::vector<std::optional<TextureUsage>> result(model.images.size());
+
+  const auto use = [&](int texture, TextureUsage usage) {
+    if (texture < 0 || static_cast<std::size_t>(texture) >= model.textures.size())
+      return;
+    const int source = model.textures[texture].source;
+    if (source < 0 || static_cast<std::size_t>(source) >= result.size())
+      return;
+
+    auto& current = result[source];
+    if (!current.has_value())
+      current = usage;
+    else if (*current != usage)
+      spdlog::warn(
+        "glTF: image {} is used in different ways, compressing it for its first usage", source);
+  };
+
+  for (const auto& material : model.materials)
+  {
+    use(material.pbrMetallicRoughness.baseColorTexture.index, TextureUsage::Albedo);
+    use(material.normalTexture.index, TextureUsage::Normal);
+    use(
+      material.pbrMetallicRoughness.metallicRoughnessTexture.index,
+      TextureUsage::MetallicRoughness);
+    use(material.occlusionTexture.index, TextureUsage::Occlusion);
+    use(material.emissiveTexture.index, TextureUsage::Emissive);
+  }
+
+  return result;
+}
+
+std::vector<GltfLoader::ProcessedTexture> GltfLoader::processTextures(
+  const LoadedModel& loaded) const
+{
+  ZoneScoped;
+
+  const auto usages = find_image_usages(loaded.model);
+
+  std::vector<std::optional<ProcessedTexture>> processed(usages.size());
+  const auto processImage = [&](std::size_t i) {
+    if (!usages[i].has_value())
+      return;
+
+    auto image = decodeImage(loaded, i);
+    if (!image.has_value())
+      return;
+
+    // Blocks are compressed in parallel as well, as a scene might have just a single huge texture
+    processed[i] = ProcessedTexture{
+      .image = static_cast<std::uint32_t>(i),
+      .usage = *usages[i],
+      .texture = compress_texture(*image, *usages[i], workers.get()),
+    };
+  };
+
+  if (workers == nullptr)
+    for (std::size_t i = 0; i < processed.size(); ++i)
+      processImage(i);
+  else
+    workers->parallelFor(processed.size(), processImage);
+
+  std::vector<ProcessedTexture> result;
+  std::size_t uncompressedBytes = 0;
+  std::size_t compressedBytes = 0;
+  for (auto& texture : processed)
+  {
+    if (!texture.has_value())
+      continue;
+
+    uncompressedBytes += std::size_t{texture->texture.width} * texture->texture.height * 4;
+    for (const auto& level : texture->texture.levels)
+      compressedBytes += level.size();
+    result.push_back(std::move(*texture));
+  }
+
+  spdlog::info(
+    "glTF: compressed {} textures, {:.1f} MiB with mips instead of {:.1f} MiB without",
+    result.size(),
+    static_cast<double>(compressedBytes) / (1 << 20),
+    static_cast<double>(uncompressedBytes) / (1 << 20));
+
+  return result;
+}
+
+std::vector<GltfLoader::DecodedTexture> GltfLoader::decodeTextures(const LoadedModel& loaded) const
+{
+  ZoneScoped;
+
+  const auto usages = find_image_usages(loaded.model);
+
+  std::vector<std::optional<DecodedTexture>> decoded(usages.size());
+  const auto decodeOne = [&](std::size_t i) {
+    if (!usages[i].has_value())
+      return;
+
+    auto image = decodeImage(loaded, i);
+    if (!image.has_value())
+      return;
+
+    decoded[i] = DecodedTexture{
+      .image = static_cast<std::uint32_t>(i),
+      .usage = *usages[i],
+      .mips = generate_mip_chain(*image, *usages[i]),
+    };
+  };
+
+  if (workers == nullptr)
+    for (std::size_t i = 0; i < decoded.size(); ++i)
+      decodeOne(i);
+  else
+    workers->parallelFor(decoded.size(), decodeOne);
+
+  std::vector<DecodedTexture> result;
+  for (auto& texture : decoded)
+    if (texture.has_value())
+      result.push_back(std::move(*texture));
+
+  return result;
+}
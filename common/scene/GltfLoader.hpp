@@ -0,0 +1,191 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include "utils/ThreadPool.hpp"
+#include "utils/MappedFile.hpp"
+#include "SceneData.hpp"
+#include "VertexRepacking.hpp"
+#include "MeshOptimizer.hpp"
+#include "Meshlets.hpp"
+#include "MeshSimplifier.hpp"
+#include "TextureCompression.hpp"
+#include "TransformHierarchy.hpp"
+
+
+/**
+ * Loads glTF models and converts them into the format we render. Doesn't touch
+ * the GPU at all, so it's used both by the SceneManager and by offline tools.
+ */
+class GltfLoader
+{
+public:
+  struct CreateInfo
+  {
+    // Amount of additional threads used for converting loaded models into our format.
+    // With 0 worker threads, everything is done serially on the thread that loads the scene.
+    std::uint32_t workerThreadCount = 0;
+    // tinygltf decodes images of .gltf scenes one by one right while parsing. With this,
+    // it only keeps the encoded files in memory, and decoding is left to decodeImage,
+    // which can be done for all images in parallel.
+    bool deferImageDecoding = false;
+  };
+
+  explicit GltfLoader(CreateInfo info);
+
+  // Null when there are no worker threads, can be used for other loading work
+  ThreadPool* getWorkers() const { return workers.get(); }
+
+  // A parsed glTF model along with the binary contents of its buffers
+  struct LoadedModel
+  {
+    tinygltf::Model model;
+    // Indexed the same way as glTF buffers. These point either into model.buffers
+    // or straight into the memory-mapped .glb file, in which case model.buffers
+    // does NOT correspond to the glTF buffers and must not be used.
+    std::vector<std::span<const std::byte>> buffers;
+    std::optional<MappedFile> mappedFile;
+    // Relative URIs of buffers and images are relative to this
+    std::filesystem::path directory;
+  };
+
+  std::optional<LoadedModel> loadModel(std::filesystem::path path);
+
+  // Path of an external resource, or an empty one for data URIs and missing URIs
+  static std::filesystem::path resolveUri(const LoadedModel& loaded, std::string_view uri);
+
+  // Pixels of an image converted to 8-bit RGBA. For .gltf scenes, tinygltf has either
+  // decoded images already or kept their encoded files (see deferImageDecoding), while
+  // images of .glb scenes are only references to their data. Returns nullopt if
+  // decoding failed.
+  static std::optional<TextureImage> decodeImage(const LoadedModel& loaded, std::size_t image);
+
+  struct ProcessedInstances
+  {
+    std::vector<glm::mat4x4> matrices;
+    std::vector<std::uint32_t> meshes;
+    // Hierarchy node of every instance. Instances follow the order of the hierarchy,
+    // so instances of a subtree are contiguous.
+    std::vector<std::uint32_t> nodes;
+    // All nodes of the default scene, including the ones without meshes
+    TransformHierarchy hierarchy;
+    // glTF node of every hierarchy node
+    std::vector<std::uint32_t> gltfNodes;
+  };
+
+  ProcessedInstances processInstances(const tinygltf::Model& model) const;
+
+  struct ProcessedMeshes
+  {
+    std::vector<PackedVertex> vertices;
+    std::vector<std::uint32_t> indices;
+    // Only filled in by packSmallIndices, see IndexFormat
+    std::vector<std::uint16_t> indices16;
+    std::vector<RenderElement> relems;
+    std::vector<Mesh> meshes;
+    // Only filled in by buildMeshlets
+    std::vector<Meshlet> meshlets;
+    // Only filled in by buildLods
+    std::vector<MeshLod> lods;
+    // Only filled in by computeMeshBounds, one per relem
+    std::vector<Aabb> relemBounds;
+  };
+
+  ProcessedMeshes processMeshes(const LoadedModel& loaded) const;
+
+  struct PrimitiveStreams
+  {
+    VertexAttributeStreams streams;
+    std::size_t vertexCount;
+  };
+
+  // Vertex attributes of every triangle primitive, the input of the repacking done
+  // by processMeshes. For benchmarking and checking repack_vertices on real data.
+  static std::vector<PrimitiveStreams> getPrimitiveStreams(const LoadedModel& loaded);
+
+  // Merges identical vertices within every relem and compacts the vertex array.
+  void weldVertices(ProcessedMeshes& meshes) const;
+
+  // Positions of all vertices, for the steps below that only care about them
+  static std::vector<glm::vec3> extractPositions(const ProcessedMeshes& meshes);
+
+  struct LodSettings
+  {
+    // Maximal error of every LOD relative to the radius of the mesh, from finest to coarsest
+    std::vector<float> errors = {0.005f, 0.01f, 0.02f, 0.05f};
+    // Every LOD aims for this fraction of the triangles of the previous one
+    float triangleRatio = 0.5f;
+  };
+
+  // Generates simplified versions of every mesh, see MeshSimplifier.hpp. LOD relems are
+  // appended after all other relems and reference the vertices of the full detail relems.
+  // Levels that don't remove a meaningful amount of triangles are skipped.
+  void buildLods(
+    ProcessedMeshes& meshes,
+    std::span<const glm::vec3> positions,
+    const LodSettings& settings) const;
+
+  // Computes bounding spheres of meshes and boxes of relems (including LOD ones)
+  // in the space of the given positions
+  void computeMeshBounds(ProcessedMeshes& meshes, std::span<const glm::vec3> positions) const;
+
+  // Splits every relem into meshlets, see Meshlets.hpp. Has to be done after all reordering
+  // of indices. Bounds are computed in the space of the given positions, which are indexed
+  // the same way as the vertices.
+  void buildMeshlets(ProcessedMeshes& meshes, std::span<const glm::vec3> positions) const;
+
+  // Moves indices of relems that fit into 16 bits into the indices16 region.
+  // Must be the last processing step, all other ones expect 32-bit indices.
+  void packSmallIndices(ProcessedMeshes& meshes) const;
+
+  struct MeshOptimizationReport
+  {
+    VertexCacheStats before;
+    VertexCacheStats after;
+  };
+
+  // Reorders triangles and vertices of every relem for vertex cache efficiency,
+  // less overdraw and vertex fetch locality, see MeshOptimizer.hpp.
+  // Returns statistics for every mesh.
+  std::vector<MeshOptimizationReport> optimizeMeshes(ProcessedMeshes& meshes) const;
+
+  struct ProcessedTexture
+  {
+    // Index of the source glTF image
+    std::uint32_t image;
+    TextureUsage usage;
+    CompressedTexture texture;
+  };
+
+  // Decodes, mips and block compresses every image that's used by materials. The usage
+  // of an image is determined by the first material slot it is referenced from.
+  std::vector<ProcessedTexture> processTextures(const LoadedModel& loaded) const;
+
+  struct DecodedTexture
+  {
+    // Index of the source glTF image
+    std::uint32_t image;
+    TextureUsage usage;
+    // Full mip chain, see generate_mip_chain
+    std::vector<TextureImage> mips;
+  };
+
+  // Same as the above, but without compression, for loading textures at runtime.
+  // Every image is decoded and mipped by a separate job.
+  std::vector<DecodedTexture> decodeTextures(const LoadedModel& loaded) const;
+
+private:
+  std::optional<LoadedModel> loadBinaryModel(const std::filesystem::path& path);
+
+private:
+  tinygltf::TinyGLTF loader;
+  std::unique_ptr<ThreadPool> workers;
+};
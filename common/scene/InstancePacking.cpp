@@ -0,0 +1,187 @@
+#include "InstancePacking.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <etna/Assert.hpp>
+#include <tracy/Tracy.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_PACKING_SSE2 1
+#endif
+
+
+static constexpr float SNORM10_MAX = 511.0f;
+
+// Nonzero components never round to 0, as the entries of the normal matrix can be more
+// than 1000 times apart for very stretched instances, and a column of zeros would turn
+// normals along it into zero vectors that can't be normalized.
+static std::uint32_t pack_snorm10(glm::vec3 v)
+{
+  std::uint32_t result = 0;
+  for (glm::length_t i = 0; i < 3; ++i)
+  {
+    const float scaled = v[i] * SNORM10_MAX;
+    long quantized = std::lrint(scaled);
+    if (quantized == 0 && scaled != 0.0f)
+      quantized = scaled > 0.0f ? 1 : -1;
+    result |= (static_cast<std::uint32_t>(quantized) & 0x3FF) << (10 * i);
+  }
+  return result;
+}
+
+static void pack_instance(const glm::mat4x4& matrix, std::uint32_t mesh, InstanceData& out)
+{
+  for (glm::length_t r = 0; r < 3; ++r)
+    out.modelRows[r] = glm::vec4(matrix[0][r], matrix[1][r], matrix[2][r], matrix[3][r]);
+
+  const glm::vec3 c0{matrix[0]};
+  const glm::vec3 c1{matrix[1]};
+  const glm::vec3 c2{matrix[2]};
+  const glm::vec3 normalColumns[3] = {glm::cross(c1, c2), glm::cross(c2, c0), glm::cross(c0, c1)};
+
+  const float det = glm::dot(c0, normalColumns[0]);
+  float maxAbs = 0.0f;
+  for (const auto& column : normalColumns)
+    for (glm::length_t i = 0; i < 3; ++i)
+      maxAbs = std::max(maxAbs, std::abs(column[i]));
+
+  // Same operations in the same order as the SIMD path, so both produce the same bits
+  float scale = maxAbs > 0.0f ? 1.0f / maxAbs : 0.0f;
+  if (std::signbit(det))
+    scale = -scale;
+
+  for (std::size_t i = 0; i < 3; ++i)
+    out.normalColumns[i] = pack_snorm10(normalColumns[i] * scale);
+  out.mesh = mesh;
+}
+
+#if defined(SCENE_PACKING_SSE2)
+
+// Lane i of every component belongs to the instance i of a group of 4
+struct Vec3x4
+{
+  __m128 x;
+  __m128 y;
+  __m128 z;
+};
+
+static Vec3x4 cross(const Vec3x4& a, const Vec3x4& b)
+{
+  return Vec3x4{
+    _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+    _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+    _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x)),
+  };
+}
+
+static __m128 max_abs(const Vec3x4& v, __m128 acc)
+{
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  acc = _mm_max_ps(acc, _mm_andnot_ps(signMask, v.x));
+  acc = _mm_max_ps(acc, _mm_andnot_ps(signMask, v.y));
+  return _mm_max_ps(acc, _mm_andnot_ps(signMask, v.z));
+}
+
+static __m128i pack_snorm10(const Vec3x4& v, __m128 scale)
+{
+  const __m128 unit = _mm_set1_ps(SNORM10_MAX);
+  const __m128i mask = _mm_set1_epi32(0x3FF);
+  // Rounds to the nearest even just like lrint does in the default rounding mode,
+  // nonzero values that round to 0 become 1 or -1 depending on their sign
+  const auto quantize = [&](__m128 c) {
+    const __m128 scaled = _mm_mul_ps(_mm_mul_ps(c, scale), unit);
+    const __m128i rounded = _mm_cvtps_epi32(scaled);
+    const __m128i lsb =
+      _mm_or_si128(_mm_srai_epi32(_mm_castps_si128(scaled), 31), _mm_set1_epi32(1));
+    const __m128i bump = _mm_and_si128(
+      _mm_cmpeq_epi32(rounded, _mm_setzero_si128()),
+      _mm_castps_si128(_mm_cmpneq_ps(scaled, _mm_setzero_ps())));
+    return _mm_and_si128(_mm_or_si128(rounded, _mm_and_si128(bump, lsb)), mask);
+  };
+  return _mm_or_si128(
+    quantize(v.x),
+    _mm_or_si128(_mm_slli_epi32(quantize(v.y), 10), _mm_slli_epi32(quantize(v.z), 20)));
+}
+
+static void pack_instances_x4(
+  const glm::mat4x4* matrices, const std::uint32_t* meshes, InstanceData* out)
+{
+  // columns[j][r] holds the component r of the column j of all 4 matrices
+  __m128 columns[4][4];
+  for (glm::length_t j = 0; j < 4; ++j)
+  {
+    __m128 m0 = _mm_loadu_ps(&matrices[0][j][0]);
+    __m128 m1 = _mm_loadu_ps(&matrices[1][j][0]);
+    __m128 m2 = _mm_loadu_ps(&matrices[2][j][0]);
+    __m128 m3 = _mm_loadu_ps(&matrices[3][j][0]);
+    _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+    columns[j][0] = m0;
+    columns[j][1] = m1;
+    columns[j][2] = m2;
+    columns[j][3] = m3;
+  }
+
+  // Transposing the row r of all 4 matrices back gives the row of every single instance
+  for (std::size_t r = 0; r < 3; ++r)
+  {
+    __m128 r0 = columns[0][r];
+    __m128 r1 = columns[1][r];
+    __m128 r2 = columns[2][r];
+    __m128 r3 = columns[3][r];
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(&out[0].modelRows[r][0], r0);
+    _mm_storeu_ps(&out[1].modelRows[r][0], r1);
+    _mm_storeu_ps(&out[2].modelRows[r][0], r2);
+    _mm_storeu_ps(&out[3].modelRows[r][0], r3);
+  }
+
+  const Vec3x4 c0{columns[0][0], columns[0][1], columns[0][2]};
+  const Vec3x4 c1{columns[1][0], columns[1][1], columns[1][2]};
+  const Vec3x4 c2{columns[2][0], columns[2][1], columns[2][2]};
+  const Vec3x4 n0 = cross(c1, c2);
+  const Vec3x4 n1 = cross(c2, c0);
+  const Vec3x4 n2 = cross(c0, c1);
+
+  const __m128 det = _mm_add_ps(
+    _mm_add_ps(_mm_mul_ps(c0.x, n0.x), _mm_mul_ps(c0.y, n0.y)), _mm_mul_ps(c0.z, n0.z));
+  const __m128 maxAbs = max_abs(n2, max_abs(n1, max_abs(n0, _mm_setzero_ps())));
+
+  // Zero scale for singular matrices, where the division gives infinity
+  __m128 scale = _mm_and_ps(
+    _mm_cmpgt_ps(maxAbs, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), maxAbs));
+  scale = _mm_xor_ps(scale, _mm_and_ps(det, _mm_set1_ps(-0.0f)));
+
+  alignas(16) std::uint32_t packed[3][4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(packed[0]), pack_snorm10(n0, scale));
+  _mm_store_si128(reinterpret_cast<__m128i*>(packed[1]), pack_snorm10(n1, scale));
+  _mm_store_si128(reinterpret_cast<__m128i*>(packed[2]), pack_snorm10(n2, scale));
+
+  for (std::size_t i = 0; i < 4; ++i)
+  {
+    for (std::size_t j = 0; j < 3; ++j)
+      out[i].normalColumns[j] = packed[j][i];
+    out[i].mesh = meshes[i];
+  }
+}
+
+#endif
+
+void pack_instances(
+  std::span<const glm::mat4x4> matrices,
+  std::span<const std::uint32_t> meshes,
+  std::span<InstanceData> out)
+{
+  ZoneScoped;
+
+  ETNA_VERIFY(matrices.size() == meshes.size() && matrices.size() == out.size());
+
+  std::size_t i = 0;
+#if defined(SCENE_PACKING_SSE2)
+  for (; i + 4 <= matrices.size(); i += 4)
+    pack_instances_x4(&matrices[i], &meshes[i], &out[i]);
+#endif
+  for (; i < matrices.size(); ++i)
+    pack_instance(matrices[i], meshes[i], out[i]);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <glm/glm.hpp>
+
+#include "SceneData.hpp"
+
+
+// Packs affine instance matrices into InstanceData, 4 instances at a time with SSE2.
+// The normal matrix is the cofactor matrix of the upper 3x3 part, which is the inverse
+// transpose times the determinant, so there is no division by it and singular matrices
+// don't produce NaNs. Its sign is flipped for mirroring matrices to keep normals facing out.
+void pack_instances(
+  std::span<const glm::mat4x4> matrices,
+  std::span<const std::uint32_t> meshes,
+  std::span<InstanceData> out);
+
@@ -0,0 +1,280 @@
+#include "Ktx2.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+
+static constexpr std::array<std::uint8_t, 12> KTX2_IDENTIFIER{
+  0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+struct Ktx2Header
+{
+  std::array<std::uint8_t, 12> identifier;
+  std::uint32_t vkFormat;
+  std::uint32_t typeSize;
+  std::uint32_t pixelWidth;
+  std::uint32_t pixelHeight;
+  std::uint32_t pixelDepth;
+  std::uint32_t layerCount;
+  std::uint32_t faceCount;
+  std::uint32_t levelCount;
+  std::uint32_t supercompressionScheme;
+  std::uint32_t dfdByteOffset;
+  std::uint32_t dfdByteLength;
+  std::uint32_t kvdByteOffset;
+  std::uint32_t kvdByteLength;
+  std::uint64_t sgdByteOffset;
+  std::uint64_t sgdByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80);
+
+struct Ktx2LevelIndexEntry
+{
+  std::uint64_t byteOffset;
+  std::uint64_t byteLength;
+  std::uint64_t uncompressedByteLength;
+};
+
+static bool is_supported_format(vk::Format format)
+{
+  switch (format)
+  {
+  case vk::Format::eBc1RgbSrgbBlock:
+  case vk::Format::eBc1RgbUnormBlock:
+  case vk::Format::eBc3SrgbBlock:
+  case vk::Format::eBc3UnormBlock:
+  case vk::Format::eBc4UnormBlock:
+  case vk::Format::eBc5UnormBlock:
+  case vk::Format::eBc7SrgbBlock:
+  case vk::Format::eBc7UnormBlock:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool is_srgb_format(vk::Format format)
+{
+  return format == vk::Format::eBc1RgbSrgbBlock || format == vk::Format::eBc3SrgbBlock ||
+    format == vk::Format::eBc7SrgbBlock;
+}
+
+// Basic data format descriptor, which KTX2 requires even though the vkFormat says it all.
+// See the "Compressed texture formats" section of
+// https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html
+static std::vector<std::uint32_t> build_dfd(vk::Format format)
+{
+  // KHR_DF_MODEL_* and KHR_DF_CHANNEL_* values
+  struct Sample
+  {
+    std::uint32_t channel;
+    std::uint32_t bitOffset;
+    bool alpha;
+  };
+  std::uint32_t colorModel = 0;
+  std::vector<Sample> samples;
+  switch (format)
+  {
+  case vk::Format::eBc1RgbSrgbBlock:
+  case vk::Format::eBc1RgbUnormBlock:
+    colorModel = 128;
+    samples = {{0, 0, false}};
+    break;
+  case vk::Format::eBc3SrgbBlock:
+  case vk::Format::eBc3UnormBlock:
+    colorModel = 130;
+    samples = {{15, 0, true}, {0, 64, false}};
+    break;
+  case vk::Format::eBc4UnormBlock:
+    colorModel = 131;
+    samples = {{0, 0, false}};
+    break;
+  case vk::Format::eBc5UnormBlock:
+    colorModel = 132;
+    samples = {{0, 0, false}, {1, 64, false}};
+    break;
+  default:
+    colorModel = 134;
+    samples = {{0, 0, false}};
+    break;
+  }
+
+  const bool srgb = is_srgb_format(format);
+  const auto blockSize = static_cast<std::uint32_t>(get_block_size(format));
+  const auto bitLength = static_cast<std::uint32_t>(blockSize * 8 / samples.size());
+
+  std::vector<std::uint32_t> result{
+    0, // dfdTotalSize, filled in below
+    0, // vendorId and descriptorType
+    2 | ((24 + 16 * static_cast<std::uint32_t>(samples.size())) << 16),
+    // BT.709 primaries and either the sRGB or the linear transfer function
+    colorModel | (1 << 8) | ((srgb ? 2u : 1u) << 16),
+    // Texel block dimensions minus one
+    3 | (3 << 8),
+    blockSize,
+    0,
+  };
+  for (const auto& sample : samples)
+  {
+    // Alpha is never sRGB encoded
+    const std::uint32_t linear = srgb && sample.alpha ? 1 : 0;
+    result.push_back(
+      sample.bitOffset | ((bitLength - 1) << 16) | (sample.channel << 24) | (linear << 28));
+    result.push_back(0);
+    result.push_back(0);
+    result.push_back(std::numeric_limits<std::uint32_t>::max());
+  }
+  result[0] = static_cast<std::uint32_t>(result.size() * sizeof(std::uint32_t));
+  return result;
+}
+
+static std::size_t align_up(std::size_t value, std::size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool write_ktx2(const std::filesystem::path& path, const CompressedTexture& texture)
+{
+  const auto levelCount = static_cast<std::uint32_t>(texture.levels.size());
+  const auto dfd = build_dfd(texture.format);
+
+  const std::size_t dfdOffset = sizeof(Ktx2Header) + levelCount * sizeof(Ktx2LevelIndexEntry);
+  const std::size_t dfdSize = dfd.size() * sizeof(std::uint32_t);
+
+  Ktx2Header header{
+    .identifier = KTX2_IDENTIFIER,
+    .vkFormat = static_cast<std::uint32_t>(texture.format),
+    .typeSize = 1,
+    .pixelWidth = texture.width,
+    .pixelHeight = texture.height,
+    .pixelDepth = 0,
+    .layerCount = 0,
+    .faceCount = 1,
+    .levelCount = levelCount,
+    .supercompressionScheme = 0,
+    .dfdByteOffset = static_cast<std::uint32_t>(dfdOffset),
+    .dfdByteLength = static_cast<std::uint32_t>(dfdSize),
+    .kvdByteOffset = 0,
+    .kvdByteLength = 0,
+    .sgdByteOffset = 0,
+    .sgdByteLength = 0,
+  };
+
+  // Levels are stored from the smallest to the largest one, each aligned to the block size
+  const std::size_t alignment = get_block_size(texture.format);
+  std::vector<Ktx2LevelIndexEntry> levelIndex(levelCount);
+  std::size_t offset = dfdOffset + dfdSize;
+  for (std::size_t i = levelCount; i-- > 0;)
+  {
+    offset = align_up(offset, alignment);
+    levelIndex[i] = Ktx2LevelIndexEntry{
+      .byteOffset = offset,
+      .byteLength = texture.levels[i].size(),
+      .uncompressedByteLength = texture.levels[i].size(),
+    };
+    offset += texture.levels[i].size();
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    spdlog::error("KTX2: unable to open '{}' for writing", path);
+    return false;
+  }
+
+  const auto writeBytes = [&out](std::span<const std::byte> bytes) {
+    out.write(
+      reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  };
+
+  writeBytes(std::as_bytes(std::span(&header, 1)));
+  writeBytes(std::as_bytes(std::span(levelIndex)));
+  writeBytes(std::as_bytes(std::span(dfd)));
+  for (std::size_t i = levelCount; i-- > 0;)
+  {
+    static constexpr std::array<char, 16> ZEROES{};
+    const auto current = static_cast<std::size_t>(out.tellp());
+    out.write(ZEROES.data(), static_cast<std::streamsize>(levelIndex[i].byteOffset - current));
+    writeBytes(texture.levels[i]);
+  }
+
+  if (!out)
+  {
+    spdlog::error("KTX2: failed writing '{}'", path);
+    return false;
+  }
+
+  return true;
+}
+
+std::optional<Ktx2View> parse_ktx2(std::span<const std::byte> file)
+{
+  Ktx2Header header;
+  if (file.size() < sizeof(header))
+  {
+    spdlog::error("KTX2: file is too small");
+    return std::nullopt;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (header.identifier != KTX2_IDENTIFIER)
+  {
+    spdlog::error("KTX2: not a KTX2 file");
+    return std::nullopt;
+  }
+
+  const auto format = static_cast<vk::Format>(header.vkFormat);
+  if (
+    !is_supported_format(format) || header.supercompressionScheme != 0 ||
+    header.pixelDepth != 0 || header.layerCount > 1 || header.faceCount != 1 ||
+    header.levelCount == 0 || header.pixelWidth == 0 || header.pixelHeight == 0)
+  {
+    spdlog::error(
+      "KTX2: only 2D block compressed textures with mips and without supercompression are "
+      "supported, got format {}",
+      header.vkFormat);
+    return std::nullopt;
+  }
+
+  const std::size_t levelIndexSize = header.levelCount * sizeof(Ktx2LevelIndexEntry);
+  if (file.size() - sizeof(header) < levelIndexSize)
+  {
+    spdlog::error("KTX2: level index is corrupted");
+    return std::nullopt;
+  }
+
+  Ktx2View result{
+    .format = format,
+    .width = header.pixelWidth,
+    .height = header.pixelHeight,
+    .levels = {},
+  };
+
+  for (std::uint32_t i = 0; i < header.levelCount; ++i)
+  {
+    Ktx2LevelIndexEntry entry;
+    std::memcpy(
+      &entry, file.data() + sizeof(header) + i * sizeof(Ktx2LevelIndexEntry), sizeof(entry));
+
+    const std::uint32_t width = std::max(header.pixelWidth >> i, 1u);
+    const std::uint32_t height = std::max(header.pixelHeight >> i, 1u);
+    if (
+      entry.byteOffset > file.size() || entry.byteLength > file.size() - entry.byteOffset ||
+      entry.byteLength != get_compressed_size(format, width, height))
+    {
+      spdlog::error("KTX2: level {} is corrupted", i);
+      return std::nullopt;
+    }
+
+    result.levels.push_back(file.subspan(entry.byteOffset, entry.byteLength));
+  }
+
+  return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+#include "TextureCompression.hpp"
+
+
+// Minimal support for KTX2 (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html):
+// single 2D images with a full mip chain of block compressed data and no supercompression.
+// Level data is aligned and stored exactly as Vulkan wants it, so loading a texture
+// boils down to a single copy per mip level straight out of the mapped file.
+
+inline constexpr const char* KTX2_EXTENSION = ".ktx2";
+
+bool write_ktx2(const std::filesystem::path& path, const CompressedTexture& texture);
+
+// Points into the memory of the parsed file
+struct Ktx2View
+{
+  vk::Format format = vk::Format::eUndefined;
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  // From the full resolution level down
+  std::vector<std::span<const std::byte>> levels;
+};
+
+// Returns nullopt and reports the problem if the file is not something we can load
+std::optional<Ktx2View> parse_ktx2(std::span<const std::byte> file);
@@ -0,0 +1,41 @@
+#include "LodSelection.hpp"
+
+#include <algorithm>
+
+
+std::uint32_t select_lod(
+  const LodCriteria& criteria,
+  const Mesh& mesh,
+  std::span<const MeshLod> lods,
+  const glm::mat4x4& model,
+  std::uint32_t current)
+{
+  const glm::vec3 wCenter = model * glm::vec4(glm::vec3(mesh.sphere), 1.0f);
+  const float scale = std::max(
+    glm::length(glm::vec3(model[0])),
+    std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  const float radius = mesh.sphere.w * scale;
+  const float distance = glm::length(wCenter - criteria.cameraPosition);
+
+  if (criteria.maxPixelError < 0 || mesh.lodCount == 0 || distance <= radius)
+    return 0;
+
+  const float projectedRadius = radius / distance * criteria.projectionScale;
+  const auto coarsestLod = [&](float max_error) {
+    std::uint32_t result = 0;
+    for (std::uint32_t i = 0; i < mesh.lodCount; ++i)
+      if (lods[mesh.firstLod + i].error * projectedRadius <= max_error)
+        result = i + 1;
+    return result;
+  };
+
+  const std::uint32_t desired = coarsestLod(criteria.maxPixelError);
+  const std::uint32_t strict = coarsestLod(criteria.maxPixelError * (1.0f - criteria.hysteresis));
+
+  current = std::min(current, mesh.lodCount);
+  if (current > desired)
+    return desired;
+  if (current < strict)
+    return strict;
+  return current;
+}
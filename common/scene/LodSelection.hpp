@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <glm/glm.hpp>
+
+#include "SceneData.hpp"
+
+
+struct LodCriteria
+{
+  glm::vec3 cameraPosition;
+  // Converts radius / distance into a radius in pixels
+  float projectionScale;
+  // Negative values always select the full detail
+  float maxPixelError;
+  // Fraction of the pixel error a LOD has to get below to be switched to a finer one
+  float hysteresis;
+};
+
+// Returns the coarsest LOD that keeps the error within the limit, but sticks with
+// the current one unless it's too coarse or a LOD coarser than it is good enough
+// even with the stricter limit, so that instances on a LOD boundary don't flicker.
+// 0 is the full detail mesh. NOTE: mirrored by lod_selection.comp of model_bakery.
+std::uint32_t select_lod(
+  const LodCriteria& criteria,
+  const Mesh& mesh,
+  std::span<const MeshLod> lods,
+  const glm::mat4x4& model,
+  std::uint32_t current);
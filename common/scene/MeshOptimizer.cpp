@@ -0,0 +1,396 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cstring>
+#include <unordered_map>
+
+#include <etna/Assert.hpp>
+
+
+float VertexCacheStats::acmr() const
+{
+  return triangles == 0 ? 0.0f
+                        : static_cast<float>(transformedVertices) / static_cast<float>(triangles);
+}
+
+float VertexCacheStats::atvr() const
+{
+  return uniqueVertices == 0
+    ? 0.0f
+    : static_cast<float>(transformedVertices) / static_cast<float>(uniqueVertices);
+}
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other)
+{
+  triangles += other.triangles;
+  uniqueVertices += other.uniqueVertices;
+  transformedVertices += other.transformedVertices;
+  return *this;
+}
+
+VertexCacheStats analyze_vertex_cache(
+  std::span<const std::uint32_t> indices, std::size_t vertex_count, std::uint32_t cache_size)
+{
+  VertexCacheStats result{.triangles = indices.size() / 3};
+
+  // A vertex is in a FIFO cache if less than `cache_size` misses happened since it was loaded
+  std::vector<std::uint64_t> loadTime(vertex_count, 0);
+  std::uint64_t time = cache_size + 1;
+
+  for (auto index : indices)
+  {
+    if (loadTime[index] == 0)
+      ++result.uniqueVertices;
+
+    if (time - loadTime[index] > cache_size)
+    {
+      loadTime[index] = time++;
+      ++result.transformedVertices;
+    }
+  }
+
+  return result;
+}
+
+// Triangles adjacent to every vertex, in CSR form
+struct Adjacency
+{
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> triangles;
+
+  std::span<const std::uint32_t> operator[](std::size_t vertex) const
+  {
+    return std::span(triangles).subspan(offsets[vertex], offsets[vertex + 1] - offsets[vertex]);
+  }
+};
+
+static Adjacency build_adjacency(std::span<const std::uint32_t> indices, std::size_t vertex_count)
+{
+  Adjacency result;
+  result.offsets.assign(vertex_count + 1, 0);
+  result.triangles.resize(indices.size());
+
+  for (auto index : indices)
+    ++result.offsets[index + 1];
+  std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+
+  std::vector<std::uint32_t> fill(result.offsets.begin(), result.offsets.end() - 1);
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    result.triangles[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+
+  return result;
+}
+
+std::vector<std::uint32_t> optimize_vertex_cache(
+  std::span<std::uint32_t> indices, std::size_t vertex_count, std::uint32_t cache_size)
+{
+  const std::size_t triangleCount = indices.size() / 3;
+
+  std::vector<std::uint32_t> clusters;
+  if (triangleCount == 0)
+    return clusters;
+
+  const Adjacency adjacency = build_adjacency(indices, vertex_count);
+
+  // Amount of not yet emitted triangles using the vertex
+  std::vector<std::uint32_t> live(vertex_count);
+  for (std::size_t v = 0; v < vertex_count; ++v)
+    live[v] = static_cast<std::uint32_t>(adjacency[v].size());
+
+  std::vector<std::uint64_t> cacheTime(vertex_count, 0);
+  std::uint64_t time = cache_size + 1;
+
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<std::uint32_t> deadEnd;
+  deadEnd.reserve(indices.size());
+  std::vector<std::uint32_t> candidates;
+
+  std::vector<std::uint32_t> result;
+  result.reserve(indices.size());
+
+  constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+  // Cursor for picking an arbitrary vertex with live triangles when we're stuck
+  std::size_t nextVertex = 0;
+  const auto skipDeadEnd = [&]() -> std::uint32_t {
+    while (!deadEnd.empty())
+    {
+      const auto vertex = deadEnd.back();
+      deadEnd.pop_back();
+      if (live[vertex] > 0)
+        return vertex;
+    }
+    for (; nextVertex < vertex_count; ++nextVertex)
+      if (live[nextVertex] > 0)
+        return static_cast<std::uint32_t>(nextVertex);
+    return NONE;
+  };
+
+  std::uint32_t fanning = skipDeadEnd();
+  clusters.push_back(0);
+
+  while (fanning != NONE)
+  {
+    candidates.clear();
+
+    for (auto triangle : adjacency[fanning])
+    {
+      if (emitted[triangle])
+        continue;
+      emitted[triangle] = true;
+
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        const auto vertex = indices[triangle * 3 + k];
+        result.push_back(vertex);
+        deadEnd.push_back(vertex);
+        candidates.push_back(vertex);
+        --live[vertex];
+        if (time - cacheTime[vertex] > cache_size)
+          cacheTime[vertex] = time++;
+      }
+    }
+
+    // Pick the candidate which will still be in the cache after fanning
+    // around it, preferring the ones that have been in the cache the longest.
+    std::uint32_t best = NONE;
+    std::int64_t bestPriority = -1;
+    for (auto vertex : candidates)
+    {
+      if (live[vertex] == 0)
+        continue;
+
+      std::int64_t priority = 0;
+      const auto age = static_cast<std::int64_t>(time - cacheTime[vertex]);
+      if (age + 2 * static_cast<std::int64_t>(live[vertex]) <= cache_size)
+        priority = age;
+
+      if (priority > bestPriority)
+      {
+        best = vertex;
+        bestPriority = priority;
+      }
+    }
+
+    if (best == NONE)
+    {
+      best = skipDeadEnd();
+      // Jumping to an arbitrary vertex means the cache will be mostly flushed
+      // anyway, so what follows can be drawn in any order relative to what preceded.
+      if (best != NONE && result.size() < indices.size())
+        clusters.push_back(static_cast<std::uint32_t>(result.size() / 3));
+    }
+
+    fanning = best;
+  }
+
+  ETNA_VERIFY(result.size() == indices.size());
+  std::ranges::copy(result, indices.begin());
+
+  return clusters;
+}
+
+void optimize_overdraw(
+  std::span<std::uint32_t> indices,
+  std::span<const PackedVertex> vertices,
+  std::span<const std::uint32_t> clusters,
+  float threshold,
+  std::uint32_t cache_size)
+{
+  const std::size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0 || clusters.empty())
+    return;
+
+  const float targetAcmr =
+    analyze_vertex_cache(indices, vertices.size(), cache_size).acmr() * threshold;
+
+  // Split hard clusters into smaller soft ones wherever the cache efficiency
+  // of the triangles since the cluster start is good enough.
+  std::vector<std::uint32_t> softClusters;
+  {
+    std::vector<std::uint64_t> cacheTime(vertices.size(), 0);
+    std::uint64_t time = cache_size + 1;
+
+    for (std::size_t c = 0; c < clusters.size(); ++c)
+    {
+      const std::size_t begin = clusters[c];
+      const std::size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+      // Start every cluster with a cold cache
+      time += cache_size + 1;
+      std::size_t misses = 0;
+      softClusters.push_back(static_cast<std::uint32_t>(begin));
+
+      for (std::size_t t = begin; t < end; ++t)
+      {
+        for (std::size_t k = 0; k < 3; ++k)
+        {
+          const auto vertex = indices[t * 3 + k];
+          if (time - cacheTime[vertex] > cache_size)
+          {
+            cacheTime[vertex] = time++;
+            ++misses;
+          }
+        }
+
+        const std::size_t triangles = t - softClusters.back() + 1;
+        if (
+          t + 1 < end &&
+          static_cast<float>(misses) <= targetAcmr * static_cast<float>(triangles))
+        {
+          softClusters.push_back(static_cast<std::uint32_t>(t + 1));
+          time += cache_size + 1;
+          misses = 0;
+        }
+      }
+    }
+  }
+
+  const auto position = [&](std::uint32_t index) {
+    return glm::vec3(vertices[index].positionAndNormal);
+  };
+
+  // Area-weighted centroid of the whole mesh
+  glm::vec3 meshCentroid(0);
+  float meshArea = 0;
+  for (std::size_t t = 0; t < triangleCount; ++t)
+  {
+    const auto p0 = position(indices[t * 3 + 0]);
+    const auto p1 = position(indices[t * 3 + 1]);
+    const auto p2 = position(indices[t * 3 + 2]);
+    const float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+    meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+    meshArea += area;
+  }
+  if (meshArea > 0)
+    meshCentroid /= meshArea;
+
+  // Clusters facing away from the mesh centroid go first
+  std::vector<float> sortKeys(softClusters.size());
+  for (std::size_t c = 0; c < softClusters.size(); ++c)
+  {
+    const std::size_t begin = softClusters[c];
+    const std::size_t end = c + 1 < softClusters.size() ? softClusters[c + 1] : triangleCount;
+
+    glm::vec3 centroid(0);
+    glm::vec3 normal(0);
+    float area = 0;
+    for (std::size_t t = begin; t < end; ++t)
+    {
+      const auto p0 = position(indices[t * 3 + 0]);
+      const auto p1 = position(indices[t * 3 + 1]);
+      const auto p2 = position(indices[t * 3 + 2]);
+      const auto crossProduct = glm::cross(p1 - p0, p2 - p0);
+      const float triangleArea = glm::length(crossProduct);
+      centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+      normal += crossProduct;
+      area += triangleArea;
+    }
+    if (area > 0)
+      centroid /= area;
+
+    const float normalLength = glm::length(normal);
+    sortKeys[c] =
+      normalLength > 0 ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+  }
+
+  std::vector<std::uint32_t> order(softClusters.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::ranges::stable_sort(
+    order, [&sortKeys](std::uint32_t a, std::uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  std::vector<std::uint32_t> result;
+  result.reserve(indices.size());
+  for (auto c : order)
+  {
+    const std::size_t begin = softClusters[c];
+    const std::size_t end = c + 1 < softClusters.size() ? softClusters[c + 1] : triangleCount;
+    result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+  }
+
+  std::ranges::copy(result, indices.begin());
+}
+
+void optimize_vertex_fetch(std::span<std::uint32_t> indices, std::span<PackedVertex> vertices)
+{
+  constexpr std::uint32_t UNUSED = std::numeric_limits<std::uint32_t>::max();
+
+  std::vector<std::uint32_t> remap(vertices.size(), UNUSED);
+  std::uint32_t next = 0;
+  for (auto& index : indices)
+  {
+    if (remap[index] == UNUSED)
+      remap[index] = next++;
+    index = remap[index];
+  }
+
+  for (auto& newIndex : remap)
+    if (newIndex == UNUSED)
+      newIndex = next++;
+
+  std::vector<PackedVertex> result(vertices.size());
+  for (std::size_t i = 0; i < vertices.size(); ++i)
+    result[remap[i]] = vertices[i];
+
+  std::ranges::copy(result, vertices.begin());
+}
+
+struct VertexBytesHash
+{
+  std::size_t operator()(const PackedVertex& vertex) const
+  {
+    std::uint64_t words[sizeof(PackedVertex) / sizeof(std::uint64_t)];
+    std::memcpy(words, &vertex, sizeof(words));
+
+    std::uint64_t hash = 0;
+    for (auto word : words)
+    {
+      hash ^= word + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+      hash *= 0xff51afd7ed558ccdull;
+    }
+    return static_cast<std::size_t>(hash ^ (hash >> 33));
+  }
+};
+
+struct VertexBytesEqual
+{
+  bool operator()(const PackedVertex& a, const PackedVertex& b) const
+  {
+    return std::memcmp(&a, &b, sizeof(PackedVertex)) == 0;
+  }
+};
+
+std::size_t weld_vertices(std::span<std::uint32_t> indices, std::span<PackedVertex> vertices)
+{
+  std::unordered_map<PackedVertex, std::uint32_t, VertexBytesHash, VertexBytesEqual> unique;
+  unique.reserve(vertices.size());
+
+  std::vector<std::uint32_t> remap(vertices.size());
+  std::uint32_t uniqueCount = 0;
+  for (std::size_t i = 0; i < vertices.size(); ++i)
+  {
+    auto [it, inserted] = unique.try_emplace(vertices[i], uniqueCount);
+    if (inserted)
+    {
+      // Never overwrites a vertex we haven't looked at yet, as uniqueCount <= i
+      vertices[uniqueCount] = vertices[i];
+      ++uniqueCount;
+    }
+    remap[i] = it->second;
+  }
+
+  for (auto& index : indices)
+    index = remap[index];
+
+  return uniqueCount;
+}
+
+void optimize_mesh(
+  std::span<std::uint32_t> indices, std::span<PackedVertex> vertices, std::uint32_t cache_size)
+{
+  const auto clusters = optimize_vertex_cache(indices, vertices.size(), cache_size);
+  optimize_overdraw(indices, vertices, clusters, 1.05f, cache_size);
+  optimize_vertex_fetch(indices, vertices);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "VertexRepacking.hpp"
+
+
+// Post-transform vertex cache efficiency of an index buffer, simulated with a FIFO cache.
+struct VertexCacheStats
+{
+  std::uint64_t triangles = 0;
+  // Vertices referenced at least once
+  std::uint64_t uniqueVertices = 0;
+  // Vertex shader invocations, i.e. cache misses
+  std::uint64_t transformedVertices = 0;
+
+  // Average cache miss ratio, 0.5 is the theoretical optimum and 3 is the worst case
+  float acmr() const;
+  // Average transform to vertex ratio, 1 is the optimum
+  float atvr() const;
+
+  VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+inline constexpr std::uint32_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+VertexCacheStats analyze_vertex_cache(
+  std::span<const std::uint32_t> indices,
+  std::size_t vertex_count,
+  std::uint32_t cache_size = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Reorders triangles for post-transform vertex cache locality using Tipsify
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// Returns the first triangles of clusters that start with a cache flush anyway,
+// which can then be freely reordered by optimize_overdraw.
+std::vector<std::uint32_t> optimize_vertex_cache(
+  std::span<std::uint32_t> indices,
+  std::size_t vertex_count,
+  std::uint32_t cache_size = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Reorders clusters of triangles so that the ones facing outwards from the center of
+// the mesh are drawn first, as they are more likely to occlude the rest. Clusters are
+// additionally split where it doesn't make the ACMR worse than `threshold` times the
+// original, to give the sorting more freedom.
+void optimize_overdraw(
+  std::span<std::uint32_t> indices,
+  std::span<const PackedVertex> vertices,
+  std::span<const std::uint32_t> clusters,
+  float threshold = 1.05f,
+  std::uint32_t cache_size = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Reorders vertices in order of their first use by the indices, so that vertex
+// fetch reads memory as linearly as possible. Unused vertices are moved to the end.
+void optimize_vertex_fetch(std::span<std::uint32_t> indices, std::span<PackedVertex> vertices);
+
+// Merges bitwise identical vertices. Unique vertices are moved to the front of `vertices`
+// preserving their relative order, and their amount is returned.
+std::size_t weld_vertices(std::span<std::uint32_t> indices, std::span<PackedVertex> vertices);
+
+// Applies all of the above to the triangles and vertices of a single relem.
+// Indices are relative to the start of `vertices`.
+void optimize_mesh(
+  std::span<std::uint32_t> indices,
+  std::span<PackedVertex> vertices,
+  std::uint32_t cache_size = DEFAULT_VERTEX_CACHE_SIZE);
@@ -0,0 +1,249 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <tuple>
+#include <unordered_map>
+
+
+// Symmetric 4x4 matrix measuring the sum of squared distances to a set of planes
+struct Quadric
+{
+  double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+  double a11 = 0, a12 = 0, a13 = 0;
+  double a22 = 0, a23 = 0;
+  double a33 = 0;
+
+  Quadric& operator+=(const Quadric& other)
+  {
+    a00 += other.a00, a01 += other.a01, a02 += other.a02, a03 += other.a03;
+    a11 += other.a11, a12 += other.a12, a13 += other.a13;
+    a22 += other.a22, a23 += other.a23;
+    a33 += other.a33;
+    return *this;
+  }
+};
+
+static Quadric plane_quadric(glm::vec3 normal, float distance)
+{
+  const double a = normal.x;
+  const double b = normal.y;
+  const double c = normal.z;
+  const double d = distance;
+  return Quadric{a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d};
+}
+
+static double evaluate_quadric(const Quadric& q, glm::vec3 point)
+{
+  const double x = point.x;
+  const double y = point.y;
+  const double z = point.z;
+  return q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + q.a33 +
+    2 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z + q.a03 * x + q.a13 * y + q.a23 * z);
+}
+
+static std::vector<bool> find_locked_vertices(
+  std::span<const std::uint32_t> indices, std::span<const glm::vec3> positions)
+{
+  std::vector<bool> locked(positions.size(), false);
+
+  // Vertices split because of differing attributes have to move together, which we don't
+  // support, so they stay where they are. Same position means same place in the sorted order.
+  std::vector<std::uint32_t> order(positions.size());
+  std::iota(order.begin(), order.end(), 0);
+  const auto asTuple = [positions](std::uint32_t v) {
+    return std::tuple(positions[v].x, positions[v].y, positions[v].z);
+  };
+  std::ranges::sort(order, {}, asTuple);
+  for (std::size_t i = 1; i < order.size(); ++i)
+    if (positions[order[i]] == positions[order[i - 1]])
+      locked[order[i]] = locked[order[i - 1]] = true;
+
+  // Edges that don't have exactly two triangles are on a border (or are non-manifold)
+  std::unordered_map<std::uint64_t, std::uint32_t> edgeTriangles;
+  edgeTriangles.reserve(indices.size());
+  const auto edgeKey = [](std::uint32_t a, std::uint32_t b) {
+    return (std::uint64_t{std::min(a, b)} << 32) | std::max(a, b);
+  };
+  for (std::size_t i = 0; i < indices.size(); i += 3)
+    for (std::size_t e = 0; e < 3; ++e)
+      ++edgeTriangles[edgeKey(indices[i + e], indices[i + (e + 1) % 3])];
+  for (auto [key, count] : edgeTriangles)
+    if (count != 2)
+      locked[key >> 32] = locked[key & 0xFFFFFFFF] = true;
+
+  return locked;
+}
+
+// Triangles adjacent to every vertex, in CSR form
+struct VertexTriangles
+{
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> triangles;
+
+  VertexTriangles(std::span<const std::uint32_t> indices, std::size_t vertex_count)
+    : offsets(vertex_count + 1, 0)
+    , triangles(indices.size())
+  {
+    for (auto index : indices)
+      ++offsets[index + 1];
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < indices.size(); ++i)
+      triangles[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+  }
+
+  std::span<const std::uint32_t> operator[](std::size_t vertex) const
+  {
+    return std::span(triangles).subspan(offsets[vertex], offsets[vertex + 1] - offsets[vertex]);
+  }
+};
+
+static bool collapse_flips_triangles(
+  std::span<const std::uint32_t> indices,
+  const VertexTriangles& adjacency,
+  std::span<const glm::vec3> positions,
+  std::uint32_t from,
+  std::uint32_t to)
+{
+  for (auto triangle : adjacency[from])
+  {
+    const std::uint32_t* v = &indices[triangle * 3];
+    // These disappear
+    if (v[0] == to || v[1] == to || v[2] == to)
+      continue;
+
+    const auto moved = [&](std::uint32_t i) {
+      return v[i] == from ? positions[to] : positions[v[i]];
+    };
+
+    const glm::vec3 before = glm::cross(
+      positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+    const glm::vec3 after = glm::cross(moved(1) - moved(0), moved(2) - moved(0));
+    if (glm::dot(before, after) <= 0)
+      return true;
+  }
+  return false;
+}
+
+float simplify_mesh(
+  std::span<const std::uint32_t> indices,
+  std::span<const glm::vec3> positions,
+  std::size_t target_index_count,
+  float target_error,
+  std::vector<std::uint32_t>& out)
+{
+  const auto triangleIndices = indices.first(indices.size() / 3 * 3);
+  out.assign(triangleIndices.begin(), triangleIndices.end());
+
+  const std::size_t vertexCount = positions.size();
+  const auto locked = find_locked_vertices(out, positions);
+
+  std::vector<Quadric> quadrics(vertexCount);
+  for (std::size_t i = 0; i < out.size(); i += 3)
+  {
+    const glm::vec3 p0 = positions[out[i + 0]];
+    const glm::vec3 normal = glm::cross(positions[out[i + 1]] - p0, positions[out[i + 2]] - p0);
+    const float length = glm::length(normal);
+    if (length <= 0)
+      continue;
+
+    const auto quadric = plane_quadric(normal / length, -glm::dot(normal / length, p0));
+    for (std::size_t j = 0; j < 3; ++j)
+      quadrics[out[i + j]] += quadric;
+  }
+
+  struct Collapse
+  {
+    std::uint32_t from;
+    std::uint32_t to;
+    double cost;
+  };
+
+  const double maxCost = static_cast<double>(target_error) * static_cast<double>(target_error);
+  double reachedCost = 0;
+
+  std::vector<Collapse> collapses;
+  std::vector<std::uint32_t> remap(vertexCount);
+  std::vector<bool> touched(vertexCount);
+
+  // Every pass collapses the cheapest edges that don't affect each other
+  while (out.size() > target_index_count)
+  {
+    const VertexTriangles adjacency(out, vertexCount);
+
+    // An interior edge is seen from both of its triangles in opposite
+    // directions, which gives us both collapse directions.
+    collapses.clear();
+    for (std::size_t i = 0; i < out.size(); i += 3)
+      for (std::size_t e = 0; e < 3; ++e)
+      {
+        const std::uint32_t from = out[i + e];
+        const std::uint32_t to = out[i + (e + 1) % 3];
+        if (locked[from] || from == to)
+          continue;
+
+        Quadric merged = quadrics[from];
+        merged += quadrics[to];
+        collapses.push_back(Collapse{from, to, evaluate_quadric(merged, positions[to])});
+      }
+
+    std::ranges::sort(collapses, {}, &Collapse::cost);
+
+    std::iota(remap.begin(), remap.end(), 0);
+    std::fill(touched.begin(), touched.end(), false);
+
+    const std::size_t indicesToRemove = out.size() - target_index_count;
+    std::size_t removedIndices = 0;
+    bool collapsedAny = false;
+
+    for (const auto& collapse : collapses)
+    {
+      if (collapse.cost > maxCost || removedIndices >= indicesToRemove)
+        break;
+
+      if (touched[collapse.from] || touched[collapse.to])
+        continue;
+
+      if (collapse_flips_triangles(out, adjacency, positions, collapse.from, collapse.to))
+        continue;
+
+      // Triangles around both vertices change shape, so nothing else may move them this pass
+      for (auto vertex : {collapse.from, collapse.to})
+        for (auto triangle : adjacency[vertex])
+          for (std::size_t j = 0; j < 3; ++j)
+            touched[out[triangle * 3 + j]] = true;
+
+      for (auto triangle : adjacency[collapse.from])
+        for (std::size_t j = 0; j < 3; ++j)
+          if (out[triangle * 3 + j] == collapse.to)
+            removedIndices += 3;
+
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      reachedCost = std::max(reachedCost, collapse.cost);
+      collapsedAny = true;
+    }
+
+    if (!collapsedAny)
+      break;
+
+    std::size_t written = 0;
+    for (std::size_t i = 0; i < out.size(); i += 3)
+    {
+      const std::uint32_t a = remap[out[i + 0]];
+      const std::uint32_t b = remap[out[i + 1]];
+      const std::uint32_t c = remap[out[i + 2]];
+      if (a == b || b == c || c == a)
+        continue;
+      out[written++] = a;
+      out[written++] = b;
+      out[written++] = c;
+    }
+    out.resize(written);
+  }
+
+  return static_cast<float>(std::sqrt(std::max(reachedCost, 0.0)));
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// Simplifies a triangle mesh with quadric error metric edge collapses
+// (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics").
+// Vertices are collapsed onto their neighbours, so the result references a subset
+// of the original vertices and can share the vertex buffer with the original mesh.
+// Vertices on open borders and on attribute seams (several vertices with the same
+// position) never move, so the result has no new holes or cracks.
+//
+// Stops once the index count drops to `target_index_count` or when any further
+// collapse would move the surface by more than `target_error` (in position units).
+// Indices are relative to the start of `positions`.
+// Returns the error of the result, which is 0 if nothing was collapsed.
+float simplify_mesh(
+  std::span<const std::uint32_t> indices,
+  std::span<const glm::vec3> positions,
+  std::size_t target_index_count,
+  float target_error,
+  std::vector<std::uint32_t>& out);
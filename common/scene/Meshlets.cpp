@@ -0,0 +1,145 @@
+#include "Meshlets.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+
+static void compute_meshlet_bounds(
+  Meshlet& meshlet,
+  std::span<const std::uint32_t> indices,
+  std::span<const glm::vec3> positions,
+  std::span<const std::uint32_t> unique_vertices)
+{
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+  for (auto v : unique_vertices)
+  {
+    min = glm::min(min, positions[v]);
+    max = glm::max(max, positions[v]);
+  }
+
+  const glm::vec3 center = (min + max) * 0.5f;
+  float radius = 0;
+  for (auto v : unique_vertices)
+    radius = std::max(radius, glm::length(positions[v] - center));
+
+  meshlet.sphere = glm::vec4(center, radius);
+
+  std::array<glm::vec3, MAX_MESHLET_TRIANGLES> normals;
+  std::size_t normalCount = 0;
+  glm::vec3 normalSum{0};
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    const glm::vec3 p0 = positions[indices[i + 0]];
+    const glm::vec3 p1 = positions[indices[i + 1]];
+    const glm::vec3 p2 = positions[indices[i + 2]];
+    const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    const float area = glm::length(normal);
+    // Degenerate triangles are never rasterized, so they can't be visible anyway
+    if (area <= 0)
+      continue;
+    normals[normalCount++] = normal / area;
+    normalSum += normal / area;
+  }
+
+  // A cutoff of 1 makes the cone test always fail
+  meshlet.cone = glm::vec4(0, 0, 0, 1);
+
+  const float sumLength = glm::length(normalSum);
+  if (normalCount == 0 || sumLength <= 0)
+    return;
+
+  const glm::vec3 axis = normalSum / sumLength;
+  float minDot = 1;
+  for (std::size_t i = 0; i < normalCount; ++i)
+    minDot = std::min(minDot, glm::dot(axis, normals[i]));
+
+  // With normals more than 90 degrees apart, some triangle is always front facing
+  if (minDot <= 0)
+    return;
+
+  // Sine of the cone's half-angle, see is_meshlet_backfacing
+  meshlet.cone = glm::vec4(axis, std::sqrt(1 - minDot * minDot));
+}
+
+std::size_t build_meshlets(
+  std::span<const std::uint32_t> indices,
+  std::span<const glm::vec3> positions,
+  std::vector<Meshlet>& out)
+{
+  const std::size_t meshletsBefore = out.size();
+
+  // Index of the last meshlet that referenced a vertex, so that we don't need any sets
+  constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+  std::vector<std::uint32_t> vertexMeshlet(positions.size(), NONE);
+
+  std::uint32_t current = 0;
+  std::size_t meshletStart = 0;
+  std::array<std::uint32_t, MAX_MESHLET_VERTICES> uniqueVertices;
+  std::size_t uniqueCount = 0;
+
+  const auto finishMeshlet = [&](std::size_t end) {
+    if (end == meshletStart)
+      return;
+
+    Meshlet meshlet{
+      .sphere = {},
+      .cone = {},
+      .indexOffset = static_cast<std::uint32_t>(meshletStart),
+      .indexCount = static_cast<std::uint32_t>(end - meshletStart),
+      .relem = 0,
+    };
+    compute_meshlet_bounds(
+      meshlet,
+      indices.subspan(meshletStart, end - meshletStart),
+      positions,
+      std::span(uniqueVertices).first(uniqueCount));
+    out.push_back(meshlet);
+
+    ++current;
+    meshletStart = end;
+    uniqueCount = 0;
+  };
+
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    const std::array triangle{indices[i + 0], indices[i + 1], indices[i + 2]};
+
+    std::size_t newVertices = 0;
+    for (std::size_t j = 0; j < 3; ++j)
+    {
+      const bool repeated = (j > 0 && triangle[j] == triangle[0]) ||
+        (j > 1 && triangle[j] == triangle[1]);
+      if (!repeated && vertexMeshlet[triangle[j]] != current)
+        ++newVertices;
+    }
+
+    const std::size_t triangleCount = (i - meshletStart) / 3;
+    if (
+      uniqueCount + newVertices > MAX_MESHLET_VERTICES || triangleCount + 1 > MAX_MESHLET_TRIANGLES)
+      finishMeshlet(i);
+
+    for (auto v : triangle)
+      if (vertexMeshlet[v] != current)
+      {
+        vertexMeshlet[v] = current;
+        uniqueVertices[uniqueCount++] = v;
+      }
+  }
+
+  finishMeshlet(indices.size() - indices.size() % 3);
+
+  return out.size() - meshletsBefore;
+}
+
+bool is_meshlet_backfacing(const Meshlet& meshlet, glm::vec3 camera_position)
+{
+  // Every point of the sphere must be behind every plane with a normal inside of the cone.
+  // See "Optimizing the Graphics Pipeline with Compute" by Graham Wihlidal.
+  const glm::vec3 center{meshlet.sphere};
+  const glm::vec3 axis{meshlet.cone};
+  const glm::vec3 toCenter = center - camera_position;
+  return glm::dot(toCenter, axis) >= meshlet.cone.w * glm::length(toCenter) + meshlet.sphere.w;
+}
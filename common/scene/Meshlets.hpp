@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "SceneData.hpp"
+
+
+// Limits of the usual mesh shader friendly meshlet size
+inline constexpr std::size_t MAX_MESHLET_VERTICES = 64;
+inline constexpr std::size_t MAX_MESHLET_TRIANGLES = 124;
+
+// Splits the triangles of a single relem into meshlets, appending them to `out`.
+// Meshlets are consecutive ranges of `indices`, so that they can be drawn straight
+// from the index buffer, which means that the triangle order (e.g. the one produced
+// by optimize_vertex_cache) determines how compact they end up being.
+// Indices are relative to the start of `positions`. The `relem` field is left as is.
+// Returns the amount of meshlets added.
+std::size_t build_meshlets(
+  std::span<const std::uint32_t> indices,
+  std::span<const glm::vec3> positions,
+  std::vector<Meshlet>& out);
+
+// True if every triangle of the meshlet faces away from the camera. The camera
+// position must be in the same space as the meshlet bounds.
+bool is_meshlet_backfacing(const Meshlet& meshlet, glm::vec3 camera_position);
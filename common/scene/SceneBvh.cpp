@@ -0,0 +1,551 @@
+#include "SceneBvh.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include <etna/Assert.hpp>
+#include <tracy/Tracy.hpp>
+
+
+static constexpr std::uint32_t BIN_COUNT = 16;
+// Leaves larger than this are split even when SAH says it's not worth it
+static constexpr std::uint32_t MAX_LEAF_SIZE = 8;
+// Cost of visiting a node relative to testing a single box
+static constexpr float TRAVERSAL_COST = 1.0f;
+// Building subtrees smaller than this costs less than handing them to another thread
+static constexpr std::uint32_t MIN_JOB_SIZE = 1024;
+
+static Aabb empty_box()
+{
+  return Aabb{
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(std::numeric_limits<float>::lowest()),
+  };
+}
+
+static void grow(Aabb& box, const Aabb& other)
+{
+  box.min = glm::min(box.min, other.min);
+  box.max = glm::max(box.max, other.max);
+}
+
+static void grow(Aabb& box, glm::vec3 point)
+{
+  box.min = glm::min(box.min, point);
+  box.max = glm::max(box.max, point);
+}
+
+static float surface_area(const Aabb& box)
+{
+  const glm::vec3 size = box.max - box.min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+Aabb get_box(const BoxesSoa& boxes, std::size_t i)
+{
+  const glm::vec3 center{boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]};
+  const glm::vec3 extent{boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]};
+  return Aabb{.min = center - extent, .max = center + extent};
+}
+
+std::optional<float> intersect_ray_box(
+  glm::vec3 origin, glm::vec3 inv_direction, const Aabb& box, float max_distance)
+{
+  if (box.min.x > box.max.x)
+    return std::nullopt;
+
+  const glm::vec3 t0 = (box.min - origin) * inv_direction;
+  const glm::vec3 t1 = (box.max - origin) * inv_direction;
+  const glm::vec3 tMin = glm::min(t0, t1);
+  const glm::vec3 tMax = glm::max(t0, t1);
+
+  const float tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+  const float tFar = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, max_distance));
+  if (!(tNear <= tFar))
+    return std::nullopt;
+  return tNear;
+}
+
+struct BuildInput
+{
+  std::span<const Aabb> bounds;
+  std::span<const glm::vec3> centroids;
+  std::span<std::uint32_t> primitives;
+};
+
+// A subtree left for a separate job by the top level of the build
+struct PendingSubtree
+{
+  std::uint32_t node;
+  std::uint32_t firstPrimitive;
+  std::uint32_t primitiveCount;
+};
+
+struct Split
+{
+  int axis = -1;
+  // Primitives with centroids in the bins before this one go to the left child
+  std::uint32_t bin = 0;
+  float cost = std::numeric_limits<float>::infinity();
+};
+
+static std::uint32_t get_bin(float centroid, float bin_start, float bin_scale)
+{
+  const auto bin = static_cast<std::uint32_t>((centroid - bin_start) * bin_scale);
+  return std::min(bin, BIN_COUNT - 1);
+}
+
+// Finds the plane between bins along any axis that minimizes the SAH cost: the sum of
+// surface areas of the children weighted by their primitive counts
+static Split find_split(
+  const BuildInput& input, std::uint32_t first, std::uint32_t count, const Aabb& centroid_bounds)
+{
+  Split best;
+
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    const float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+    if (!(extent > 0))
+      continue;
+
+    const float binScale = static_cast<float>(BIN_COUNT) / extent;
+
+    std::array<Aabb, BIN_COUNT> binBounds;
+    binBounds.fill(empty_box());
+    std::array<std::uint32_t, BIN_COUNT> binCounts{};
+    for (std::uint32_t i = first; i < first + count; ++i)
+    {
+      const auto primitive = input.primitives[i];
+      const auto bin =
+        get_bin(input.centroids[primitive][axis], centroid_bounds.min[axis], binScale);
+      grow(binBounds[bin], input.bounds[primitive]);
+      ++binCounts[bin];
+    }
+
+    // Right sides of the planes between bins, then a sweep from the left
+    std::array<float, BIN_COUNT> rightCosts{};
+    std::array<std::uint32_t, BIN_COUNT> rightCounts{};
+    Aabb accumulated = empty_box();
+    std::uint32_t accumulatedCount = 0;
+    for (std::uint32_t bin = BIN_COUNT - 1; bin > 0; --bin)
+    {
+      grow(accumulated, binBounds[bin]);
+      accumulatedCount += binCounts[bin];
+      rightCounts[bin] = accumulatedCount;
+      rightCosts[bin] = accumulatedCount == 0 ? 0 : surface_area(accumulated) * accumulatedCount;
+    }
+
+    accumulated = empty_box();
+    accumulatedCount = 0;
+    for (std::uint32_t bin = 1; bin < BIN_COUNT; ++bin)
+    {
+      grow(accumulated, binBounds[bin - 1]);
+      accumulatedCount += binCounts[bin - 1];
+      if (accumulatedCount == 0 || rightCounts[bin] == 0)
+        continue;
+
+      const float cost = surface_area(accumulated) * accumulatedCount + rightCosts[bin];
+      if (cost < best.cost)
+        best = Split{.axis = axis, .bin = bin, .cost = cost};
+    }
+  }
+
+  return best;
+}
+
+// Builds the subtree of nodes[index] over the primitives [first, first + count). When `jobs`
+// is not null, subtrees of at most `job_size` primitives are left to it instead.
+static void build_node(
+  const BuildInput& input,
+  std::vector<SceneBvh::Node>& nodes,
+  std::uint32_t index,
+  std::uint32_t first,
+  std::uint32_t count,
+  std::vector<PendingSubtree>* jobs,
+  std::uint32_t job_size)
+{
+  if (jobs != nullptr && count <= job_size)
+  {
+    jobs->push_back(
+      PendingSubtree{.node = index, .firstPrimitive = first, .primitiveCount = count});
+    return;
+  }
+
+  Aabb bounds = empty_box();
+  Aabb centroidBounds = empty_box();
+  for (std::uint32_t i = first; i < first + count; ++i)
+  {
+    grow(bounds, input.bounds[input.primitives[i]]);
+    grow(centroidBounds, input.centroids[input.primitives[i]]);
+  }
+
+  nodes[index] = SceneBvh::Node{
+    .bounds = bounds,
+    .firstChild = 0,
+    .firstPrimitive = first,
+    .primitiveCount = count,
+  };
+
+  if (count == 1)
+    return;
+
+  const auto split = find_split(input, first, count, centroidBounds);
+  const float leafCost = surface_area(bounds) * static_cast<float>(count);
+  const float splitCost = TRAVERSAL_COST * surface_area(bounds) + split.cost;
+
+  std::uint32_t leftCount = 0;
+  if (split.axis >= 0 && (splitCost < leafCost || count > MAX_LEAF_SIZE))
+  {
+    const auto axis = split.axis;
+    const float binScale =
+      static_cast<float>(BIN_COUNT) / (centroidBounds.max[axis] - centroidBounds.min[axis]);
+    const auto begin = input.primitives.begin() + first;
+    const auto middle = std::partition(begin, begin + count, [&](std::uint32_t primitive) {
+      return get_bin(input.centroids[primitive][axis], centroidBounds.min[axis], binScale) <
+        split.bin;
+    });
+    leftCount = static_cast<std::uint32_t>(middle - begin);
+  }
+  else if (count > MAX_LEAF_SIZE)
+  {
+    // All centroids are at the same spot, any split is as good as any other
+    leftCount = count / 2;
+  }
+  else
+  {
+    return;
+  }
+
+  const auto firstChild = static_cast<std::uint32_t>(nodes.size());
+  nodes.resize(nodes.size() + 2);
+  nodes[index].firstChild = firstChild;
+
+  build_node(input, nodes, firstChild, first, leftCount, jobs, job_size);
+  build_node(
+    input, nodes, firstChild + 1, first + leftCount, count - leftCount, jobs, job_size);
+}
+
+void SceneBvh::build(const BoxesSoa& boxes, ThreadPool* workers)
+{
+  ZoneScoped;
+
+  boxCount = boxes.count;
+  nodes.clear();
+  primitives.clear();
+  primitiveBounds.clear();
+
+  std::vector<Aabb> bounds(boxes.count);
+  std::vector<glm::vec3> centroids(boxes.count);
+  for (std::uint32_t i = 0; i < boxes.count; ++i)
+  {
+    // Empty boxes have negative extents, see BoxesSoa::set
+    if (!(boxes.extentX[i] >= 0))
+      continue;
+    bounds[i] = get_box(boxes, i);
+    centroids[i] = glm::vec3{boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]};
+    primitives.push_back(i);
+  }
+
+  if (primitives.empty())
+    return;
+
+  const auto count = static_cast<std::uint32_t>(primitives.size());
+  const BuildInput input{.bounds = bounds, .centroids = centroids, .primitives = primitives};
+
+  nodes.reserve(2 * count);
+  nodes.resize(1);
+
+  if (workers == nullptr)
+    build_node(input, nodes, 0, 0, count, nullptr, 0);
+  else
+  {
+    // Several jobs per thread, as subtrees end up being of rather different sizes
+    const auto jobCount = static_cast<std::uint32_t>(4 * (workers->getThreadCount() + 1));
+    const std::uint32_t jobSize = std::max(MIN_JOB_SIZE, count / jobCount);
+
+    std::vector<PendingSubtree> jobs;
+    build_node(input, nodes, 0, 0, count, &jobs, jobSize);
+
+    std::vector<std::vector<Node>> subtrees(jobs.size());
+    workers->parallelFor(jobs.size(), [&](std::size_t i) {
+      subtrees[i].reserve(2 * jobs[i].primitiveCount);
+      subtrees[i].resize(1);
+      build_node(
+        input, subtrees[i], 0, jobs[i].firstPrimitive, jobs[i].primitiveCount, nullptr, 0);
+    });
+
+    // The root of a subtree takes the place reserved for it, the rest goes to the end.
+    // Children still come after their parents, which is what refit relies upon.
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+    {
+      const auto base = static_cast<std::uint32_t>(nodes.size());
+      const auto relocate = [base](Node node) {
+        if (!node.isLeaf())
+          node.firstChild += base - 1;
+        return node;
+      };
+
+      nodes[jobs[i].node] = relocate(subtrees[i].front());
+      for (std::size_t j = 1; j < subtrees[i].size(); ++j)
+        nodes.push_back(relocate(subtrees[i][j]));
+    }
+  }
+
+  primitiveBounds.reserve(count);
+  for (auto primitive : primitives)
+    primitiveBounds.push_back(bounds[primitive]);
+}
+
+void SceneBvh::refit(const BoxesSoa& boxes)
+{
+  ZoneScoped;
+
+  ETNA_VERIFY(boxes.count == boxCount);
+
+  for (std::size_t i = 0; i < primitives.size(); ++i)
+    primitiveBounds[i] = get_box(boxes, primitives[i]);
+
+  for (std::size_t i = nodes.size(); i-- > 0;)
+  {
+    auto& node = nodes[i];
+    if (node.isLeaf())
+    {
+      node.bounds = empty_box();
+      for (std::uint32_t j = 0; j < node.primitiveCount; ++j)
+        grow(node.bounds, primitiveBounds[node.firstPrimitive + j]);
+    }
+    else
+    {
+      node.bounds = nodes[node.firstChild].bounds;
+      grow(node.bounds, nodes[node.firstChild + 1].bounds);
+    }
+  }
+}
+
+// Returns false when the box is outside of some plane, otherwise clears
+// the bits of the planes that the box is fully inside of from the mask
+static bool test_planes(const Frustum& frustum, const Aabb& box, std::uint32_t& mask)
+{
+  const glm::vec3 center = (box.min + box.max) * 0.5f;
+  const glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+  for (std::uint32_t i = 0; i < frustum.planes.size(); ++i)
+  {
+    if ((mask & (1u << i)) == 0)
+      continue;
+
+    const auto& plane = frustum.planes[i];
+    const glm::vec3 normal{plane};
+    const float distance = glm::dot(normal, center) + plane.w;
+    const float radius = glm::dot(glm::abs(normal), extent);
+    if (distance + radius < 0)
+      return false;
+    if (distance - radius >= 0)
+      mask &= ~(1u << i);
+  }
+  return true;
+}
+
+void SceneBvh::cullFrustum(const Frustum& frustum, std::vector<std::uint32_t>& visible) const
+{
+  if (nodes.empty())
+    return;
+
+  struct Entry
+  {
+    std::uint32_t node;
+    std::uint32_t planeMask;
+  };
+
+  std::vector<Entry> stack;
+  stack.reserve(64);
+  stack.push_back(Entry{.node = 0, .planeMask = (1u << frustum.planes.size()) - 1});
+
+  while (!stack.empty())
+  {
+    auto [index, mask] = stack.back();
+    stack.pop_back();
+
+    const auto& node = nodes[index];
+    if (!test_planes(frustum, node.bounds, mask))
+      continue;
+
+    if (mask == 0)
+    {
+      const auto begin = primitives.begin() + node.firstPrimitive;
+      visible.insert(visible.end(), begin, begin + node.primitiveCount);
+    }
+    else if (node.isLeaf())
+    {
+      const std::uint32_t end = node.firstPrimitive + node.primitiveCount;
+      for (std::uint32_t i = node.firstPrimitive; i < end; ++i)
+      {
+        std::uint32_t primitiveMask = mask;
+        if (test_planes(frustum, primitiveBounds[i], primitiveMask))
+          visible.push_back(primitives[i]);
+      }
+    }
+    else
+    {
+      stack.push_back(Entry{.node = node.firstChild + 1, .planeMask = mask});
+      stack.push_back(Entry{.node = node.firstChild, .planeMask = mask});
+    }
+  }
+}
+
+template <class NodeTest, class PrimitiveFunc>
+void SceneBvh::traverse(NodeTest node_test, PrimitiveFunc func) const
+{
+  if (nodes.empty())
+    return;
+
+  std::vector<std::uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+
+  while (!stack.empty())
+  {
+    const auto& node = nodes[stack.back()];
+    stack.pop_back();
+
+    if (!node_test(node.bounds))
+      continue;
+
+    if (node.isLeaf())
+    {
+      const std::uint32_t end = node.firstPrimitive + node.primitiveCount;
+      for (std::uint32_t i = node.firstPrimitive; i < end; ++i)
+        if (node_test(primitiveBounds[i]))
+          func(primitives[i]);
+    }
+    else
+    {
+      stack.push_back(node.firstChild + 1);
+      stack.push_back(node.firstChild);
+    }
+  }
+}
+
+void SceneBvh::overlapSphere(
+  glm::vec3 center, float radius, std::vector<std::uint32_t>& result) const
+{
+  traverse(
+    [center, radiusSq = radius * radius](const Aabb& box) {
+      const glm::vec3 offset = glm::clamp(center, box.min, box.max) - center;
+      return glm::dot(offset, offset) <= radiusSq;
+    },
+    [&result](std::uint32_t primitive) { result.push_back(primitive); });
+}
+
+void SceneBvh::overlapBox(const Aabb& box, std::vector<std::uint32_t>& result) const
+{
+  traverse(
+    [&box](const Aabb& other) {
+      return glm::all(glm::lessThanEqual(box.min, other.max)) &&
+        glm::all(glm::lessThanEqual(other.min, box.max));
+    },
+    [&result](std::uint32_t primitive) { result.push_back(primitive); });
+}
+
+template <class Test>
+static std::optional<SceneBvh::RayHit> raycast_impl(
+  std::span<const SceneBvh::Node> nodes,
+  std::span<const std::uint32_t> primitives,
+  std::span<const Aabb> primitive_bounds,
+  const SceneBvh::Ray& ray,
+  Test test)
+{
+  if (nodes.empty())
+    return std::nullopt;
+
+  const glm::vec3 invDirection = 1.0f / ray.direction;
+
+  std::optional<SceneBvh::RayHit> best;
+  float bestDistance = ray.maxDistance;
+
+  struct Entry
+  {
+    std::uint32_t node;
+    float distance;
+  };
+
+  const auto rootDistance =
+    intersect_ray_box(ray.origin, invDirection, nodes[0].bounds, bestDistance);
+  if (!rootDistance.has_value())
+    return std::nullopt;
+
+  std::vector<Entry> stack;
+  stack.reserve(64);
+  stack.push_back(Entry{.node = 0, .distance = *rootDistance});
+
+  while (!stack.empty())
+  {
+    const auto [index, distance] = stack.back();
+    stack.pop_back();
+
+    // Something closer was hit since the node was pushed
+    if (distance > bestDistance)
+      continue;
+
+    const auto& node = nodes[index];
+    if (node.isLeaf())
+    {
+      const std::uint32_t end = node.firstPrimitive + node.primitiveCount;
+      for (std::uint32_t i = node.firstPrimitive; i < end; ++i)
+      {
+        const auto boxDistance =
+          intersect_ray_box(ray.origin, invDirection, primitive_bounds[i], bestDistance);
+        if (!boxDistance.has_value())
+          continue;
+
+        const auto hitDistance = test(primitives[i], *boxDistance, bestDistance);
+        if (hitDistance.has_value() && *hitDistance <= bestDistance)
+        {
+          bestDistance = *hitDistance;
+          best = SceneBvh::RayHit{.primitive = primitives[i], .distance = *hitDistance};
+        }
+      }
+      continue;
+    }
+
+    const auto left =
+      intersect_ray_box(ray.origin, invDirection, nodes[node.firstChild].bounds, bestDistance);
+    const auto right =
+      intersect_ray_box(ray.origin, invDirection, nodes[node.firstChild + 1].bounds, bestDistance);
+
+    // The closer child goes on top, so that it's visited first
+    Entry entries[2];
+    std::uint32_t entryCount = 0;
+    if (left.has_value())
+      entries[entryCount++] = Entry{.node = node.firstChild, .distance = *left};
+    if (right.has_value())
+      entries[entryCount++] = Entry{.node = node.firstChild + 1, .distance = *right};
+    if (entryCount == 2 && entries[0].distance < entries[1].distance)
+      std::swap(entries[0], entries[1]);
+    stack.insert(stack.end(), entries, entries + entryCount);
+  }
+
+  return best;
+}
+
+std::optional<SceneBvh::RayHit> SceneBvh::raycast(const Ray& ray) const
+{
+  return raycast_impl(
+    nodes,
+    primitives,
+    primitiveBounds,
+    ray,
+    [](std::uint32_t, float box_distance, float) -> std::optional<float> { return box_distance; });
+}
+
+std::optional<SceneBvh::RayHit> SceneBvh::raycast(const Ray& ray, PrimitiveRayTest test) const
+{
+  return raycast_impl(
+    nodes,
+    primitives,
+    primitiveBounds,
+    ray,
+    [&test](std::uint32_t primitive, float, float max_distance) {
+      return test(primitive, max_distance);
+    });
+}
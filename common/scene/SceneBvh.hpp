@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <function2/function2.hpp>
+
+#include "utils/ThreadPool.hpp"
+#include "SceneData.hpp"
+#include "FrustumCulling.hpp"
+
+
+/**
+ * Bounding volume hierarchy over world space boxes, instances of the scene in our case.
+ * Built top-down with binned SAH, large subtrees are built by separate jobs. When the boxes
+ * move, the hierarchy is refit instead of rebuilt: the topology stays the same and only
+ * node bounds are recomputed, which is cheap but gets less efficient the more things move
+ * relative to each other.
+ */
+class SceneBvh
+{
+public:
+  struct Node
+  {
+    Aabb bounds;
+    // Inner nodes have two children, the second one right after the first one.
+    // 0 for leaves, as the root is never anybody's child.
+    std::uint32_t firstChild;
+    // Every subtree covers a contiguous range of primitives, leaves and inner nodes alike
+    std::uint32_t firstPrimitive;
+    std::uint32_t primitiveCount;
+
+    bool isLeaf() const { return firstChild == 0; }
+  };
+
+  struct Ray
+  {
+    glm::vec3 origin;
+    // Doesn't have to be normalized, distances are measured in units of its length
+    glm::vec3 direction;
+    float maxDistance = std::numeric_limits<float>::infinity();
+  };
+
+  struct RayHit
+  {
+    std::uint32_t primitive;
+    float distance;
+  };
+
+  // Exact intersection with a primitive whose box was hit, closer than the given distance
+  using PrimitiveRayTest = fu2::function_view<std::optional<float>(std::uint32_t, float)>;
+
+  SceneBvh() = default;
+
+  // Boxes that are empty are left out and never reported by queries
+  void build(const BoxesSoa& boxes, ThreadPool* workers);
+
+  // Must be called with the same amount of boxes as the hierarchy was built with
+  void refit(const BoxesSoa& boxes);
+
+  bool empty() const { return nodes.empty(); }
+  std::span<const Node> getNodes() const { return nodes; }
+
+  // Appends the indices of the boxes that intersect the frustum to `visible`. Subtrees
+  // that are fully inside are accepted as a whole, without testing their boxes, and
+  // planes that a node is fully inside of aren't tested for its descendants.
+  void cullFrustum(const Frustum& frustum, std::vector<std::uint32_t>& visible) const;
+
+  // Closest primitive along the ray. Without a test, hitting the box is a hit, otherwise
+  // the test is called for every box that is hit closer than the best hit so far.
+  std::optional<RayHit> raycast(const Ray& ray) const;
+  std::optional<RayHit> raycast(const Ray& ray, PrimitiveRayTest test) const;
+
+  // Appends the indices of the boxes that overlap the sphere or the box to `result`
+  void overlapSphere(glm::vec3 center, float radius, std::vector<std::uint32_t>& result) const;
+  void overlapBox(const Aabb& box, std::vector<std::uint32_t>& result) const;
+
+private:
+  template <class NodeTest, class PrimitiveFunc>
+  void traverse(NodeTest node_test, PrimitiveFunc func) const;
+
+private:
+  std::size_t boxCount = 0;
+  std::vector<Node> nodes;
+  // Indices of the boxes, in the order in which leaves reference them
+  std::vector<std::uint32_t> primitives;
+  // Box of every primitive, in the same order as above
+  std::vector<Aabb> primitiveBounds;
+};
+
+// Distance along the ray at which it enters the box, if it does so within [0, max_distance]
+std::optional<float> intersect_ray_box(
+  glm::vec3 origin, glm::vec3 inv_direction, const Aabb& box, float max_distance);
+
+Aabb get_box(const BoxesSoa& boxes, std::size_t i);
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+// Relems that reference less than 2^16 vertices store their indices
+// in a separate, more compact region of the unified index buffer.
+enum class IndexFormat : std::uint32_t
+{
+  Uint32,
+  Uint16,
+};
+
+// Axis-aligned bounding box, empty ones have min > max
+struct Aabb
+{
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+// A single render element (relem) corresponds to a single draw call
+// of a certain pipeline with specific bindings (including material data)
+struct RenderElement
+{
+  std::uint32_t vertexOffset;
+  // Counted in indices of the relem's format from the start of that format's region
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  IndexFormat indexFormat = IndexFormat::Uint32;
+  // Range of the relem's meshlets in the scene's meshlet array
+  std::uint32_t firstMeshlet = 0;
+  std::uint32_t meshletCount = 0;
+  // Not implemented!
+  // Material* material;
+};
+
+// A small cluster of consecutive triangles of a relem that is culled as a whole.
+// Bounds are in the space of the vertex data, i.e. before the instance transform.
+// NOTE: mirrored in std430 layout by the meshlet culling shader.
+struct Meshlet
+{
+  // xyz is the center of the bounding sphere, w is its radius
+  glm::vec4 sphere;
+  // xyz is the axis of the cone containing normals of all triangles, w is the cutoff,
+  // see is_meshlet_backfacing for how these are used.
+  glm::vec4 cone;
+  // Counted in indices from the start of the relem
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  std::uint32_t relem;
+  std::uint32_t padding = 0;
+};
+
+static_assert(sizeof(Meshlet) == 48);
+
+// A mesh is a collection of relems. A scene may have the same mesh
+// located in several different places, so a scene consists of **instances**,
+// not meshes.
+struct Mesh
+{
+  std::uint32_t firstRelem;
+  std::uint32_t relemCount;
+  // Simplified versions of the mesh in the scene's LOD array, from finest to coarsest
+  std::uint32_t firstLod = 0;
+  std::uint32_t lodCount = 0;
+  // Bounding sphere of the full detail mesh, in the same space as meshlet bounds.
+  // xyz is the center and w is the radius.
+  glm::vec4 sphere{0};
+};
+
+// A level of detail of a mesh consists of its own relems, which
+// share vertices with the full detail relems of the mesh.
+// NOTE: mirrored in std430 layout by the LOD selection shader.
+struct MeshLod
+{
+  std::uint32_t firstRelem;
+  std::uint32_t relemCount;
+  // Maximal deviation from the full detail mesh relative to the mesh's bounding sphere
+  // radius, which makes it independent of the instance transform and quantization.
+  float error;
+  std::uint32_t padding = 0;
+};
+
+// Everything shaders need to know about an instance, half of what a model matrix
+// together with its inverse transpose would take. See pack_instances.
+// NOTE: mirrored in std430 layout by the vertex and culling shaders.
+struct InstanceData
+{
+  // Rows of the affine part of the model matrix, the last row is always (0, 0, 0, 1)
+  glm::vec4 modelRows[3];
+  // Columns of the normal matrix as snorm 10:10:10, scaled so that the largest entry
+  // is 1, as normals are renormalized after being transformed anyway. Nonzero entries
+  // are kept at least 1 LSB large, so that stretched instances don't lose a direction.
+  std::uint32_t normalColumns[3];
+  std::uint32_t mesh;
+};
+
+static_assert(sizeof(InstanceData) == 64);
+
+// Layouts of vertices that the renderer knows how to read.
+// See PackedVertex and QuantizedVertex respectively.
+enum class VertexFormat : std::uint32_t
+{
+  Full,
+  Quantized,
+};
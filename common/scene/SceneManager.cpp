@@ -1,403 +1,896 @@
 #include "SceneManager.hpp"
 
-#include <stack>
+#include <chrono>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <cstddef>
+#include <numeric>
+#include <cstring>
+#include <unordered_map>
 
 #include <spdlog/spdlog.h>
 #include <fmt/std.h>
-#include <glm/ext/matrix_transform.hpp>
-#include <glm/gtc/quaternion.hpp>
 #include <etna/GlobalContext.hpp>
-#include <etna/OneShotCmdMgr.hpp>
+#include <tracy/Tracy.hpp>
+
+#include "InstancePacking.hpp"
 
 
 SceneManager::SceneManager()
-  : oneShotCommands{etna::get_context().createOneShotCmdMgr()}
-  , transferHelper{etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 4}}
+  : SceneManager(CreateInfo{})
+{
+}
+
+SceneManager::SceneManager(CreateInfo info)
+  : loader{GltfLoader::CreateInfo{
+      .workerThreadCount = info.workerThreadCount,
+      .deferImageDecoding = true,
+    }}
+  , uploader{RingStagingUploader::CreateInfo{.stagingSize = info.stagingSize}}
+  , optimizeMeshes{info.optimizeMeshes}
+  , generateLods{info.generateLods}
+  , loadTextures{info.loadTextures}
+  , sceneCopies{std::max(info.sceneCopies, 1u)}
+  , maxOccluderTriangles{info.maxOccluderTriangles}
+  , maxOccluderError{info.maxOccluderError}
+  , framesInFlight{info.framesInFlight}
+  , uploadBudgetPerFrame{info.uploadBudgetPerFrame}
+{
+}
+
+std::optional<SceneManager::PendingScene> SceneManager::prepareScene(std::filesystem::path path)
 {
+  ZoneScoped;
+
+  auto maybeModel = loader.loadModel(path);
+  if (!maybeModel.has_value())
+    return std::nullopt;
+
+  auto loaded = std::move(*maybeModel);
+
+  // NOTE: you might want to store these on the GPU for GPU-driven rendering.
+  auto [instMats, instMeshes, instNodes, hierarchy, gltfNodes] =
+    loader.processInstances(loaded.model);
+  auto processedMeshes = loader.processMeshes(loaded);
+
+  if (optimizeMeshes)
+  {
+    loader.weldVertices(processedMeshes);
+    const auto reports = loader.optimizeMeshes(processedMeshes);
+    for (std::size_t i = 0; i < reports.size(); ++i)
+      spdlog::debug(
+        "SceneManager: mesh {} ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+        i,
+        reports[i].before.acmr(),
+        reports[i].after.acmr(),
+        reports[i].before.atvr(),
+        reports[i].after.atvr());
+  }
+
+  const auto positions = GltfLoader::extractPositions(processedMeshes);
+  if (generateLods)
+    loader.buildLods(processedMeshes, positions, {});
+  loader.computeMeshBounds(processedMeshes, positions);
+  loader.buildMeshlets(processedMeshes, positions);
+  loader.packSmallIndices(processedMeshes);
+
+  auto [verts, inds, inds16, relems, meshs, meshlets, lods, relemBounds] =
+    std::move(processedMeshes);
+
+  PendingScene result{
+    .path = std::move(path),
+    .instanceMatrices = std::move(instMats),
+    .instanceMeshes = std::move(instMeshes),
+    .instanceNodes = std::move(instNodes),
+    .hierarchy = std::move(hierarchy),
+    .relems = std::move(relems),
+    .relemBounds = std::move(relemBounds),
+    .meshes = std::move(meshs),
+    .lods = std::move(lods),
+    .meshlets = std::move(meshlets),
+    .vertexStorage = std::move(verts),
+    .indexStorage = std::move(inds),
+    .index16Storage = std::move(inds16),
+  };
+  result.vertices = std::as_bytes(std::span(result.vertexStorage));
+  result.indices = result.indexStorage;
+  result.indices16 = result.index16Storage;
+  computeBounds(result);
+  packInstances(result);
+  countDraws(result);
+  extractOccluders(result);
+
+  if (loadTextures)
+    decodeTextures(result, loaded);
+
+  return result;
 }
 
-std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path path)
+std::optional<SceneManager::PendingScene> SceneManager::prepareBakedScene(
+  std::filesystem::path path)
 {
-  tinygltf::Model model;
-
-  std::string error;
-  std::string warning;
-  bool success = false;
-
-  auto ext = path.extension();
-  if (ext == ".gltf")
-    success = loader.LoadASCIIFromFile(&model, &error, &warning, path.string());
-  else if (ext == ".glb")
-    success = loader.LoadBinaryFromFile(&model, &error, &warning, path.string());
-  else
+  ZoneScoped;
+
+  auto mappedFile = MappedFile::open(path);
+  if (!mappedFile.has_value())
   {
-    spdlog::error("glTF: Unknown glTF file extension: '{}'. Expected .gltf or .glb.", ext);
+    spdlog::error("SceneManager: unable to open and map baked scene '{}'", path);
     return std::nullopt;
   }
 
-  if (!success)
+  auto scene = parse_baked_scene(mappedFile->getData());
+  if (!scene.has_value())
   {
-    spdlog::error("glTF: Failed to load model!");
-    if (!error.empty())
-      spdlog::error("glTF: {}", error);
+    spdlog::error("SceneManager: '{}' is not a valid baked scene", path);
     return std::nullopt;
   }
 
-  if (!warning.empty())
-    spdlog::warn("glTF: {}", warning);
+  // Geometry is uploaded straight from the mapping, only the small tables get copied
+  PendingScene result{
+    .path = std::move(path),
+    .instanceMatrices = {scene->instanceMatrices.begin(), scene->instanceMatrices.end()},
+    .instanceMeshes = {scene->instanceMeshes.begin(), scene->instanceMeshes.end()},
+    .relems = {scene->relems.begin(), scene->relems.end()},
+    .relemBounds = {scene->relemBounds.begin(), scene->relemBounds.end()},
+    .meshes = {scene->meshes.begin(), scene->meshes.end()},
+    .lods = {scene->lods.begin(), scene->lods.end()},
+    .meshlets = {scene->meshlets.begin(), scene->meshlets.end()},
+    .vertexFormat = scene->vertexFormat,
+    .vertices = scene->vertices,
+    .indices = scene->indices,
+    .indices16 = scene->indices16,
+    .mappedFile = std::move(mappedFile),
+  };
+  computeBounds(result);
+  packInstances(result);
+  countDraws(result);
+  extractOccluders(result);
+  mapTextures(result, *scene, result.path.parent_path());
+  return result;
+}
 
-  if (
-    !model.extensions.empty() || !model.extensionsRequired.empty() || !model.extensionsUsed.empty())
-    spdlog::warn("glTF: No glTF extensions are currently implemented!");
+void SceneManager::computeBounds(PendingScene& scene)
+{
+  ZoneScoped;
 
-  return model;
+  scene.meshBounds.assign(
+    scene.meshes.size(),
+    Aabb{
+      .min = glm::vec3(std::numeric_limits<float>::max()),
+      .max = glm::vec3(std::numeric_limits<float>::lowest()),
+    });
+  for (std::size_t i = 0; i < scene.meshes.size(); ++i)
+    for (std::uint32_t j = 0; j < scene.meshes[i].relemCount; ++j)
+    {
+      const auto& bounds = scene.relemBounds[scene.meshes[i].firstRelem + j];
+      scene.meshBounds[i].min = glm::min(scene.meshBounds[i].min, bounds.min);
+      scene.meshBounds[i].max = glm::max(scene.meshBounds[i].max, bounds.max);
+    }
+
+  if (sceneCopies > 1)
+    replicateInstances(scene, sceneCopies);
+
+  scene.instanceBounds.resize(scene.instanceMatrices.size());
+  for (std::size_t i = 0; i < scene.instanceMatrices.size(); ++i)
+    scene.instanceBounds.set(
+      i, scene.meshBounds[scene.instanceMeshes[i]], scene.instanceMatrices[i]);
+
+  // Happens on the loading thread, as building the BVH of a large scene takes a while
+  scene.bvh.build(scene.instanceBounds, loader.getWorkers());
 }
 
-SceneManager::ProcessedInstances SceneManager::processInstances(const tinygltf::Model& model) const
+void SceneManager::replicateInstances(PendingScene& scene, std::uint32_t copies)
 {
-  std::vector nodeTransforms(model.nodes.size(), glm::identity<glm::mat4x4>());
+  ZoneScoped;
 
-  for (std::size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx)
+  const auto instanceCount = scene.instanceMatrices.size();
+
+  BoxesSoa bounds;
+  bounds.resize(instanceCount);
+  Aabb sceneBox{
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(std::numeric_limits<float>::lowest()),
+  };
+  for (std::size_t i = 0; i < instanceCount; ++i)
   {
-    const auto& node = model.nodes[nodeIdx];
-    auto& transform = nodeTransforms[nodeIdx];
+    bounds.set(i, scene.meshBounds[scene.instanceMeshes[i]], scene.instanceMatrices[i]);
+    if (!(bounds.extentX[i] >= 0))
+      continue;
+    const auto box = get_box(bounds, i);
+    sceneBox.min = glm::min(sceneBox.min, box.min);
+    sceneBox.max = glm::max(sceneBox.max, box.max);
+  }
+  if (!(sceneBox.min.x <= sceneBox.max.x))
+    return;
 
-    if (!node.matrix.empty())
-    {
-      for (int i = 0; i < 4; ++i)
-        for (int j = 0; j < 4; ++j)
-          transform[i][j] = static_cast<float>(node.matrix[4 * i + j]);
-    }
-    else
+  // Copies go next to each other on a square grid in the XZ plane
+  const auto side = static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<float>(copies))));
+  const glm::vec3 spacing = (sceneBox.max - sceneBox.min) * 1.1f;
+  for (std::uint32_t copy = 1; copy < copies; ++copy)
+  {
+    const float x = spacing.x * static_cast<float>(copy % side);
+    const float z = spacing.z * static_cast<float>(copy / side);
+    const glm::vec4 offset{x, 0.0f, z, 0.0f};
+    for (std::size_t i = 0; i < instanceCount; ++i)
     {
-      if (!node.scale.empty())
-        transform = scale(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.scale[0]),
-            static_cast<float>(node.scale[1]),
-            static_cast<float>(node.scale[2])));
-
-      if (!node.rotation.empty())
-        transform *= mat4_cast(glm::quat(
-          static_cast<float>(node.rotation[3]),
-          static_cast<float>(node.rotation[0]),
-          static_cast<float>(node.rotation[1]),
-          static_cast<float>(node.rotation[2])));
-
-      if (!node.translation.empty())
-        transform = translate(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.translation[0]),
-            static_cast<float>(node.translation[1]),
-            static_cast<float>(node.translation[2])));
+      glm::mat4x4 matrix = scene.instanceMatrices[i];
+      matrix[3] += offset;
+      scene.instanceMatrices.push_back(matrix);
+      scene.instanceMeshes.push_back(scene.instanceMeshes[i]);
     }
   }
 
-  std::stack<std::size_t> vertices;
-  for (auto vert : model.scenes[model.defaultScene].nodes)
-    vertices.push(vert);
+  scene.instanceNodes.clear();
+  scene.hierarchy = {};
 
-  while (!vertices.empty())
-  {
-    auto vert = vertices.top();
-    vertices.pop();
+  spdlog::info(
+    "SceneManager: laid out {} copies of the scene, {} instances in total",
+    copies,
+    scene.instanceMatrices.size());
+}
 
-    for (auto child : model.nodes[vert].children)
-    {
-      nodeTransforms[child] = nodeTransforms[vert] * nodeTransforms[child];
-      vertices.push(child);
-    }
-  }
+void SceneManager::packInstances(PendingScene& scene)
+{
+  scene.instanceData.resize(scene.instanceMatrices.size());
+  pack_instances(scene.instanceMatrices, scene.instanceMeshes, scene.instanceData);
+}
 
-  ProcessedInstances result;
+void SceneManager::mapTextures(
+  PendingScene& scene, const BakedSceneView& baked, const std::filesystem::path& directory)
+{
+  ZoneScoped;
 
-  // Don't overallocate matrices, they are pretty chonky.
+  scene.textures.resize(baked.textures.size());
+  scene.textureUsages.resize(baked.textures.size());
+  for (std::size_t i = 0; i < baked.textures.size(); ++i)
   {
-    std::size_t totalNodesWithMeshes = 0;
-    for (std::size_t i = 0; i < model.nodes.size(); ++i)
-      if (model.nodes[i].mesh >= 0)
-        ++totalNodesWithMeshes;
-    result.matrices.reserve(totalNodesWithMeshes);
-    result.meshes.reserve(totalNodesWithMeshes);
-  }
+    scene.textureUsages[i] = baked.textures[i].usage;
 
-  for (std::size_t i = 0; i < model.nodes.size(); ++i)
-    if (model.nodes[i].mesh >= 0)
+    const auto relativePath = get_texture_path(baked, baked.textures[i]);
+    if (relativePath.empty())
+      continue;
+
+    // A missing texture is not a reason to throw the whole scene away
+    const auto path = directory / std::u8string(relativePath.begin(), relativePath.end());
+    auto file = MappedFile::open(path);
+    if (!file.has_value())
     {
-      result.matrices.push_back(nodeTransforms[i]);
-      result.meshes.push_back(model.nodes[i].mesh);
+      spdlog::error("SceneManager: unable to open and map texture '{}'", path);
+      continue;
     }
 
-  return result;
+    auto view = parse_ktx2(file->getData());
+    if (!view.has_value())
+    {
+      spdlog::error("SceneManager: '{}' is not a texture we can load", path);
+      continue;
+    }
+
+    scene.textures[i] = PendingTexture{
+      .name = path.stem().string(),
+      .format = view->format,
+      .width = view->width,
+      .height = view->height,
+      .blockExtent = 4,
+      .levels = std::move(view->levels),
+      .file = std::move(*file),
+    };
+  }
 }
 
-static std::uint32_t encode_normal(glm::vec3 normal)
+void SceneManager::decodeTextures(PendingScene& scene, const GltfLoader::LoadedModel& loaded)
 {
-  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
-  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
+  ZoneScoped;
 
-  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
-  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
-  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
+  const auto start = std::chrono::steady_clock::now();
 
-  return sx | sy;
-}
+  auto decoded = loader.decodeTextures(loaded);
 
-SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model& model) const
-{
-  // NOTE: glTF assets can have pretty wonky data layouts which are not appropriate
-  // for real-time rendering, so we have to press the data first. In serious engines
-  // this is mitigated by storing assets on the disc in an engine-specific format that
-  // is appropriate for GPU upload right after reading from disc.
+  scene.textures.resize(loaded.model.images.size());
+  scene.textureUsages.resize(loaded.model.images.size(), TextureUsage::Albedo);
+  for (auto& texture : decoded)
+  {
+    scene.textureUsages[texture.image] = texture.usage;
+
+    auto& pending = scene.textures[texture.image].emplace(PendingTexture{
+      .name = loaded.model.images[texture.image].name,
+      .format = choose_uncompressed_texture_format(texture.usage),
+      .width = texture.mips.front().width,
+      .height = texture.mips.front().height,
+      .blockExtent = 1,
+      .levels = {},
+      .mips = std::move(texture.mips),
+    });
+    for (const auto& mip : pending.mips)
+      pending.levels.push_back(std::as_bytes(std::span(mip.pixels)));
+  }
 
-  ProcessedMeshes result;
+  spdlog::info(
+    "SceneManager: decoded {} textures in {:.2f} ms",
+    decoded.size(),
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
 
-  // Pre-allocate enough memory so as not to hit the
-  // allocator on the memcpy hotpath
+void SceneManager::countDraws(PendingScene& scene)
+{
+  // Culling shaders emit a draw per relem or per meshlet of the selected LOD,
+  // so every instance needs room for the LOD with the most of them
+  scene.relemDrawCapacity32 = 0;
+  scene.relemDrawCapacity16 = 0;
+  scene.meshletDrawCapacity32 = 0;
+  scene.meshletDrawCapacity16 = 0;
+  for (auto meshIdx : scene.instanceMeshes)
   {
-    std::size_t vertexBytes = 0;
-    std::size_t indexBytes = 0;
-    for (const auto& bufView : model.bufferViews)
+    const auto& mesh = scene.meshes[meshIdx];
+    std::uint32_t mostRelems32 = 0;
+    std::uint32_t mostRelems16 = 0;
+    std::uint32_t mostMeshlets32 = 0;
+    std::uint32_t mostMeshlets16 = 0;
+    for (std::uint32_t lod = 0; lod <= mesh.lodCount; ++lod)
     {
-      switch (bufView.target)
+      const auto firstRelem =
+        lod == 0 ? mesh.firstRelem : scene.lods[mesh.firstLod + lod - 1].firstRelem;
+      const auto relemCount =
+        lod == 0 ? mesh.relemCount : scene.lods[mesh.firstLod + lod - 1].relemCount;
+
+      std::uint32_t relems16 = 0;
+      std::uint32_t meshlets32 = 0;
+      std::uint32_t meshlets16 = 0;
+      for (std::uint32_t j = 0; j < relemCount; ++j)
       {
-      case TINYGLTF_TARGET_ARRAY_BUFFER:
-        vertexBytes += bufView.byteLength;
-        break;
-      case TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER:
-        indexBytes += bufView.byteLength;
-        break;
-      default:
-        break;
+        const auto& relem = scene.relems[firstRelem + j];
+        if (relem.indexFormat == IndexFormat::Uint16)
+        {
+          ++relems16;
+          meshlets16 += relem.meshletCount;
+        }
+        else
+          meshlets32 += relem.meshletCount;
       }
+      mostRelems32 = std::max(mostRelems32, relemCount - relems16);
+      mostRelems16 = std::max(mostRelems16, relems16);
+      mostMeshlets32 = std::max(mostMeshlets32, meshlets32);
+      mostMeshlets16 = std::max(mostMeshlets16, meshlets16);
     }
-    result.vertices.reserve(vertexBytes / sizeof(Vertex));
-    result.indices.reserve(indexBytes / sizeof(std::uint32_t));
+    scene.relemDrawCapacity32 += mostRelems32;
+    scene.relemDrawCapacity16 += mostRelems16;
+    scene.meshletDrawCapacity32 += mostMeshlets32;
+    scene.meshletDrawCapacity16 += mostMeshlets16;
   }
+}
 
-  {
-    std::size_t totalPrimitives = 0;
-    for (const auto& mesh : model.meshes)
-      totalPrimitives += mesh.primitives.size();
-    result.relems.reserve(totalPrimitives);
-  }
+void SceneManager::extractOccluders(PendingScene& scene)
+{
+  ZoneScoped;
 
-  result.meshes.reserve(model.meshes.size());
+  scene.occluders.assign(scene.meshes.size(), Occluder{});
+  if (maxOccluderTriangles == 0)
+    return;
 
-  for (const auto& mesh : model.meshes)
+  const auto readPosition = [&scene](std::size_t vertex) {
+    if (scene.vertexFormat == VertexFormat::Quantized)
+    {
+      QuantizedVertex quantized;
+      std::memcpy(
+        &quantized, scene.vertices.data() + vertex * sizeof(QuantizedVertex), sizeof(quantized));
+      return dequantize_position(quantized);
+    }
+    Vertex packed;
+    std::memcpy(&packed, scene.vertices.data() + vertex * sizeof(Vertex), sizeof(packed));
+    return glm::vec3(packed.positionAndNormal);
+  };
+
+  // LODs reference the vertices of the full detail mesh, only the used ones are copied
+  std::unordered_map<std::uint32_t, std::uint32_t> remap;
+  for (std::size_t i = 0; i < scene.meshes.size(); ++i)
   {
-    result.meshes.push_back(Mesh{
-      .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
-      .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
-    });
+    const auto& mesh = scene.meshes[i];
 
-    for (const auto& prim : mesh.primitives)
+    std::optional<std::uint32_t> chosen;
+    for (std::uint32_t lod = 0; lod <= mesh.lodCount && !chosen.has_value(); ++lod)
     {
-      if (prim.mode != TINYGLTF_MODE_TRIANGLES)
-      {
-        spdlog::warn(
-          "Encountered a non-triangles primitive, these are not supported for now, skipping it!");
-        --result.meshes.back().relemCount;
-        continue;
-      }
-
-      const auto normalIt = prim.attributes.find("NORMAL");
-      const auto tangentIt = prim.attributes.find("TANGENT");
-      const auto texcoordIt = prim.attributes.find("TEXCOORD_0");
-
-      const bool hasNormals = normalIt != prim.attributes.end();
-      const bool hasTangents = tangentIt != prim.attributes.end();
-      const bool hasTexcoord = texcoordIt != prim.attributes.end();
-      std::array accessorIndices{
-        prim.indices,
-        prim.attributes.at("POSITION"),
-        hasNormals ? normalIt->second : -1,
-        hasTangents ? tangentIt->second : -1,
-        hasTexcoord ? texcoordIt->second : -1,
-      };
-
-      std::array accessors{
-        &model.accessors[prim.indices],
-        &model.accessors[accessorIndices[1]],
-        hasNormals ? &model.accessors[accessorIndices[2]] : nullptr,
-        hasTangents ? &model.accessors[accessorIndices[3]] : nullptr,
-        hasTexcoord ? &model.accessors[accessorIndices[4]] : nullptr,
-      };
-
-      std::array bufViews{
-        &model.bufferViews[accessors[0]->bufferView],
-        &model.bufferViews[accessors[1]->bufferView],
-        hasNormals ? &model.bufferViews[accessors[2]->bufferView] : nullptr,
-        hasTangents ? &model.bufferViews[accessors[3]->bufferView] : nullptr,
-        hasTexcoord ? &model.bufferViews[accessors[4]->bufferView] : nullptr,
-      };
-
-      result.relems.push_back(RenderElement{
-        .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
-        .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
-        .indexCount = static_cast<std::uint32_t>(accessors[0]->count),
-      });
-
-      const std::size_t vertexCount = accessors[1]->count;
-
-      std::array ptrs{
-        reinterpret_cast<const std::byte*>(model.buffers[bufViews[0]->buffer].data.data()) +
-          bufViews[0]->byteOffset + accessors[0]->byteOffset,
-        reinterpret_cast<const std::byte*>(model.buffers[bufViews[1]->buffer].data.data()) +
-          bufViews[1]->byteOffset + accessors[1]->byteOffset,
-        hasNormals
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[2]->buffer].data.data()) +
-            bufViews[2]->byteOffset + accessors[2]->byteOffset
-          : nullptr,
-        hasTangents
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[3]->buffer].data.data()) +
-            bufViews[3]->byteOffset + accessors[3]->byteOffset
-          : nullptr,
-        hasTexcoord
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[4]->buffer].data.data()) +
-            bufViews[4]->byteOffset + accessors[4]->byteOffset
-          : nullptr,
-      };
-
-      std::array strides{
-        bufViews[0]->byteStride != 0
-          ? bufViews[0]->byteStride
-          : tinygltf::GetComponentSizeInBytes(accessors[0]->componentType) *
-            tinygltf::GetNumComponentsInType(accessors[0]->type),
-        bufViews[1]->byteStride != 0
-          ? bufViews[1]->byteStride
-          : tinygltf::GetComponentSizeInBytes(accessors[1]->componentType) *
-            tinygltf::GetNumComponentsInType(accessors[1]->type),
-        hasNormals ? (bufViews[2]->byteStride != 0
-                        ? bufViews[2]->byteStride
-                        : tinygltf::GetComponentSizeInBytes(accessors[2]->componentType) *
-                          tinygltf::GetNumComponentsInType(accessors[2]->type))
-                   : 0,
-        hasTangents ? (bufViews[3]->byteStride != 0
-                         ? bufViews[3]->byteStride
-                         : tinygltf::GetComponentSizeInBytes(accessors[3]->componentType) *
-                           tinygltf::GetNumComponentsInType(accessors[3]->type))
-                    : 0,
-        hasTexcoord ? (bufViews[4]->byteStride != 0
-                         ? bufViews[4]->byteStride
-                         : tinygltf::GetComponentSizeInBytes(accessors[4]->componentType) *
-                           tinygltf::GetNumComponentsInType(accessors[4]->type))
-                    : 0,
-      };
-
-      for (std::size_t i = 0; i < vertexCount; ++i)
-      {
-        auto& vtx = result.vertices.emplace_back();
-        glm::vec3 pos;
-        // Fall back to 0 in case we don't have something.
-        // NOTE: if tangents are not available, one could use http://mikktspace.com/
-        // NOTE: if normals are not available, reconstructing them is possible but will look ugly
-        glm::vec3 normal{0};
-        glm::vec3 tangent{0};
-        glm::vec2 texcoord{0};
-        std::memcpy(&pos, ptrs[1], sizeof(pos));
-
-        // NOTE: it's faster to do a template here with specializations for all combinations than to
-        // do ifs at runtime. Also, SIMD should be used. Try implementing this!
-        if (hasNormals)
-          std::memcpy(&normal, ptrs[2], sizeof(normal));
-        if (hasTangents)
-          std::memcpy(&tangent, ptrs[3], sizeof(tangent));
-        if (hasTexcoord)
-          std::memcpy(&texcoord, ptrs[4], sizeof(texcoord));
-
-
-        vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
-        vtx.texCoordAndTangentAndPadding =
-          glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
-
-        ptrs[1] += strides[1];
-        if (hasNormals)
-          ptrs[2] += strides[2];
-        if (hasTangents)
-          ptrs[3] += strides[3];
-        if (hasTexcoord)
-          ptrs[4] += strides[4];
-      }
-
-      // Indices are guaranteed to have no stride
-      ETNA_VERIFY(bufViews[0]->byteStride == 0);
-      const std::size_t indexCount = accessors[0]->count;
-      if (accessors[0]->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
+      if (lod > 0 && scene.lods[mesh.firstLod + lod - 1].error > maxOccluderError)
+        break;
+      const auto firstRelem =
+        lod == 0 ? mesh.firstRelem : scene.lods[mesh.firstLod + lod - 1].firstRelem;
+      const auto relemCount =
+        lod == 0 ? mesh.relemCount : scene.lods[mesh.firstLod + lod - 1].relemCount;
+
+      std::uint64_t triangleCount = 0;
+      for (std::uint32_t j = 0; j < relemCount; ++j)
+        triangleCount += scene.relems[firstRelem + j].indexCount / 3;
+      if (triangleCount <= maxOccluderTriangles)
+        chosen = lod;
+    }
+    if (!chosen.has_value())
+      continue;
+
+    const auto firstRelem =
+      *chosen == 0 ? mesh.firstRelem : scene.lods[mesh.firstLod + *chosen - 1].firstRelem;
+    const auto relemCount =
+      *chosen == 0 ? mesh.relemCount : scene.lods[mesh.firstLod + *chosen - 1].relemCount;
+
+    auto& occluder = scene.occluders[i];
+    occluder.firstVertex = static_cast<std::uint32_t>(scene.occluderVertices.size());
+    occluder.firstIndex = static_cast<std::uint32_t>(scene.occluderIndices.size());
+    remap.clear();
+    for (std::uint32_t j = 0; j < relemCount; ++j)
+    {
+      const auto& relem = scene.relems[firstRelem + j];
+      for (std::uint32_t k = 0; k < relem.indexCount; ++k)
       {
-        for (std::size_t i = 0; i < indexCount; ++i)
+        const std::uint32_t vertex = relem.vertexOffset +
+          (relem.indexFormat == IndexFormat::Uint16 ? scene.indices16[relem.indexOffset + k]
+                                                    : scene.indices[relem.indexOffset + k]);
+        const auto [it, inserted] = remap.try_emplace(vertex, occluder.vertexCount);
+        if (inserted)
         {
-          std::uint16_t index;
-          std::memcpy(&index, ptrs[0], sizeof(index));
-          result.indices.push_back(index);
-          ptrs[0] += 2;
+          scene.occluderVertices.push_back(readPosition(vertex));
+          ++occluder.vertexCount;
         }
-      }
-      else if (accessors[0]->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
-      {
-        const std::size_t lastTotalIndices = result.indices.size();
-        result.indices.resize(lastTotalIndices + indexCount);
-        std::memcpy(
-          result.indices.data() + lastTotalIndices,
-          ptrs[0],
-          sizeof(result.indices[0]) * indexCount);
+        scene.occluderIndices.push_back(it->second);
       }
     }
+    occluder.indexCount =
+      static_cast<std::uint32_t>(scene.occluderIndices.size()) - occluder.firstIndex;
   }
-
-  return result;
 }
 
-void SceneManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+static etna::Buffer create_scene_buffer(
+  vk::DeviceSize size, vk::BufferUsageFlags usage, const char* name)
 {
-  unifiedVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = vertices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+  return etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    // Vulkan doesn't allow empty buffers
+    .size = std::max<vk::DeviceSize>(size, 1),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | usage,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
-    .name = "unifiedVbuf",
+    .name = name,
   });
+}
 
-  unifiedIbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = indices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
-    .name = "unifiedIbuf",
-  });
+// Shaders read mesh bounds as a plain float array
+static_assert(sizeof(Aabb) == 6 * sizeof(float));
 
-  transferHelper.uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
-  transferHelper.uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+void SceneManager::createBuffers(PendingScene& scene)
+{
+  const auto storage = vk::BufferUsageFlagBits::eStorageBuffer;
+
+  scene.buffers = SceneBuffers{
+    .vertices = create_scene_buffer(
+      scene.vertices.size_bytes(), vk::BufferUsageFlagBits::eVertexBuffer, "unifiedVbuf"),
+    // 32-bit region goes first, so both regions are naturally aligned
+    .indices = create_scene_buffer(
+      scene.indices.size_bytes() + scene.indices16.size_bytes(),
+      vk::BufferUsageFlagBits::eIndexBuffer,
+      "unifiedIbuf"),
+    .relems = create_scene_buffer(std::span(scene.relems).size_bytes(), storage, "renderElements"),
+    .meshes = create_scene_buffer(std::span(scene.meshes).size_bytes(), storage, "meshes"),
+    .meshBounds =
+      create_scene_buffer(std::span(scene.meshBounds).size_bytes(), storage, "meshBounds"),
+    .lods = create_scene_buffer(std::span(scene.lods).size_bytes(), storage, "lods"),
+    .meshlets = create_scene_buffer(std::span(scene.meshlets).size_bytes(), storage, "meshlets"),
+    .instanceData =
+      create_scene_buffer(std::span(scene.instanceData).size_bytes(), storage, "instanceData"),
+    .instanceMeshes = create_scene_buffer(
+      std::span(scene.instanceMeshes).size_bytes(), storage, "instanceMeshes"),
+    .drawCommands = create_scene_buffer(
+      (scene.meshletDrawCapacity32 + scene.meshletDrawCapacity16) *
+        sizeof(vk::DrawIndexedIndirectCommand),
+      storage | vk::BufferUsageFlagBits::eIndirectBuffer,
+      "drawCommands"),
+    .instanceLods = create_scene_buffer(
+      scene.instanceMeshes.size() * sizeof(std::uint32_t), storage, "instanceLods"),
+    .relemDrawCommands = create_scene_buffer(
+      (scene.relemDrawCapacity32 + scene.relemDrawCapacity16) *
+        sizeof(vk::DrawIndexedIndirectCommand),
+      storage | vk::BufferUsageFlagBits::eIndirectBuffer,
+      "relemDrawCommands"),
+    .drawCounts = create_scene_buffer(
+      2 * sizeof(std::uint32_t), storage | vk::BufferUsageFlagBits::eIndirectBuffer, "drawCounts"),
+    .textures = {},
+  };
+
+  scene.buffers.textures.resize(scene.textures.size());
+  for (std::size_t i = 0; i < scene.textures.size(); ++i)
+  {
+    if (!scene.textures[i].has_value())
+      continue;
+
+    const auto& texture = *scene.textures[i];
+    scene.buffers.textures[i] = etna::get_context().createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{texture.width, texture.height, 1},
+      .name = texture.name,
+      .format = texture.format,
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+      .mipLevels = static_cast<std::uint32_t>(texture.levels.size()),
+    });
+  }
 }
 
-void SceneManager::selectScene(std::filesystem::path path)
+bool SceneManager::uploadData(PendingScene& scene, std::size_t budget)
 {
-  auto maybeModel = loadModel(path);
-  if (!maybeModel.has_value())
-    return;
+  ZoneScoped;
+
+  struct Region
+  {
+    const etna::Buffer& dst;
+    vk::DeviceSize offset;
+    std::span<const std::byte> src;
+  };
+
+  const std::array regions{
+    Region{scene.buffers.vertices, 0, scene.vertices},
+    Region{scene.buffers.indices, 0, std::as_bytes(scene.indices)},
+    Region{scene.buffers.indices, scene.indices.size_bytes(), std::as_bytes(scene.indices16)},
+    Region{scene.buffers.relems, 0, std::as_bytes(std::span(scene.relems))},
+    Region{scene.buffers.meshes, 0, std::as_bytes(std::span(scene.meshes))},
+    Region{scene.buffers.meshBounds, 0, std::as_bytes(std::span(scene.meshBounds))},
+    Region{scene.buffers.lods, 0, std::as_bytes(std::span(scene.lods))},
+    Region{scene.buffers.meshlets, 0, std::as_bytes(std::span(scene.meshlets))},
+    Region{scene.buffers.instanceData, 0, std::as_bytes(std::span(scene.instanceData))},
+    Region{scene.buffers.instanceMeshes, 0, std::as_bytes(std::span(scene.instanceMeshes))},
+  };
+
+  if (scene.uploadedBytes == 0)
+    scene.uploadStart = std::chrono::steady_clock::now();
+
+  // Regions are uploaded one after another, so progress is a single byte count
+  std::size_t totalBytes = 0;
+  for (const auto& region : regions)
+  {
+    const std::size_t done =
+      std::clamp(scene.uploadedBytes, totalBytes, totalBytes + region.src.size()) - totalBytes;
+    totalBytes += region.src.size();
+
+    const std::size_t size = std::min(budget, region.src.size() - done);
+    if (size == 0)
+      continue;
+    uploader.uploadBuffer(region.dst, region.offset + done, region.src.subspan(done, size));
+    scene.uploadedBytes += size;
+    budget -= size;
+  }
 
-  auto model = std::move(*maybeModel);
+  // Mip levels are uploaded whole, so a large one might overshoot the budget of this frame
+  for (std::size_t i = 0; i < scene.textures.size(); ++i)
+  {
+    if (!scene.textures[i].has_value())
+      continue;
 
+    const auto& texture = *scene.textures[i];
+    for (std::uint32_t level = 0; level < texture.levels.size(); ++level)
+    {
+      const auto src = texture.levels[level];
+      const bool done = scene.uploadedBytes >= totalBytes + src.size();
+      totalBytes += src.size();
+      if (done || budget == 0)
+        continue;
+
+      uploader.uploadImage(
+        scene.buffers.textures[i],
+        level,
+        vk::Extent2D{std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u)},
+        texture.blockExtent,
+        src);
+      scene.uploadedBytes += src.size();
+      budget -= std::min(budget, src.size());
+    }
+  }
+
+  // Let the GPU start on this frame's portion right away
+  uploader.flush();
+
+  if (scene.uploadedBytes != totalBytes)
+    return false;
+
+  if (!uploader.isIdle())
+    return false;
+
+  {
+    const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - scene.uploadStart).count();
+    spdlog::info(
+      "SceneManager: uploaded {:.1f} MiB of geometry and textures in {:.2f} ms ({:.1f} MB/s)",
+      static_cast<double>(totalBytes) / (1 << 20),
+      seconds * 1000.0,
+      seconds > 0 ? static_cast<double>(totalBytes) / seconds / 1e6 : 0.0);
+  }
+
+  return true;
+}
+
+void SceneManager::swapIn(PendingScene&& scene)
+{
   // By aggregating all SceneManager fields mutations here,
   // we guarantee that we don't forget to clear something
   // when re-loading a scene.
 
-  // NOTE: you might want to store these on the GPU for GPU-driven rendering.
-  auto [instMats, instMeshes] = processInstances(model);
-  instanceMatrices = std::move(instMats);
-  instanceMeshes = std::move(instMeshes);
+  if (buffers.vertices.get())
+    retiredBuffers.push_back(RetiredBuffers{
+      .buffers = std::move(buffers),
+      .framesLeft = framesInFlight,
+    });
 
-  auto [verts, inds, relems, meshs] = processMeshes(model);
+  instanceMatrices = std::move(scene.instanceMatrices);
+  instanceMeshes = std::move(scene.instanceMeshes);
+  instanceData = std::move(scene.instanceData);
+  instanceNodes = std::move(scene.instanceNodes);
+  hierarchy = std::move(scene.hierarchy);
+
+  // Instances follow the hierarchy order, so the instances of a node range are contiguous
+  nodeInstanceOffsets.assign(hierarchy.size() + 1, 0);
+  for (auto node : instanceNodes)
+    ++nodeInstanceOffsets[node + 1];
+  std::partial_sum(
+    nodeInstanceOffsets.begin(), nodeInstanceOffsets.end(), nodeInstanceOffsets.begin());
+
+  renderElements = std::move(scene.relems);
+  relemBounds = std::move(scene.relemBounds);
+  meshes = std::move(scene.meshes);
+  lods = std::move(scene.lods);
+  meshlets = std::move(scene.meshlets);
+  relemDrawCapacity32 = scene.relemDrawCapacity32;
+  relemDrawCapacity16 = scene.relemDrawCapacity16;
+  meshletDrawCapacity32 = scene.meshletDrawCapacity32;
+  meshletDrawCapacity16 = scene.meshletDrawCapacity16;
+  textureUsages = std::move(scene.textureUsages);
+  occluders = std::move(scene.occluders);
+  occluderVertices = std::move(scene.occluderVertices);
+  occluderIndices = std::move(scene.occluderIndices);
+
+  meshBounds = std::move(scene.meshBounds);
+  instanceBounds = std::move(scene.instanceBounds);
+  bvh = std::move(scene.bvh);
+  movedInstances.clear();
+
+  buffers = std::move(scene.buffers);
+  index16Offset = scene.indices.size_bytes();
+  vertexFormat = scene.vertexFormat;
+
+  spdlog::info("SceneManager: switched to scene '{}'", scene.path);
+}
 
-  renderElements = std::move(relems);
-  meshes = std::move(meshs);
+void SceneManager::selectScene(std::filesystem::path path)
+{
+  finishLoading(prepareScene(std::move(path)));
+}
 
-  uploadData(verts, inds);
+void SceneManager::selectBakedScene(std::filesystem::path path)
+{
+  finishLoading(prepareBakedScene(std::move(path)));
 }
 
-etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription()
+void SceneManager::finishLoading(std::optional<PendingScene> scene)
 {
+  if (!scene.has_value())
+    return;
+
+  createBuffers(*scene);
+  while (!uploadData(*scene, std::numeric_limits<std::size_t>::max()))
+    uploader.wait();
+  swapIn(std::move(*scene));
+}
+
+void SceneManager::startLoading(std::filesystem::path path, bool baked)
+{
+  loadingScene = std::async(std::launch::async, [this, path = std::move(path), baked]() mutable {
+    return baked ? prepareBakedScene(std::move(path)) : prepareScene(std::move(path));
+  });
+}
+
+void SceneManager::requestScene(std::filesystem::path path, bool baked)
+{
+  // We can't cancel a load in progress, so the request waits for it to finish
+  if (loadingScene.valid())
+  {
+    queuedScene = QueuedScene{.path = std::move(path), .baked = baked};
+    return;
+  }
+
+  // The GPU might still be copying into the buffers of the scene being uploaded
+  if (uploadingScene.has_value())
+  {
+    uploader.wait();
+    uploadingScene.reset();
+  }
+  startLoading(std::move(path), baked);
+}
+
+void SceneManager::selectSceneAsync(std::filesystem::path path)
+{
+  requestScene(std::move(path), false);
+}
+
+void SceneManager::selectBakedSceneAsync(std::filesystem::path path)
+{
+  requestScene(std::move(path), true);
+}
+
+void SceneManager::update()
+{
+  ZoneScoped;
+
+  // A frame that could have used these buffers was recorded before the last swap.
+  // Acquiring a command buffer for a new frame waits for the frame that used the
+  // same command buffer `framesInFlight` frames ago, so after `framesInFlight`
+  // updates (each one followed by such an acquire), the GPU is done with them.
+  std::erase_if(retiredBuffers, [](RetiredBuffers& retired) { return --retired.framesLeft == 0; });
+
+  if (
+    loadingScene.valid() &&
+    loadingScene.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+  {
+    auto scene = loadingScene.get();
+
+    if (queuedScene.has_value())
+    {
+      // Somebody wants a different scene already, no point in uploading this one
+      startLoading(std::move(queuedScene->path), queuedScene->baked);
+      queuedScene.reset();
+    }
+    else if (scene.has_value())
+    {
+      createBuffers(*scene);
+      uploadingScene = std::move(scene);
+    }
+  }
+
+  if (uploadingScene.has_value() && uploadData(*uploadingScene, uploadBudgetPerFrame))
+  {
+    swapIn(std::move(*uploadingScene));
+    uploadingScene.reset();
+  }
+
+  updateTransforms();
+}
+
+void SceneManager::updateTransforms()
+{
+  movedInstances.clear();
+
+  if (!hierarchy.hasChanges())
+    return;
+
+  ZoneScoped;
+
+  const auto changed = hierarchy.update();
+  const auto worldMatrices = hierarchy.getWorldMatrices();
+
+  std::size_t uploadedInstances = 0;
+  for (const auto& range : changed)
+  {
+    const std::uint32_t first = nodeInstanceOffsets[range.first];
+    const std::uint32_t end = nodeInstanceOffsets[range.first + range.count];
+    if (first == end)
+      continue;
+
+    Aabb swept{
+      .min = glm::vec3(std::numeric_limits<float>::max()),
+      .max = glm::vec3(std::numeric_limits<float>::lowest()),
+    };
+    const auto sweep = [&](std::uint32_t i) {
+      if (instanceBounds.extentX[i] < 0)
+        return;
+      const auto box = get_box(instanceBounds, i);
+      swept.min = glm::min(swept.min, box.min);
+      swept.max = glm::max(swept.max, box.max);
+    };
+
+    for (std::uint32_t i = first; i < end; ++i)
+    {
+      sweep(i);
+      instanceMatrices[i] = worldMatrices[instanceNodes[i]];
+      instanceBounds.set(i, meshBounds[instanceMeshes[i]], instanceMatrices[i]);
+      sweep(i);
+    }
+
+    movedInstances.push_back(MovedInstances{
+      .firstInstance = first,
+      .instanceCount = end - first,
+      .sweptBounds = swept,
+    });
+
+    const auto count = end - first;
+    pack_instances(
+      std::span(instanceMatrices).subspan(first, count),
+      std::span(instanceMeshes).subspan(first, count),
+      std::span(instanceData).subspan(first, count));
+    uploader.updateBuffer(
+      buffers.instanceData,
+      first * sizeof(InstanceData),
+      std::as_bytes(std::span(instanceData).subspan(first, count)));
+    uploadedInstances += count;
+  }
+
+  if (uploadedInstances > 0)
+    bvh.refit(instanceBounds);
+
+  // Has to land before this frame is submitted
+  uploader.flush();
+
+  spdlog::debug(
+    "SceneManager: {} changed node ranges, repacked and uploaded {} instances",
+    changed.size(),
+    uploadedInstances);
+}
+
+std::optional<SceneManager::RayHit> SceneManager::raycast(
+  glm::vec3 origin, glm::vec3 direction, float max_distance)
+{
+  // The ray is moved into the space of the instance, where distances along it stay the same
+  const auto hitRelems = [&](std::uint32_t instance, float max_dist) -> std::optional<RayHit> {
+    const glm::mat4x4 toLocal = glm::inverse(instanceMatrices[instance]);
+    const glm::vec3 localOrigin = glm::vec3(toLocal * glm::vec4(origin, 1.0f));
+    const glm::vec3 localInvDirection = 1.0f / glm::vec3(toLocal * glm::vec4(direction, 0.0f));
+
+    std::optional<RayHit> best;
+    const auto& mesh = meshes[instanceMeshes[instance]];
+    for (std::uint32_t i = mesh.firstRelem; i < mesh.firstRelem + mesh.relemCount; ++i)
+    {
+      const auto distance =
+        intersect_ray_box(localOrigin, localInvDirection, relemBounds[i], max_dist);
+      if (!distance.has_value())
+        continue;
+      max_dist = *distance;
+      best = RayHit{.instance = instance, .relem = i, .distance = *distance};
+    }
+    return best;
+  };
+
+  const auto hit = bvh.raycast(
+    SceneBvh::Ray{.origin = origin, .direction = direction, .maxDistance = max_distance},
+    [&hitRelems](std::uint32_t instance, float max_dist) -> std::optional<float> {
+      const auto relemHit = hitRelems(instance, max_dist);
+      return relemHit.has_value() ? std::optional{relemHit->distance} : std::nullopt;
+    });
+  if (!hit.has_value())
+    return std::nullopt;
+
+  return hitRelems(hit->primitive, hit->distance);
+}
+
+std::uint32_t SceneManager::getRelemDrawCapacity(IndexFormat format)
+{
+  return format == IndexFormat::Uint16 ? relemDrawCapacity16 : relemDrawCapacity32;
+}
+
+std::uint32_t SceneManager::getMeshletDrawCapacity(IndexFormat format)
+{
+  return format == IndexFormat::Uint16 ? meshletDrawCapacity16 : meshletDrawCapacity32;
+}
+
+vk::DeviceSize SceneManager::getIndexBufferOffset(IndexFormat format)
+{
+  return format == IndexFormat::Uint16 ? index16Offset : 0;
+}
+
+vk::IndexType SceneManager::getVkIndexType(IndexFormat format)
+{
+  return format == IndexFormat::Uint16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+}
+
+etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription(
+  VertexFormat format)
+{
+  if (format == VertexFormat::Quantized)
+    return etna::VertexByteStreamFormatDescription{
+      .stride = sizeof(QuantizedVertex),
+      .attributes = {
+        etna::VertexByteStreamFormatDescription::Attribute{
+          .format = vk::Format::eR16G16B16A16Snorm,
+          .offset = offsetof(QuantizedVertex, position),
+        },
+        etna::VertexByteStreamFormatDescription::Attribute{
+          .format = vk::Format::eR8G8B8A8Snorm,
+          .offset = offsetof(QuantizedVertex, normalAndTangent),
+        },
+        etna::VertexByteStreamFormatDescription::Attribute{
+          .format = vk::Format::eR16G16Sfloat,
+          .offset = offsetof(QuantizedVertex, texCoord),
+        },
+      }};
+
   return etna::VertexByteStreamFormatDescription{
     .stride = sizeof(Vertex),
     .attributes = {
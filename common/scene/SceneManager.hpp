@@ -1,98 +1,372 @@
 #pragma once
 
 #include <filesystem>
+#include <future>
+#include <chrono>
 
 #include <glm/glm.hpp>
-#include <tiny_gltf.h>
 #include <etna/Buffer.hpp>
-#include <etna/BlockingTransferHelper.hpp>
+#include <etna/Image.hpp>
 #include <etna/VertexInput.hpp>
 
+#include "utils/MappedFile.hpp"
+#include "render_utils/RingStagingUploader.hpp"
+#include "GltfLoader.hpp"
+#include "SceneData.hpp"
+#include "VertexRepacking.hpp"
+#include "VertexQuantization.hpp"
+#include "TransformHierarchy.hpp"
+#include "FrustumCulling.hpp"
+#include "SceneBvh.hpp"
+#include "BakedScene.hpp"
+#include "Ktx2.hpp"
 
-// A single render element (relem) corresponds to a single draw call
-// of a certain pipeline with specific bindings (including material data)
-struct RenderElement
-{
-  std::uint32_t vertexOffset;
-  std::uint32_t indexOffset;
-  std::uint32_t indexCount;
-  // Not implemented!
-  // Material* material;
-};
-
-// A mesh is a collection of relems. A scene may have the same mesh
-// located in several different places, so a scene consists of **instances**,
-// not meshes.
-struct Mesh
-{
-  std::uint32_t firstRelem;
-  std::uint32_t relemCount;
-};
 
 class SceneManager
 {
 public:
+  using Vertex = PackedVertex;
+
+  struct CreateInfo
+  {
+    // Amount of additional threads used for converting loaded models into our format.
+    // With 0 worker threads, everything is done serially on the thread that loads the scene.
+    std::uint32_t workerThreadCount = 0;
+    // Optimize index and vertex order of loaded glTF scenes for rendering. Takes some
+    // time, so it is better done offline by the baker, but is handy for raw glTF scenes.
+    bool optimizeMeshes = false;
+    // Generate simplified LODs of meshes of loaded glTF scenes. Same as above, better
+    // done by the baker, as it takes a while.
+    bool generateLods = false;
+    // Must match the amount of frames in flight of the renderer, as resources of
+    // a replaced scene are only destroyed when no frame in flight can use them.
+    std::uint32_t framesInFlight = 2;
+    // Amount of geometry and texture data uploaded per frame when loading a scene asynchronously.
+    std::size_t uploadBudgetPerFrame = 8 * 1024 * 1024;
+    // Decode the images of glTF scenes used by materials and upload them as RGBA8
+    // textures. Decoding is done in parallel with one job per image.
+    bool loadTextures = true;
+    // Size of the staging ring used for uploading geometry and textures to the GPU
+    vk::DeviceSize stagingSize = 64 * 1024 * 1024;
+    // Lays this many copies of every loaded scene out on a grid, for stress testing.
+    // Copies don't have a node hierarchy, so all instances of such scenes are static.
+    std::uint32_t sceneCopies = 1;
+    // Meshes keep a copy of the positions and indices of their finest LOD with at most
+    // this many triangles and an error within the limit on the CPU, which is meant for
+    // software occlusion culling. With 0, no geometry is kept.
+    std::uint32_t maxOccluderTriangles = 0;
+    // Simplified LODs may stick out of the original surface and wrongly hide whatever is
+    // right behind it, so by default only the full detail meshes are used as occluders.
+    float maxOccluderError = 0.0f;
+  };
+
   SceneManager();
+  explicit SceneManager(CreateInfo info);
 
+  // Loads the scene and blocks until it's ready for rendering.
   void selectScene(std::filesystem::path path);
 
+  // Loads and processes the scene on a separate thread and streams the data to
+  // the GPU over several frames, the current scene keeps being rendered meanwhile.
+  // The new scene replaces the current one inside of `update` once it's fully uploaded.
+  // If another scene is requested while this one is still loading, the latest request wins.
+  void selectSceneAsync(std::filesystem::path path);
+
+  // Same as the above, but for scenes produced by the model baker. The file is mapped
+  // into memory and uploaded as is, no processing whatsoever is done on the CPU.
+  void selectBakedScene(std::filesystem::path path);
+  void selectBakedSceneAsync(std::filesystem::path path);
+
+  // Must be called exactly once per frame before rendering, as this is the
+  // only place where the scene being rendered changes.
+  void update();
+
   // Every instance is a mesh drawn with a certain transform
   // NOTE: maybe you can pass some additional data through unused matrix entries?
   std::span<const glm::mat4x4> getInstanceMatrices() { return instanceMatrices; }
   std::span<const std::uint32_t> getInstanceMeshes() { return instanceMeshes; }
+  // Same as the above packed together for shaders, see InstanceData
+  std::span<const InstanceData> getInstanceData() { return instanceData; }
+
+  // Node hierarchy of the current glTF scene. Baked scenes only keep the final instance
+  // matrices, so their hierarchy is empty. Changing the local transform of a node moves
+  // the instances of its whole subtree during the next `update`, which only recomputes
+  // and uploads the instances that have actually changed.
+  TransformHierarchy& getHierarchy() { return hierarchy; }
+  // Hierarchy node of every instance
+  std::span<const std::uint32_t> getInstanceNodes() { return instanceNodes; }
 
   // Every mesh is a collection of relems
   std::span<const Mesh> getMeshes() { return meshes; }
 
+  // Meshes might have several levels of detail, see MeshLod
+  std::span<const MeshLod> getLods() { return lods; }
+
   // Every relem is a single draw call
   std::span<const RenderElement> getRenderElements() { return renderElements; }
 
-  vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
-  vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
+  // Bounds in the space of the vertex data, i.e. before the instance transform
+  std::span<const Aabb> getRenderElementBounds() { return relemBounds; }
+  // Bounds of the full detail relems of a mesh, LODs are always within them
+  std::span<const Aabb> getMeshBounds() { return meshBounds; }
+  // World space bounds of every instance, kept up to date with the hierarchy
+  const BoxesSoa& getInstanceBounds() { return instanceBounds; }
+  // Hierarchy over the instance bounds, built when a scene is loaded and refit
+  // whenever instances move. Primitives of the BVH are instance indices.
+  const SceneBvh& getBvh() { return bvh; }
+
+  struct MovedInstances
+  {
+    std::uint32_t firstInstance;
+    std::uint32_t instanceCount;
+    // Encloses the bounds of all of the instances both before and after the move
+    Aabb sweptBounds;
+  };
+
+  // Ranges of instances moved by the last `update`, for renderers that cache
+  // something derived from them and need to find out what became stale.
+  std::span<const MovedInstances> getMovedInstances() { return movedInstances; }
 
-  etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  // Geometry of a mesh kept on the CPU, see CreateInfo::maxOccluderTriangles.
+  // Meshes without any LOD simple enough have no indices.
+  struct Occluder
+  {
+    std::uint32_t firstVertex;
+    std::uint32_t vertexCount;
+    std::uint32_t firstIndex;
+    std::uint32_t indexCount;
+  };
 
-private:
-  std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
+  // One per mesh. Positions are in the space of the vertex data, i.e. they have to be
+  // transformed by instance matrices, and indices are relative to the first vertex.
+  std::span<const Occluder> getMeshOccluders() { return occluders; }
+  std::span<const glm::vec3> getOccluderVertices() { return occluderVertices; }
+  std::span<const std::uint32_t> getOccluderIndices() { return occluderIndices; }
 
-  struct ProcessedInstances
+  struct RayHit
   {
-    std::vector<glm::mat4x4> matrices;
-    std::vector<std::uint32_t> meshes;
+    std::uint32_t instance;
+    std::uint32_t relem;
+    float distance;
   };
 
-  ProcessedInstances processInstances(const tinygltf::Model& model) const;
+  // Closest full detail relem of any instance hit by the ray, for picking and such.
+  // Geometry only lives on the GPU, so relems are hit by their bounds, which are
+  // intersected in the space of the instance and not in world space.
+  std::optional<RayHit> raycast(
+    glm::vec3 origin,
+    glm::vec3 direction,
+    float max_distance = std::numeric_limits<float>::infinity());
 
-  struct Vertex
+  // Every relem is split into meshlets that can be culled separately
+  std::span<const Meshlet> getMeshlets() { return meshlets; }
+
+  vk::Buffer getVertexBuffer() { return buffers.vertices.get(); }
+  vk::Buffer getIndexBuffer() { return buffers.indices.get(); }
+
+  // The index buffer consists of a 32-bit and a 16-bit region, a relem must be drawn
+  // with the index buffer bound at the offset of the region of its index format.
+  vk::DeviceSize getIndexBufferOffset(IndexFormat format);
+  static vk::IndexType getVkIndexType(IndexFormat format);
+
+  // Storage buffers with copies of the above tables for shaders
+  const etna::Buffer& getRenderElementBuffer() { return buffers.relems; }
+  const etna::Buffer& getMeshBuffer() { return buffers.meshes; }
+  // Same as getMeshBounds, 6 floats per mesh: the min corner followed by the max one
+  const etna::Buffer& getMeshBoundsBuffer() { return buffers.meshBounds; }
+  const etna::Buffer& getLodBuffer() { return buffers.lods; }
+  const etna::Buffer& getInstanceMeshBuffer() { return buffers.instanceMeshes; }
+  const etna::Buffer& getMeshletBuffer() { return buffers.meshlets; }
+  // Kept up to date with the hierarchy just like the instance matrices
+  const etna::Buffer& getInstanceDataBuffer() { return buffers.instanceData; }
+  // Room for a vk::DrawIndexedIndirectCommand per meshlet of every instance, counting the
+  // largest LOD of each, not initialized. Commands of meshlets of relems with 32-bit indices
+  // take the first getMeshletDrawCapacity(Uint32) slots. Lives as long as the scene,
+  // so that renderers don't have to track scene changes.
+  const etna::Buffer& getDrawCommandBuffer() { return buffers.drawCommands; }
+  // Room for a LOD index per instance, not initialized either
+  const etna::Buffer& getInstanceLodBuffer() { return buffers.instanceLods; }
+  // Room for a vk::DrawIndexedIndirectCommand per relem of every instance, in case all of
+  // them are visible. Commands of relems with 32-bit indices take the first
+  // getRelemDrawCapacity(Uint32) slots, the ones of 16-bit relems come after them.
+  const etna::Buffer& getRelemDrawCommandBuffer() { return buffers.relemDrawCommands; }
+  // Two 32-bit counts of commands in either of the buffers above, one per index format
+  const etna::Buffer& getDrawCountBuffer() { return buffers.drawCounts; }
+  // Largest amount of relem draws of an index format, counting the largest LOD of every instance
+  std::uint32_t getRelemDrawCapacity(IndexFormat format);
+  // Same for meshlet draws
+  std::uint32_t getMeshletDrawCapacity(IndexFormat format);
+
+  // Textures with full mip chains, indexed the same way as glTF images. Block compressed
+  // for baked scenes and RGBA8 for glTF ones. Images that aren't used by materials are null.
+  // All of them are in the shader read-only layout.
+  std::span<const etna::Image> getTextures() { return buffers.textures; }
+  std::span<const TextureUsage> getTextureUsages() { return textureUsages; }
+
+  // Format of the vertex buffer of the current scene. Baked scenes might be quantized,
+  // so renderers should be ready to render both formats.
+  VertexFormat getVertexFormat() { return vertexFormat; }
+
+  static etna::VertexByteStreamFormatDescription getVertexFormatDescription(
+    VertexFormat format = VertexFormat::Full);
+
+private:
+  // Everything that lives on the GPU, replaced as a whole together with the scene
+  struct SceneBuffers
   {
-    // First 3 floats are position, 4th float is a packed normal
-    glm::vec4 positionAndNormal;
-    // First 2 floats are tex coords, 3rd is a packed tangent, 4th is padding
-    glm::vec4 texCoordAndTangentAndPadding;
+    etna::Buffer vertices;
+    etna::Buffer indices;
+    etna::Buffer relems;
+    etna::Buffer meshes;
+    etna::Buffer meshBounds;
+    etna::Buffer lods;
+    etna::Buffer meshlets;
+    etna::Buffer instanceData;
+    etna::Buffer instanceMeshes;
+    etna::Buffer drawCommands;
+    etna::Buffer instanceLods;
+    etna::Buffer relemDrawCommands;
+    etna::Buffer drawCounts;
+    std::vector<etna::Image> textures;
   };
 
-  static_assert(sizeof(Vertex) == sizeof(float) * 8);
+  // Either a KTX2 texture of a baked scene, uploaded straight from the mapped
+  // file, or a texture of a glTF scene decoded and mipped on the CPU
+  struct PendingTexture
+  {
+    std::string name;
+    vk::Format format;
+    std::uint32_t width;
+    std::uint32_t height;
+    // Side of a texel block, 4 for block compressed formats and 1 otherwise
+    std::uint32_t blockExtent;
+    // From the full resolution level down
+    std::vector<std::span<const std::byte>> levels;
+    std::optional<MappedFile> file{};
+    std::vector<TextureImage> mips{};
+  };
 
-  struct ProcessedMeshes
+  // A scene that was loaded but is not rendered yet
+  struct PendingScene
   {
-    std::vector<Vertex> vertices;
-    std::vector<std::uint32_t> indices;
-    std::vector<RenderElement> relems;
-    std::vector<Mesh> meshes;
+    std::filesystem::path path{};
+
+    std::vector<glm::mat4x4> instanceMatrices{};
+    std::vector<std::uint32_t> instanceMeshes{};
+    std::vector<InstanceData> instanceData{};
+    std::vector<std::uint32_t> instanceNodes{};
+    TransformHierarchy hierarchy{};
+    std::vector<RenderElement> relems{};
+    std::vector<Aabb> relemBounds{};
+    std::vector<Aabb> meshBounds{};
+    BoxesSoa instanceBounds{};
+    SceneBvh bvh{};
+    std::vector<Mesh> meshes{};
+    std::vector<MeshLod> lods{};
+    std::vector<Meshlet> meshlets{};
+    std::uint32_t relemDrawCapacity32 = 0;
+    std::uint32_t relemDrawCapacity16 = 0;
+    std::uint32_t meshletDrawCapacity32 = 0;
+    std::uint32_t meshletDrawCapacity16 = 0;
+    std::vector<Occluder> occluders{};
+    std::vector<glm::vec3> occluderVertices{};
+    std::vector<std::uint32_t> occluderIndices{};
+
+    // Geometry to be uploaded. Points either into the processed
+    // glTF data or into the memory-mapped baked scene.
+    VertexFormat vertexFormat = VertexFormat::Full;
+    std::span<const std::byte> vertices{};
+    std::span<const std::uint32_t> indices{};
+    std::span<const std::uint16_t> indices16{};
+    std::vector<Vertex> vertexStorage{};
+    std::vector<std::uint32_t> indexStorage{};
+    std::vector<std::uint16_t> index16Storage{};
+    std::optional<MappedFile> mappedFile{};
+
+    std::vector<std::optional<PendingTexture>> textures{};
+    std::vector<TextureUsage> textureUsages{};
+
+    SceneBuffers buffers{};
+    // Counted across all buffers, see uploadData
+    std::size_t uploadedBytes = 0;
+    std::chrono::steady_clock::time_point uploadStart{};
   };
-  ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t>);
+
+  std::optional<PendingScene> prepareScene(std::filesystem::path path);
+  std::optional<PendingScene> prepareBakedScene(std::filesystem::path path);
+  void startLoading(std::filesystem::path path, bool baked);
+  void requestScene(std::filesystem::path path, bool baked);
+  void finishLoading(std::optional<PendingScene> scene);
+  static void countDraws(PendingScene& scene);
+  void extractOccluders(PendingScene& scene);
+  static void replicateInstances(PendingScene& scene, std::uint32_t copies);
+  void computeBounds(PendingScene& scene);
+  static void packInstances(PendingScene& scene);
+  static void mapTextures(
+    PendingScene& scene, const BakedSceneView& baked, const std::filesystem::path& directory);
+  void decodeTextures(PendingScene& scene, const GltfLoader::LoadedModel& loaded);
+  void createBuffers(PendingScene& scene);
+  // Returns true when everything was uploaded and the copies have finished on the GPU
+  bool uploadData(PendingScene& scene, std::size_t budget);
+  void swapIn(PendingScene&& scene);
+  void updateTransforms();
 
 private:
-  tinygltf::TinyGLTF loader;
-  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
-  etna::BlockingTransferHelper transferHelper;
+  GltfLoader loader;
+  RingStagingUploader uploader;
 
   std::vector<RenderElement> renderElements;
+  std::vector<Aabb> relemBounds;
+  std::vector<Aabb> meshBounds;
+  BoxesSoa instanceBounds;
+  SceneBvh bvh;
+  std::vector<MovedInstances> movedInstances;
   std::vector<Mesh> meshes;
+  std::vector<MeshLod> lods;
   std::vector<glm::mat4x4> instanceMatrices;
   std::vector<std::uint32_t> instanceMeshes;
+  std::vector<InstanceData> instanceData;
+  std::vector<std::uint32_t> instanceNodes;
+  TransformHierarchy hierarchy;
+  // Instances of the nodes [a, b) are [nodeInstanceOffsets[a], nodeInstanceOffsets[b])
+  std::vector<std::uint32_t> nodeInstanceOffsets;
+  std::vector<Meshlet> meshlets;
+  std::uint32_t relemDrawCapacity32 = 0;
+  std::uint32_t relemDrawCapacity16 = 0;
+  std::uint32_t meshletDrawCapacity32 = 0;
+  std::uint32_t meshletDrawCapacity16 = 0;
+  std::vector<Occluder> occluders;
+  std::vector<glm::vec3> occluderVertices;
+  std::vector<std::uint32_t> occluderIndices;
+  std::vector<TextureUsage> textureUsages;
+
+  SceneBuffers buffers;
+  vk::DeviceSize index16Offset = 0;
+  VertexFormat vertexFormat = VertexFormat::Full;
 
-  etna::Buffer unifiedVbuf;
-  etna::Buffer unifiedIbuf;
+  // Buffers of replaced scenes that might still be used by frames in flight
+  struct RetiredBuffers
+  {
+    SceneBuffers buffers;
+    std::uint32_t framesLeft;
+  };
+  std::vector<RetiredBuffers> retiredBuffers;
+  bool optimizeMeshes;
+  bool generateLods;
+  bool loadTextures;
+  std::uint32_t sceneCopies;
+  std::uint32_t maxOccluderTriangles;
+  float maxOccluderError;
+  std::uint32_t framesInFlight;
+  std::size_t uploadBudgetPerFrame;
+
+  struct QueuedScene
+  {
+    std::filesystem::path path;
+    bool baked;
+  };
+  std::optional<QueuedScene> queuedScene;
+  std::optional<PendingScene> uploadingScene;
+  // Declared last so that it's destroyed (and waited upon) before anything it uses
+  std::future<std::optional<PendingScene>> loadingScene;
 };
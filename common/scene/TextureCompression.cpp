@@ -0,0 +1,625 @@
+#include "TextureCompression.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <glm/glm.hpp>
+#include <etna/Assert.hpp>
+
+
+static bool is_srgb_usage(TextureUsage usage)
+{
+  return usage == TextureUsage::Albedo || usage == TextureUsage::Emissive;
+}
+
+vk::Format choose_texture_format(TextureUsage usage, const TextureImage& image)
+{
+  switch (usage)
+  {
+  case TextureUsage::Albedo: {
+    bool opaque = true;
+    for (std::size_t i = 3; i < image.pixels.size() && opaque; i += 4)
+      opaque = image.pixels[i] == 255;
+    return opaque ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eBc3SrgbBlock;
+  }
+  case TextureUsage::Normal:
+    return vk::Format::eBc5UnormBlock;
+  case TextureUsage::MetallicRoughness:
+    return vk::Format::eBc7UnormBlock;
+  case TextureUsage::Occlusion:
+    return vk::Format::eBc4UnormBlock;
+  case TextureUsage::Emissive:
+    return vk::Format::eBc1RgbSrgbBlock;
+  }
+  ETNA_PANIC("Unknown texture usage {}", static_cast<std::uint32_t>(usage));
+}
+
+vk::Format choose_uncompressed_texture_format(TextureUsage usage)
+{
+  return usage == TextureUsage::Albedo || usage == TextureUsage::Emissive
+    ? vk::Format::eR8G8B8A8Srgb
+    : vk::Format::eR8G8B8A8Unorm;
+}
+
+static float srgb_to_linear(float value)
+{
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float value)
+{
+  return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static std::uint8_t to_unorm8(float value)
+{
+  return static_cast<std::uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Texels of the source image that overlap every texel of the destination one along an axis
+struct FilterTaps
+{
+  // Taps of destination texel i are [offsets[i], offsets[i + 1])
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> sources;
+  std::vector<float> weights;
+};
+
+static FilterTaps box_filter_taps(std::uint32_t src_size, std::uint32_t dst_size)
+{
+  FilterTaps result;
+  result.offsets.push_back(0);
+
+  const double scale = static_cast<double>(src_size) / dst_size;
+  for (std::uint32_t dst = 0; dst < dst_size; ++dst)
+  {
+    const double begin = dst * scale;
+    const double end = (dst + 1) * scale;
+    for (auto src = static_cast<std::uint32_t>(begin); src < end && src < src_size; ++src)
+    {
+      const double overlap = std::min<double>(end, src + 1) - std::max<double>(begin, src);
+      if (overlap <= 0)
+        continue;
+      result.sources.push_back(src);
+      result.weights.push_back(static_cast<float>(overlap / scale));
+    }
+    result.offsets.push_back(static_cast<std::uint32_t>(result.sources.size()));
+  }
+
+  return result;
+}
+
+static std::vector<glm::vec4> downsample(
+  std::span<const glm::vec4> src,
+  std::uint32_t width,
+  std::uint32_t height,
+  std::uint32_t new_width,
+  std::uint32_t new_height)
+{
+  const auto horizontal = box_filter_taps(width, new_width);
+  const auto vertical = box_filter_taps(height, new_height);
+
+  // The box filter is separable, so rows go first and columns second
+  std::vector<glm::vec4> rows(std::size_t{new_width} * height, glm::vec4(0));
+  for (std::uint32_t y = 0; y < height; ++y)
+    for (std::uint32_t x = 0; x < new_width; ++x)
+      for (auto i = horizontal.offsets[x]; i < horizontal.offsets[x + 1]; ++i)
+        rows[y * new_width + x] +=
+          src[y * width + horizontal.sources[i]] * horizontal.weights[i];
+
+  std::vector<glm::vec4> result(std::size_t{new_width} * new_height, glm::vec4(0));
+  for (std::uint32_t y = 0; y < new_height; ++y)
+    for (auto i = vertical.offsets[y]; i < vertical.offsets[y + 1]; ++i)
+      for (std::uint32_t x = 0; x < new_width; ++x)
+        result[y * new_width + x] +=
+          rows[vertical.sources[i] * new_width + x] * vertical.weights[i];
+
+  return result;
+}
+
+std::vector<TextureImage> generate_mip_chain(const TextureImage& image, TextureUsage usage)
+{
+  std::vector<TextureImage> result{image};
+
+  const bool srgb = is_srgb_usage(usage);
+  const bool normal = usage == TextureUsage::Normal;
+
+  std::array<float, 256> srgbToLinear;
+  for (std::size_t i = 0; i < srgbToLinear.size(); ++i)
+    srgbToLinear[i] = srgb_to_linear(static_cast<float>(i) / 255.0f);
+
+  // Filtering happens in linear space, and with normals in [-1, 1]
+  std::vector<glm::vec4> current(std::size_t{image.width} * image.height);
+  for (std::size_t i = 0; i < current.size(); ++i)
+  {
+    const std::uint8_t* p = &image.pixels[i * 4];
+    glm::vec4 texel{p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f, p[3] / 255.0f};
+    if (srgb)
+      texel = glm::vec4(srgbToLinear[p[0]], srgbToLinear[p[1]], srgbToLinear[p[2]], texel.w);
+    else if (normal)
+      texel = glm::vec4(glm::vec3(texel) * 2.0f - glm::vec3(1.0f), texel.w);
+    current[i] = texel;
+  }
+
+  std::uint32_t width = image.width;
+  std::uint32_t height = image.height;
+  while (width > 1 || height > 1)
+  {
+    const std::uint32_t newWidth = std::max(width / 2, 1u);
+    const std::uint32_t newHeight = std::max(height / 2, 1u);
+    current = downsample(current, width, height, newWidth, newHeight);
+    width = newWidth;
+    height = newHeight;
+
+    TextureImage level{.width = width, .height = height, .pixels = {}};
+    level.pixels.resize(current.size() * 4);
+    for (std::size_t i = 0; i < current.size(); ++i)
+    {
+      glm::vec4 texel = current[i];
+      if (srgb)
+      {
+        texel = glm::vec4(
+          linear_to_srgb(texel.x), linear_to_srgb(texel.y), linear_to_srgb(texel.z), texel.w);
+      }
+      else if (normal)
+      {
+        // Averaged normals get shorter, which would make the lighting darker
+        glm::vec3 n{texel};
+        if (const float length = glm::length(n); length > 0)
+          n /= length;
+        texel = glm::vec4(n * 0.5f + glm::vec3(0.5f), texel.w);
+      }
+      for (std::size_t c = 0; c < 4; ++c)
+        level.pixels[i * 4 + c] = to_unorm8(texel[static_cast<glm::length_t>(c)]);
+    }
+    result.push_back(std::move(level));
+  }
+
+  return result;
+}
+
+std::size_t get_block_size(vk::Format format)
+{
+  switch (format)
+  {
+  case vk::Format::eBc1RgbSrgbBlock:
+  case vk::Format::eBc1RgbUnormBlock:
+  case vk::Format::eBc4UnormBlock:
+    return 8;
+  case vk::Format::eBc3SrgbBlock:
+  case vk::Format::eBc3UnormBlock:
+  case vk::Format::eBc5UnormBlock:
+  case vk::Format::eBc7SrgbBlock:
+  case vk::Format::eBc7UnormBlock:
+    return 16;
+  default:
+    ETNA_PANIC("Unsupported block compression format {}", vk::to_string(format));
+  }
+}
+
+std::size_t get_compressed_size(vk::Format format, std::uint32_t width, std::uint32_t height)
+{
+  return std::size_t{(width + 3) / 4} * ((height + 3) / 4) * get_block_size(format);
+}
+
+// 16 texels of a 4x4 block with channels in [0, 255]
+using Block = std::array<glm::vec4, 16>;
+
+static float squared_distance(glm::vec4 a, glm::vec4 b)
+{
+  return glm::dot(a - b, a - b);
+}
+
+// Endpoints of the line that fits the texels best, found through the principal
+// component of their covariance. Both endpoints are inset a bit, as extremes
+// are usually outliers and there's more precision to gain closer to the middle.
+static void find_principal_endpoints(const Block& block, glm::vec4& e0, glm::vec4& e1)
+{
+  glm::vec4 mean{0};
+  for (const auto& texel : block)
+    mean += texel;
+  mean /= 16.0f;
+
+  std::array<std::array<float, 4>, 4> covariance{};
+  for (const auto& texel : block)
+  {
+    const glm::vec4 d = texel - mean;
+    for (glm::length_t i = 0; i < 4; ++i)
+      for (glm::length_t j = 0; j < 4; ++j)
+        covariance[i][j] += d[i] * d[j];
+  }
+
+  // Power iteration converges quickly enough for 4x4 matrices
+  glm::vec4 axis{1, 1, 1, 1};
+  for (int iteration = 0; iteration < 8; ++iteration)
+  {
+    glm::vec4 next{0};
+    for (glm::length_t i = 0; i < 4; ++i)
+      for (glm::length_t j = 0; j < 4; ++j)
+        next[i] += covariance[i][j] * axis[j];
+    const float length = glm::length(next);
+    if (length < 1e-6f)
+      break;
+    axis = next / length;
+  }
+
+  float minT = 0;
+  float maxT = 0;
+  for (const auto& texel : block)
+  {
+    const float t = glm::dot(texel - mean, axis);
+    minT = std::min(minT, t);
+    maxT = std::max(maxT, t);
+  }
+
+  const float inset = (maxT - minT) / 32.0f;
+  e0 = mean + axis * (minT + inset);
+  e1 = mean + axis * (maxT - inset);
+}
+
+// Least squares endpoints for texels that were assigned interpolation weights
+// (0 is e0, 1 is e1). Returns false if the weights don't determine the endpoints.
+static bool fit_endpoints(
+  const Block& block, const std::array<float, 16>& weights, glm::vec4& e0, glm::vec4& e1)
+{
+  float aa = 0;
+  float ab = 0;
+  float bb = 0;
+  glm::vec4 ap{0};
+  glm::vec4 bp{0};
+  for (std::size_t i = 0; i < 16; ++i)
+  {
+    const float a = 1.0f - weights[i];
+    const float b = weights[i];
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    ap += block[i] * a;
+    bp += block[i] * b;
+  }
+
+  const float det = aa * bb - ab * ab;
+  if (std::abs(det) < 1e-6f)
+    return false;
+
+  e0 = (ap * bb - bp * ab) / det;
+  e1 = (bp * aa - ap * ab) / det;
+  return true;
+}
+
+template <std::size_t N>
+static std::uint32_t nearest_index(glm::vec4 texel, const std::array<glm::vec4, N>& palette)
+{
+  std::uint32_t best = 0;
+  float bestDistance = squared_distance(texel, palette[0]);
+  for (std::uint32_t i = 1; i < N; ++i)
+    if (const float distance = squared_distance(texel, palette[i]); distance < bestDistance)
+    {
+      best = i;
+      bestDistance = distance;
+    }
+  return best;
+}
+
+static std::uint16_t pack_565(glm::vec4 color)
+{
+  const auto channel = [](float value, float max) {
+    return static_cast<std::uint16_t>(std::clamp(value / 255.0f * max + 0.5f, 0.0f, max));
+  };
+  return static_cast<std::uint16_t>(
+    (channel(color.x, 31) << 11) | (channel(color.y, 63) << 5) | channel(color.z, 31));
+}
+
+static glm::vec4 unpack_565(std::uint16_t packed)
+{
+  const std::uint32_t r = (packed >> 11) & 31;
+  const std::uint32_t g = (packed >> 5) & 63;
+  const std::uint32_t b = packed & 31;
+  return glm::vec4((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 0);
+}
+
+struct Bc1Encoding
+{
+  std::uint16_t color0;
+  std::uint16_t color1;
+  std::uint32_t indices;
+  float error;
+};
+
+static Bc1Encoding encode_bc1_endpoints(const Block& block, glm::vec4 e0, glm::vec4 e1)
+{
+  Bc1Encoding result{pack_565(e0), pack_565(e1), 0, 0};
+
+  // The 4 color mode requires color0 > color1, while equal colors mean a solid block
+  if (result.color0 < result.color1)
+    std::swap(result.color0, result.color1);
+  if (result.color0 == result.color1)
+  {
+    for (const auto& texel : block)
+      result.error += squared_distance(texel, unpack_565(result.color0));
+    return result;
+  }
+
+  const glm::vec4 c0 = unpack_565(result.color0);
+  const glm::vec4 c1 = unpack_565(result.color1);
+  const std::array palette{c0, c1, (c0 * 2.0f + c1) / 3.0f, (c0 + c1 * 2.0f) / 3.0f};
+  for (std::size_t i = 0; i < 16; ++i)
+  {
+    const auto index = nearest_index(block[i], palette);
+    result.indices |= index << (2 * i);
+    result.error += squared_distance(block[i], palette[index]);
+  }
+  return result;
+}
+
+static void encode_bc1(Block block, std::byte* out)
+{
+  // Alpha is not stored, so it must not affect the fit either
+  for (auto& texel : block)
+    texel.w = 0;
+
+  glm::vec4 e0;
+  glm::vec4 e1;
+  find_principal_endpoints(block, e0, e1);
+  Bc1Encoding best = encode_bc1_endpoints(block, e0, e1);
+
+  // Refit the endpoints to the chosen indices, which reduces the error most of the time
+  static constexpr std::array<float, 4> WEIGHTS{0, 1, 1.0f / 3.0f, 2.0f / 3.0f};
+  std::array<float, 16> weights;
+  for (std::size_t i = 0; i < 16; ++i)
+    weights[i] = WEIGHTS[(best.indices >> (2 * i)) & 3];
+  if (best.color0 != best.color1 && fit_endpoints(block, weights, e0, e1))
+    if (auto refined = encode_bc1_endpoints(block, e0, e1); refined.error < best.error)
+      best = refined;
+
+  std::memcpy(out + 0, &best.color0, 2);
+  std::memcpy(out + 2, &best.color1, 2);
+  std::memcpy(out + 4, &best.indices, 4);
+}
+
+// Encodes a single channel, which is the same for BC4, BC5 and alpha of BC3
+static void encode_bc4(const Block& block, glm::length_t channel, std::byte* out)
+{
+  float minValue = 255;
+  float maxValue = 0;
+  for (const auto& texel : block)
+  {
+    minValue = std::min(minValue, texel[channel]);
+    maxValue = std::max(maxValue, texel[channel]);
+  }
+
+  // The 8 value mode requires a0 > a1
+  const auto a0 = static_cast<std::uint8_t>(maxValue + 0.5f);
+  const auto a1 = static_cast<std::uint8_t>(minValue + 0.5f);
+
+  std::uint64_t indices = 0;
+  if (a0 != a1)
+  {
+    std::array<float, 8> palette{static_cast<float>(a0), static_cast<float>(a1)};
+    for (std::size_t i = 1; i < 7; ++i)
+      palette[i + 1] = static_cast<float>((7 - i) * a0 + i * a1) / 7.0f;
+
+    for (std::size_t i = 0; i < 16; ++i)
+    {
+      std::uint64_t best = 0;
+      for (std::uint64_t j = 1; j < 8; ++j)
+        if (std::abs(block[i][channel] - palette[j]) < std::abs(block[i][channel] - palette[best]))
+          best = j;
+      indices |= best << (3 * i);
+    }
+  }
+
+  out[0] = std::byte{a0};
+  out[1] = std::byte{a1};
+  for (std::size_t i = 0; i < 6; ++i)
+    out[2 + i] = static_cast<std::byte>((indices >> (8 * i)) & 0xFF);
+}
+
+// Writes fields into a block starting from the least significant bit
+class BlockBitWriter
+{
+public:
+  explicit BlockBitWriter(std::byte* out)
+    : out{out}
+  {
+    std::memset(out, 0, 16);
+  }
+
+  void write(std::uint32_t value, std::uint32_t bit_count)
+  {
+    for (std::uint32_t i = 0; i < bit_count; ++i, ++position)
+      if ((value >> i) & 1)
+        out[position / 8] |= static_cast<std::byte>(1u << (position % 8));
+  }
+
+private:
+  std::byte* out;
+  std::uint32_t position = 0;
+};
+
+struct Bc7Mode6Encoding
+{
+  // 7 bit RGBA per endpoint along with a shared lowest bit
+  std::array<std::array<std::uint32_t, 4>, 2> endpoints;
+  std::array<std::uint32_t, 2> pbits;
+  std::array<std::uint32_t, 16> indices;
+  float error;
+};
+
+static constexpr std::array<std::uint32_t, 16> BC7_WEIGHTS4{
+  0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+static Bc7Mode6Encoding encode_bc7_endpoints(const Block& block, glm::vec4 e0, glm::vec4 e1)
+{
+  Bc7Mode6Encoding result{};
+
+  // Both p-bit values are tried for every endpoint
+  std::array<glm::vec4, 2> unquantized{e0, e1};
+  std::array<glm::vec4, 2> quantized;
+  for (std::size_t e = 0; e < 2; ++e)
+  {
+    float bestError = std::numeric_limits<float>::max();
+    for (std::uint32_t p = 0; p < 2; ++p)
+    {
+      std::array<std::uint32_t, 4> q;
+      glm::vec4 value;
+      for (glm::length_t c = 0; c < 4; ++c)
+      {
+        const float v = (unquantized[e][c] - static_cast<float>(p)) / 2.0f;
+        q[c] = static_cast<std::uint32_t>(std::clamp(v + 0.5f, 0.0f, 127.0f));
+        value[c] = static_cast<float>((q[c] << 1) | p);
+      }
+      if (const float error = squared_distance(value, unquantized[e]); error < bestError)
+      {
+        bestError = error;
+        result.endpoints[e] = q;
+        result.pbits[e] = p;
+        quantized[e] = value;
+      }
+    }
+  }
+
+  std::array<glm::vec4, 16> palette;
+  for (std::size_t i = 0; i < 16; ++i)
+    for (glm::length_t c = 0; c < 4; ++c)
+    {
+      const auto a = static_cast<std::uint32_t>(quantized[0][c]);
+      const auto b = static_cast<std::uint32_t>(quantized[1][c]);
+      palette[i][c] =
+        static_cast<float>(((64 - BC7_WEIGHTS4[i]) * a + BC7_WEIGHTS4[i] * b + 32) >> 6);
+    }
+
+  for (std::size_t i = 0; i < 16; ++i)
+  {
+    result.indices[i] = nearest_index(block[i], palette);
+    result.error += squared_distance(block[i], palette[result.indices[i]]);
+  }
+  return result;
+}
+
+// Mode 6 only: a single subset with 7777.1 endpoints and 4-bit indices. It handles
+// unrelated channels way better than BC1 while being simple, which is the point here.
+static void encode_bc7(const Block& block, std::byte* out)
+{
+  glm::vec4 e0;
+  glm::vec4 e1;
+  find_principal_endpoints(block, e0, e1);
+  Bc7Mode6Encoding best = encode_bc7_endpoints(block, e0, e1);
+
+  std::array<float, 16> weights;
+  for (std::size_t i = 0; i < 16; ++i)
+    weights[i] = static_cast<float>(BC7_WEIGHTS4[best.indices[i]]) / 64.0f;
+  if (fit_endpoints(block, weights, e0, e1))
+    if (auto refined = encode_bc7_endpoints(block, e0, e1); refined.error < best.error)
+      best = refined;
+
+  // The highest bit of the first index is implicitly 0, so flip the block if it's not
+  if (best.indices[0] >= 8)
+  {
+    std::swap(best.endpoints[0], best.endpoints[1]);
+    std::swap(best.pbits[0], best.pbits[1]);
+    for (auto& index : best.indices)
+      index = 15 - index;
+  }
+
+  BlockBitWriter writer(out);
+  writer.write(1u << 6, 7);
+  for (std::size_t c = 0; c < 4; ++c)
+    for (std::size_t e = 0; e < 2; ++e)
+      writer.write(best.endpoints[e][c], 7);
+  writer.write(best.pbits[0], 1);
+  writer.write(best.pbits[1], 1);
+  writer.write(best.indices[0], 3);
+  for (std::size_t i = 1; i < 16; ++i)
+    writer.write(best.indices[i], 4);
+}
+
+static Block load_block(const TextureImage& image, std::uint32_t block_x, std::uint32_t block_y)
+{
+  // Texels outside of the image repeat the edge ones, which doesn't affect the fit much
+  Block result;
+  for (std::uint32_t y = 0; y < 4; ++y)
+    for (std::uint32_t x = 0; x < 4; ++x)
+    {
+      const std::uint32_t srcX = std::min(block_x * 4 + x, image.width - 1);
+      const std::uint32_t srcY = std::min(block_y * 4 + y, image.height - 1);
+      const std::uint8_t* p = &image.pixels[(std::size_t{srcY} * image.width + srcX) * 4];
+      result[y * 4 + x] = glm::vec4(p[0], p[1], p[2], p[3]);
+    }
+  return result;
+}
+
+static void compress_block(const Block& block, vk::Format format, std::byte* out)
+{
+  switch (format)
+  {
+  case vk::Format::eBc1RgbSrgbBlock:
+  case vk::Format::eBc1RgbUnormBlock:
+    encode_bc1(block, out);
+    break;
+  case vk::Format::eBc3SrgbBlock:
+  case vk::Format::eBc3UnormBlock:
+    encode_bc4(block, 3, out);
+    encode_bc1(block, out + 8);
+    break;
+  case vk::Format::eBc4UnormBlock:
+    encode_bc4(block, 0, out);
+    break;
+  case vk::Format::eBc5UnormBlock:
+    encode_bc4(block, 0, out);
+    encode_bc4(block, 1, out + 8);
+    break;
+  case vk::Format::eBc7SrgbBlock:
+  case vk::Format::eBc7UnormBlock:
+    encode_bc7(block, out);
+    break;
+  default:
+    ETNA_PANIC("Unsupported block compression format {}", vk::to_string(format));
+  }
+}
+
+void compress_image(
+  const TextureImage& image, vk::Format format, std::span<std::byte> out, ThreadPool* workers)
+{
+  const std::size_t blockSize = get_block_size(format);
+  const std::uint32_t blocksX = (image.width + 3) / 4;
+  const std::uint32_t blocksY = (image.height + 3) / 4;
+  ETNA_VERIFY(out.size() == std::size_t{blocksX} * blocksY * blockSize);
+
+  const auto compressRow = [&](std::size_t block_y) {
+    for (std::uint32_t blockX = 0; blockX < blocksX; ++blockX)
+      compress_block(
+        load_block(image, blockX, static_cast<std::uint32_t>(block_y)),
+        format,
+        out.data() + (block_y * blocksX + blockX) * blockSize);
+  };
+
+  if (workers == nullptr)
+    for (std::size_t y = 0; y < blocksY; ++y)
+      compressRow(y);
+  else
+    workers->parallelFor(blocksY, compressRow);
+}
+
+CompressedTexture compress_texture(
+  const TextureImage& image, TextureUsage usage, ThreadPool* workers)
+{
+  CompressedTexture result{
+    .format = choose_texture_format(usage, image),
+    .width = image.width,
+    .height = image.height,
+    .levels = {},
+  };
+
+  for (const auto& level : generate_mip_chain(image, usage))
+  {
+    auto& data = result.levels.emplace_back(
+      get_compressed_size(result.format, level.width, level.height));
+    compress_image(level, result.format, data, workers);
+  }
+
+  return result;
+}
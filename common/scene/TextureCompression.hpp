@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+#include "utils/ThreadPool.hpp"
+
+
+// What a texture is used for by materials, which determines how it's filtered and compressed
+enum class TextureUsage : std::uint32_t
+{
+  // sRGB color, possibly with alpha
+  Albedo,
+  // Tangent space normals, only XY are kept and Z has to be reconstructed
+  Normal,
+  // Linear data with unrelated channels, roughness in G and metalness in B
+  MetallicRoughness,
+  // Linear data in R
+  Occlusion,
+  // sRGB color without alpha
+  Emissive,
+};
+
+// An uncompressed image with 8-bit RGBA pixels in tightly packed rows
+struct TextureImage
+{
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  std::vector<std::uint8_t> pixels;
+};
+
+struct CompressedTexture
+{
+  vk::Format format = vk::Format::eUndefined;
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  // Block data of every mip level, from the full resolution one down to 1x1
+  std::vector<std::vector<std::byte>> levels;
+};
+
+// Picks a block compression format depending on the usage: BC1 for opaque color,
+// BC3 for color with alpha, BC5 for normals, BC4 for occlusion and BC7 for
+// metallic-roughness, as BC1 can't keep unrelated channels apart well enough.
+vk::Format choose_texture_format(TextureUsage usage, const TextureImage& image);
+
+// RGBA8 format for textures that are used as is, with sRGB decoding for colors
+vk::Format choose_uncompressed_texture_format(TextureUsage usage);
+
+// Generates the whole mip chain down to 1x1, starting with a copy of the image itself.
+// Color is averaged in linear space and normals are renormalized after averaging.
+// Odd sizes are handled by averaging over the exact footprint of every texel,
+// so no source texels are ever skipped.
+std::vector<TextureImage> generate_mip_chain(const TextureImage& image, TextureUsage usage);
+
+// Size of a single 4x4 block in bytes for one of the formats above
+std::size_t get_block_size(vk::Format format);
+std::size_t get_compressed_size(vk::Format format, std::uint32_t width, std::uint32_t height);
+
+// Compresses a single image into `out`, which must be get_compressed_size bytes large.
+// Rows of blocks are distributed between the workers, if there are any.
+void compress_image(
+  const TextureImage& image, vk::Format format, std::span<std::byte> out, ThreadPool* workers);
+
+// Generates mips and compresses all of them into the format chosen for the usage
+CompressedTexture compress_texture(
+  const TextureImage& image, TextureUsage usage, ThreadPool* workers);
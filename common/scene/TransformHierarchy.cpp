@@ -0,0 +1,174 @@
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+
+#include <etna/Assert.hpp>
+#include <tracy/Tracy.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_TRANSFORM_SSE2 1
+#endif
+
+
+TransformHierarchy::TransformHierarchy(
+  std::vector<std::uint32_t> node_parents, std::span<const LocalTransform> locals)
+  : parents{std::move(node_parents)}
+  , subtreeSizes(parents.size(), 1)
+  , worldMatrices(parents.size())
+  , dirty(parents.size(), 0)
+{
+  ETNA_VERIFY(parents.size() == locals.size());
+  ETNA_VERIFY(parents.size() < NO_PARENT);
+
+  const auto count = static_cast<std::uint32_t>(parents.size());
+
+  // Children come after parents, so walking backwards accumulates whole subtrees
+  for (std::uint32_t i = count; i-- > 0;)
+    if (parents[i] != NO_PARENT)
+    {
+      ETNA_VERIFY(parents[i] < i);
+      subtreeSizes[parents[i]] += subtreeSizes[i];
+    }
+
+  // Preorder means that every node lies within the subtree range of its parent
+  for (std::uint32_t i = 0; i < count; ++i)
+    if (parents[i] != NO_PARENT)
+      ETNA_VERIFY(i < parents[i] + subtreeSizes[parents[i]]);
+
+  translations.reserve(count);
+  rotations.reserve(count);
+  scales.reserve(count);
+  for (const auto& local : locals)
+  {
+    translations.push_back(local.translation);
+    rotations.push_back(local.rotation);
+    scales.push_back(local.scale);
+  }
+
+  recompute(0, count);
+}
+
+TransformHierarchy::LocalTransform TransformHierarchy::getLocal(std::uint32_t node) const
+{
+  return LocalTransform{
+    .translation = translations[node],
+    .rotation = rotations[node],
+    .scale = scales[node],
+  };
+}
+
+void TransformHierarchy::markDirty(std::uint32_t node)
+{
+  if (dirty[node] != 0)
+    return;
+  dirty[node] = 1;
+  dirtyNodes.push_back(node);
+}
+
+void TransformHierarchy::setLocal(std::uint32_t node, const LocalTransform& local)
+{
+  translations[node] = local.translation;
+  rotations[node] = local.rotation;
+  scales[node] = local.scale;
+  markDirty(node);
+}
+
+void TransformHierarchy::setTranslation(std::uint32_t node, glm::vec3 translation)
+{
+  translations[node] = translation;
+  markDirty(node);
+}
+
+void TransformHierarchy::setRotation(std::uint32_t node, glm::quat rotation)
+{
+  rotations[node] = rotation;
+  markDirty(node);
+}
+
+void TransformHierarchy::setScale(std::uint32_t node, glm::vec3 scale)
+{
+  scales[node] = scale;
+  markDirty(node);
+}
+
+// T * R * S, as glTF wants it
+static glm::mat4x4 compose_transform(glm::vec3 translation, glm::quat rotation, glm::vec3 scale)
+{
+  const float x = rotation.x;
+  const float y = rotation.y;
+  const float z = rotation.z;
+  const float w = rotation.w;
+
+  glm::mat4x4 result;
+  result[0] = glm::vec4(1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y), 0);
+  result[1] = glm::vec4(2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x), 0);
+  result[2] = glm::vec4(2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y), 0);
+  result[0] *= scale.x;
+  result[1] *= scale.y;
+  result[2] *= scale.z;
+  result[3] = glm::vec4(translation, 1);
+  return result;
+}
+
+static void multiply_matrices(const glm::mat4x4& a, const glm::mat4x4& b, glm::mat4x4& out)
+{
+#if defined(SCENE_TRANSFORM_SSE2)
+  // Every column of the result is a combination of the columns of `a`
+  const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+  const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+  const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+  const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+  for (int j = 0; j < 4; ++j)
+  {
+    const __m128 column = _mm_loadu_ps(&b[j][0]);
+    __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0)));
+    r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1))));
+    r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))));
+    r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3))));
+    _mm_storeu_ps(&out[j][0], r);
+  }
+#else
+  out = a * b;
+#endif
+}
+
+void TransformHierarchy::recompute(std::uint32_t first, std::uint32_t end)
+{
+  for (std::uint32_t i = first; i < end; ++i)
+  {
+    const auto local = compose_transform(translations[i], rotations[i], scales[i]);
+    if (parents[i] == NO_PARENT)
+      worldMatrices[i] = local;
+    else
+      multiply_matrices(worldMatrices[parents[i]], local, worldMatrices[i]);
+  }
+}
+
+std::span<const TransformHierarchy::NodeRange> TransformHierarchy::update()
+{
+  ZoneScoped;
+
+  changedRanges.clear();
+  std::ranges::sort(dirtyNodes);
+
+  // Dirty nodes within a subtree that was already recomputed are covered by it
+  std::uint32_t coveredEnd = 0;
+  for (auto node : dirtyNodes)
+  {
+    dirty[node] = 0;
+    if (node < coveredEnd)
+      continue;
+
+    coveredEnd = node + subtreeSizes[node];
+    recompute(node, coveredEnd);
+
+    if (!changedRanges.empty() && changedRanges.back().first + changedRanges.back().count == node)
+      changedRanges.back().count += subtreeSizes[node];
+    else
+      changedRanges.push_back(NodeRange{.first = node, .count = subtreeSizes[node]});
+  }
+  dirtyNodes.clear();
+
+  return changedRanges;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+
+/**
+ * Transforms of a forest of nodes, with world matrices that are only recomputed
+ * where something has changed. Nodes are stored in depth-first preorder, so parents
+ * always come before their children and every subtree is a contiguous range of nodes.
+ * Updating a changed subtree is therefore a single linear pass over it, and the
+ * changed world matrices form a handful of ranges that can be uploaded as they are.
+ * Local transforms are stored as separate translation, rotation and scale arrays.
+ */
+class TransformHierarchy
+{
+public:
+  static constexpr std::uint32_t NO_PARENT = std::numeric_limits<std::uint32_t>::max();
+
+  struct LocalTransform
+  {
+    glm::vec3 translation{0.0f};
+    glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+    glm::vec3 scale{1.0f};
+  };
+
+  // A range of nodes whose world matrices have changed
+  struct NodeRange
+  {
+    std::uint32_t first;
+    std::uint32_t count;
+  };
+
+  TransformHierarchy() = default;
+
+  // Parents must be in depth-first preorder: every node comes right after its parent
+  // or after the last node of the subtree of its previous sibling. All world matrices
+  // are computed right away.
+  TransformHierarchy(std::vector<std::uint32_t> parents, std::span<const LocalTransform> locals);
+
+  std::size_t size() const { return parents.size(); }
+
+  std::uint32_t getParent(std::uint32_t node) const { return parents[node]; }
+  // Including the node itself
+  std::uint32_t getSubtreeSize(std::uint32_t node) const { return subtreeSizes[node]; }
+
+  LocalTransform getLocal(std::uint32_t node) const;
+
+  // These only mark the node as dirty, world matrices are recomputed by `update`
+  void setLocal(std::uint32_t node, const LocalTransform& local);
+  void setTranslation(std::uint32_t node, glm::vec3 translation);
+  void setRotation(std::uint32_t node, glm::quat rotation);
+  void setScale(std::uint32_t node, glm::vec3 scale);
+
+  bool hasChanges() const { return !dirtyNodes.empty(); }
+
+  // Recomputes world matrices of all dirty nodes and of their descendants. Returns the
+  // sorted and disjoint ranges of nodes whose matrices have changed, valid until the
+  // next call. Doesn't touch anything outside of the dirty subtrees.
+  std::span<const NodeRange> update();
+
+  std::span<const glm::mat4x4> getWorldMatrices() const { return worldMatrices; }
+
+private:
+  void markDirty(std::uint32_t node);
+  void recompute(std::uint32_t first, std::uint32_t end);
+
+private:
+  std::vector<std::uint32_t> parents;
+  std::vector<std::uint32_t> subtreeSizes;
+
+  std::vector<glm::vec3> translations;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+
+  std::vector<glm::mat4x4> worldMatrices;
+
+  std::vector<std::uint8_t> dirty;
+  std::vector<std::uint32_t> dirtyNodes;
+  std::vector<NodeRange> changedRanges;
+};
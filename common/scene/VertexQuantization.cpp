@@ -0,0 +1,125 @@
+#include "VertexQuantization.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#include <glm/gtc/packing.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+
+glm::vec2 encode_octahedral(glm::vec3 dir)
+{
+  const float l1 = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+  if (l1 == 0)
+    return {0, 0};
+
+  glm::vec2 result = glm::vec2(dir.x, dir.y) / l1;
+  if (dir.z < 0)
+  {
+    const glm::vec2 folded = glm::vec2(1.0f) - glm::abs(glm::vec2(result.y, result.x));
+    result.x = result.x >= 0 ? folded.x : -folded.x;
+    result.y = result.y >= 0 ? folded.y : -folded.y;
+  }
+  return result;
+}
+
+static std::int8_t quantize_snorm8(float value)
+{
+  return static_cast<std::int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+
+static std::int16_t quantize_snorm16(float value)
+{
+  return static_cast<std::int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+QuantizedGeometry quantize_geometry(
+  std::span<const PackedVertex> vertices,
+  std::span<const std::uint32_t> indices,
+  std::span<const RenderElement> relems,
+  std::span<const Mesh> meshes)
+{
+  QuantizedGeometry result;
+  result.vertices.resize(vertices.size(), QuantizedVertex{});
+  result.dequantization.reserve(meshes.size());
+
+  for (const auto& mesh : meshes)
+  {
+    // Vertices of a mesh are the ones referenced by its relems
+    std::size_t first = std::numeric_limits<std::size_t>::max();
+    std::size_t last = 0;
+    for (std::uint32_t i = mesh.firstRelem; i < mesh.firstRelem + mesh.relemCount; ++i)
+    {
+      const auto& relem = relems[i];
+      const auto relemIndices = indices.subspan(relem.indexOffset, relem.indexCount);
+      if (relemIndices.empty())
+        continue;
+      first = std::min<std::size_t>(first, relem.vertexOffset);
+      last = std::max<std::size_t>(
+        last, relem.vertexOffset + *std::ranges::max_element(relemIndices) + 1);
+    }
+
+    if (first >= last)
+    {
+      result.dequantization.push_back(glm::identity<glm::mat4x4>());
+      continue;
+    }
+
+    const auto meshVertices = vertices.subspan(first, last - first);
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (const auto& vertex : meshVertices)
+    {
+      min = glm::min(min, glm::vec3(vertex.positionAndNormal));
+      max = glm::max(max, glm::vec3(vertex.positionAndNormal));
+    }
+
+    const glm::vec3 center = (min + max) * 0.5f;
+    // The same scale on all axes, otherwise normals would have to be scaled by it too,
+    // which distorts them badly for thin meshes after the 8-bit octahedral encoding.
+    // A single point would make the dequantization matrix non-invertible.
+    const glm::vec3 extent = (max - min) * 0.5f;
+    const float halfExtent = std::max({extent.x, extent.y, extent.z, 1e-6f});
+
+    result.dequantization.push_back(glm::scale(
+      glm::translate(glm::identity<glm::mat4x4>(), center), glm::vec3(halfExtent)));
+
+    for (std::size_t i = 0; i < meshVertices.size(); ++i)
+    {
+      const auto& src = meshVertices[i];
+      auto& dst = result.vertices[first + i];
+
+      const glm::vec3 position = (glm::vec3(src.positionAndNormal) - center) / halfExtent;
+      dst.position[0] = quantize_snorm16(position.x);
+      dst.position[1] = quantize_snorm16(position.y);
+      dst.position[2] = quantize_snorm16(position.z);
+      dst.position[3] = 0;
+
+      const auto normal = decode_normal(std::bit_cast<std::uint32_t>(src.positionAndNormal.w));
+      const auto tangent =
+        decode_normal(std::bit_cast<std::uint32_t>(src.texCoordAndTangentAndPadding.z));
+
+      const auto octNormal = encode_octahedral(normal);
+      const auto octTangent = encode_octahedral(tangent);
+      dst.normalAndTangent[0] = quantize_snorm8(octNormal.x);
+      dst.normalAndTangent[1] = quantize_snorm8(octNormal.y);
+      dst.normalAndTangent[2] = quantize_snorm8(octTangent.x);
+      dst.normalAndTangent[3] = quantize_snorm8(octTangent.y);
+
+      dst.texCoord[0] = glm::packHalf1x16(src.texCoordAndTangentAndPadding.x);
+      dst.texCoord[1] = glm::packHalf1x16(src.texCoordAndTangentAndPadding.y);
+    }
+  }
+
+  return result;
+}
+
+glm::vec3 dequantize_position(const QuantizedVertex& vertex)
+{
+  // Same as the hardware snorm conversion
+  const auto decode = [](std::int16_t value) { return std::max(value / 32767.0f, -1.0f); };
+  return {decode(vertex.position[0]), decode(vertex.position[1]), decode(vertex.position[2])};
+}
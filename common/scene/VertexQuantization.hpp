@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "SceneData.hpp"
+#include "VertexRepacking.hpp"
+
+
+// A compact vertex format in the spirit of KHR_mesh_quantization,
+// half the size of PackedVertex.
+struct QuantizedVertex
+{
+  // snorm16 position inside of the mesh's bounding box, w is padding
+  std::int16_t position[4];
+  // snorm8 octahedral normal (xy) and tangent (zw)
+  std::int8_t normalAndTangent[4];
+  // Half-float tex coords
+  std::uint16_t texCoord[2];
+};
+
+static_assert(sizeof(QuantizedVertex) == 16);
+
+struct QuantizedGeometry
+{
+  std::vector<QuantizedVertex> vertices;
+  // Transforms quantized positions of a mesh back into its local space,
+  // supposed to be folded into the matrices of all instances of the mesh.
+  std::vector<glm::mat4x4> dequantization;
+};
+
+// Positions are quantized relative to the bounding box of their mesh, the longest side of
+// which is mapped onto [-1, 1]. The dequantization transform is a uniform scale, so normals
+// and tangents are stored as they are and still point the right way after being transformed
+// by the inverse transpose of the instance matrix.
+QuantizedGeometry quantize_geometry(
+  std::span<const PackedVertex> vertices,
+  std::span<const std::uint32_t> indices,
+  std::span<const RenderElement> relems,
+  std::span<const Mesh> meshes);
+
+glm::vec2 encode_octahedral(glm::vec3 dir);
+
+// Position as seen by the vertex shader before the dequantization transform
+glm::vec3 dequantize_position(const QuantizedVertex& vertex);
@@ -0,0 +1,349 @@
+#include "VertexRepacking.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCENE_REPACK_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_REPACK_SSE2 1
+#endif
+
+
+std::uint32_t encode_normal(glm::vec3 normal)
+{
+  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
+  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
+
+  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
+  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
+  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
+
+  return sx | sy;
+}
+
+glm::vec3 decode_normal(std::uint32_t data)
+{
+  const std::uint32_t encX = data & 0x0000FFFFu;
+  const std::uint32_t encY = (data & 0xFFFF0000u) >> 16;
+  const float sign = (encX & 0x0001u) != 0 ? -1.0f : 1.0f;
+
+  const auto sx = static_cast<std::int16_t>(encX & 0x0000FFFEu);
+  const auto sy = static_cast<std::int16_t>(encY);
+
+  const float x = static_cast<float>(sx) * (1.0f / 32767.0f);
+  const float y = static_cast<float>(sy) * (1.0f / 32767.0f);
+  const float z = sign * std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+
+  return {x, y, z};
+}
+
+// NOTE: all SIMD versions of the encoding below are bit-exact with encode_normal:
+// cvtt* truncates just like static_cast, and the "not greater or equal" comparison
+// treats NaNs the same way the scalar `z >= 0` does.
+
+#if defined(SCENE_REPACK_AVX2)
+
+static constexpr std::size_t BATCH_SIZE = 8;
+
+static __m256i encode_normals_simd(__m256 x, __m256 y, __m256 z)
+{
+  const __m256 scale = _mm256_set1_ps(32767.0f);
+  const __m256i ix = _mm256_cvttps_epi32(_mm256_mul_ps(x, scale));
+  const __m256i iy = _mm256_cvttps_epi32(_mm256_mul_ps(y, scale));
+  const __m256i sign = _mm256_and_si256(
+    _mm256_castps_si256(_mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_NGE_UQ)),
+    _mm256_set1_epi32(1));
+  const __m256i sx = _mm256_or_si256(_mm256_and_si256(ix, _mm256_set1_epi32(0xfffe)), sign);
+  // (y & 0xffff) << 16 is the same thing as y << 16 for 32 bit integers
+  const __m256i sy = _mm256_slli_epi32(iy, 16);
+  return _mm256_or_si256(sx, sy);
+}
+
+// Gathers work for any stride, so there's no need for a separate packed path here:
+// when the stride is a compile-time constant, the offsets get constant-folded.
+template <std::size_t Components, bool Packed>
+static void encode_normal_batch(const std::byte* src, std::size_t stride, std::uint32_t* out)
+{
+  static_assert(Components == 3 || Components == 4);
+  const std::size_t actualStride = Packed ? Components * sizeof(float) : stride;
+  const __m256i offsets = _mm256_mullo_epi32(
+    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(actualStride)));
+
+  const float* base = reinterpret_cast<const float*>(src);
+  const __m256 x = _mm256_i32gather_ps(base + 0, offsets, 1);
+  const __m256 y = _mm256_i32gather_ps(base + 1, offsets, 1);
+  const __m256 z = _mm256_i32gather_ps(base + 2, offsets, 1);
+
+  _mm256_store_si256(reinterpret_cast<__m256i*>(out), encode_normals_simd(x, y, z));
+}
+
+#elif defined(SCENE_REPACK_SSE2)
+
+static constexpr std::size_t BATCH_SIZE = 4;
+
+static __m128i encode_normals_simd(__m128 x, __m128 y, __m128 z)
+{
+  const __m128 scale = _mm_set1_ps(32767.0f);
+  const __m128i ix = _mm_cvttps_epi32(_mm_mul_ps(x, scale));
+  const __m128i iy = _mm_cvttps_epi32(_mm_mul_ps(y, scale));
+  const __m128i sign =
+    _mm_and_si128(_mm_castps_si128(_mm_cmpnge_ps(z, _mm_setzero_ps())), _mm_set1_epi32(1));
+  const __m128i sx = _mm_or_si128(_mm_and_si128(ix, _mm_set1_epi32(0xfffe)), sign);
+  // (y & 0xffff) << 16 is the same thing as y << 16 for 32 bit integers
+  const __m128i sy = _mm_slli_epi32(iy, 16);
+  return _mm_or_si128(sx, sy);
+}
+
+// Loads exactly 3 floats, never touching memory past them
+static __m128 load_float3(const std::byte* src)
+{
+  const __m128 xy = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(src));
+  const __m128 z = _mm_load_ss(reinterpret_cast<const float*>(src) + 2);
+  return _mm_movelh_ps(xy, z);
+}
+
+template <std::size_t Components, bool Packed>
+static void encode_normal_batch(const std::byte* src, std::size_t stride, std::uint32_t* out)
+{
+  static_assert(Components == 3 || Components == 4);
+
+  __m128 x;
+  __m128 y;
+  __m128 z;
+  if constexpr (Components == 3 && Packed)
+  {
+    // 4 tightly packed float3s are exactly 3 SSE registers:
+    // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+    const float* base = reinterpret_cast<const float*>(src);
+    const __m128 a = _mm_loadu_ps(base + 0);
+    const __m128 b = _mm_loadu_ps(base + 4);
+    const __m128 c = _mm_loadu_ps(base + 8);
+
+    const __m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+    x = _mm_shuffle_ps(a, bc, _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(
+      _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+      _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+      _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(
+      _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+      _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+      _MM_SHUFFLE(2, 0, 2, 0));
+  }
+  else
+  {
+    const std::size_t actualStride = Packed ? Components * sizeof(float) : stride;
+
+    __m128 r0;
+    __m128 r1;
+    __m128 r2;
+    __m128 r3;
+    if constexpr (Components == 4)
+    {
+      r0 = _mm_loadu_ps(reinterpret_cast<const float*>(src + 0 * actualStride));
+      r1 = _mm_loadu_ps(reinterpret_cast<const float*>(src + 1 * actualStride));
+      r2 = _mm_loadu_ps(reinterpret_cast<const float*>(src + 2 * actualStride));
+      r3 = _mm_loadu_ps(reinterpret_cast<const float*>(src + 3 * actualStride));
+    }
+    else
+    {
+      r0 = load_float3(src + 0 * actualStride);
+      r1 = load_float3(src + 1 * actualStride);
+      r2 = load_float3(src + 2 * actualStride);
+      r3 = load_float3(src + 3 * actualStride);
+    }
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    x = r0;
+    y = r1;
+    z = r2;
+  }
+
+  _mm_store_si128(reinterpret_cast<__m128i*>(out), encode_normals_simd(x, y, z));
+}
+
+#else
+
+static constexpr std::size_t BATCH_SIZE = 4;
+
+template <std::size_t Components, bool Packed>
+static void encode_normal_batch(const std::byte* src, std::size_t stride, std::uint32_t* out)
+{
+  const std::size_t actualStride = Packed ? Components * sizeof(float) : stride;
+  for (std::size_t i = 0; i < BATCH_SIZE; ++i)
+  {
+    glm::vec3 normal;
+    std::memcpy(&normal, src + i * actualStride, sizeof(normal));
+    out[i] = encode_normal(normal);
+  }
+}
+
+#endif
+
+template <bool HasTexcoord>
+static void write_vertex(
+  PackedVertex& vtx,
+  const std::byte* position,
+  const std::byte* texcoord,
+  std::uint32_t normal,
+  std::uint32_t tangent)
+{
+  glm::vec3 pos;
+  std::memcpy(&pos, position, sizeof(pos));
+
+  glm::vec2 uv{0};
+  if constexpr (HasTexcoord)
+    std::memcpy(&uv, texcoord, sizeof(uv));
+
+  vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(normal));
+  vtx.texCoordAndTangentAndPadding = glm::vec4(uv, std::bit_cast<float>(tangent), 0);
+}
+
+template <bool HasNormals, bool HasTangents, bool HasTexcoord, bool Packed>
+static void repack_vertices_impl(
+  const VertexAttributeStreams& streams, std::span<PackedVertex> out)
+{
+  // When the streams are tightly packed, strides are compile-time constants
+  const std::size_t positionStride = Packed ? 3 * sizeof(float) : streams.positionStride;
+  const std::size_t normalStride = Packed ? 3 * sizeof(float) : streams.normalStride;
+  const std::size_t tangentStride = Packed ? 4 * sizeof(float) : streams.tangentStride;
+  const std::size_t texcoordStride = Packed ? 2 * sizeof(float) : streams.texcoordStride;
+
+  const std::byte* position = streams.position;
+  const std::byte* normal = streams.normal;
+  const std::byte* tangent = streams.tangent;
+  const std::byte* texcoord = streams.texcoord;
+
+  // Zero vector encodes to 0, which is what we use for missing attributes
+  alignas(32) std::array<std::uint32_t, BATCH_SIZE> normals{};
+  alignas(32) std::array<std::uint32_t, BATCH_SIZE> tangents{};
+
+  std::size_t i = 0;
+  for (; i + BATCH_SIZE <= out.size(); i += BATCH_SIZE)
+  {
+    if constexpr (HasNormals)
+    {
+      encode_normal_batch<3, Packed>(normal, normalStride, normals.data());
+      normal += BATCH_SIZE * normalStride;
+    }
+    if constexpr (HasTangents)
+    {
+      encode_normal_batch<4, Packed>(tangent, tangentStride, tangents.data());
+      tangent += BATCH_SIZE * tangentStride;
+    }
+
+    for (std::size_t k = 0; k < BATCH_SIZE; ++k)
+    {
+      write_vertex<HasTexcoord>(out[i + k], position, texcoord, normals[k], tangents[k]);
+      position += positionStride;
+      if constexpr (HasTexcoord)
+        texcoord += texcoordStride;
+    }
+  }
+
+  // Leftovers that don't fill up a whole batch
+  for (; i < out.size(); ++i)
+  {
+    std::uint32_t packedNormal = 0;
+    std::uint32_t packedTangent = 0;
+    if constexpr (HasNormals)
+    {
+      glm::vec3 value;
+      std::memcpy(&value, normal, sizeof(value));
+      packedNormal = encode_normal(value);
+      normal += normalStride;
+    }
+    if constexpr (HasTangents)
+    {
+      glm::vec3 value;
+      std::memcpy(&value, tangent, sizeof(value));
+      packedTangent = encode_normal(value);
+      tangent += tangentStride;
+    }
+
+    write_vertex<HasTexcoord>(out[i], position, texcoord, packedNormal, packedTangent);
+    position += positionStride;
+    if constexpr (HasTexcoord)
+      texcoord += texcoordStride;
+  }
+}
+
+using RepackFunction = void (*)(const VertexAttributeStreams&, std::span<PackedVertex>);
+
+// Bit 0 -- normals, bit 1 -- tangents, bit 2 -- tex coords, bit 3 -- tightly packed streams
+template <std::size_t... Is>
+static constexpr std::array<RepackFunction, sizeof...(Is)> make_repack_table(
+  std::index_sequence<Is...>)
+{
+  return {
+    &repack_vertices_impl<(Is & 1) != 0, (Is & 2) != 0, (Is & 4) != 0, (Is & 8) != 0>...,
+  };
+}
+
+static constexpr auto REPACK_TABLE = make_repack_table(std::make_index_sequence<16>{});
+
+void repack_vertices(const VertexAttributeStreams& streams, std::span<PackedVertex> out)
+{
+  const bool hasNormals = streams.normal != nullptr;
+  const bool hasTangents = streams.tangent != nullptr;
+  const bool hasTexcoord = streams.texcoord != nullptr;
+
+  const bool packed = streams.positionStride == 3 * sizeof(float) &&
+    (!hasNormals || streams.normalStride == 3 * sizeof(float)) &&
+    (!hasTangents || streams.tangentStride == 4 * sizeof(float)) &&
+    (!hasTexcoord || streams.texcoordStride == 2 * sizeof(float));
+
+  const std::size_t idx = (hasNormals ? 1 : 0) | (hasTangents ? 2 : 0) | (hasTexcoord ? 4 : 0) |
+    (packed ? 8 : 0);
+
+  REPACK_TABLE[idx](streams, out);
+}
+
+void repack_vertices_reference(const VertexAttributeStreams& streams, std::span<PackedVertex> out)
+{
+  const bool hasNormals = streams.normal != nullptr;
+  const bool hasTangents = streams.tangent != nullptr;
+  const bool hasTexcoord = streams.texcoord != nullptr;
+
+  const std::byte* position = streams.position;
+  const std::byte* normalPtr = streams.normal;
+  const std::byte* tangentPtr = streams.tangent;
+  const std::byte* texcoordPtr = streams.texcoord;
+
+  for (auto& vtx : out)
+  {
+    glm::vec3 pos;
+    // Fall back to 0 in case we don't have something.
+    // NOTE: if tangents are not available, one could use http://mikktspace.com/
+    // NOTE: if normals are not available, reconstructing them is possible but will look ugly
+    glm::vec3 normal{0};
+    glm::vec3 tangent{0};
+    glm::vec2 texcoord{0};
+    std::memcpy(&pos, position, sizeof(pos));
+
+    if (hasNormals)
+      std::memcpy(&normal, normalPtr, sizeof(normal));
+    if (hasTangents)
+      std::memcpy(&tangent, tangentPtr, sizeof(tangent));
+    if (hasTexcoord)
+      std::memcpy(&texcoord, texcoordPtr, sizeof(texcoord));
+
+    vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
+    vtx.texCoordAndTangentAndPadding =
+      glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
+
+    position += streams.positionStride;
+    if (hasNormals)
+      normalPtr += streams.normalStride;
+    if (hasTangents)
+      tangentPtr += streams.tangentStride;
+    if (hasTexcoord)
+      texcoordPtr += streams.texcoordStride;
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <glm/glm.hpp>
+
+
+// The format in which vertices are stored on the GPU
+struct PackedVertex
+{
+  // First 3 floats are position, 4th float is a packed normal
+  glm::vec4 positionAndNormal;
+  // First 2 floats are tex coords, 3rd is a packed tangent, 4th is padding
+  glm::vec4 texCoordAndTangentAndPadding;
+};
+
+static_assert(sizeof(PackedVertex) == sizeof(float) * 8);
+
+// Describes where the attributes of a glTF primitive live in memory.
+// Only float attributes are supported: float3 positions and normals,
+// float4 tangents (the w component is ignored) and float2 tex coords.
+// Missing attributes are marked by a nullptr and are filled with zeros.
+struct VertexAttributeStreams
+{
+  const std::byte* position = nullptr;
+  const std::byte* normal = nullptr;
+  const std::byte* tangent = nullptr;
+  const std::byte* texcoord = nullptr;
+
+  std::size_t positionStride = 0;
+  std::size_t normalStride = 0;
+  std::size_t tangentStride = 0;
+  std::size_t texcoordStride = 0;
+};
+
+std::uint32_t encode_normal(glm::vec3 normal);
+// Inverse of the above, mirrors decode_normal from unpack_attributes.glsl
+glm::vec3 decode_normal(std::uint32_t data);
+
+// Converts `out.size()` vertices from the glTF attribute streams into our format.
+// Internally, this dispatches to a version of the conversion loop that is specialized
+// for the exact combination of present attributes and for tightly packed streams,
+// so that no per-vertex branching happens and normals are encoded in SIMD batches.
+void repack_vertices(const VertexAttributeStreams& streams, std::span<PackedVertex> out);
+
+// Reference implementation with per-vertex branching, the specialized paths are checked
+// and benchmarked against it, see benchmarks/VertexRepackingBenchmark.cpp.
+void repack_vertices_reference(const VertexAttributeStreams& streams, std::span<PackedVertex> out);
@@ -0,0 +1,153 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path& path)
+{
+  MappedFile result;
+
+  result.fileHandle = CreateFileW(
+    path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    nullptr,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL,
+    nullptr);
+  if (result.fileHandle == INVALID_HANDLE_VALUE)
+  {
+    result.fileHandle = nullptr;
+    return std::nullopt;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(result.fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    return std::nullopt;
+
+  result.mappingHandle =
+    CreateFileMappingW(result.fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (result.mappingHandle == nullptr)
+    return std::nullopt;
+
+  void* view = MapViewOfFile(result.mappingHandle, FILE_MAP_READ, 0, 0, 0);
+  if (view == nullptr)
+    return std::nullopt;
+
+  result.data = static_cast<const std::byte*>(view);
+  result.size = static_cast<std::size_t>(fileSize.QuadPart);
+
+  return result;
+}
+
+void MappedFile::reset()
+{
+  if (data != nullptr)
+    UnmapViewOfFile(data);
+  if (mappingHandle != nullptr)
+    CloseHandle(mappingHandle);
+  if (fileHandle != nullptr)
+    CloseHandle(fileHandle);
+
+  data = nullptr;
+  size = 0;
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data{std::exchange(other.data, nullptr)}
+  , size{std::exchange(other.size, 0)}
+  , fileHandle{std::exchange(other.fileHandle, nullptr)}
+  , mappingHandle{std::exchange(other.mappingHandle, nullptr)}
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this == &other)
+    return *this;
+
+  reset();
+  data = std::exchange(other.data, nullptr);
+  size = std::exchange(other.size, 0);
+  fileHandle = std::exchange(other.fileHandle, nullptr);
+  mappingHandle = std::exchange(other.mappingHandle, nullptr);
+  return *this;
+}
+
+#else
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path& path)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return std::nullopt;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    close(fd);
+    return std::nullopt;
+  }
+
+  const auto size = static_cast<std::size_t>(st.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // The mapping keeps the file alive on its own
+  close(fd);
+
+  if (mapping == MAP_FAILED)
+    return std::nullopt;
+
+  MappedFile result;
+  result.data = static_cast<const std::byte*>(mapping);
+  result.size = size;
+  return result;
+}
+
+void MappedFile::reset()
+{
+  if (data != nullptr)
+    munmap(const_cast<std::byte*>(data), size); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+
+  data = nullptr;
+  size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data{std::exchange(other.data, nullptr)}
+  , size{std::exchange(other.size, 0)}
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this == &other)
+    return *this;
+
+  reset();
+  data = std::exchange(other.data, nullptr);
+  size = std::exchange(other.size, 0);
+  return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  reset();
+}
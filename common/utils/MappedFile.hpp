@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+
+/**
+ * Read-only memory mapping of a whole file. Pages are only read from the disc
+ * when they are actually touched and are backed by the OS page cache, so nothing
+ * gets copied into our own memory unless we explicitly do so.
+ */
+class MappedFile
+{
+public:
+  // Returns nullopt if the file doesn't exist, is empty or can't be mapped for some other reason.
+  static std::optional<MappedFile> open(const std::filesystem::path& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  ~MappedFile();
+
+  std::span<const std::byte> getData() const { return {data, size}; }
+
+private:
+  MappedFile() = default;
+
+  void reset();
+
+private:
+  const std::byte* data = nullptr;
+  std::size_t size = 0;
+
+#ifdef _WIN32
+  void* fileHandle = nullptr;
+  void* mappingHandle = nullptr;
+#endif
+};
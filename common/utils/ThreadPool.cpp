@@ -0,0 +1,114 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+
+ThreadPool::ThreadPool(std::size_t thread_count)
+{
+  threads.reserve(thread_count);
+  for (std::size_t i = 0; i < thread_count; ++i)
+    threads.emplace_back([this]() { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::unique_lock lock{mutex};
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+
+  for (auto& thread : threads)
+    thread.join();
+}
+
+void ThreadPool::submit(Job job)
+{
+  if (threads.empty())
+  {
+    job();
+    return;
+  }
+
+  {
+    std::unique_lock lock{mutex};
+    jobs.push_back(std::move(job));
+  }
+  jobAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+  while (true)
+  {
+    Job job;
+    {
+      std::unique_lock lock{mutex};
+      jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+      // NOTE: remaining jobs are still drained on shutdown, somebody might be waiting on them
+      if (jobs.empty())
+        return;
+
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
+
+void ThreadPool::parallelFor(std::size_t count, fu2::function_view<void(std::size_t)> func)
+{
+  if (count == 0)
+    return;
+
+  // Helper jobs might get picked up by workers after we've already returned from here,
+  // so the shared state has to outlive this stack frame. Such late helpers won't be able to
+  // claim an index though, so they never touch `func`.
+  struct State
+  {
+    State(fu2::function_view<void(std::size_t)> f, std::size_t c)
+      : func{f}
+      , count{c}
+    {
+    }
+
+    fu2::function_view<void(std::size_t)> func;
+    std::size_t count;
+    std::atomic<std::size_t> nextIndex{0};
+    std::atomic<std::size_t> finished{0};
+    std::mutex mutex;
+    std::condition_variable allFinished;
+  };
+
+  auto state = std::make_shared<State>(func, count);
+
+  const auto work = [](State& st) {
+    while (true)
+    {
+      const std::size_t idx = st.nextIndex.fetch_add(1, std::memory_order_relaxed);
+      if (idx >= st.count)
+        return;
+
+      st.func(idx);
+
+      if (st.finished.fetch_add(1, std::memory_order_acq_rel) + 1 == st.count)
+      {
+        std::unique_lock lock{st.mutex};
+        st.allFinished.notify_all();
+      }
+    }
+  };
+
+  const std::size_t helperCount = std::min(threads.size(), count - 1);
+  for (std::size_t i = 0; i < helperCount; ++i)
+    submit([state, work]() { work(*state); });
+
+  work(*state);
+
+  std::unique_lock lock{state->mutex};
+  state->allFinished.wait(
+    lock, [&state]() { return state->finished.load(std::memory_order_acquire) == state->count; });
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <function2/function2.hpp>
+
+
+/**
+ * A simple pool of worker threads for CPU-heavy tasks like asset processing.
+ * Not a fancy work-stealing job system, just a shared queue.
+ */
+class ThreadPool
+{
+public:
+  using Job = fu2::unique_function<void()>;
+
+  // NOTE: a pool with 0 threads is valid, everything is executed on the calling thread then.
+  explicit ThreadPool(std::size_t thread_count);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  std::size_t getThreadCount() const { return threads.size(); }
+
+  // Enqueues a job to be executed on some worker thread at some point in the future.
+  void submit(Job job);
+
+  // Calls func(i) for every i in [0, count) and blocks until all calls are finished.
+  // The calling thread participates in the work too, so this is safe to call from
+  // inside of jobs. Indices are handed out dynamically, so it's fine for the work
+  // items to be of wildly different sizes.
+  void parallelFor(std::size_t count, fu2::function_view<void(std::size_t)> func);
+
+private:
+  void workerLoop();
+
+private:
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable jobAvailable;
+  std::deque<Job> jobs;
+  bool stopping = false;
+};
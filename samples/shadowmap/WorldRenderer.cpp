@@ -1,5 +1,13 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <thread>
+
+#include <etna/Etna.hpp>
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
@@ -7,9 +15,19 @@
 #include <glm/ext.hpp>
 #include <imgui.h>
 
+#include "scene/SceneBvh.hpp"
+
 
 WorldRenderer::WorldRenderer()
   : sceneMgr{std::make_unique<SceneManager>()}
+  , recordingWorkers{std::make_unique<ThreadPool>(
+      std::max(std::thread::hardware_concurrency(), 1u) - 1)}
+  , recorder{std::make_unique<ParallelCommandRecorder>(ParallelCommandRecorder::CreateInfo{
+      .workers = recordingWorkers.get(),
+      .framesInFlight = FRAMES_IN_FLIGHT,
+      // Static and dynamic casters of every shadow cascade, then forward
+      .passesPerFrame = 2 * SHADOW_CASCADE_COUNT + 1,
+    })}
 {
 }
 
@@ -27,12 +45,23 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
   });
 
   shadowMap = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{2048, 2048, 1},
+    .extent = vk::Extent3D{SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION, 1},
     .name = "shadow_map",
     .format = vk::Format::eD16Unorm,
+    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment |
+      vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+    .layers = SHADOW_CASCADE_COUNT,
+  });
+
+  staticShadowMap = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION, 1},
+    .name = "static_shadow_map",
+    .format = vk::Format::eD16Unorm,
     .imageUsage =
-      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+    .layers = SHADOW_CASCADE_COUNT,
   });
+  cascadeCaches = {};
 
   defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
   constants = ctx.createBuffer(etna::Buffer::CreateInfo{
@@ -60,6 +89,8 @@ void WorldRenderer::loadShaders()
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
+  swapchainFormat = swapchain_format;
+
   quadRenderer = std::make_unique<QuadRenderer>(QuadRenderer::CreateInfo{
     .format = swapchain_format,
     .rect = {{0, 0}, {512, 512}},
@@ -118,40 +149,26 @@ void WorldRenderer::debugInput(const Keyboard& kb)
     drawDebugFSQuad = !drawDebugFSQuad;
 
   if (kb[KeyboardKey::kP] == ButtonState::Falling)
-    lightProps.usePerspectiveM = !lightProps.usePerspectiveM;
+    uniformParams.showCascades = !uniformParams.showCascades;
 }
 
 void WorldRenderer::update(const FramePacket& packet)
 {
   ZoneScoped;
 
+  sceneMgr->update();
+  trackMovedInstances();
+
   // calc camera matrix
-  {
-    const float aspect = float(resolution.x) / float(resolution.y);
-    worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
-  }
+  const float aspect = float(resolution.x) / float(resolution.y);
+  worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
 
-  // calc light matrix
-  {
-    const auto mProj = lightProps.usePerspectiveM
-      ? glm::perspectiveLH_ZO(
-          -glm::radians(packet.shadowCam.fov), 1.0f, 1.0f, lightProps.lightTargetDist * 2.0f)
-      : glm::orthoLH_ZO(
-          +lightProps.radius,
-          -lightProps.radius,
-          +lightProps.radius,
-          -lightProps.radius,
-          0.0f,
-          lightProps.lightTargetDist);
-
-    lightMatrix = mProj * packet.shadowCam.viewTm();
-
-    lightPos = packet.shadowCam.position;
-  }
+  updateCascades(packet.mainCam, packet.shadowCam, aspect);
+  lightPos = packet.shadowCam.position;
 
   // Upload everything to GPU-mapped memory
   {
-    uniformParams.lightMatrix = lightMatrix;
+    std::copy(cascadeMatrices.begin(), cascadeMatrices.end(), uniformParams.cascadeMatrices);
     uniformParams.lightPos = lightPos;
     uniformParams.time = packet.currentTime;
 
@@ -159,60 +176,424 @@ void WorldRenderer::update(const FramePacket& packet)
   }
 }
 
+bool WorldRenderer::isDynamic(std::uint32_t instance) const
+{
+  const auto movedAt = instanceMoveFrames[instance];
+  return movedAt != 0 && frameNumber - movedAt < DYNAMIC_FRAMES;
+}
+
+void WorldRenderer::trackMovedInstances()
+{
+  ++frameNumber;
+  staleRegions.clear();
+
+  if (sceneMgr->getVertexBuffer() != cachedSceneVertexBuffer)
+  {
+    cachedSceneVertexBuffer = sceneMgr->getVertexBuffer();
+    instanceMoveFrames.assign(sceneMgr->getInstanceMeshes().size(), 0);
+    dynamicInstances.clear();
+    for (auto& cache : cascadeCaches)
+      cache.valid = false;
+  }
+
+  // Instances that were dynamic already were never drawn into the static maps,
+  // so only ranges with static ones make anything stale
+  for (const auto& moved : sceneMgr->getMovedInstances())
+  {
+    bool hadStatic = false;
+    for (std::uint32_t i = 0; i < moved.instanceCount; ++i)
+    {
+      const std::uint32_t instance = moved.firstInstance + i;
+      if (!isDynamic(instance))
+      {
+        hadStatic = true;
+        dynamicInstances.push_back(instance);
+      }
+      instanceMoveFrames[instance] = frameNumber;
+    }
+    if (hadStatic)
+      staleRegions.push_back(moved.sweptBounds);
+  }
+
+  // Instances that came to rest become static casters again, so the
+  // cached maps around them have to be re-rendered with them included
+  const BoxesSoa& instanceBounds = sceneMgr->getInstanceBounds();
+  std::erase_if(dynamicInstances, [&](std::uint32_t instance) {
+    if (isDynamic(instance))
+      return false;
+    if (instanceBounds.extentX[instance] >= 0)
+      staleRegions.push_back(get_box(instanceBounds, instance));
+    return true;
+  });
+}
+
+// Bounds of the boxes for which `include` returns true
+template <class Filter>
+static std::optional<Aabb> compute_scene_box(const BoxesSoa& boxes, Filter include)
+{
+  std::optional<Aabb> result;
+  for (std::size_t i = 0; i < boxes.count; ++i)
+  {
+    if (boxes.extentX[i] < 0 || !include(static_cast<std::uint32_t>(i)))
+      continue;
+
+    const auto box = get_box(boxes, i);
+    if (!result.has_value())
+      result = box;
+    result->min = glm::min(result->min, box.min);
+    result->max = glm::max(result->max, box.max);
+  }
+  return result;
+}
+
+void WorldRenderer::updateCascades(const Camera& main_cam, const Camera& light_cam, float aspect)
+{
+  ZoneScoped;
+
+  const float nearPlane = main_cam.zNear;
+  const float farPlane = std::min(main_cam.zFar, cascadeProps.maxDistance);
+
+  // Practical split scheme: logarithmic splits keep the amount of shadow texels per screen
+  // pixel constant, but give almost everything to the first meters, so they are blended
+  // with uniform ones.
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    const float t = static_cast<float>(i + 1) / SHADOW_CASCADE_COUNT;
+    const float logSplit = nearPlane * std::pow(farPlane / nearPlane, t);
+    const float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+    cascadeSplits[i] = glm::mix(uniformSplit, logSplit, cascadeProps.splitLambda);
+  }
+
+  const BoxesSoa& instanceBounds = sceneMgr->getInstanceBounds();
+  // Dynamic casters must not move the cascades, or they would invalidate the cached
+  // static shadows whenever they move
+  const auto staticBox = compute_scene_box(
+    instanceBounds, [this](std::uint32_t instance) { return !isDynamic(instance); });
+
+  staleBounds.resize(staleRegions.size());
+  for (std::size_t i = 0; i < staleRegions.size(); ++i)
+    staleBounds.set(i, staleRegions[i], glm::identity<glm::mat4>());
+
+  const float tanHalfFov = std::tan(glm::radians(main_cam.fov) * 0.5f);
+  const glm::mat4x4 lightRotation = glm::mat4_cast(light_cam.rotation);
+  // Columns are the axes of the light space in the world, so its transpose goes back
+  const glm::mat3x3 lightAxes{lightRotation};
+  const glm::mat3x3 toLightSpace = glm::transpose(lightAxes);
+
+  // The depth range of every cascade only depends on the light and on the static casters.
+  // Dynamic ones and receivers a bit outside of it get some room too.
+  std::optional<glm::vec2> staticDepthRange;
+  if (staticBox.has_value())
+  {
+    staticDepthRange =
+      glm::vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+    for (std::size_t c = 0; c < 8; ++c)
+    {
+      const glm::vec3 corner{
+        (c & 1) != 0 ? staticBox->max.x : staticBox->min.x,
+        (c & 2) != 0 ? staticBox->max.y : staticBox->min.y,
+        (c & 4) != 0 ? staticBox->max.z : staticBox->min.z,
+      };
+      const float depth = (toLightSpace * corner).z;
+      staticDepthRange->x = std::min(staticDepthRange->x, depth);
+      staticDepthRange->y = std::max(staticDepthRange->y, depth);
+    }
+  }
+
+  float sliceNear = nearPlane;
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    const float sliceFar = cascadeSplits[i];
+
+    std::array<glm::vec3, 8> corners;
+    for (std::size_t c = 0; c < corners.size(); ++c)
+    {
+      const float distance = (c & 4) != 0 ? sliceFar : sliceNear;
+      const float halfHeight = distance * tanHalfFov;
+      const float halfWidth = halfHeight * aspect;
+      corners[c] = main_cam.position + main_cam.forward() * distance +
+        main_cam.right() * ((c & 1) != 0 ? halfWidth : -halfWidth) +
+        main_cam.up() * ((c & 2) != 0 ? halfHeight : -halfHeight);
+    }
+
+    // A bounding sphere of the slice instead of a tight box: its size doesn't depend on
+    // the rotation of the camera, so the size of shadow texels never changes either.
+    glm::vec3 center{0};
+    for (const auto& corner : corners)
+      center += corner / static_cast<float>(corners.size());
+    float radius = 0;
+    for (const auto& corner : corners)
+      radius = std::max(radius, glm::length(corner - center));
+    // Otherwise float noise changes the size by tiny amounts every frame
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // The cascade only moves in whole steps across the light, so that the cached static
+    // shadows stay valid while the camera moves within a step. It is made larger by
+    // half a step, which is how far the slice can be from the snapped center.
+    const float snapStep = radius * cascadeProps.snapFraction;
+    const float halfSize = radius + snapStep * 0.5f;
+    const glm::vec3 lightCenter = toLightSpace * center;
+    const glm::vec2 snappedCenter = glm::round(glm::vec2(lightCenter) / snapStep) * snapStep;
+
+    // Casters between the light and the slice have to end up in the map too,
+    // so the near plane is pulled back to wherever the static casters end.
+    const glm::vec2 depthRange =
+      staticDepthRange.value_or(glm::vec2(lightCenter.z - radius, lightCenter.z + radius));
+    const float nearDepth = depthRange.x - radius;
+    const float farDepth = depthRange.y + radius;
+
+    const glm::vec3 eye = lightAxes * glm::vec3(snappedCenter, nearDepth);
+    const glm::mat4x4 view =
+      glm::inverse(glm::translate(glm::identity<glm::mat4>(), eye) * lightRotation);
+    const glm::mat4x4 proj =
+      glm::orthoLH_ZO(+halfSize, -halfSize, +halfSize, -halfSize, 0.0f, farDepth - nearDepth);
+    glm::mat4x4 shadowMatrix = proj * view;
+
+    // Texel snapping: the world origin is moved onto the nearest texel, so that the whole
+    // projection only ever moves by whole texels and shadow edges don't crawl when
+    // the camera moves.
+    const float halfResolution = SHADOW_MAP_RESOLUTION * 0.5f;
+    const glm::vec2 origin = glm::vec2(shadowMatrix[3]) * halfResolution;
+    const glm::vec2 offset = (glm::round(origin) - origin) / halfResolution;
+    shadowMatrix[3][0] += offset.x;
+    shadowMatrix[3][1] += offset.y;
+
+    cascadeMatrices[i] = shadowMatrix;
+    const Frustum cascadeFrustum = extract_frustum(shadowMatrix);
+    cull_boxes(cascadeFrustum, instanceBounds, cascadeInstances[i]);
+
+    cascadeStaticInstances[i].clear();
+    cascadeDynamicInstances[i].clear();
+    for (const auto instance : cascadeInstances[i])
+      (isDynamic(instance) ? cascadeDynamicInstances[i] : cascadeStaticInstances[i])
+        .push_back(instance);
+
+    // Accumulated until the cascade is actually rendered, in case some frames are skipped
+    auto& cache = cascadeCaches[i];
+    if (!cache.stale && staleBounds.count > 0)
+    {
+      cull_boxes(cascadeFrustum, staleBounds, staleHits);
+      cache.stale = !staleHits.empty();
+    }
+
+    sliceNear = sliceFar;
+  }
+
+  cull_boxes(extract_frustum(worldViewProj), instanceBounds, visibleInstances);
+
+  std::size_t casterDraws = 0;
+  for (const auto& instances : cascadeInstances)
+    casterDraws += instances.size();
+  TracyPlot("Shadow caster instances", static_cast<std::int64_t>(casterDraws));
+  TracyPlot("Visible instances", static_cast<std::int64_t>(visibleInstances.size()));
+}
+
 void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  vk::PipelineLayout pipeline_layout,
+  std::span<const std::uint32_t> instances)
 {
   if (!sceneMgr->getVertexBuffer())
     return;
 
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
-  pushConst2M.projView = glob_tm;
+  // Instances are fetched by the vertex shader, so this is the only push of the pass
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {PushConstants{.projView = glob_tm}});
 
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
-  auto instanceMatrices = sceneMgr->getInstanceMatrices();
 
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
-  {
-    pushConst2M.model = instanceMatrices[instIdx];
-
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+  // Small relems use 16-bit indices, which live in a separate region of the index buffer
+  std::optional<IndexFormat> boundIndexFormat;
 
+  for (std::size_t i = 0; i < instances.size();)
+  {
+    const auto instIdx = instances[i];
     const auto meshIdx = instanceMeshes[instIdx];
 
+    // A run of consecutive instances of the same mesh is a single instanced draw
+    std::uint32_t instanceCount = 1;
+    while (i + instanceCount < instances.size() &&
+           instances[i + instanceCount] == instIdx + instanceCount &&
+           instanceMeshes[instIdx + instanceCount] == meshIdx)
+      ++instanceCount;
+    i += instanceCount;
+
     for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      if (boundIndexFormat != relem.indexFormat)
+      {
+        cmd_buf.bindIndexBuffer(
+          sceneMgr->getIndexBuffer(),
+          sceneMgr->getIndexBufferOffset(relem.indexFormat),
+          SceneManager::getVkIndexType(relem.indexFormat));
+        boundIndexFormat = relem.indexFormat;
+      }
+      cmd_buf.drawIndexed(
+        relem.indexCount, instanceCount, relem.indexOffset, relem.vertexOffset, instIdx);
     }
   }
 }
 
+void WorldRenderer::renderShadowPass(
+  vk::CommandBuffer cmd_buf,
+  const etna::Image& target,
+  std::uint32_t cascade,
+  std::span<const std::uint32_t> instances,
+  vk::AttachmentLoadOp load_op)
+{
+  const auto layerView = target.getView({.baseLayer = cascade, .layerCount = 1});
+  const glm::mat4x4& cascadeMatrix = cascadeMatrices[cascade];
+
+  auto set = etna::create_descriptor_set(
+    etna::get_shader_program("simple_shadow").getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{2, sceneMgr->getInstanceDataBuffer().genBinding()}});
+
+  // Secondary buffers don't inherit bound descriptor sets either
+  auto bindShadow = [this, vkSet = set.getVkSet()](vk::CommandBuffer target_cmd_buf) {
+    target_cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
+    target_cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipelineLayout(), 0, {vkSet}, {});
+  };
+
+  if (parallelRecording)
+  {
+    recorder->render(
+      cmd_buf,
+      ParallelCommandRecorder::RenderTarget{
+        .area = {{0, 0}, {SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION}},
+        .colorAttachments = {},
+        .depthAttachment =
+          ParallelCommandRecorder::Attachment{
+            .image = target.get(),
+            .view = layerView,
+            .format = vk::Format::eD16Unorm,
+            .loadOp = load_op,
+          },
+      },
+      instances.size(),
+      [&](vk::CommandBuffer secondary, std::size_t first, std::size_t count) {
+        bindShadow(secondary);
+        renderScene(
+          secondary,
+          cascadeMatrix,
+          shadowPipeline.getVkPipelineLayout(),
+          instances.subspan(first, count));
+      });
+  }
+  else
+  {
+    etna::RenderTargetState renderTargets(
+      cmd_buf,
+      {{0, 0}, {SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION}},
+      {},
+      {.image = target.get(), .view = layerView, .loadOp = load_op});
+
+    bindShadow(cmd_buf);
+    renderScene(cmd_buf, cascadeMatrix, shadowPipeline.getVkPipelineLayout(), instances);
+  }
+}
+
+void WorldRenderer::copyStaticShadows(vk::CommandBuffer cmd_buf, std::uint32_t cascade)
+{
+  etna::set_state(
+    cmd_buf,
+    staticShadowMap.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead,
+    vk::ImageLayout::eTransferSrcOptimal,
+    vk::ImageAspectFlagBits::eDepth);
+  etna::set_state(
+    cmd_buf,
+    shadowMap.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageAspectFlagBits::eDepth);
+  etna::flush_barriers(cmd_buf);
+
+  const vk::ImageSubresourceLayers layer{
+    .aspectMask = vk::ImageAspectFlagBits::eDepth,
+    .mipLevel = 0,
+    .baseArrayLayer = cascade,
+    .layerCount = 1,
+  };
+  cmd_buf.copyImage(
+    staticShadowMap.get(),
+    vk::ImageLayout::eTransferSrcOptimal,
+    shadowMap.get(),
+    vk::ImageLayout::eTransferDstOptimal,
+    {vk::ImageCopy{
+      .srcSubresource = layer,
+      .srcOffset = {},
+      .dstSubresource = layer,
+      .dstOffset = {},
+      .extent = {SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION, 1},
+    }});
+}
+
 void WorldRenderer::renderWorld(
   vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
-  // draw scene to shadowmap
+  const auto recordingStart = std::chrono::steady_clock::now();
+
+  // Pools of this frame were last used FRAMES_IN_FLIGHT frames ago, which the Renderer has
+  // already waited for when acquiring the command buffer we are recording into.
+  if (parallelRecording)
+    recorder->beginFrame();
 
+  // draw scene to shadowmap, cascade by cascade
+
+  std::uint32_t renderedCascades = 0;
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
+    auto& cache = cascadeCaches[i];
 
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {2048, 2048}},
-      {},
-      {.image = shadowMap.get(), .view = shadowMap.getView({})});
+    if (!cacheStaticShadows)
+    {
+      ETNA_PROFILE_GPU(cmd_buf, renderShadowCascade);
+      renderShadowPass(cmd_buf, shadowMap, i, cascadeInstances[i], vk::AttachmentLoadOp::eClear);
+      cache.valid = false;
+      ++renderedCascades;
+      continue;
+    }
+
+    const bool refresh = !cache.valid || cache.stale || cache.matrix != cascadeMatrices[i];
+    if (refresh)
+    {
+      ETNA_PROFILE_GPU(cmd_buf, renderStaticShadowCascade);
+      renderShadowPass(
+        cmd_buf, staticShadowMap, i, cascadeStaticInstances[i], vk::AttachmentLoadOp::eClear);
+      cache.matrix = cascadeMatrices[i];
+      cache.valid = true;
+      cache.stale = false;
+      ++renderedCascades;
+    }
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
-    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout());
+    // On static frames without dynamic casters the shadow map already has what we need
+    const bool hasDynamicCasters = !cascadeDynamicInstances[i].empty();
+    if (refresh || hasDynamicCasters || cache.hasDynamicCasters)
+    {
+      ETNA_PROFILE_GPU(cmd_buf, renderDynamicShadowCascade);
+      copyStaticShadows(cmd_buf, i);
+      if (hasDynamicCasters)
+        renderShadowPass(
+          cmd_buf, shadowMap, i, cascadeDynamicInstances[i], vk::AttachmentLoadOp::eLoad);
+    }
+    cache.hasDynamicCasters = hasDynamicCasters;
   }
+  lastRenderedCascades = renderedCascades;
+  TracyPlot("Shadow cascades rendered", static_cast<std::int64_t>(renderedCascades));
 
   // draw final scene to screen
 
@@ -226,27 +607,80 @@ void WorldRenderer::renderWorld(
       cmd_buf,
       {etna::Binding{0, constants.genBinding()},
        etna::Binding{
-         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
-
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {resolution.x, resolution.y}},
-      {{.image = target_image, .view = target_image_view}},
-      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eGraphics,
-      basicForwardPipeline.getVkPipelineLayout(),
-      0,
-      {set.getVkSet()},
-      {});
-
-    renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout());
+         1,
+         shadowMap.genBinding(
+           defaultSampler.get(),
+           vk::ImageLayout::eShaderReadOnlyOptimal,
+           {.type = vk::ImageViewType::e2DArray})},
+       etna::Binding{2, sceneMgr->getInstanceDataBuffer().genBinding()}});
+
+    auto bindForward = [this, vkSet = set.getVkSet()](vk::CommandBuffer target_cmd_buf) {
+      target_cmd_buf.bindPipeline(
+        vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
+      target_cmd_buf.bindDescriptorSets(
+        vk::PipelineBindPoint::eGraphics,
+        basicForwardPipeline.getVkPipelineLayout(),
+        0,
+        {vkSet},
+        {});
+    };
+
+    const std::span<const std::uint32_t> instances = visibleInstances;
+
+    if (parallelRecording)
+    {
+      recorder->render(
+        cmd_buf,
+        ParallelCommandRecorder::RenderTarget{
+          .area = {{0, 0}, {resolution.x, resolution.y}},
+          .colorAttachments = {ParallelCommandRecorder::Attachment{
+            .image = target_image,
+            .view = target_image_view,
+            .format = swapchainFormat,
+          }},
+          .depthAttachment =
+            ParallelCommandRecorder::Attachment{
+              .image = mainViewDepth.get(),
+              .view = mainViewDepth.getView({}),
+              .format = vk::Format::eD32Sfloat,
+            },
+        },
+        instances.size(),
+        [&](vk::CommandBuffer secondary, std::size_t first, std::size_t count) {
+          bindForward(secondary);
+          renderScene(
+            secondary,
+            worldViewProj,
+            basicForwardPipeline.getVkPipelineLayout(),
+            instances.subspan(first, count));
+        });
+    }
+    else
+    {
+      etna::RenderTargetState renderTargets(
+        cmd_buf,
+        {{0, 0}, {resolution.x, resolution.y}},
+        {{.image = target_image, .view = target_image_view}},
+        {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
+
+      bindForward(cmd_buf);
+      renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout(), instances);
+    }
   }
 
+  const std::chrono::duration<float, std::milli> recordingTime =
+    std::chrono::steady_clock::now() - recordingStart;
+  lastRecordingMs = recordingTime.count();
+  TracyPlot("Scene recording, ms", lastRecordingMs);
+
   if (drawDebugFSQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, shadowMap, defaultSampler);
+    quadRenderer->render(
+      cmd_buf,
+      target_image,
+      target_image_view,
+      shadowMap,
+      defaultSampler,
+      {.baseLayer = static_cast<std::uint32_t>(debugCascade), .layerCount = 1});
 }
 
 void WorldRenderer::drawGui()
@@ -262,6 +696,27 @@ void WorldRenderer::drawGui()
   ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
   uniformParams.lightPos = {pos[0], pos[1], pos[2]};
 
+  ImGui::SliderFloat("Shadow distance", &cascadeProps.maxDistance, 10.0f, 1000.0f);
+  ImGui::SliderFloat("Cascade split lambda", &cascadeProps.splitLambda, 0.0f, 1.0f);
+  ImGui::SliderFloat("Cascade snap step", &cascadeProps.snapFraction, 0.01f, 0.5f);
+  ImGui::SliderInt("Cascade shown by 'Q'", &debugCascade, 0, SHADOW_CASCADE_COUNT - 1);
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+    ImGui::Text(
+      "Cascade %u: up to %.1f m, %zu static and %zu dynamic casters",
+      i,
+      cascadeSplits[i],
+      cascadeStaticInstances[i].size(),
+      cascadeDynamicInstances[i].size());
+
+  ImGui::Checkbox("Cache static shadows", &cacheStaticShadows);
+  ImGui::Text("Shadow cascades rendered this frame: %u", lastRenderedCascades);
+
+  ImGui::Checkbox("Record draws in parallel", &parallelRecording);
+  ImGui::Text(
+    "Scene recorded in %.3f ms on %zu threads",
+    lastRecordingMs,
+    parallelRecording ? recorder->getWorkerCount() : std::size_t{1});
+
   ImGui::Text(
     "Application average %.3f ms/frame (%.1f FPS)",
     1000.0f / ImGui::GetIO().Framerate,
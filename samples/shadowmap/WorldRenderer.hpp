@@ -1,5 +1,9 @@
 #pragma once
 
+#include <array>
+#include <span>
+#include <vector>
+
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
@@ -8,7 +12,10 @@
 
 #include "shaders/UniformParams.h"
 #include "scene/SceneManager.hpp"
+#include "scene/Camera.hpp"
 #include "render_utils/QuadRenderer.hpp"
+#include "render_utils/ParallelCommandRecorder.hpp"
+#include "utils/ThreadPool.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -36,8 +43,29 @@ public:
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
 private:
+  // Fits the cascades to slices of the main camera frustum and culls
+  // the instances against them and the camera itself.
+  void updateCascades(const Camera& main_cam, const Camera& light_cam, float aspect);
+
+  // Keeps track of which instances are dynamic casters and collects the bounds
+  // that make the cached static shadows stale
+  void trackMovedInstances();
+  bool isDynamic(std::uint32_t instance) const;
+
+  void renderShadowPass(
+    vk::CommandBuffer cmd_buf,
+    const etna::Image& target,
+    std::uint32_t cascade,
+    std::span<const std::uint32_t> instances,
+    vk::AttachmentLoadOp load_op);
+  void copyStaticShadows(vk::CommandBuffer cmd_buf, std::uint32_t cascade);
+
+  // Called concurrently for different parts of the list when recording in parallel
   void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    vk::PipelineLayout pipeline_layout,
+    std::span<const std::uint32_t> instances);
 
 
 private:
@@ -45,31 +73,80 @@ private:
 
   etna::Image mainViewDepth;
   etna::Image shadowMap;
+  // Static casters only, copied into the shadow map before dynamic ones are drawn over them
+  etna::Image staticShadowMap;
   etna::Sampler defaultSampler;
   etna::Buffer constants;
 
   struct PushConstants
   {
     glm::mat4x4 projView;
-    glm::mat4x4 model;
-  } pushConst2M;
+  };
 
   glm::mat4x4 worldViewProj;
-  glm::mat4x4 lightMatrix;
   glm::vec3 lightPos;
 
-  struct ShadowMapCam
+  static constexpr std::uint32_t SHADOW_MAP_RESOLUTION = 2048;
+
+  struct CascadeProps
+  {
+    // Nothing is shadowed further away from the camera than this
+    float maxDistance = 100;
+    // 0 splits the distance into equal parts, 1 makes every cascade cover
+    // the same amount of depth in the log scale
+    float splitLambda = 0.75f;
+    // Cascades move across the light in steps of this fraction of their radius. Larger
+    // steps re-render the cached static shadows less often but waste more texels.
+    float snapFraction = 0.125f;
+  } cascadeProps;
+
+  std::array<glm::mat4x4, SHADOW_CASCADE_COUNT> cascadeMatrices;
+  // Distances from the camera at which the cascades end
+  std::array<float, SHADOW_CASCADE_COUNT> cascadeSplits;
+  std::array<std::vector<std::uint32_t>, SHADOW_CASCADE_COUNT> cascadeInstances;
+  std::array<std::vector<std::uint32_t>, SHADOW_CASCADE_COUNT> cascadeStaticInstances;
+  std::array<std::vector<std::uint32_t>, SHADOW_CASCADE_COUNT> cascadeDynamicInstances;
+  std::vector<std::uint32_t> visibleInstances;
+
+  struct CascadeCache
   {
-    float radius = 10;
-    float lightTargetDist = 24;
-    bool usePerspectiveM = false;
-  } lightProps;
+    // The matrix the static casters were last rendered with
+    glm::mat4x4 matrix{};
+    bool valid = false;
+    // Set when a change in the scene touched the cascade since it was last rendered
+    bool stale = false;
+    // Dynamic casters were drawn over the static ones, so the layer of
+    // the shadow map has to be restored even if there aren't any now
+    bool hasDynamicCasters = false;
+  };
+
+  // The static part of a cascade is only re-rendered when the cascade moves or when
+  // the bounds of something that changed overlap it, so static frames skip it entirely
+  bool cacheStaticShadows = true;
+  std::array<CascadeCache, SHADOW_CASCADE_COUNT> cascadeCaches;
+  std::uint32_t lastRenderedCascades = 0;
+
+  // Instances that moved during the last DYNAMIC_FRAMES frames are dynamic casters,
+  // the rest are static ones. Going back and forth costs a re-render of the cascades
+  // around the instance, so that's not done on every frame it stops for.
+  static constexpr std::uint64_t DYNAMIC_FRAMES = 30;
+  std::uint64_t frameNumber = 0;
+  // Frame of the last move of every instance, 0 for ones that never moved
+  std::vector<std::uint64_t> instanceMoveFrames;
+  std::vector<std::uint32_t> dynamicInstances;
+  // Regions where static casters appeared, disappeared or moved this frame
+  std::vector<Aabb> staleRegions;
+  BoxesSoa staleBounds;
+  std::vector<std::uint32_t> staleHits;
+  // A new scene invalidates everything, it always comes with a new vertex buffer
+  vk::Buffer cachedSceneVertexBuffer;
 
   UniformParams uniformParams{
-    .lightMatrix = {},
+    .cascadeMatrices = {},
     .lightPos = {},
     .time = {},
     .baseColor = {0.9f, 0.92f, 1.0f},
+    .showCascades = false,
   };
 
   etna::GraphicsPipeline basicForwardPipeline{};
@@ -77,6 +154,16 @@ private:
 
   std::unique_ptr<QuadRenderer> quadRenderer;
   bool drawDebugFSQuad = false;
+  int debugCascade = 0;
+
+  // Matches numFramesInFlight of the Renderer
+  static constexpr std::uint32_t FRAMES_IN_FLIGHT = 2;
+
+  std::unique_ptr<ThreadPool> recordingWorkers;
+  std::unique_ptr<ParallelCommandRecorder> recorder;
+  bool parallelRecording = true;
+  float lastRecordingMs = 0;
 
   glm::uvec2 resolution;
+  vk::Format swapchainFormat = vk::Format::eUndefined;
 };
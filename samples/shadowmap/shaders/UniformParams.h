@@ -4,12 +4,17 @@
 #include "cpp_glsl_compat.h"
 
 
+// Every cascade is a layer of the shadow map array, the first one is the closest to the camera
+#define SHADOW_CASCADE_COUNT 4
+
 struct UniformParams
 {
-  shader_mat4 lightMatrix;
+  shader_mat4 cascadeMatrices[SHADOW_CASCADE_COUNT];
   shader_vec3 lightPos;
   shader_float time;
   shader_vec3 baseColor;
+  // Tints every surface with the color of the cascade it takes its shadow from
+  shader_bool showCascades;
 };
 
 
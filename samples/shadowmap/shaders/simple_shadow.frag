@@ -20,20 +20,34 @@ layout(binding = 0, set = 0) uniform AppData
   UniformParams params;
 };
 
-layout(binding = 1) uniform sampler2D shadowMap;
+layout(binding = 1) uniform sampler2DArray shadowMap;
 
 void main()
 {
-  const vec4 posLightClipSpace = params.lightMatrix*vec4(surf.wPos, 1.0f);
+  // Cascades go from the closest to the farthest one, so the first one that contains
+  // the point has the best resolution for it. Points outside of all cascades are lit.
+  float shadow = 1.0f;
+  uint cascade = SHADOW_CASCADE_COUNT;
+  for (uint i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    const vec4 posLightClipSpace = params.cascadeMatrices[i]*vec4(surf.wPos, 1.0f);
 
-  // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
-  const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
+    // cascades are orthographic, so w is always 1, but let's keep the general case
+    const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
 
-  // just shift coords from [-1,1] to [0,1]
-  const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
+    // just shift coords from [-1,1] to [0,1]
+    const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
 
-  const bool  outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f);
-  const float shadow    = ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+    const bool outOfView = any(lessThan(shadowTexCoord, vec2(0.0001f)))
+      || any(greaterThan(shadowTexCoord, vec2(0.9999f))) || posLightSpaceNDC.z > 1.0f;
+    if (outOfView)
+      continue;
+
+    const float depth = textureLod(shadowMap, vec3(shadowTexCoord, float(i)), 0).x;
+    shadow = posLightSpaceNDC.z < depth + 0.001f ? 1.0f : 0.0f;
+    cascade = i;
+    break;
+  }
 
   const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
   const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
@@ -46,4 +60,14 @@ void main()
   const float ambient = 0.05;
   // Light formula is pretty arbitrary and most definitely wrong
   out_fragColor = (lightColor * shadow + ambient) * vec4(params.baseColor, 1.0f);
+
+  if (params.showCascades && cascade < SHADOW_CASCADE_COUNT)
+  {
+    const vec3 cascadeColors[4] = vec3[](
+      vec3(1.0f, 0.3f, 0.3f),
+      vec3(0.3f, 1.0f, 0.3f),
+      vec3(0.3f, 0.3f, 1.0f),
+      vec3(1.0f, 1.0f, 0.3f));
+    out_fragColor.rgb *= cascadeColors[cascade % 4];
+  }
 }
@@ -0,0 +1,187 @@
+#include "BakeCache.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "utils/MappedFile.hpp"
+
+
+static constexpr std::string_view CACHE_ENTRY_EXTENSION = ".cache";
+static constexpr std::string_view CACHE_ENTRY_HEADER = "baked-scene-cache 2";
+
+void ContentHash::update(std::span<const std::byte> bytes)
+{
+  constexpr std::uint64_t PRIME = 0x100000001B3;
+  for (auto byte : bytes)
+  {
+    state ^= static_cast<std::uint64_t>(byte);
+    state *= PRIME;
+  }
+}
+
+std::optional<std::uint64_t> hash_file(const std::filesystem::path& path)
+{
+  std::error_code error;
+  if (!std::filesystem::is_regular_file(path, error))
+    return std::nullopt;
+
+  ContentHash hash;
+  // Empty files can't be mapped, but hash just fine
+  if (std::filesystem::file_size(path, error) > 0)
+  {
+    auto file = MappedFile::open(path);
+    if (!file.has_value())
+      return std::nullopt;
+    hash.update(file->getData());
+  }
+  return hash.get();
+}
+
+std::filesystem::path get_cache_entry_path(const std::filesystem::path& output)
+{
+  auto result = output;
+  result += CACHE_ENTRY_EXTENSION;
+  return result;
+}
+
+// The format is line-based:
+//   baked-scene-cache 2
+//   key <hex>
+//   dep <hex> <path>
+//   out <hex> <path>
+//   ...
+std::optional<BakeCacheEntry> read_cache_entry(const std::filesystem::path& output)
+{
+  std::ifstream file(get_cache_entry_path(output));
+  if (!file)
+    return std::nullopt;
+
+  std::string line;
+  if (!std::getline(file, line) || line != CACHE_ENTRY_HEADER)
+    return std::nullopt;
+
+  BakeCacheEntry result;
+  bool hasKey = false;
+  while (std::getline(file, line))
+  {
+    std::istringstream stream(line);
+    std::string kind;
+    std::uint64_t hash;
+    if (!(stream >> kind >> std::hex >> hash))
+      return std::nullopt;
+
+    if (kind == "key")
+    {
+      result.key = hash;
+      hasKey = true;
+    }
+    else if (kind == "dep" || kind == "out")
+    {
+      std::string path;
+      // Paths may contain spaces, so the rest of the line is the path
+      stream.get();
+      if (!std::getline(stream, path) || path.empty())
+        return std::nullopt;
+      auto& files = kind == "dep" ? result.dependencies : result.outputs;
+      files.push_back(BakeDependency{
+        .path = std::u8string(path.begin(), path.end()),
+        .hash = hash,
+      });
+    }
+    else
+    {
+      return std::nullopt;
+    }
+  }
+
+  if (!hasKey)
+    return std::nullopt;
+
+  return result;
+}
+
+bool write_cache_entry(const std::filesystem::path& output, const BakeCacheEntry& entry)
+{
+  const auto path = get_cache_entry_path(output);
+  std::ofstream file(path, std::ios::trunc);
+  if (!file)
+  {
+    spdlog::error("Unable to write baking cache entry '{}'", path);
+    return false;
+  }
+
+  file << CACHE_ENTRY_HEADER << '\n';
+  file << fmt::format("key {:016x}\n", entry.key);
+  const auto writeFiles = [&file](std::string_view kind, std::span<const BakeDependency> files) {
+    for (const auto& dependency : files)
+    {
+      const auto utf8 = dependency.path.generic_u8string();
+      file << fmt::format("{} {:016x} ", kind, dependency.hash)
+           << std::string_view(reinterpret_cast<const char*>(utf8.data()), utf8.size()) << '\n';
+    }
+  };
+  writeFiles("dep", entry.dependencies);
+  writeFiles("out", entry.outputs);
+
+  return static_cast<bool>(file);
+}
+
+void remove_cache_entry(const std::filesystem::path& output)
+{
+  std::error_code error;
+  std::filesystem::remove(get_cache_entry_path(output), error);
+}
+
+bool is_up_to_date(
+  const std::filesystem::path& output, const BakeCacheEntry& entry, std::uint64_t key)
+{
+  std::error_code error;
+  if (entry.key != key || !std::filesystem::is_regular_file(output, error))
+    return false;
+
+  // Textures that were deleted or overwritten have to be baked again too
+  const auto unchanged = [](const BakeDependency& file) {
+    return hash_file(file.path) == file.hash;
+  };
+  return std::ranges::all_of(entry.dependencies, unchanged) &&
+    std::ranges::all_of(entry.outputs, unchanged);
+}
+
+bool write_depfile(
+  const std::filesystem::path& depfile,
+  const std::filesystem::path& output,
+  std::span<const BakeDependency> dependencies)
+{
+  std::ofstream file(depfile, std::ios::trunc);
+  if (!file)
+  {
+    spdlog::error("Unable to write depfile '{}'", depfile);
+    return false;
+  }
+
+  // Spaces separate paths in Makefiles, so they have to be escaped
+  const auto escaped = [](const std::filesystem::path& path) {
+    const auto utf8 = path.generic_u8string();
+    std::string result;
+    for (auto c : utf8)
+    {
+      if (c == ' ' || c == '#')
+        result.push_back('\\');
+      else if (c == '$')
+        result.push_back('$');
+      result.push_back(static_cast<char>(c));
+    }
+    return result;
+  };
+
+  file << escaped(output) << ':';
+  for (const auto& dependency : dependencies)
+    file << " \\\n  " << escaped(dependency.path);
+  file << '\n';
+
+  return static_cast<bool>(file);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+
+// 64-bit FNV-1a. Not cryptographic in any way, but good enough to notice
+// that an asset or the settings it is baked with have changed.
+class ContentHash
+{
+public:
+  void update(std::span<const std::byte> bytes);
+  void update(std::string_view str) { update(std::as_bytes(std::span(str))); }
+
+  std::uint64_t get() const { return state; }
+
+private:
+  std::uint64_t state = 0xCBF29CE484222325;
+};
+
+// Returns nullopt if the file can't be read. Empty files are fine.
+std::optional<std::uint64_t> hash_file(const std::filesystem::path& path);
+
+struct BakeDependency
+{
+  std::filesystem::path path;
+  std::uint64_t hash;
+};
+
+// Every baked scene has a small text file next to it which remembers what the
+// scene was baked from and what else was written along with it. If none of that
+// changed, baking again is pointless.
+struct BakeCacheEntry
+{
+  // Hash of the baker version and options
+  std::uint64_t key = 0;
+  std::vector<BakeDependency> dependencies;
+  // Files besides the baked scene itself, e.g. textures
+  std::vector<BakeDependency> outputs;
+};
+
+std::filesystem::path get_cache_entry_path(const std::filesystem::path& output);
+
+std::optional<BakeCacheEntry> read_cache_entry(const std::filesystem::path& output);
+bool write_cache_entry(const std::filesystem::path& output, const BakeCacheEntry& entry);
+void remove_cache_entry(const std::filesystem::path& output);
+
+// True if the output exists, was baked with the same key and none of the
+// dependencies or additional outputs changed since then.
+bool is_up_to_date(
+  const std::filesystem::path& output, const BakeCacheEntry& entry, std::uint64_t key);
+
+// Writes a Makefile-style depfile, which lets build systems know about
+// dependencies they can't see, e.g. external buffers of a .gltf scene.
+bool write_depfile(
+  const std::filesystem::path& depfile,
+  const std::filesystem::path& output,
+  std::span<const BakeDependency> dependencies);
@@ -0,0 +1,222 @@
+#include "SceneBaker.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <fmt/ranges.h>
+
+#include "scene/BakedScene.hpp"
+#include "scene/Ktx2.hpp"
+
+
+std::string SceneBakingOptions::describe() const
+{
+  return fmt::format(
+    "quantize={};optimize={};lods={};textures={};lod-errors={};lod-triangle-ratio={}",
+    quantize,
+    optimize,
+    generateLods,
+    textures,
+    fmt::join(lodSettings.errors, ","),
+    lodSettings.triangleRatio);
+}
+
+static std::vector<std::filesystem::path> collect_dependencies(
+  const std::filesystem::path& input, const GltfLoader::LoadedModel& loaded)
+{
+  std::vector<std::filesystem::path> result{input};
+
+  // Embedded resources are covered by the scene file itself
+  const auto addUri = [&](const std::string& uri) {
+    if (auto path = GltfLoader::resolveUri(loaded, uri); !path.empty())
+      result.push_back(std::move(path));
+  };
+
+  for (const auto& buffer : loaded.model.buffers)
+    addUri(buffer.uri);
+  for (const auto& image : loaded.model.images)
+    addUri(image.uri);
+
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+
+  return result;
+}
+
+// Texture file names only need to be unique and somewhat recognizable
+static std::string get_texture_file_name(std::size_t image, std::string_view name)
+{
+  std::string result = fmt::format("{}", image);
+  if (!name.empty())
+    result += '_';
+  for (char c : name.substr(0, 64))
+    result += std::isalnum(static_cast<unsigned char>(c)) || c == '-' ? c : '_';
+  return result + KTX2_EXTENSION;
+}
+
+struct BakedTextures
+{
+  std::vector<BakedTexture> textures;
+  std::vector<char> strings;
+  std::vector<std::filesystem::path> files;
+};
+
+static std::optional<BakedTextures> bake_textures(
+  GltfLoader& loader, const GltfLoader::LoadedModel& model, const std::filesystem::path& output)
+{
+  BakedTextures result;
+  result.textures.resize(model.model.images.size(), BakedTexture{0, 0, TextureUsage::Albedo});
+
+  const auto processed = loader.processTextures(model);
+  if (processed.empty())
+    return result;
+
+  // Textures of different scenes baked into the same directory must not collide
+  const auto directoryName = output.stem().u8string() + u8"_textures";
+  const auto directory = output.parent_path() / directoryName;
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  if (error)
+  {
+    spdlog::error("Unable to create '{}': {}", directory, error.message());
+    return std::nullopt;
+  }
+
+  for (const auto& texture : processed)
+  {
+    const auto fileName = get_texture_file_name(
+      texture.image, model.model.images[texture.image].name);
+    if (!write_ktx2(directory / fileName, texture.texture))
+      return std::nullopt;
+    result.files.push_back(directory / fileName);
+
+    // Always with forward slashes, so that baked scenes are portable
+    const auto relative = fmt::format(
+      "{}/{}", std::string(directoryName.begin(), directoryName.end()), fileName);
+    result.textures[texture.image] = BakedTexture{
+      .pathOffset = static_cast<std::uint32_t>(result.strings.size()),
+      .pathLength = static_cast<std::uint32_t>(relative.size()),
+      .usage = texture.usage,
+    };
+    result.strings.insert(result.strings.end(), relative.begin(), relative.end());
+  }
+
+  return result;
+}
+
+std::optional<BakedSceneFiles> bake_scene(
+  GltfLoader& loader,
+  const std::filesystem::path& input,
+  const std::filesystem::path& output,
+  const SceneBakingOptions& options)
+{
+  auto model = loader.loadModel(input);
+  if (!model.has_value())
+    return std::nullopt;
+
+  auto instances = loader.processInstances(model->model);
+  auto meshes = loader.processMeshes(*model);
+
+  if (options.optimize)
+  {
+    loader.weldVertices(meshes);
+    const auto reports = loader.optimizeMeshes(meshes);
+    for (std::size_t i = 0; i < reports.size(); ++i)
+      spdlog::info(
+        "Mesh {} '{}': ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+        i,
+        model->model.meshes[i].name,
+        reports[i].before.acmr(),
+        reports[i].after.acmr(),
+        reports[i].before.atvr(),
+        reports[i].after.atvr());
+  }
+
+  // LODs are simplified using the full precision positions
+  if (options.generateLods)
+    loader.buildLods(meshes, GltfLoader::extractPositions(meshes), options.lodSettings);
+
+  // Quantization looks at 32-bit indices, so this has to happen before packing them
+  QuantizedGeometry quantized;
+  if (options.quantize)
+  {
+    quantized = quantize_geometry(meshes.vertices, meshes.indices, meshes.relems, meshes.meshes);
+
+    for (std::size_t i = 0; i < instances.matrices.size(); ++i)
+      instances.matrices[i] *= quantized.dequantization[instances.meshes[i]];
+  }
+
+  // Bounds must be in the space of the vertices that end up in the file
+  std::vector<glm::vec3> positions;
+  if (options.quantize)
+  {
+    positions.resize(quantized.vertices.size());
+    for (std::size_t i = 0; i < positions.size(); ++i)
+      positions[i] = dequantize_position(quantized.vertices[i]);
+  }
+  else
+  {
+    positions = GltfLoader::extractPositions(meshes);
+  }
+  loader.computeMeshBounds(meshes, positions);
+  loader.buildMeshlets(meshes, positions);
+
+  loader.packSmallIndices(meshes);
+
+  BakedTextures textures;
+  if (options.textures)
+  {
+    auto baked = bake_textures(loader, *model, output);
+    if (!baked.has_value())
+      return std::nullopt;
+    textures = std::move(*baked);
+  }
+
+  BakedSceneView baked{
+    .vertexFormat = VertexFormat::Full,
+    .vertices = std::as_bytes(std::span(meshes.vertices)),
+    .indices = meshes.indices,
+    .indices16 = meshes.indices16,
+    .relems = meshes.relems,
+    .relemBounds = meshes.relemBounds,
+    .meshlets = meshes.meshlets,
+    .meshes = meshes.meshes,
+    .lods = meshes.lods,
+    .instanceMatrices = instances.matrices,
+    .instanceMeshes = instances.meshes,
+    .textures = textures.textures,
+    .strings = textures.strings,
+  };
+
+  if (options.quantize)
+  {
+    baked.vertexFormat = VertexFormat::Quantized;
+    baked.vertices = std::as_bytes(std::span(quantized.vertices));
+  }
+
+  if (!write_baked_scene(output, baked))
+    return std::nullopt;
+
+  spdlog::info(
+    "Baked '{}' into '{}': {} vertices ({:.1f} MiB), {} + {} 16-bit indices, {} relems, "
+    "{} meshlets, {} meshes, {} LODs, {} instances, {} textures",
+    input,
+    output,
+    meshes.vertices.size(),
+    static_cast<double>(baked.vertices.size()) / (1 << 20),
+    meshes.indices.size(),
+    meshes.indices16.size(),
+    meshes.relems.size(),
+    meshes.meshlets.size(),
+    meshes.meshes.size(),
+    meshes.lods.size(),
+    instances.matrices.size(),
+    std::ranges::count_if(textures.textures, [](const auto& t) { return t.pathLength != 0; }));
+
+  return BakedSceneFiles{
+    .dependencies = collect_dependencies(input, *model),
+    .outputs = std::move(textures.files),
+  };
+}
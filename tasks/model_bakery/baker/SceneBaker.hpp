@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "scene/GltfLoader.hpp"
+
+
+// Increment whenever the baking pipeline starts producing different results for
+// the same inputs, as that invalidates all cached baked scenes. Changes to the
+// baked scene format are covered by BAKED_SCENE_VERSION already.
+inline constexpr std::uint32_t SCENE_BAKER_VERSION = 1;
+
+struct SceneBakingOptions
+{
+  // Quantization is optional, as it loses some precision
+  bool quantize = false;
+  bool optimize = true;
+  bool generateLods = true;
+  // Textures are written as KTX2 files into a directory next to the output
+  bool textures = true;
+  GltfLoader::LodSettings lodSettings{};
+
+  // Canonical textual form of everything that affects the result, for cache keys
+  std::string describe() const;
+};
+
+struct BakedSceneFiles
+{
+  // Everything the result was produced from, i.e. the scene itself
+  // along with its external buffers and images
+  std::vector<std::filesystem::path> dependencies;
+  // Files written besides the baked scene itself, i.e. KTX2 textures
+  std::vector<std::filesystem::path> outputs;
+};
+
+// Converts a glTF scene into a baked scene. Returns nullopt if something
+// went wrong, which is reported to the log.
+std::optional<BakedSceneFiles> bake_scene(
+  GltfLoader& loader,
+  const std::filesystem::path& input,
+  const std::filesystem::path& output,
+  const SceneBakingOptions& options);
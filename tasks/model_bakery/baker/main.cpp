@@ -1,4 +1,289 @@
-int main()
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "scene/GltfLoader.hpp"
+#include "scene/BakedScene.hpp"
+#include "utils/ThreadPool.hpp"
+
+#include "SceneBaker.hpp"
+#include "BakeCache.hpp"
+
+
+static constexpr std::string_view USAGE = R"(Usage: model_bakery_baker [options] <inputs...>
+
+Inputs are .gltf/.glb scenes, directories that are searched for scenes recursively,
+or manifests: text files listing inputs, one per line, relative to the manifest.
+Scenes whose sources and options didn't change since they were last baked are skipped.
+
+Options:
+  --quantize               Store quantized 16-byte vertices
+  --no-optimize            Skip welding and vertex cache optimization
+  --no-lods                Don't generate LODs
+  --no-textures            Don't compress textures into KTX2 files
+  --lod-errors=e1,e2,...   Relative errors of the generated LODs
+  --output=<path>          Output path, only for a single input scene
+  --output-dir=<dir>       Put outputs here instead of next to the sources
+  --depfile=<path>         Write a Makefile-style depfile, only for a single input scene
+  --jobs=<n>               Amount of threads to use
+  --force                  Bake everything, even if it is up to date)";
+
+struct BakingJob
 {
-  return 0;
+  std::filesystem::path input;
+  std::filesystem::path output;
+};
+
+static bool is_scene_file(const std::filesystem::path& path)
+{
+  return path.extension() == ".gltf" || path.extension() == ".glb";
+}
+
+// Finds the scenes to bake, along with paths relative to the input they were
+// found through, which are used to lay out the output directory.
+static bool collect_scenes(
+  const std::filesystem::path& input,
+  const std::filesystem::path& relative_to,
+  std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& out)
+{
+  std::error_code error;
+
+  if (std::filesystem::is_directory(input, error))
+  {
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(input, error))
+      if (entry.is_regular_file() && is_scene_file(entry.path()))
+        out.emplace_back(entry.path(), entry.path().lexically_relative(input));
+    return !error;
+  }
+
+  if (is_scene_file(input))
+  {
+    out.emplace_back(input, input.lexically_relative(relative_to));
+    return true;
+  }
+
+  std::ifstream manifest(input);
+  if (!manifest)
+  {
+    spdlog::error("Unable to open '{}'", input);
+    return false;
+  }
+
+  const auto manifestDir = input.parent_path();
+  bool success = true;
+  std::string line;
+  while (std::getline(manifest, line))
+  {
+    // Allow comments and Windows line endings
+    line.erase(std::min(line.find('#'), line.size()));
+    while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back())))
+      line.pop_back();
+    if (line.empty())
+      continue;
+
+    success &= collect_scenes(
+      manifestDir / std::u8string(line.begin(), line.end()), manifestDir, out);
+  }
+  return success;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::string_view> args(argv + 1, argv + argc);
+
+  const auto takeFlag = [&args](std::string_view flag) {
+    auto it = std::ranges::find(args, flag);
+    if (it == args.end())
+      return false;
+    args.erase(it);
+    return true;
+  };
+
+  // Returns the value of a `--name=value` option
+  const auto takeOption = [&args](std::string_view name) -> std::optional<std::string_view> {
+    auto it = std::ranges::find_if(args, [name](std::string_view arg) {
+      return arg.starts_with(name) && arg.size() > name.size() && arg[name.size()] == '=';
+    });
+    if (it == args.end())
+      return std::nullopt;
+    const auto value = it->substr(name.size() + 1);
+    args.erase(it);
+    return value;
+  };
+
+  SceneBakingOptions options;
+  options.quantize = takeFlag("--quantize");
+  options.optimize = !takeFlag("--no-optimize");
+  options.generateLods = !takeFlag("--no-lods");
+  options.textures = !takeFlag("--no-textures");
+  const bool force = takeFlag("--force");
+
+  if (auto errors = takeOption("--lod-errors"))
+  {
+    // Comma-separated list of relative errors, one per LOD
+    options.lodSettings.errors.clear();
+    for (auto part : std::views::split(*errors, ','))
+    {
+      const std::string_view error(part.begin(), part.end());
+      float value = 0;
+      const auto [ptr, ec] = std::from_chars(error.data(), error.data() + error.size(), value);
+      if (ec != std::errc{} || ptr != error.data() + error.size() || !(value >= 0))
+      {
+        spdlog::error("Invalid LOD error '{}'\n{}", error, USAGE);
+        return EXIT_FAILURE;
+      }
+      options.lodSettings.errors.push_back(value);
+    }
+  }
+
+  const auto outputPath = takeOption("--output");
+  const auto outputDir = takeOption("--output-dir");
+  const auto depfilePath = takeOption("--depfile");
+
+  std::uint32_t jobCount = std::max(std::thread::hardware_concurrency(), 1u);
+  if (auto jobs = takeOption("--jobs"))
+  {
+    const auto [ptr, error] = std::from_chars(jobs->data(), jobs->data() + jobs->size(), jobCount);
+    if (error != std::errc{} || ptr != jobs->data() + jobs->size() || jobCount == 0)
+    {
+      spdlog::error("Invalid amount of jobs '{}'", *jobs);
+      return EXIT_FAILURE;
+    }
+  }
+
+  const bool unknownOption =
+    std::ranges::any_of(args, [](std::string_view arg) { return arg.starts_with("--"); });
+  if (args.empty() || unknownOption || (outputPath.has_value() && outputDir.has_value()))
+  {
+    spdlog::error("{}", USAGE);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::pair<std::filesystem::path, std::filesystem::path>> scenes;
+  for (auto arg : args)
+  {
+    const std::filesystem::path input = arg;
+    if (!collect_scenes(input, input.parent_path(), scenes))
+      return EXIT_FAILURE;
+  }
+
+  // The same scene might be listed several times
+  std::sort(scenes.begin(), scenes.end());
+  scenes.erase(std::unique(scenes.begin(), scenes.end()), scenes.end());
+
+  if ((outputPath.has_value() || depfilePath.has_value()) && scenes.size() != 1)
+  {
+    spdlog::error("--output and --depfile can only be used with a single input scene");
+    return EXIT_FAILURE;
+  }
+
+  std::vector<BakingJob> jobs;
+  jobs.reserve(scenes.size());
+  for (const auto& [input, relative] : scenes)
+  {
+    // By default, the baked scene is put right next to the source one
+    std::filesystem::path output = std::filesystem::path(input);
+    if (outputPath.has_value())
+      output = *outputPath;
+    else if (outputDir.has_value())
+      output = std::filesystem::path(*outputDir) / relative;
+    if (!outputPath.has_value())
+      output.replace_extension(BAKED_SCENE_EXTENSION);
+    jobs.push_back(BakingJob{.input = input, .output = std::move(output)});
+  }
+
+  ContentHash keyHash;
+  keyHash.update(fmt::format(
+    "baker={};format={};{}", SCENE_BAKER_VERSION, BAKED_SCENE_VERSION, options.describe()));
+  const std::uint64_t key = keyHash.get();
+
+  std::atomic<std::size_t> bakedCount = 0;
+  std::atomic<std::size_t> skippedCount = 0;
+  std::atomic<std::size_t> failedCount = 0;
+
+  // Scenes are baked in parallel. A lonely scene gets all of the threads
+  // for itself instead, as most baking steps are parallel internally too.
+  const bool parallelScenes = jobs.size() > 1;
+  ThreadPool pool(parallelScenes ? jobCount - 1 : 0);
+
+  pool.parallelFor(jobs.size(), [&](std::size_t i) {
+    const auto& [input, output] = jobs[i];
+
+    std::optional<BakeCacheEntry> entry;
+    const auto cached = force ? std::nullopt : read_cache_entry(output);
+    if (cached.has_value() && is_up_to_date(output, *cached, key))
+    {
+      spdlog::info("'{}' is up to date", output);
+
+      // Build systems only look at modification times, so the output has to look fresh
+      std::error_code error;
+      std::filesystem::last_write_time(
+        output, std::filesystem::file_time_type::clock::now(), error);
+
+      entry = cached;
+      ++skippedCount;
+    }
+    else
+    {
+      // A half-written output must never look up to date
+      remove_cache_entry(output);
+
+      std::error_code error;
+      if (output.has_parent_path())
+        std::filesystem::create_directories(output.parent_path(), error);
+
+      GltfLoader loader(GltfLoader::CreateInfo{
+        .workerThreadCount = parallelScenes ? 0 : jobCount - 1,
+        .deferImageDecoding = true,
+      });
+
+      const auto files = bake_scene(loader, input, output, options);
+      if (!files.has_value())
+      {
+        spdlog::error("Failed to bake '{}'", input);
+        ++failedCount;
+        return;
+      }
+
+      entry.emplace(BakeCacheEntry{.key = key, .dependencies = {}, .outputs = {}});
+      for (const auto& path : files->dependencies)
+        if (auto hash = hash_file(path))
+          entry->dependencies.push_back(BakeDependency{.path = path, .hash = *hash});
+      for (const auto& path : files->outputs)
+        if (auto hash = hash_file(path))
+          entry->outputs.push_back(BakeDependency{.path = path, .hash = *hash});
+
+      if (!write_cache_entry(output, *entry))
+      {
+        ++failedCount;
+        return;
+      }
+      ++bakedCount;
+    }
+
+    // Has to be rewritten even if nothing changed, as the build system might have lost it
+    if (depfilePath.has_value() && !write_depfile(*depfilePath, output, entry->dependencies))
+      ++failedCount;
+  });
+
+  spdlog::info(
+    "Baked {} scenes, {} up to date, {} failed",
+    bakedCount.load(),
+    skippedCount.load(),
+    failedCount.load());
+
+  return failedCount == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
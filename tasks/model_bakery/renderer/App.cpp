@@ -3,14 +3,14 @@
 #include <tracy/Tracy.hpp>
 
 
-App::App()
+App::App(std::uint32_t scene_copies)
 {
   glm::uvec2 initialRes = {1280, 720};
   mainWindow = windowing.createWindow(OsWindow::CreateInfo{
     .resolution = initialRes,
   });
 
-  renderer.reset(new Renderer(initialRes));
+  renderer.reset(new Renderer(initialRes, scene_copies));
 
   auto instExts = windowing.getRequiredVulkanInstanceExtensions();
   renderer->initVulkan(instExts);
@@ -21,7 +21,7 @@ App::App()
 
   mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
 
-  renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
+  renderer->loadScene(MODEL_BAKERY_RENDERER_BAKED_SCENES_ROOT "low_poly_dark_town/scene.baked");
 }
 
 void App::run()
@@ -63,6 +63,10 @@ void App::processInput(float dt)
     rotateCam(mainCam, mainWindow->mouse, dt);
 
   renderer->debugInput(mainWindow->keyboard);
+
+  // The cursor is hidden while the mouse is captured
+  if (!mainWindow->captureMouse && mainWindow->mouse[MouseButton::mbLeft] == ButtonState::Rising)
+    renderer->pick(mainWindow->mouse.freePos);
 }
 
 void App::drawFrame()
@@ -9,7 +9,7 @@
 class App
 {
 public:
-  App();
+  explicit App(std::uint32_t scene_copies);
 
   void run();
 
@@ -7,8 +7,9 @@
 #include <etna/Profiling.hpp>
 
 
-Renderer::Renderer(glm::uvec2 res)
+Renderer::Renderer(glm::uvec2 res, std::uint32_t scene_copies)
   : resolution{res}
+  , sceneCopies{scene_copies}
 {
 }
 
@@ -23,12 +24,25 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+  // The GPU instance culling path draws as many relems as the culling shader has emitted
+  vk::PhysicalDeviceVulkan12Features vulkan12Features{
+    .drawIndirectCount = VK_TRUE,
+  };
+
   etna::initialize(etna::InitParams{
     .applicationName = "model_bakery_renderer",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {}},
+    .features = vk::PhysicalDeviceFeatures2{
+      .pNext = &vulkan12Features,
+      .features = {
+        // Meshlet culling draws all meshlets with a single multi-draw per index format,
+        // and meshlet draws carry the index of their instance as the first instance.
+        .multiDrawIndirect = VK_TRUE,
+        .drawIndirectFirstInstance = VK_TRUE,
+      },
+    },
     .physicalDeviceIndexOverride = {},
     .numFramesInFlight = 2,
   });
@@ -54,7 +68,7 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
 
   resolution = {w, h};
 
-  worldRenderer = std::make_unique<WorldRenderer>();
+  worldRenderer = std::make_unique<WorldRenderer>(sceneCopies);
 
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
@@ -85,6 +99,11 @@ void Renderer::debugInput(const Keyboard& kb)
   }
 }
 
+void Renderer::pick(glm::vec2 cursor_pos)
+{
+  worldRenderer->pick(cursor_pos);
+}
+
 void Renderer::update(const FramePacket& packet)
 {
   worldRenderer->update(packet);
@@ -16,7 +16,7 @@ using ResolutionProvider = fu2::unique_function<glm::uvec2() const>;
 class Renderer
 {
 public:
-  explicit Renderer(glm::uvec2 resolution);
+  Renderer(glm::uvec2 resolution, std::uint32_t scene_copies);
   ~Renderer();
 
   void initVulkan(std::span<const char*> instance_extensions);
@@ -25,6 +25,7 @@ public:
   void loadScene(std::filesystem::path path);
 
   void debugInput(const Keyboard& kb);
+  void pick(glm::vec2 cursor_pos);
   void update(const FramePacket& packet);
   void drawFrame();
 
@@ -35,6 +36,7 @@ private:
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 
   glm::uvec2 resolution;
+  std::uint32_t sceneCopies;
   bool useVsync = true;
 
   std::unique_ptr<WorldRenderer> worldRenderer;
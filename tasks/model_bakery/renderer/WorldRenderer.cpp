@@ -1,14 +1,39 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+#include <tracy/Tracy.hpp>
+#include <etna/Etna.hpp>
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
+#include <etna/DescriptorSet.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
 
+#include "scene/BakedScene.hpp"
+#include "scene/FrustumCulling.hpp"
+#include "scene/LodSelection.hpp"
+#include "occlusion/SoftwareOcclusion.hpp"
+
 
-WorldRenderer::WorldRenderer()
-  : sceneMgr{std::make_unique<SceneManager>()}
+WorldRenderer::WorldRenderer(std::uint32_t scene_copies)
+  : sceneMgr{std::make_unique<SceneManager>(SceneManager::CreateInfo{
+      // The main thread participates in model processing too
+      .workerThreadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1,
+      .generateLods = true,
+      .sceneCopies = scene_copies,
+      // Simple enough to be rasterized on the CPU for occlusion culling
+      .maxOccluderTriangles = 512,
+    })}
+  , occlusionWorkers{std::max(std::thread::hardware_concurrency(), 1u) - 1}
+  , occlusionRasterizer{OcclusionRasterizer::CreateInfo{.workers = &occlusionWorkers}}
 {
 }
 
@@ -22,13 +47,33 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
     .extent = vk::Extent3D{resolution.x, resolution.y, 1},
     .name = "main_view_depth",
     .format = vk::Format::eD32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+    // Sampled to build the Hi-Z pyramid
+    .imageUsage =
+      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+  });
+
+  // Odd sizes are rounded down, the last row and column of a level cover the leftovers
+  const glm::uvec2 hizSize = glm::max(resolution / 2u, glm::uvec2(1));
+  hizLevelCount = static_cast<std::uint32_t>(std::bit_width(std::max(hizSize.x, hizSize.y)));
+  hiZ = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{hizSize.x, hizSize.y, 1},
+    .name = "hi_z",
+    .format = vk::Format::eR32Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+    .mipLevels = hizLevelCount,
   });
+
+  // Every texel is fetched directly, so filtering doesn't matter
+  hizSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "hiz_sampler"});
 }
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
-  sceneMgr->selectScene(path);
+  // Loading happens in the background, the scene shows up once it's ready
+  if (path.extension() == BAKED_SCENE_EXTENSION)
+    sceneMgr->selectBakedSceneAsync(path);
+  else
+    sceneMgr->selectSceneAsync(path);
 }
 
 void WorldRenderer::loadShaders()
@@ -37,50 +82,596 @@ void WorldRenderer::loadShaders()
     "static_mesh_material",
     {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
      MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
+  etna::create_program(
+    "static_mesh_quantized_material",
+    {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
+     MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh_quantized.vert.spv"});
   etna::create_program("static_mesh", {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
+  etna::create_program(
+    "static_mesh_quantized", {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh_quantized.vert.spv"});
+  etna::create_program(
+    "lod_selection", {MODEL_BAKERY_RENDERER_SHADERS_ROOT "lod_selection.comp.spv"});
+  etna::create_program(
+    "meshlet_culling", {MODEL_BAKERY_RENDERER_SHADERS_ROOT "meshlet_culling.comp.spv"});
+  etna::create_program(
+    "instance_culling", {MODEL_BAKERY_RENDERER_SHADERS_ROOT "instance_culling.comp.spv"});
+  etna::create_program("hiz_build", {MODEL_BAKERY_RENDERER_SHADERS_ROOT "hiz_build.comp.spv"});
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
-  etna::VertexShaderInputDescription sceneVertexInputDesc{
-    .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
-    }},
-  };
-
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
+  // Baked scenes may come with quantized vertices, which are
+  // read by a different vertex shader with a different vertex input.
+  // Depth-only pipelines are used by the pre-pass and have no fragment shader.
+  const auto createPipeline = [&](const char* program, VertexFormat format, bool depth_only) {
+    return pipelineManager.createGraphicsPipeline(
+      program,
+      etna::GraphicsPipeline::CreateInfo{
+        .vertexShaderInput =
+          etna::VertexShaderInputDescription{
+            .bindings = {etna::VertexShaderInputDescription::Binding{
+              .byteStreamDescription = SceneManager::getVertexFormatDescription(format),
+            }},
+          },
+        .rasterizationConfig =
+          vk::PipelineRasterizationStateCreateInfo{
+            .polygonMode = vk::PolygonMode::eFill,
+            .cullMode = vk::CullModeFlagBits::eBack,
+            .frontFace = vk::FrontFace::eCounterClockwise,
+            .lineWidth = 1.f,
+          },
+        // The forward pass after the pre-pass produces exactly the same depth again
+        .depthConfig =
+          vk::PipelineDepthStencilStateCreateInfo{
+            .depthTestEnable = VK_TRUE,
+            .depthWriteEnable = VK_TRUE,
+            .depthCompareOp = vk::CompareOp::eLessOrEqual,
+            .maxDepthBounds = 1.f,
+          },
+        .fragmentShaderOutput =
+          {
+            .colorAttachmentFormats =
+              depth_only ? std::vector<vk::Format>{} : std::vector<vk::Format>{swapchain_format},
+            .depthAttachmentFormat = vk::Format::eD32Sfloat,
+          },
+      });
+  };
+
   staticMeshPipeline = {};
-  staticMeshPipeline = pipelineManager.createGraphicsPipeline(
-    "static_mesh_material",
-    etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {swapchain_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
+  staticMeshPipeline = createPipeline("static_mesh_material", VertexFormat::Full, false);
+  quantizedStaticMeshPipeline = {};
+  quantizedStaticMeshPipeline =
+    createPipeline("static_mesh_quantized_material", VertexFormat::Quantized, false);
+  depthOnlyPipeline = {};
+  depthOnlyPipeline = createPipeline("static_mesh", VertexFormat::Full, true);
+  quantizedDepthOnlyPipeline = {};
+  quantizedDepthOnlyPipeline =
+    createPipeline("static_mesh_quantized", VertexFormat::Quantized, true);
+
+  lodSelectionPipeline = {};
+  lodSelectionPipeline = pipelineManager.createComputePipeline("lod_selection", {});
+  meshletCullingPipeline = {};
+  meshletCullingPipeline = pipelineManager.createComputePipeline("meshlet_culling", {});
+  instanceCullingPipeline = {};
+  instanceCullingPipeline = pipelineManager.createComputePipeline("instance_culling", {});
+  hizBuildPipeline = {};
+  hizBuildPipeline = pipelineManager.createComputePipeline("hiz_build", {});
+}
+
+void WorldRenderer::debugInput(const Keyboard& kb)
+{
+  if (kb[KeyboardKey::kC] == ButtonState::Falling)
+  {
+    switch (cullingPath)
+    {
+    case CullingPath::Cpu:
+      cullingPath = CullingPath::GpuInstances;
+      spdlog::info("Culling instances on the GPU");
+      break;
+    case CullingPath::GpuInstances:
+      cullingPath = CullingPath::GpuMeshlets;
+      spdlog::info("Culling meshlets on the GPU");
+      break;
+    case CullingPath::GpuMeshlets:
+      cullingPath = CullingPath::Cpu;
+      spdlog::info("Culling instances on the CPU");
+      break;
+    }
+  }
+
+  if (kb[KeyboardKey::kV] == ButtonState::Falling)
+  {
+    useConeCulling = !useConeCulling;
+    spdlog::info("Meshlet cone culling {}", useConeCulling ? "enabled" : "disabled");
+  }
+
+  if (kb[KeyboardKey::kL] == ButtonState::Falling)
+  {
+    useLods = !useLods;
+    spdlog::info("LODs {}", useLods ? "enabled" : "disabled");
+  }
+
+  if (kb[KeyboardKey::kH] == ButtonState::Falling)
+  {
+    useBvhCulling = !useBvhCulling;
+    spdlog::info("BVH culling {}", useBvhCulling ? "enabled" : "disabled");
+  }
+
+  if (kb[KeyboardKey::kO] == ButtonState::Falling)
+  {
+    useOcclusionCulling = !useOcclusionCulling;
+    spdlog::info(
+      "Occlusion culling {} for the GPU paths", useOcclusionCulling ? "enabled" : "disabled");
+  }
+
+  if (kb[KeyboardKey::kZ] == ButtonState::Falling)
+  {
+    useDepthPrepass = !useDepthPrepass;
+    spdlog::info(
+      "Depth pre-pass {} for GPU occlusion culling", useDepthPrepass ? "enabled" : "disabled");
+  }
+
+  if (kb[KeyboardKey::kX] == ButtonState::Falling)
+  {
+    useSoftwareOcclusion = !useSoftwareOcclusion;
+    spdlog::info("Software occlusion culling {}", useSoftwareOcclusion ? "enabled" : "disabled");
+  }
 }
 
-void WorldRenderer::debugInput(const Keyboard&) {}
+void WorldRenderer::pick(glm::vec2 cursor_pos)
+{
+  // Points on the near and far planes under the cursor
+  const glm::vec2 ndc = cursor_pos / glm::vec2(resolution) * 2.0f - 1.0f;
+  const glm::mat4x4 invViewProj = glm::inverse(worldViewProj);
+  const glm::vec4 nearPoint = invViewProj * glm::vec4(ndc, 0.0f, 1.0f);
+  const glm::vec4 farPoint = invViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+  const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+  const glm::vec3 target = glm::vec3(farPoint) / farPoint.w;
+
+  const auto hit = sceneMgr->raycast(origin, glm::normalize(target - origin));
+  if (!hit.has_value())
+  {
+    spdlog::info("Picked nothing");
+    return;
+  }
+
+  spdlog::info(
+    "Picked instance {} (mesh {}), relem {} at distance {:.2f}",
+    hit->instance,
+    sceneMgr->getInstanceMeshes()[hit->instance],
+    hit->relem,
+    hit->distance);
+}
 
 void WorldRenderer::update(const FramePacket& packet)
 {
   ZoneScoped;
 
+  sceneMgr->update();
+
   // calc camera matrix
   {
     const float aspect = float(resolution.x) / float(resolution.y);
     worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
   }
+
+  cullingParams.viewProj = worldViewProj;
+  cullingParams.cameraPosition = glm::vec4(packet.mainCam.position, 1.0f);
+  cullingParams.coneCulling = useConeCulling;
+  cullingParams.emitAllVisible = useDepthPrepass;
+  cullingParams.depthSize = resolution;
+  cullingParams.hizLevelCount = hizLevelCount;
+
+  instanceCullingParams.viewProj = worldViewProj;
+  instanceCullingParams.emitAllVisible = useDepthPrepass;
+  instanceCullingParams.depthSize = resolution;
+  instanceCullingParams.hizLevelCount = hizLevelCount;
+
+  // An error of a pixel is hardly noticeable, while hysteresis of a quarter of that
+  // is enough to not switch LODs back and forth on tiny camera movements.
+  const glm::mat4x4 proj = packet.mainCam.projTm(float(resolution.x) / float(resolution.y));
+  lodParams.cameraPosition = glm::vec4(packet.mainCam.position, 1.0f);
+  lodParams.projectionScale = float(resolution.y) * 0.5f * std::abs(proj[1][1]);
+  lodParams.maxPixelError = useLods ? 1.0f : -1.0f;
+  lodParams.hysteresis = 0.25f;
+}
+
+void WorldRenderer::selectLods(vk::CommandBuffer cmd_buf)
+{
+  ETNA_PROFILE_GPU(cmd_buf, selectLods);
+
+  lodParams.instanceCount = static_cast<std::uint32_t>(sceneMgr->getInstanceMeshes().size());
+  if (lodParams.instanceCount == 0)
+    return;
+
+  auto programInfo = etna::get_shader_program("lod_selection");
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, sceneMgr->getMeshBuffer().genBinding()},
+      etna::Binding{1, sceneMgr->getLodBuffer().genBinding()},
+      etna::Binding{2, sceneMgr->getInstanceDataBuffer().genBinding()},
+      etna::Binding{3, sceneMgr->getInstanceMeshBuffer().genBinding()},
+      etna::Binding{4, sceneMgr->getInstanceLodBuffer().genBinding()},
+    });
+  vk::DescriptorSet vkSet = set.getVkSet();
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, lodSelectionPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    lodSelectionPipeline.getVkPipelineLayout(),
+    0,
+    1,
+    &vkSet,
+    0,
+    nullptr);
+  cmd_buf.pushConstants<LodSelectionParams>(
+    lodSelectionPipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    {lodParams});
+
+  etna::flush_barriers(cmd_buf);
+
+  // Matches local_size_x of the shader
+  constexpr std::uint32_t GROUP_SIZE = 64;
+  cmd_buf.dispatch((lodParams.instanceCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+  // Culling reads the selected LODs
+  cmd_buf.pipelineBarrier(
+    vk::PipelineStageFlagBits::eComputeShader,
+    vk::PipelineStageFlagBits::eComputeShader,
+    {},
+    {vk::MemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+      .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+    }},
+    {},
+    {});
+}
+
+void WorldRenderer::cullMeshlets(vk::CommandBuffer cmd_buf, std::uint32_t occlusion_phase)
+{
+  ETNA_PROFILE_GPU(cmd_buf, cullMeshlets);
+
+  cullingParams.instanceCount = static_cast<std::uint32_t>(sceneMgr->getInstanceMeshes().size());
+  cullingParams.drawCapacity32 = sceneMgr->getMeshletDrawCapacity(IndexFormat::Uint32);
+  cullingParams.occlusionPhase = occlusion_phase;
+  if (cullingParams.instanceCount == 0)
+    return;
+
+  // The draws of the first phase read the commands and counts that are about to be rewritten
+  if (occlusion_phase == OCCLUSION_SECOND_PHASE)
+    cmd_buf.pipelineBarrier(
+      vk::PipelineStageFlagBits::eDrawIndirect,
+      vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+      {},
+      {},
+      {},
+      {});
+
+  // Culling appends to the lists, so they have to start out empty
+  cmd_buf.fillBuffer(sceneMgr->getDrawCountBuffer().get(), 0, VK_WHOLE_SIZE, 0);
+  cmd_buf.pipelineBarrier(
+    vk::PipelineStageFlagBits::eTransfer,
+    vk::PipelineStageFlagBits::eComputeShader,
+    {},
+    {vk::MemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+    }},
+    {},
+    {});
+
+  auto programInfo = etna::get_shader_program("meshlet_culling");
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, sceneMgr->getMeshBuffer().genBinding()},
+      etna::Binding{1, sceneMgr->getLodBuffer().genBinding()},
+      etna::Binding{2, sceneMgr->getRenderElementBuffer().genBinding()},
+      etna::Binding{3, sceneMgr->getMeshletBuffer().genBinding()},
+      etna::Binding{4, sceneMgr->getInstanceDataBuffer().genBinding()},
+      etna::Binding{5, sceneMgr->getInstanceMeshBuffer().genBinding()},
+      etna::Binding{6, sceneMgr->getInstanceLodBuffer().genBinding()},
+      etna::Binding{7, sceneMgr->getDrawCommandBuffer().genBinding()},
+      etna::Binding{8, sceneMgr->getDrawCountBuffer().genBinding()},
+      etna::Binding{9, sceneMgr->getMeshBoundsBuffer().genBinding()},
+      etna::Binding{10, hiZ.genBinding(hizSampler.get(), vk::ImageLayout::eGeneral)},
+      etna::Binding{11, instanceVisibility.genBinding()},
+    });
+  vk::DescriptorSet vkSet = set.getVkSet();
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, meshletCullingPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    meshletCullingPipeline.getVkPipelineLayout(),
+    0,
+    1,
+    &vkSet,
+    0,
+    nullptr);
+  cmd_buf.pushConstants<MeshletCullingParams>(
+    meshletCullingPipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    {cullingParams});
+
+  etna::flush_barriers(cmd_buf);
+
+  // A workgroup per instance. Vulkan only guarantees this many workgroups along
+  // an axis, so large scenes spill over into the second one.
+  constexpr std::uint32_t MAX_GROUP_COUNT = 65535;
+  const std::uint32_t groupCountX = std::min(cullingParams.instanceCount, MAX_GROUP_COUNT);
+  cmd_buf.dispatch(groupCountX, (cullingParams.instanceCount + groupCountX - 1) / groupCountX, 1);
+
+  cmd_buf.pipelineBarrier(
+    vk::PipelineStageFlagBits::eComputeShader,
+    vk::PipelineStageFlagBits::eDrawIndirect,
+    {},
+    {vk::MemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+      .dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead,
+    }},
+    {},
+    {});
+}
+
+void WorldRenderer::resetInstanceVisibility(vk::CommandBuffer cmd_buf)
+{
+  const auto instanceCount = sceneMgr->getInstanceMeshes().size();
+  // The previous user of this slot was the frame that the GPU has finished by now
+  retiredInstanceVisibility[frameIndex] = std::move(instanceVisibility);
+  instanceVisibility = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = std::max<vk::DeviceSize>(instanceCount, 1) * sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "instanceVisibility",
+  });
+
+  // Nothing was visible before the scene showed up, so the first phase draws nothing
+  // and the second one tests every instance against an empty depth buffer
+  cmd_buf.fillBuffer(instanceVisibility.get(), 0, VK_WHOLE_SIZE, 0);
+  cmd_buf.pipelineBarrier(
+    vk::PipelineStageFlagBits::eTransfer,
+    vk::PipelineStageFlagBits::eComputeShader,
+    {},
+    {vk::MemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+    }},
+    {},
+    {});
+
+  visibilitySceneVertexBuffer = sceneMgr->getVertexBuffer();
+}
+
+void WorldRenderer::cullInstances(vk::CommandBuffer cmd_buf, std::uint32_t occlusion_phase)
+{
+  ETNA_PROFILE_GPU(cmd_buf, cullInstances);
+
+  instanceCullingParams.instanceCount =
+    static_cast<std::uint32_t>(sceneMgr->getInstanceMeshes().size());
+  instanceCullingParams.drawCapacity32 = sceneMgr->getRelemDrawCapacity(IndexFormat::Uint32);
+  instanceCullingParams.occlusionPhase = occlusion_phase;
+  if (instanceCullingParams.instanceCount == 0)
+    return;
+
+  // The draws of the first phase read the commands and counts that are about to be rewritten
+  if (occlusion_phase == OCCLUSION_SECOND_PHASE)
+    cmd_buf.pipelineBarrier(
+      vk::PipelineStageFlagBits::eDrawIndirect,
+      vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+      {},
+      {},
+      {},
+      {});
+
+  // Culling appends to the lists, so they have to start out empty
+  cmd_buf.fillBuffer(sceneMgr->getDrawCountBuffer().get(), 0, VK_WHOLE_SIZE, 0);
+  cmd_buf.pipelineBarrier(
+    vk::PipelineStageFlagBits::eTransfer,
+    vk::PipelineStageFlagBits::eComputeShader,
+    {},
+    {vk::MemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+    }},
+    {},
+    {});
+
+  auto programInfo = etna::get_shader_program("instance_culling");
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, sceneMgr->getMeshBuffer().genBinding()},
+      etna::Binding{1, sceneMgr->getLodBuffer().genBinding()},
+      etna::Binding{2, sceneMgr->getRenderElementBuffer().genBinding()},
+      etna::Binding{3, sceneMgr->getInstanceDataBuffer().genBinding()},
+      etna::Binding{4, sceneMgr->getInstanceMeshBuffer().genBinding()},
+      etna::Binding{5, sceneMgr->getInstanceLodBuffer().genBinding()},
+      etna::Binding{6, sceneMgr->getRelemDrawCommandBuffer().genBinding()},
+      etna::Binding{7, sceneMgr->getDrawCountBuffer().genBinding()},
+      etna::Binding{8, hiZ.genBinding(hizSampler.get(), vk::ImageLayout::eGeneral)},
+      etna::Binding{9, instanceVisibility.genBinding()},
+      etna::Binding{10, sceneMgr->getMeshBoundsBuffer().genBinding()},
+    });
+  vk::DescriptorSet vkSet = set.getVkSet();
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, instanceCullingPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    instanceCullingPipeline.getVkPipelineLayout(),
+    0,
+    1,
+    &vkSet,
+    0,
+    nullptr);
+  cmd_buf.pushConstants<InstanceCullingParams>(
+    instanceCullingPipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    {instanceCullingParams});
+
+  etna::flush_barriers(cmd_buf);
+
+  // Matches local_size_x of the shader
+  constexpr std::uint32_t GROUP_SIZE = 64;
+  cmd_buf.dispatch((instanceCullingParams.instanceCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+  cmd_buf.pipelineBarrier(
+    vk::PipelineStageFlagBits::eComputeShader,
+    vk::PipelineStageFlagBits::eDrawIndirect,
+    {},
+    {vk::MemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+      .dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead,
+    }},
+    {},
+    {});
+}
+
+void WorldRenderer::cullOnGpu(vk::CommandBuffer cmd_buf, std::uint32_t occlusion_phase)
+{
+  if (cullingPath == CullingPath::GpuMeshlets)
+    cullMeshlets(cmd_buf, occlusion_phase);
+  else
+    cullInstances(cmd_buf, occlusion_phase);
+}
+
+void WorldRenderer::buildHiZ(vk::CommandBuffer cmd_buf)
+{
+  ETNA_PROFILE_GPU(cmd_buf, buildHiZ);
+
+  auto programInfo = etna::get_shader_program("hiz_build");
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, hizBuildPipeline.getVkPipeline());
+
+  // Every level is reduced from the previous one, the first one from the depth buffer itself
+  glm::uvec2 srcSize = resolution;
+  for (std::uint32_t level = 0; level < hizLevelCount; ++level)
+  {
+    const glm::uvec2 dstSize = glm::max(srcSize / 2u, glm::uvec2(1));
+
+    auto set = etna::create_descriptor_set(
+      programInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{
+          0,
+          level == 0
+            ? mainViewDepth.genBinding(hizSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)
+            : hiZ.genBinding(
+                hizSampler.get(),
+                vk::ImageLayout::eGeneral,
+                {.baseMip = level - 1, .levelCount = 1})},
+        etna::Binding{
+          1, hiZ.genBinding({}, vk::ImageLayout::eGeneral, {.baseMip = level, .levelCount = 1})},
+      });
+    vk::DescriptorSet vkSet = set.getVkSet();
+
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      hizBuildPipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+    cmd_buf.pushConstants<HizBuildParams>(
+      hizBuildPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      {HizBuildParams{.srcSize = srcSize, .dstSize = dstSize}});
+
+    etna::flush_barriers(cmd_buf);
+
+    // Matches local_size_x and local_size_y of the shader
+    constexpr std::uint32_t GROUP_SIZE = 8;
+    cmd_buf.dispatch(
+      (dstSize.x + GROUP_SIZE - 1) / GROUP_SIZE, (dstSize.y + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+    // Read by the next level or by the culling
+    cmd_buf.pipelineBarrier(
+      vk::PipelineStageFlagBits::eComputeShader,
+      vk::PipelineStageFlagBits::eComputeShader,
+      {},
+      {vk::MemoryBarrier{
+        .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+      }},
+      {},
+      {});
+
+    srcSize = dstSize;
+  }
+}
+
+void WorldRenderer::bindInstanceData(
+  vk::CommandBuffer cmd_buf, const char* program, const etna::GraphicsPipeline& pipeline)
+{
+  auto programInfo = etna::get_shader_program(program);
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{
+      0,
+      cullingPath == CullingPath::Cpu ? frameInstanceBuffers[frameIndex].buffer.genBinding()
+                                      : sceneMgr->getInstanceDataBuffer().genBinding()}});
+  vk::DescriptorSet vkSet = set.getVkSet();
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics, pipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+}
+
+void WorldRenderer::renderDepthPrepass(vk::CommandBuffer cmd_buf)
+{
+  ETNA_PROFILE_GPU(cmd_buf, renderDepthPrepass);
+
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {resolution.x, resolution.y}},
+    {},
+    {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
+
+  const bool quantized = sceneMgr->getVertexFormat() == VertexFormat::Quantized;
+  const auto& pipeline = quantized ? quantizedDepthOnlyPipeline : depthOnlyPipeline;
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+  bindInstanceData(cmd_buf, quantized ? "static_mesh_quantized" : "static_mesh", pipeline);
+  renderScene(cmd_buf, worldViewProj, pipeline.getVkPipelineLayout());
+}
+
+void WorldRenderer::renderForward(
+  vk::CommandBuffer cmd_buf,
+  vk::Image target_image,
+  vk::ImageView target_image_view,
+  vk::AttachmentLoadOp color_load_op,
+  vk::AttachmentLoadOp depth_load_op)
+{
+  ETNA_PROFILE_GPU(cmd_buf, renderForward);
+
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {resolution.x, resolution.y}},
+    {{.image = target_image, .view = target_image_view, .loadOp = color_load_op}},
+    {.image = mainViewDepth.get(), .view = mainViewDepth.getView({}), .loadOp = depth_load_op});
+
+  const bool quantized = sceneMgr->getVertexFormat() == VertexFormat::Quantized;
+  const auto& pipeline = quantized ? quantizedStaticMeshPipeline : staticMeshPipeline;
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+
+  if (sceneMgr->getVertexBuffer())
+    bindInstanceData(
+      cmd_buf,
+      quantized ? "static_mesh_quantized_material" : "static_mesh_material",
+      pipeline);
+
+  renderScene(cmd_buf, worldViewProj, pipeline.getVkPipelineLayout());
 }
 
 void WorldRenderer::renderScene(
@@ -90,32 +681,172 @@ void WorldRenderer::renderScene(
     return;
 
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
-  pushConst2M.projView = glob_tm;
+  pushConst.projView = glob_tm;
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst});
+
+  if (cullingPath != CullingPath::Cpu)
+  {
+    // Draws are compacted by the culling shaders and counted on the GPU, the capacities
+    // are only upper bounds. Draws of 32-bit relems go first, as do their counts.
+    const bool meshlets = cullingPath == CullingPath::GpuMeshlets;
+    const auto& commands =
+      meshlets ? sceneMgr->getDrawCommandBuffer() : sceneMgr->getRelemDrawCommandBuffer();
+    constexpr vk::DeviceSize STRIDE = sizeof(vk::DrawIndexedIndirectCommand);
+    vk::DeviceSize offset = 0;
+    for (auto format : {IndexFormat::Uint32, IndexFormat::Uint16})
+    {
+      const auto capacity = meshlets ? sceneMgr->getMeshletDrawCapacity(format)
+                                     : sceneMgr->getRelemDrawCapacity(format);
+      if (capacity == 0)
+        continue;
+      cmd_buf.bindIndexBuffer(
+        sceneMgr->getIndexBuffer(),
+        sceneMgr->getIndexBufferOffset(format),
+        SceneManager::getVkIndexType(format));
+      cmd_buf.drawIndexedIndirectCount(
+        commands.get(),
+        offset,
+        sceneMgr->getDrawCountBuffer().get(),
+        static_cast<vk::DeviceSize>(format) * sizeof(std::uint32_t),
+        capacity,
+        static_cast<std::uint32_t>(STRIDE));
+      offset += capacity * STRIDE;
+    }
+    return;
+  }
+
+  auto relems = sceneMgr->getRenderElements();
+
+  // Small relems use 16-bit indices, which live in a separate region of the index buffer
+  std::optional<IndexFormat> boundIndexFormat;
+  std::int64_t drawCount = 0;
+
+  for (const auto& batch : instanceBatches)
+    for (std::uint32_t i = batch.firstRelem; i < batch.firstRelem + batch.relemCount; ++i)
+    {
+      const auto& relem = relems[i];
+      if (boundIndexFormat != relem.indexFormat)
+      {
+        cmd_buf.bindIndexBuffer(
+          sceneMgr->getIndexBuffer(),
+          sceneMgr->getIndexBufferOffset(relem.indexFormat),
+          SceneManager::getVkIndexType(relem.indexFormat));
+        boundIndexFormat = relem.indexFormat;
+      }
+      // The vertex shader fetches the instance data of the batch starting at its first instance
+      cmd_buf.drawIndexed(
+        relem.indexCount,
+        batch.instanceCount,
+        relem.indexOffset,
+        relem.vertexOffset,
+        batch.firstInstance);
+      ++drawCount;
+    }
+
+  TracyPlot("Draw calls", drawCount);
+}
+
+void WorldRenderer::batchInstances()
+{
+  ZoneScoped;
 
-  auto instanceMeshes = sceneMgr->getInstanceMeshes();
   auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  auto instanceMeshes = sceneMgr->getInstanceMeshes();
+  auto instanceData = sceneMgr->getInstanceData();
 
   auto meshes = sceneMgr->getMeshes();
-  auto relems = sceneMgr->getRenderElements();
+  auto lods = sceneMgr->getLods();
+
+  // A new scene starts out with the finest LODs
+  instanceLods.resize(instanceMeshes.size(), 0);
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
   {
-    pushConst2M.model = instanceMatrices[instIdx];
+    ZoneScopedN("cullInstances");
+    const auto& bounds = sceneMgr->getInstanceBounds();
+    if (useBvhCulling)
+    {
+      visibleInstances.clear();
+      sceneMgr->getBvh().cullFrustum(extract_frustum(worldViewProj), visibleInstances);
+    }
+    else
+      cull_boxes(extract_frustum(worldViewProj), bounds, visibleInstances);
+    TracyPlot("Tested instances", static_cast<std::int64_t>(bounds.count));
+    TracyPlot("Visible instances", static_cast<std::int64_t>(visibleInstances.size()));
+  }
 
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+  if (useSoftwareOcclusion)
+  {
+    const auto stats = cull_occluded_instances(
+      occlusionRasterizer,
+      *sceneMgr,
+      worldViewProj,
+      glm::vec3(lodParams.cameraPosition),
+      visibleInstances);
+    TracyPlot("Occluders", static_cast<std::int64_t>(stats.occluderCount));
+    TracyPlot("Occluded instances", static_cast<std::int64_t>(stats.occludedCount));
+  }
+
+  // Instances of the same mesh with the same LOD end up next to each other
+  batchKeys.clear();
+  const LodCriteria lodCriteria{
+    .cameraPosition = glm::vec3(lodParams.cameraPosition),
+    .projectionScale = lodParams.projectionScale,
+    .maxPixelError = lodParams.maxPixelError,
+    .hysteresis = lodParams.hysteresis,
+  };
+  for (auto instIdx : visibleInstances)
+  {
+    const auto& mesh = meshes[instanceMeshes[instIdx]];
+    const auto lod =
+      select_lod(lodCriteria, mesh, lods, instanceMatrices[instIdx], instanceLods[instIdx]);
+    instanceLods[instIdx] = lod;
+    batchKeys.push_back(BatchKey{.mesh = instanceMeshes[instIdx], .lod = lod, .instance = instIdx});
+  }
+  std::ranges::sort(
+    batchKeys, {}, [](const BatchKey& key) { return std::pair(key.mesh, key.lod); });
+
+  // The previous user of this buffer was the frame that the GPU has finished by now
+  auto& target = frameInstanceBuffers[frameIndex];
+  const std::size_t requiredSize =
+    std::max<std::size_t>(batchKeys.size(), 1) * sizeof(InstanceData);
+  if (target.capacity < requiredSize)
+  {
+    target.capacity = std::max(requiredSize, 2 * target.capacity);
+    target.buffer = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = target.capacity,
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .name = "batchedInstanceData",
+    });
+    target.buffer.map();
+  }
 
-    const auto meshIdx = instanceMeshes[instIdx];
+  instanceBatches.clear();
+  std::byte* const batched = target.buffer.data();
+  for (std::uint32_t i = 0; i < batchKeys.size(); ++i)
+  {
+    const auto& key = batchKeys[i];
+    std::memcpy(
+      batched + i * sizeof(InstanceData), &instanceData[key.instance], sizeof(InstanceData));
 
-    for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+    if (i > 0 && batchKeys[i - 1].mesh == key.mesh && batchKeys[i - 1].lod == key.lod)
     {
-      const auto relemIdx = meshes[meshIdx].firstRelem + j;
-      const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      ++instanceBatches.back().instanceCount;
+      continue;
     }
+
+    const auto& mesh = meshes[key.mesh];
+    instanceBatches.push_back(InstanceBatch{
+      .firstRelem = key.lod == 0 ? mesh.firstRelem : lods[mesh.firstLod + key.lod - 1].firstRelem,
+      .relemCount = key.lod == 0 ? mesh.relemCount : lods[mesh.firstLod + key.lod - 1].relemCount,
+      .firstInstance = i,
+      .instanceCount = 1,
+    });
   }
+
+  TracyPlot("Instance batches", static_cast<std::int64_t>(instanceBatches.size()));
 }
 
 void WorldRenderer::renderWorld(
@@ -123,17 +854,74 @@ void WorldRenderer::renderWorld(
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
-  // draw final scene to screen
+  const auto recordingStart = std::chrono::steady_clock::now();
+
+  frameIndex = (frameIndex + 1) % FRAMES_IN_FLIGHT;
+  if (cullingPath == CullingPath::Cpu && sceneMgr->getVertexBuffer())
+    batchInstances();
+
+  // Both GPU paths cull occluded instances, the meshlet one also culls occluded meshlets
+  const bool occlusion =
+    cullingPath != CullingPath::Cpu && useOcclusionCulling && sceneMgr->getVertexBuffer();
+
+  // Has to happen outside of rendering
+  if (cullingPath != CullingPath::Cpu && sceneMgr->getVertexBuffer())
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderForward);
+    // The previous frame might still be reading the commands, counts and LODs that we are
+    // about to overwrite, while the LODs it has written are read by the selection.
+    cmd_buf.pipelineBarrier(
+      vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect,
+      vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+      {},
+      {vk::MemoryBarrier{
+        .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite |
+          vk::AccessFlagBits::eTransferWrite,
+      }},
+      {},
+      {});
+
+    selectLods(cmd_buf);
+    if (sceneMgr->getVertexBuffer() != visibilitySceneVertexBuffer)
+      resetInstanceVisibility(cmd_buf);
+    cullOnGpu(cmd_buf, occlusion ? OCCLUSION_FIRST_PHASE : OCCLUSION_DISABLED);
+  }
 
-    etna::RenderTargetState renderTargets(
+  if (!occlusion)
+  {
+    renderForward(
       cmd_buf,
-      {{0, 0}, {resolution.x, resolution.y}},
-      {{.image = target_image, .view = target_image_view}},
-      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
+      target_image,
+      target_image_view,
+      vk::AttachmentLoadOp::eClear,
+      vk::AttachmentLoadOp::eClear);
+  }
+  else
+  {
+    // Whatever was visible last frame is likely to be visible now and to hide most of the rest
+    if (useDepthPrepass)
+      renderDepthPrepass(cmd_buf);
+    else
+      renderForward(
+        cmd_buf,
+        target_image,
+        target_image_view,
+        vk::AttachmentLoadOp::eClear,
+        vk::AttachmentLoadOp::eClear);
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, staticMeshPipeline.getVkPipeline());
-    renderScene(cmd_buf, worldViewProj, staticMeshPipeline.getVkPipelineLayout());
+    // Newly disoccluded instances are drawn on top, along with the ones from the pre-pass
+    buildHiZ(cmd_buf);
+    cullOnGpu(cmd_buf, OCCLUSION_SECOND_PHASE);
+    renderForward(
+      cmd_buf,
+      target_image,
+      target_image_view,
+      useDepthPrepass ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad,
+      vk::AttachmentLoadOp::eLoad);
   }
+
+  const double recordingTime = std::chrono::duration<double, std::milli>(
+                                 std::chrono::steady_clock::now() - recordingStart)
+                                 .count();
+  TracyPlot("renderWorld CPU ms", recordingTime);
 }
@@ -1,21 +1,30 @@
 #pragma once
 
+#include <array>
+
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
 #include <etna/GraphicsPipeline.hpp>
+#include <etna/ComputePipeline.hpp>
 #include <glm/glm.hpp>
 
 #include "scene/SceneManager.hpp"
+#include "occlusion/OcclusionRasterizer.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
+#include "shaders/MeshletCulling.h"
+#include "shaders/LodSelection.h"
+#include "shaders/InstanceCulling.h"
+#include "shaders/HizBuild.h"
 
 
 class WorldRenderer
 {
 public:
-  WorldRenderer();
+  // Every loaded scene is laid out this many times, see SceneManager::CreateInfo
+  explicit WorldRenderer(std::uint32_t scene_copies);
 
   void loadScene(std::filesystem::path path);
 
@@ -24,32 +33,137 @@ public:
   void setupPipelines(vk::Format swapchain_format);
 
   void debugInput(const Keyboard& kb);
+  // Logs the instance and relem under the cursor, given in pixels
+  void pick(glm::vec2 cursor_pos);
   void update(const FramePacket& packet);
   void drawGui();
   void renderWorld(
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
 private:
+  void selectLods(vk::CommandBuffer cmd_buf);
+  void cullMeshlets(vk::CommandBuffer cmd_buf, std::uint32_t occlusion_phase);
+  void cullInstances(vk::CommandBuffer cmd_buf, std::uint32_t occlusion_phase);
+  // Either of the above, depending on the culling path
+  void cullOnGpu(vk::CommandBuffer cmd_buf, std::uint32_t occlusion_phase);
+  void buildHiZ(vk::CommandBuffer cmd_buf);
+  void renderDepthPrepass(vk::CommandBuffer cmd_buf);
+  void renderForward(
+    vk::CommandBuffer cmd_buf,
+    vk::Image target_image,
+    vk::ImageView target_image_view,
+    vk::AttachmentLoadOp color_load_op,
+    vk::AttachmentLoadOp depth_load_op);
+  void batchInstances();
+  void resetInstanceVisibility(vk::CommandBuffer cmd_buf);
+  void bindInstanceData(
+    vk::CommandBuffer cmd_buf, const char* program, const etna::GraphicsPipeline& pipeline);
   void renderScene(
     vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
 
 
 private:
+  // Matches numFramesInFlight of the Renderer
+  static constexpr std::uint32_t FRAMES_IN_FLIGHT = 2;
+
   std::unique_ptr<SceneManager> sceneMgr;
 
   etna::Image mainViewDepth;
+  // Farthest depth of 2x2, 4x4 and so on pixels of the main view, starts at half resolution
+  etna::Image hiZ;
+  std::uint32_t hizLevelCount = 0;
+  etna::Sampler hizSampler;
   etna::Buffer constants;
 
   struct PushConstants
   {
     glm::mat4x4 projView;
-    glm::mat4x4 model;
-  } pushConst2M;
+  } pushConst;
+
+  enum class CullingPath
+  {
+    // Instances are culled and LODs are selected on the CPU, a draw call per relem
+    Cpu,
+    // A compute shader culls instances and emits compacted draws of their relems,
+    // which are drawn with a single indirect draw with a count per index format
+    GpuInstances,
+    // Same, but meshlets of the selected LODs of visible instances are culled
+    // separately and drawn one by one
+    GpuMeshlets,
+  };
+  CullingPath cullingPath = CullingPath::GpuMeshlets;
+  bool useConeCulling = true;
+  MeshletCullingParams cullingParams{};
+  InstanceCullingParams instanceCullingParams{};
+
+  // Instances visible on the previous frame are drawn first, the depth they produce is
+  // used to cull everything else, which is then drawn too. Works on both GPU paths, the
+  // meshlet one also tests meshlets of newly visible instances. The CPU path has
+  // software occlusion culling instead.
+  bool useOcclusionCulling = true;
+  // Draw the previously visible instances into the depth buffer only, so that the forward
+  // pass shades every pixel once. Otherwise they are shaded right away.
+  bool useDepthPrepass = false;
+  // Whether each instance was visible last frame, reset when a new scene shows up.
+  // Buffers of previous scenes are kept for a frame in flight each, as those
+  // frames might still be using them.
+  etna::Buffer instanceVisibility;
+  std::array<etna::Buffer, FRAMES_IN_FLIGHT> retiredInstanceVisibility;
+  vk::Buffer visibilitySceneVertexBuffer;
+
+  // Pick simplified versions of meshes based on their size on screen
+  bool useLods = true;
+  LodSelectionParams lodParams{};
+  // LODs selected for the CPU path on the previous frame, for hysteresis
+  std::vector<std::uint32_t> instanceLods;
+  // Instances that passed frustum culling on the CPU path, reused between frames
+  std::vector<std::uint32_t> visibleInstances;
+  // Cull the scene BVH instead of testing every instance
+  bool useBvhCulling = true;
+  // Rasterize the largest visible instances on the CPU and drop the ones hidden behind them
+  bool useSoftwareOcclusion = false;
+  ThreadPool occlusionWorkers;
+  OcclusionRasterizer occlusionRasterizer;
+
+  // Visible instances of the same mesh with the same LOD, drawn by the CPU path
+  // with a single instanced draw call per relem
+  struct InstanceBatch
+  {
+    std::uint32_t firstRelem;
+    std::uint32_t relemCount;
+    std::uint32_t firstInstance;
+    std::uint32_t instanceCount;
+  };
+  struct BatchKey
+  {
+    std::uint32_t mesh;
+    std::uint32_t lod;
+    std::uint32_t instance;
+  };
+  std::vector<InstanceBatch> instanceBatches;
+  std::vector<BatchKey> batchKeys;
+
+  // Instance data of the batched instances, written every frame in batch order. There's a buffer
+  // per frame in flight, so that frames on the GPU don't see the data changing.
+  struct FrameInstanceBuffer
+  {
+    etna::Buffer buffer;
+    std::size_t capacity = 0;
+  };
+  std::array<FrameInstanceBuffer, FRAMES_IN_FLIGHT> frameInstanceBuffers;
+  std::uint32_t frameIndex = 0;
 
   glm::mat4x4 worldViewProj;
   glm::mat4x4 lightMatrix;
 
   etna::GraphicsPipeline staticMeshPipeline{};
+  etna::GraphicsPipeline quantizedStaticMeshPipeline{};
+  etna::GraphicsPipeline depthOnlyPipeline{};
+  etna::GraphicsPipeline quantizedDepthOnlyPipeline{};
+  etna::ComputePipeline lodSelectionPipeline{};
+  etna::ComputePipeline meshletCullingPipeline{};
+  etna::ComputePipeline instanceCullingPipeline{};
+  etna::ComputePipeline hizBuildPipeline{};
 
   glm::uvec2 resolution;
 };
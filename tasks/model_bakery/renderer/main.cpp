@@ -1,10 +1,37 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <span>
+#include <string_view>
+
+#include <spdlog/spdlog.h>
+
 #include "App.hpp"
 
 
-int main()
+static constexpr std::string_view USAGE = R"(Usage: model_bakery_renderer [--copies=N]
+  --copies=N  lay the scene out N times on a grid, for comparing culling paths
+              on scenes with 10k+ instances)";
+
+int main(int argc, char** argv)
 {
+  std::uint32_t sceneCopies = 1;
+  for (std::string_view arg : std::span(argv + 1, argv + argc))
+  {
+    constexpr std::string_view COPIES = "--copies=";
+    const auto value = arg.substr(std::min(arg.size(), COPIES.size()));
+    const auto [ptr, error] =
+      std::from_chars(value.data(), value.data() + value.size(), sceneCopies);
+    if (!arg.starts_with(COPIES) || error != std::errc{} || ptr != value.data() + value.size() ||
+      sceneCopies == 0)
+    {
+      spdlog::error("{}", USAGE);
+      return EXIT_FAILURE;
+    }
+  }
+
   {
-    App app;
+    App app{sceneCopies};
     app.run();
   }
 
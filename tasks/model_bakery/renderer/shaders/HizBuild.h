@@ -0,0 +1,14 @@
+#ifndef HIZ_BUILD_H_INCLUDED
+#define HIZ_BUILD_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+struct HizBuildParams
+{
+  shader_uvec2 srcSize;
+  shader_uvec2 dstSize;
+};
+
+
+#endif // HIZ_BUILD_H_INCLUDED
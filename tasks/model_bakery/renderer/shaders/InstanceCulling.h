@@ -0,0 +1,34 @@
+#ifndef INSTANCE_CULLING_H_INCLUDED
+#define INSTANCE_CULLING_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Frustum culling only, every instance is emitted
+#define OCCLUSION_DISABLED 0
+// Emits the instances that were visible on the previous frame
+#define OCCLUSION_FIRST_PHASE 1
+// Tests instances against the Hi-Z pyramid built from the depth of the first phase
+// and remembers the result for the next frame
+#define OCCLUSION_SECOND_PHASE 2
+
+struct InstanceCullingParams
+{
+  // Frustum planes are extracted from it by the shader, it also
+  // projects the bounds of instances for occlusion culling
+  shader_mat4 viewProj;
+  shader_uint instanceCount;
+  // Draws of relems with 16-bit indices start right after the room for 32-bit ones
+  shader_uint drawCapacity32;
+  shader_uint occlusionPhase;
+  // Whether the second phase emits instances drawn by the first one as well,
+  // which is needed when the first phase was only a depth pre-pass
+  shader_bool emitAllVisible;
+  // Resolution of the depth buffer the Hi-Z pyramid was built from
+  shader_uvec2 depthSize;
+  shader_uint hizLevelCount;
+  shader_uint padding;
+};
+
+
+#endif // INSTANCE_CULLING_H_INCLUDED
@@ -0,0 +1,22 @@
+#ifndef LOD_SELECTION_H_INCLUDED
+#define LOD_SELECTION_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+struct LodSelectionParams
+{
+  // World space, w is 1
+  shader_vec4 cameraPosition;
+  // Converts radius / distance into a radius in pixels
+  shader_float projectionScale;
+  // Negative values always select the full detail
+  shader_float maxPixelError;
+  // Fraction of the pixel error a LOD has to get below to be switched to a finer one,
+  // which keeps instances on a LOD boundary from flickering between two LODs
+  shader_float hysteresis;
+  shader_uint instanceCount;
+};
+
+
+#endif // LOD_SELECTION_H_INCLUDED
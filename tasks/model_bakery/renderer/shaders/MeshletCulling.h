@@ -0,0 +1,28 @@
+#ifndef MESHLET_CULLING_H_INCLUDED
+#define MESHLET_CULLING_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+// For the OCCLUSION_* phases, which are the same for both culling shaders
+#include "InstanceCulling.h"
+
+
+struct MeshletCullingParams
+{
+  // Frustum planes are extracted from it by the shader, it also
+  // projects the bounds of instances and meshlets for occlusion culling
+  shader_mat4 viewProj;
+  // World space, w is 1
+  shader_vec4 cameraPosition;
+  shader_uint instanceCount;
+  // Draws of meshlets of relems with 16-bit indices start right after the room for 32-bit ones
+  shader_uint drawCapacity32;
+  shader_bool coneCulling;
+  // Same as in InstanceCullingParams, visibility is tracked per instance
+  shader_uint occlusionPhase;
+  shader_bool emitAllVisible;
+  shader_uint hizLevelCount;
+  shader_uvec2 depthSize;
+};
+
+
+#endif // MESHLET_CULLING_H_INCLUDED
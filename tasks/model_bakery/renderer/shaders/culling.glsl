@@ -0,0 +1,97 @@
+#ifndef CULLING_GLSL_INCLUDED
+#define CULLING_GLSL_INCLUDED
+
+// Tests shared by the instance and meshlet culling shaders
+
+
+// Same as the CPU path does with the world space boxes of instances, see cull_boxes
+bool is_box_inside_frustum(mat4 view_proj, vec3 center, vec3 extent)
+{
+  // Rows of the matrix, the planes are sums and differences of them (Gribb-Hartmann).
+  // The near plane is just the third row, as depth is in [0, 1].
+  const mat4 m = transpose(view_proj);
+  const vec4 planes[6] =
+    vec4[6](m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[2], m[3] - m[2]);
+  for (int i = 0; i < 6; ++i)
+    if (dot(planes[i].xyz, center) + planes[i].w < -dot(abs(planes[i].xyz), extent))
+      return false;
+  return true;
+}
+
+// The radius has to be in world space too
+bool is_sphere_inside_frustum(mat4 view_proj, vec3 center, float radius)
+{
+  // Same planes as above, which are not normalized
+  const mat4 m = transpose(view_proj);
+  const vec4 planes[6] =
+    vec4[6](m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[2], m[3] - m[2]);
+  for (int i = 0; i < 6; ++i)
+    if (dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz))
+      return false;
+  return true;
+}
+
+// Half extent of the world space box around the model space one with the given
+// half extent (Arvo), its center is simply transformed by the model matrix
+vec3 world_box_extent(mat4 model, vec3 half_extent)
+{
+  return abs(model[0].xyz) * half_extent.x + abs(model[1].xyz) * half_extent.y +
+    abs(model[2].xyz) * half_extent.z;
+}
+
+// Whether any part of the model space box might be visible over the Hi-Z pyramid, see
+// hiz_build.comp, which was built from a depth buffer of depth_size
+bool is_visible_over_hiz(
+  sampler2D hiz,
+  uint hiz_level_count,
+  uvec2 depth_size,
+  mat4 view_proj,
+  mat4 model,
+  vec3 box_min,
+  vec3 box_max)
+{
+  // Screen bounds of the box, which is usually a lot tighter than a bounding sphere,
+  // especially for long and thin things like fences and walls
+  vec3 ndcMin = vec3(1.0f);
+  vec3 ndcMax = vec3(-1.0f);
+  for (uint i = 0; i < 8; ++i)
+  {
+    const vec3 corner = vec3(
+      (i & 1) == 0 ? box_min.x : box_max.x,
+      (i & 2) == 0 ? box_min.y : box_max.y,
+      (i & 4) == 0 ? box_min.z : box_max.z);
+    const vec4 clip = view_proj * (model * vec4(corner, 1.0f));
+    // Crosses the camera plane, nothing to project
+    if (clip.w <= 0.0f)
+      return true;
+    const vec3 ndc = clip.xyz / clip.w;
+    ndcMin = min(ndcMin, ndc);
+    ndcMax = max(ndcMax, ndc);
+  }
+  if (ndcMin.z < 0.0f)
+    return true;
+
+  const vec2 uvMin = clamp(ndcMin.xy * 0.5f + 0.5f, 0.0f, 1.0f);
+  const vec2 uvMax = clamp(ndcMax.xy * 0.5f + 0.5f, 0.0f, 1.0f);
+  const uvec2 pixelMin = min(uvec2(uvMin * vec2(depth_size)), depth_size - 1);
+  const uvec2 pixelMax = min(uvec2(uvMax * vec2(depth_size)), depth_size - 1);
+
+  // The level where the pixel range spans at most two texels. Level L of the depth
+  // buffer is level L - 1 of the pyramid, as the pyramid starts at half resolution.
+  const uvec2 extent = pixelMax - pixelMin + 1;
+  const uint level =
+    clamp(uint(ceil(log2(float(max(extent.x, extent.y))))), 1u, hiz_level_count);
+  const ivec2 levelSize = textureSize(hiz, int(level - 1));
+  const ivec2 texelMin = min(ivec2(pixelMin >> level), levelSize - 1);
+  const ivec2 texelMax = min(ivec2(pixelMax >> level), levelSize - 1);
+
+  float maxDepth = 0.0f;
+  for (int y = texelMin.y; y <= texelMax.y; ++y)
+    for (int x = texelMin.x; x <= texelMax.x; ++x)
+      maxDepth = max(maxDepth, texelFetch(hiz, ivec2(x, y), int(level - 1)).x);
+
+  // The nearest point of the bounds is behind everything already drawn there
+  return ndcMin.z <= maxDepth;
+}
+
+#endif // CULLING_GLSL_INCLUDED
@@ -3,6 +3,7 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "unpack_attributes.glsl"
+#include "instance_data.glsl"
 
 
 layout(location = 0) in vec4 vPosNorm;
@@ -11,9 +12,14 @@ layout(location = 1) in vec4 vTexCoordAndTang;
 layout(push_constant) uniform params_t
 {
   mat4 mProjView;
-  mat4 mModel;
 } params;
 
+// Indexed by the first instance of the draw call
+layout(std430, binding = 0) readonly buffer Instances
+{
+  InstanceData instances[];
+};
+
 
 layout (location = 0 ) out VS_OUT
 {
@@ -23,16 +29,20 @@ layout (location = 0 ) out VS_OUT
   vec2 texCoord;
 } vOut;
 
-out gl_PerVertex { vec4 gl_Position; };
+// The depth pre-pass and the forward pass must produce exactly the same depth
+out gl_PerVertex { invariant vec4 gl_Position; };
 
 void main(void)
 {
+  const InstanceData instance = instances[gl_InstanceIndex];
+  const mat3 mNormal = instance_normal_matrix(instance);
+
   const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
   const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
 
-  vOut.wPos   = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-  vOut.wNorm  = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
-  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
+  vOut.wPos   = instance_transform_point(instance, vPosNorm.xyz);
+  vOut.wNorm  = normalize(mNormal * wNorm.xyz);
+  vOut.wTangent = normalize(mNormal * wTang.xyz);
   vOut.texCoord = vTexCoordAndTang.xy;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
@@ -0,0 +1,52 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "unpack_attributes.glsl"
+#include "instance_data.glsl"
+
+
+// Hardware converts these from snorm16, snorm8 and half floats respectively
+layout(location = 0) in vec4 vPos;
+layout(location = 1) in vec4 vNormTang;
+layout(location = 2) in vec2 vTexCoord;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+} params;
+
+// Indexed by the first instance of the draw call. Model matrices
+// include the dequantization transforms of their meshes.
+layout(std430, binding = 0) readonly buffer Instances
+{
+  InstanceData instances[];
+};
+
+
+layout (location = 0 ) out VS_OUT
+{
+  vec3 wPos;
+  vec3 wNorm;
+  vec3 wTangent;
+  vec2 texCoord;
+} vOut;
+
+// The depth pre-pass and the forward pass must produce exactly the same depth
+out gl_PerVertex { invariant vec4 gl_Position; };
+
+void main(void)
+{
+  const InstanceData instance = instances[gl_InstanceIndex];
+  const mat3 mNormal = instance_normal_matrix(instance);
+
+  const vec3 norm = decode_octahedral(vNormTang.xy);
+  const vec3 tang = decode_octahedral(vNormTang.zw);
+
+  vOut.wPos   = instance_transform_point(instance, vPos.xyz);
+  vOut.wNorm  = normalize(mNormal * norm);
+  vOut.wTangent = normalize(mNormal * tang);
+  vOut.texCoord = vTexCoord;
+
+  gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
+}
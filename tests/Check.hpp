@@ -0,0 +1,32 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+
+// Tests are plain executables run by ctest. A failed check is reported and the test
+// goes on, so that a single run lists all failures, see checks_result.
+
+inline int& failed_checks()
+{
+  static int count = 0;
+  return count;
+}
+
+#define CHECK(...)                                                                                 \
+  do                                                                                               \
+  {                                                                                                \
+    if (!(__VA_ARGS__))                                                                            \
+    {                                                                                              \
+      ++failed_checks();                                                                           \
+      spdlog::error("{}:{}: check failed: {}", __FILE__, __LINE__, #__VA_ARGS__);                  \
+    }                                                                                              \
+  } while (false)
+
+// Exit code of the test
+inline int checks_result()
+{
+  if (failed_checks() == 0)
+    return 0;
+  spdlog::error("{} check(s) failed", failed_checks());
+  return 1;
+}
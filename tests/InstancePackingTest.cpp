@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Check.hpp"
+#include "scene/InstancePacking.hpp"
+
+
+// Packs instance matrices with all kinds of scales and checks that normals transformed
+// by the packed normal matrix, the way instance_data.glsl unpacks it, point the right way.
+// Also checks that the SIMD and the scalar paths produce the same bits.
+
+// Mirrors unpack_snorm10 from instance_data.glsl
+static glm::vec3 unpack_snorm10(std::uint32_t packed)
+{
+  glm::vec3 result;
+  for (glm::length_t i = 0; i < 3; ++i)
+  {
+    const auto bits = static_cast<std::int32_t>(packed << (22 - 10 * i)) >> 22;
+    result[i] = std::max(static_cast<float>(bits) / 511.0f, -1.0f);
+  }
+  return result;
+}
+
+static glm::vec3 transform_normal(const InstanceData& instance, glm::vec3 normal)
+{
+  return unpack_snorm10(instance.normalColumns[0]) * normal.x +
+    unpack_snorm10(instance.normalColumns[1]) * normal.y +
+    unpack_snorm10(instance.normalColumns[2]) * normal.z;
+}
+
+// Inverse transpose of the upper 3x3 part up to a positive scale
+static glm::vec3 transform_normal_exact(const glm::mat4x4& model, glm::vec3 normal)
+{
+  const glm::vec3 c0{model[0]};
+  const glm::vec3 c1{model[1]};
+  const glm::vec3 c2{model[2]};
+  const glm::vec3 n0 = glm::cross(c1, c2);
+  const glm::vec3 n1 = glm::cross(c2, c0);
+  const glm::vec3 n2 = glm::cross(c0, c1);
+  const float sign = glm::dot(c0, n0) < 0 ? -1.0f : 1.0f;
+  return (n0 * normal.x + n1 * normal.y + n2 * normal.z) * sign;
+}
+
+static glm::mat4x4 make_matrix(glm::vec3 scale, float angle, glm::vec3 translation)
+{
+  // Rotation around y after the scale
+  const float c = std::cos(angle);
+  const float s = std::sin(angle);
+  glm::mat4x4 result{1.0f};
+  result[0] = glm::vec4(c * scale.x, 0, -s * scale.x, 0);
+  result[1] = glm::vec4(0, scale.y, 0, 0);
+  result[2] = glm::vec4(s * scale.z, 0, c * scale.z, 0);
+  result[3] = glm::vec4(translation, 1);
+  return result;
+}
+
+int main()
+{
+  struct Case
+  {
+    glm::vec3 scale;
+    // Smallest allowed cosine between the packed and the exact transformed normal
+    float minCos;
+  };
+  const std::vector<Case> cases{
+    {{1, 1, 1}, std::cos(glm::radians(1.0f))},
+    {{-1, 1, 1}, std::cos(glm::radians(1.0f))},
+    {{0.01f, 0.01f, 0.01f}, std::cos(glm::radians(1.0f))},
+    {{10, 1, 3}, std::cos(glm::radians(2.0f))},
+    // Beyond ~1000:1 the smallest entries only survive as a single LSB, so normals are
+    // bent, but they must never be lost or flipped
+    {{1000, 1, 1}, 0.0f},
+    {{1, 5000, 1}, 0.0f},
+    {{1e5f, 1, 1e-2f}, 0.0f},
+    {{1e-4f, 1, 1}, 0.0f},
+    {{-3000, 1, 2}, 0.0f},
+  };
+
+  std::mt19937 rng(11);
+  std::normal_distribution<float> gaussian;
+
+  std::vector<glm::mat4x4> matrices;
+  for (const auto& testCase : cases)
+    for (float angle : {0.0f, 0.3f, 1.2f})
+      matrices.push_back(make_matrix(testCase.scale, angle, glm::vec3(1, 2, 3)));
+
+  const std::vector<std::uint32_t> meshes(matrices.size(), 7);
+  std::vector<InstanceData> packed(matrices.size());
+  pack_instances(matrices, meshes, packed);
+
+  for (std::size_t i = 0; i < matrices.size(); ++i)
+  {
+    const auto& testCase = cases[i / 3];
+    CHECK(packed[i].mesh == 7);
+
+    std::vector<glm::vec3> normals{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {-1, 0, 0}};
+    for (int j = 0; j < 32; ++j)
+      normals.push_back(glm::normalize(glm::vec3(gaussian(rng), gaussian(rng), gaussian(rng))));
+
+    for (const auto& normal : normals)
+    {
+      const glm::vec3 transformed = transform_normal(packed[i], normal);
+      const float length = glm::length(transformed);
+      CHECK(std::isfinite(length) && length > 0.0f);
+      if (!(length > 0.0f))
+        continue;
+
+      const glm::vec3 exact = glm::normalize(transform_normal_exact(matrices[i], normal));
+      const float cosine = glm::dot(transformed / length, exact);
+      CHECK(cosine > testCase.minCos);
+    }
+  }
+
+  // Packing one by one goes through the scalar path only
+  for (std::size_t i = 0; i < matrices.size(); ++i)
+  {
+    InstanceData single;
+    pack_instances(
+      std::span(matrices).subspan(i, 1), std::span(meshes).subspan(i, 1), {&single, 1});
+    CHECK(std::memcmp(&single, &packed[i], sizeof(InstanceData)) == 0);
+  }
+
+  return checks_result();
+}
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "Check.hpp"
+#include "scene/Ktx2.hpp"
+
+
+// Writes KTX2 files and reads their header, data format descriptor and level index
+// back byte by byte, the way other tools would see them.
+
+static constexpr std::array<std::uint8_t, 12> KTX2_IDENTIFIER{
+  0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+static constexpr std::size_t HEADER_SIZE = 80;
+static constexpr std::size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+template <class T>
+static T read(const std::vector<std::byte>& file, std::size_t offset)
+{
+  T result{};
+  if (offset + sizeof(T) <= file.size())
+    std::memcpy(&result, file.data() + offset, sizeof(T));
+  return result;
+}
+
+struct ExpectedFormat
+{
+  vk::Format format;
+  std::uint32_t colorModel;
+  std::uint32_t sampleCount;
+  bool srgb;
+};
+
+static void check_round_trip(
+  const ExpectedFormat& expected, std::uint32_t width, std::uint32_t height)
+{
+  CompressedTexture texture{
+    .format = expected.format, .width = width, .height = height, .levels = {}};
+  for (std::uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+  {
+    // Every level gets its own recognizable contents
+    std::vector<std::byte> level(get_compressed_size(expected.format, w, h));
+    for (std::size_t i = 0; i < level.size(); ++i)
+      level[i] = static_cast<std::byte>(i * 7 + texture.levels.size() * 31);
+    texture.levels.push_back(std::move(level));
+    if (w == 1 && h == 1)
+      break;
+  }
+  const auto levelCount = static_cast<std::uint32_t>(texture.levels.size());
+
+  const auto path = std::filesystem::temp_directory_path() /
+    fmt::format(
+      "ktx2_test_{}_{}x{}.ktx2", static_cast<std::uint32_t>(expected.format), width, height);
+  CHECK(write_ktx2(path, texture));
+
+  std::vector<std::byte> file;
+  {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> chars{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    file.resize(chars.size());
+    std::memcpy(file.data(), chars.data(), chars.size());
+  }
+  std::error_code error;
+  std::filesystem::remove(path, error);
+
+  CHECK(file.size() > HEADER_SIZE);
+  CHECK(read<std::array<std::uint8_t, 12>>(file, 0) == KTX2_IDENTIFIER);
+  CHECK(read<std::uint32_t>(file, 12) == static_cast<std::uint32_t>(expected.format));
+  CHECK(read<std::uint32_t>(file, 16) == 1); // typeSize
+  CHECK(read<std::uint32_t>(file, 20) == width);
+  CHECK(read<std::uint32_t>(file, 24) == height);
+  CHECK(read<std::uint32_t>(file, 28) == 0); // pixelDepth
+  CHECK(read<std::uint32_t>(file, 32) == 0); // layerCount
+  CHECK(read<std::uint32_t>(file, 36) == 1); // faceCount
+  CHECK(read<std::uint32_t>(file, 40) == levelCount);
+  CHECK(read<std::uint32_t>(file, 44) == 0); // supercompressionScheme
+  CHECK(read<std::uint32_t>(file, 56) == 0); // kvdByteOffset
+  CHECK(read<std::uint32_t>(file, 60) == 0); // kvdByteLength
+  CHECK(read<std::uint64_t>(file, 64) == 0); // sgdByteOffset
+  CHECK(read<std::uint64_t>(file, 72) == 0); // sgdByteLength
+
+  // The DFD follows the level index
+  const auto dfdOffset = read<std::uint32_t>(file, 48);
+  const auto dfdLength = read<std::uint32_t>(file, 52);
+  CHECK(dfdOffset == HEADER_SIZE + levelCount * LEVEL_INDEX_ENTRY_SIZE);
+  CHECK(dfdOffset % 4 == 0);
+  CHECK(read<std::uint32_t>(file, dfdOffset) == dfdLength); // dfdTotalSize
+
+  // A single basic descriptor block
+  const std::size_t block = dfdOffset + 4;
+  CHECK(read<std::uint32_t>(file, block) == 0); // vendorId and descriptorType
+  const auto versionAndSize = read<std::uint32_t>(file, block + 4);
+  CHECK((versionAndSize & 0xFFFF) == 2);
+  CHECK((versionAndSize >> 16) == 24 + 16 * expected.sampleCount);
+  CHECK(dfdLength == 4 + (versionAndSize >> 16));
+  const auto modelAndTransfer = read<std::uint32_t>(file, block + 8);
+  CHECK((modelAndTransfer & 0xFF) == expected.colorModel);
+  CHECK(((modelAndTransfer >> 16) & 0xFF) == (expected.srgb ? 2u : 1u));
+  CHECK(read<std::uint32_t>(file, block + 12) == (3u | (3u << 8))); // 4x4 texel blocks
+  const std::size_t blockSize = get_block_size(expected.format);
+  CHECK(read<std::uint32_t>(file, block + 16) == blockSize); // bytesPlane0
+
+  // Levels are stored from the smallest to the largest one, right after the DFD
+  std::size_t previousEnd = dfdOffset + dfdLength;
+  for (std::uint32_t i = levelCount; i-- > 0;)
+  {
+    const std::size_t entry = HEADER_SIZE + i * LEVEL_INDEX_ENTRY_SIZE;
+    const auto byteOffset = read<std::uint64_t>(file, entry);
+    const auto byteLength = read<std::uint64_t>(file, entry + 8);
+    const auto uncompressedByteLength = read<std::uint64_t>(file, entry + 16);
+
+    CHECK(byteOffset % blockSize == 0 && byteOffset % 4 == 0);
+    CHECK(byteOffset >= previousEnd && byteOffset - previousEnd < blockSize);
+    CHECK(byteLength == texture.levels[i].size());
+    CHECK(uncompressedByteLength == byteLength);
+    CHECK(byteOffset + byteLength <= file.size());
+    if (byteOffset + byteLength <= file.size())
+      CHECK(std::ranges::equal(
+        std::span(file).subspan(byteOffset, byteLength), texture.levels[i]));
+    previousEnd = byteOffset + byteLength;
+  }
+  CHECK(previousEnd == file.size());
+
+  // And what we write, we can read
+  const auto parsed = parse_ktx2(file);
+  CHECK(parsed.has_value());
+  if (parsed.has_value())
+  {
+    CHECK(parsed->format == expected.format);
+    CHECK(parsed->width == width && parsed->height == height);
+    CHECK(parsed->levels.size() == levelCount);
+    for (std::size_t i = 0; i < std::min<std::size_t>(parsed->levels.size(), levelCount); ++i)
+      CHECK(std::ranges::equal(parsed->levels[i], texture.levels[i]));
+  }
+}
+
+int main()
+{
+  const std::array formats{
+    ExpectedFormat{vk::Format::eBc1RgbSrgbBlock, 128, 1, true},
+    ExpectedFormat{vk::Format::eBc3UnormBlock, 130, 2, false},
+    ExpectedFormat{vk::Format::eBc4UnormBlock, 131, 1, false},
+    ExpectedFormat{vk::Format::eBc5UnormBlock, 132, 2, false},
+    ExpectedFormat{vk::Format::eBc7SrgbBlock, 134, 1, true},
+  };
+
+  for (const auto& format : formats)
+  {
+    // Sizes that are not a multiple of the block size are rounded up to whole blocks
+    check_round_trip(format, 64, 64);
+    check_round_trip(format, 37, 5);
+    check_round_trip(format, 1, 1);
+  }
+
+  return checks_result();
+}
@@ -0,0 +1,102 @@
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Check.hpp"
+#include "scene/LodSelection.hpp"
+
+
+// Moves the camera back and forth around the distances at which LODs switch and
+// checks that the hysteresis keeps the selection from flip-flopping.
+
+static const LodCriteria CRITERIA{
+  .cameraPosition = glm::vec3(0.0f),
+  .projectionScale = 1000.0f,
+  .maxPixelError = 1.0f,
+  .hysteresis = 0.25f,
+};
+
+// Distance at which the LOD with the given error becomes good enough with the given limit
+static float switch_distance(const Mesh& mesh, float lod_error, float max_error)
+{
+  return lod_error * mesh.sphere.w * CRITERIA.projectionScale / max_error;
+}
+
+int main()
+{
+  const Mesh mesh{
+    .firstRelem = 0, .relemCount = 1, .firstLod = 0, .lodCount = 3, .sphere = {0, 0, 0, 1}};
+  const std::array<MeshLod, 3> lods{
+    MeshLod{.firstRelem = 1, .relemCount = 1, .error = 0.001f},
+    MeshLod{.firstRelem = 2, .relemCount = 1, .error = 0.004f},
+    MeshLod{.firstRelem = 3, .relemCount = 1, .error = 0.016f},
+  };
+
+  const auto select = [&](float distance, std::uint32_t current) {
+    glm::mat4x4 model(1.0f);
+    model[3] = glm::vec4(0, 0, distance, 1);
+    return select_lod(CRITERIA, mesh, lods, model, current);
+  };
+
+  // Close up everything is full detail, far away the coarsest LOD is enough
+  CHECK(select(0.5f, 3) == 0);
+  CHECK(select(1e6f, 0) == 3);
+
+  const float strictLimit = CRITERIA.maxPixelError * (1.0f - CRITERIA.hysteresis);
+  for (std::uint32_t i = 0; i < lods.size(); ++i)
+  {
+    // LOD i + 1 is allowed from here on, but only switched to from a finer one past `strict`
+    const float desired = switch_distance(mesh, lods[i].error, CRITERIA.maxPixelError);
+    const float strict = switch_distance(mesh, lods[i].error, strictLimit);
+    CHECK(desired < strict);
+
+    const float inside = (desired + strict) * 0.5f;
+    // Stepping within the hysteresis band keeps whatever LOD was selected before
+    CHECK(select(inside, i) == i);
+    CHECK(select(inside, i + 1) == i + 1);
+    // Past the band the selection switches regardless of the previous one
+    CHECK(select(desired * 0.99f, i + 1) == i);
+    CHECK(select(strict * 1.01f, i) == i + 1);
+
+    // Small steps back and forth across the threshold never switch more than once
+    std::uint32_t current = i;
+    std::uint32_t switches = 0;
+    for (int step = 0; step < 100; ++step)
+    {
+      const float distance = desired * ((step % 2 == 0) ? 0.995f : 1.005f);
+      const std::uint32_t next = select(distance, current);
+      switches += next != current;
+      current = next;
+    }
+    CHECK(switches == 0);
+    CHECK(current == i);
+
+    // Same across the strict threshold, after the first switch to the coarser LOD
+    current = i;
+    switches = 0;
+    for (int step = 0; step < 100; ++step)
+    {
+      const float distance = strict * ((step % 2 == 0) ? 1.005f : 0.995f);
+      const std::uint32_t next = select(distance, current);
+      switches += next != current;
+      current = next;
+    }
+    CHECK(switches == 1);
+    CHECK(current == i + 1);
+  }
+
+  // A full walk away and back switches every LOD once in each direction
+  std::vector<std::uint32_t> walk;
+  std::uint32_t current = 0;
+  for (int step = 0; step <= 400; ++step)
+  {
+    const float t = step <= 200 ? static_cast<float>(step) : static_cast<float>(400 - step);
+    const float distance = 1.0f + t * 0.5f;
+    current = select(distance, current);
+    if (walk.empty() || walk.back() != current)
+      walk.push_back(current);
+  }
+  CHECK(walk == std::vector<std::uint32_t>{0, 1, 2, 3, 2, 1, 0});
+
+  return checks_result();
+}
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Check.hpp"
+#include "scene/Meshlets.hpp"
+
+
+// Builds meshlets over a few synthetic meshes and checks the limits, the coverage
+// of triangles and that the bounds are conservative.
+
+struct TestMesh
+{
+  std::vector<glm::vec3> positions;
+  std::vector<std::uint32_t> indices;
+};
+
+// Grid of size x size vertices in the z = height(x, y) plane, with counter-clockwise
+// triangles when looking from +z
+template <class F>
+static TestMesh make_heightfield(std::uint32_t size, float spacing, F height)
+{
+  TestMesh mesh;
+  for (std::uint32_t y = 0; y < size; ++y)
+    for (std::uint32_t x = 0; x < size; ++x)
+    {
+      const float px = static_cast<float>(x) * spacing;
+      const float py = static_cast<float>(y) * spacing;
+      mesh.positions.emplace_back(px, py, height(px, py));
+    }
+
+  for (std::uint32_t y = 0; y + 1 < size; ++y)
+    for (std::uint32_t x = 0; x + 1 < size; ++x)
+    {
+      const std::uint32_t v = y * size + x;
+      mesh.indices.insert(mesh.indices.end(), {v, v + 1, v + size + 1});
+      mesh.indices.insert(mesh.indices.end(), {v, v + size + 1, v + size});
+    }
+  return mesh;
+}
+
+// Triangles between random vertices, which exhausts the vertex limit of meshlets first
+static TestMesh make_triangle_soup(std::uint32_t vertex_count, std::uint32_t triangle_count)
+{
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> coord(-10.0f, 10.0f);
+  std::uniform_int_distribution<std::uint32_t> vertex(0, vertex_count - 1);
+
+  TestMesh mesh;
+  for (std::uint32_t i = 0; i < vertex_count; ++i)
+    mesh.positions.emplace_back(coord(rng), coord(rng), coord(rng));
+  for (std::uint32_t i = 0; i < triangle_count * 3; ++i)
+    mesh.indices.push_back(vertex(rng));
+  return mesh;
+}
+
+static std::vector<Meshlet> check_meshlets(const TestMesh& mesh)
+{
+  std::vector<Meshlet> meshlets;
+  const std::size_t count = build_meshlets(mesh.indices, mesh.positions, meshlets);
+  CHECK(count == meshlets.size());
+
+  // Meshlets are consecutive ranges of indices, so covering every triangle exactly
+  // once means that each one starts right where the previous one ends
+  std::uint32_t expectedOffset = 0;
+  for (const auto& meshlet : meshlets)
+  {
+    CHECK(meshlet.indexOffset == expectedOffset);
+    CHECK(meshlet.indexCount > 0 && meshlet.indexCount % 3 == 0);
+    CHECK(meshlet.indexCount / 3 <= MAX_MESHLET_TRIANGLES);
+    expectedOffset = meshlet.indexOffset + meshlet.indexCount;
+
+    std::vector<std::uint32_t> vertices(
+      mesh.indices.begin() + meshlet.indexOffset,
+      mesh.indices.begin() + meshlet.indexOffset + meshlet.indexCount);
+    std::ranges::sort(vertices);
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+    CHECK(vertices.size() <= MAX_MESHLET_VERTICES);
+
+    const glm::vec3 center{meshlet.sphere};
+    for (auto v : vertices)
+      CHECK(glm::length(mesh.positions[v] - center) <= meshlet.sphere.w * (1.0f + 1e-5f));
+  }
+  CHECK(expectedOffset == mesh.indices.size());
+
+  return meshlets;
+}
+
+// The cone test may only cull meshlets all triangles of which face away from the camera
+static std::size_t check_backfacing_is_conservative(
+  const TestMesh& mesh, std::span<const Meshlet> meshlets)
+{
+  std::mt19937 rng(7);
+  std::normal_distribution<float> direction;
+
+  std::size_t culled = 0;
+  for (int i = 0; i < 256; ++i)
+  {
+    const glm::vec3 camera =
+      glm::vec3(5.0f, 5.0f, 0.0f) +
+      glm::normalize(glm::vec3(direction(rng), direction(rng), direction(rng))) * 20.0f;
+
+    for (const auto& meshlet : meshlets)
+    {
+      if (!is_meshlet_backfacing(meshlet, camera))
+        continue;
+      ++culled;
+
+      for (std::uint32_t j = meshlet.indexOffset; j < meshlet.indexOffset + meshlet.indexCount;
+           j += 3)
+      {
+        const glm::vec3 p0 = mesh.positions[mesh.indices[j + 0]];
+        const glm::vec3 p1 = mesh.positions[mesh.indices[j + 1]];
+        const glm::vec3 p2 = mesh.positions[mesh.indices[j + 2]];
+        CHECK(glm::dot(glm::cross(p1 - p0, p2 - p0), p0 - camera) >= 0.0f);
+      }
+    }
+  }
+  return culled;
+}
+
+int main()
+{
+  // Limits and coverage
+  check_meshlets(make_triangle_soup(1000, 3000));
+  check_meshlets(make_heightfield(64, 0.1f, [](float, float) { return 0.0f; }));
+
+  // Cone of a flat patch facing +z
+  {
+    const auto flat = make_heightfield(6, 0.1f, [](float, float) { return 0.0f; });
+    const auto meshlets = check_meshlets(flat);
+    CHECK(meshlets.size() == 1);
+    for (const auto& meshlet : meshlets)
+    {
+      CHECK(glm::length(glm::vec3(meshlet.cone) - glm::vec3(0, 0, 1)) < 1e-5f);
+      CHECK(std::abs(meshlet.cone.w) < 1e-5f);
+
+      const glm::vec3 center{meshlet.sphere};
+      CHECK(is_meshlet_backfacing(meshlet, center - glm::vec3(0, 0, 10)));
+      CHECK(!is_meshlet_backfacing(meshlet, center + glm::vec3(0, 0, 10)));
+      // Grazing views see the patch edge-on, but the sphere may still peek over the plane
+      CHECK(!is_meshlet_backfacing(meshlet, center + glm::vec3(10, 0, 0)));
+    }
+  }
+
+  // Cones of a curved surface against the triangles themselves
+  {
+    const auto bumpy = make_heightfield(
+      100, 0.1f, [](float x, float y) { return 0.3f * std::sin(x) * std::cos(y); });
+    const auto meshlets = check_meshlets(bumpy);
+    CHECK(check_backfacing_is_conservative(bumpy, meshlets) > 0);
+  }
+
+  return checks_result();
+}
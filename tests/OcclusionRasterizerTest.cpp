@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include "Check.hpp"
+#include "occlusion/OcclusionRasterizer.hpp"
+
+
+// Rasterizes a fixed set of occluders serially and on several threads, in different orders,
+// expecting exactly the same depth, and tests boxes that are known to be visible or hidden.
+
+static constexpr float NEAR = 0.1f;
+static constexpr float FAR = 100.0f;
+
+struct Occluder
+{
+  std::vector<glm::vec3> positions;
+  std::vector<std::uint32_t> indices;
+  glm::mat4x4 model{1.0f};
+};
+
+// Camera at the origin looking along +z, the wall is a 10 x 6 quad 10 units away
+static std::vector<Occluder> make_occluders()
+{
+  std::vector<Occluder> result;
+
+  result.push_back(Occluder{
+    .positions = {{-5, -3, 10}, {5, -3, 10}, {5, 3, 10}, {-5, 3, 10}},
+    .indices = {0, 1, 2, 0, 2, 3},
+  });
+
+  // A unit cube moved and scaled by its model matrix, partially behind the wall
+  Occluder cube{
+    .positions =
+      {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0}, {0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}},
+    .indices = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5},
+    .model = glm::mat4x4(1.0f),
+  };
+  cube.model[0] = glm::vec4(4, 0, 0, 0);
+  cube.model[1] = glm::vec4(0, 4, 0, 0);
+  cube.model[2] = glm::vec4(0, 0, 4, 0);
+  cube.model[3] = glm::vec4(3, -6, 8, 1);
+  result.push_back(std::move(cube));
+
+  // A floor crossing the near plane, which has to be clipped
+  result.push_back(Occluder{
+    .positions = {{-20, -4, -5}, {20, -4, -5}, {20, -4, 60}, {-20, -4, 60}},
+    .indices = {0, 2, 1, 0, 3, 2},
+  });
+
+  // Random overlapping triangles on the left side of the screen, which make the order matter
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float> x(-40.0f, -6.0f);
+  std::uniform_real_distribution<float> y(-30.0f, 30.0f);
+  std::uniform_real_distribution<float> z(12.0f, 50.0f);
+  Occluder clutter;
+  for (std::uint32_t i = 0; i < 300; ++i)
+  {
+    clutter.positions.emplace_back(x(rng), y(rng), z(rng));
+    clutter.indices.push_back(i);
+  }
+  clutter.indices.resize(clutter.indices.size() / 3 * 3);
+  result.push_back(std::move(clutter));
+
+  return result;
+}
+
+static std::vector<float> rasterize(
+  OcclusionRasterizer& rasterizer,
+  const glm::mat4x4& view_proj,
+  std::span<const Occluder> occluders,
+  bool reversed)
+{
+  rasterizer.beginFrame(view_proj);
+  for (std::size_t i = 0; i < occluders.size(); ++i)
+  {
+    const auto& occluder = occluders[reversed ? occluders.size() - 1 - i : i];
+    rasterizer.addOccluder(occluder.positions, occluder.indices, occluder.model);
+  }
+  rasterizer.rasterize();
+  return {rasterizer.getDepth().begin(), rasterizer.getDepth().end()};
+}
+
+int main()
+{
+  const glm::mat4x4 viewProj = glm::perspectiveLH_ZO(glm::radians(90.0f), 2.0f, NEAR, FAR);
+  const auto occluders = make_occluders();
+
+  OcclusionRasterizer serial{OcclusionRasterizer::CreateInfo{.width = 256, .height = 128}};
+  const auto serialDepth = rasterize(serial, viewProj, occluders, false);
+
+  ThreadPool workers(3);
+  OcclusionRasterizer parallel{
+    OcclusionRasterizer::CreateInfo{.width = 256, .height = 128, .workers = &workers}};
+  for (bool reversed : {false, true})
+  {
+    const auto parallelDepth = rasterize(parallel, viewProj, occluders, reversed);
+    CHECK(parallelDepth.size() == serialDepth.size());
+    CHECK(std::memcmp(
+            parallelDepth.data(),
+            serialDepth.data(),
+            std::min(parallelDepth.size(), serialDepth.size()) * sizeof(float)) == 0);
+  }
+
+  // The center of the screen sees the wall, nearer than anything behind it
+  {
+    const auto center = serialDepth[64 * 256 + 128];
+    const float wallDepth = FAR / (FAR - NEAR) * (1.0f - NEAR / 10.0f);
+    CHECK(std::abs(center - wallDepth) < 1e-5f);
+  }
+
+  struct KnownBox
+  {
+    glm::vec3 min;
+    glm::vec3 max;
+    bool visible;
+  };
+  const std::array boxes{
+    // Right behind the wall
+    KnownBox{{-1, -1, 20}, {1, 1, 22}, false},
+    KnownBox{{-4, -2, 10.5f}, {4, 2, 11}, false},
+    // In front of it
+    KnownBox{{-1, -1, 5}, {1, 1, 6}, true},
+    // Behind, but peeking out to the side or from above
+    KnownBox{{4, -1, 20}, {14, 1, 22}, true},
+    KnownBox{{-1, 2, 20}, {1, 8, 22}, true},
+    // Larger than the shadow of the wall
+    KnownBox{{-20, -1, 20}, {20, 1, 22}, true},
+    // Under the floor
+    KnownBox{{-1, -10, 20}, {1, -5, 22}, false},
+    // Crossing the near plane
+    KnownBox{{-1, -1, -1}, {1, 1, 1}, true},
+    // Off screen
+    KnownBox{{100, -1, 20}, {110, 1, 22}, false},
+  };
+  for (const auto& box : boxes)
+  {
+    CHECK(serial.isBoxVisible(box.min, box.max) == box.visible);
+    CHECK(parallel.isBoxVisible(box.min, box.max) == box.visible);
+  }
+
+  // Without occluders, everything on screen is visible
+  serial.beginFrame(viewProj);
+  serial.rasterize();
+  CHECK(serial.isBoxVisible({-1, -1, 20}, {1, 1, 22}));
+  CHECK(!serial.isBoxVisible({100, -1, 20}, {110, 1, 22}));
+
+  return checks_result();
+}
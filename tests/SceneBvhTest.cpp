@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "Check.hpp"
+#include "scene/SceneBvh.hpp"
+
+
+// Compares every kind of BVH query against brute force over random boxes, for serial and
+// parallel builds and after a refit. Ray, sphere and box queries test the very same boxes
+// in the same way, so they have to match exactly. Frustum culling may disagree on boxes
+// that touch a plane, as the hierarchy tests them through a different path.
+
+static constexpr std::size_t BOX_COUNT = 3000;
+static constexpr std::size_t QUERY_COUNT = 200;
+static constexpr float PLANE_TOLERANCE = 1e-3f;
+
+static BoxesSoa make_boxes(std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+  std::uniform_real_distribution<float> extent(0.1f, 3.0f);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  BoxesSoa boxes;
+  boxes.resize(BOX_COUNT);
+  for (std::size_t i = 0; i < BOX_COUNT; ++i)
+  {
+    // Some instances have no geometry at all
+    if (unit(rng) < 0.05f)
+    {
+      boxes.set(i, Aabb{.min = glm::vec3(1.0f), .max = glm::vec3(-1.0f)}, glm::mat4x4(1.0f));
+      continue;
+    }
+    const glm::vec3 center(position(rng), position(rng), position(rng));
+    const glm::vec3 halfExtent(extent(rng), extent(rng), extent(rng));
+    boxes.set(i, Aabb{.min = center - halfExtent, .max = center + halfExtent}, glm::mat4x4(1.0f));
+  }
+  return boxes;
+}
+
+static bool is_empty(const BoxesSoa& boxes, std::size_t i)
+{
+  return !(boxes.extentX[i] >= 0);
+}
+
+// Empty boxes stay empty, as they are not a part of the hierarchy at all
+static void move_boxes(BoxesSoa& boxes, std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> offset(-5.0f, 5.0f);
+  for (std::size_t i = 0; i < boxes.count; ++i)
+  {
+    if (is_empty(boxes, i))
+      continue;
+    boxes.centerX[i] += offset(rng);
+    boxes.centerY[i] += offset(rng);
+    boxes.centerZ[i] += offset(rng);
+    boxes.extentX[i] *= 2.0f;
+    boxes.extentY[i] *= 2.0f;
+    boxes.extentZ[i] *= 2.0f;
+  }
+}
+
+static bool overlaps_sphere(const Aabb& box, glm::vec3 center, float radius)
+{
+  const glm::vec3 offset = glm::clamp(center, box.min, box.max) - center;
+  return glm::dot(offset, offset) <= radius * radius;
+}
+
+static bool overlaps_box(const Aabb& a, const Aabb& b)
+{
+  return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
+}
+
+// A 90 degree frustum looking along +z from `apex`, from 1 to 100 units away
+static Frustum make_frustum(glm::vec3 apex)
+{
+  const float s = 1.0f / std::sqrt(2.0f);
+  Frustum result{{
+    glm::vec4(s, 0, s, 0),
+    glm::vec4(-s, 0, s, 0),
+    glm::vec4(0, s, s, 0),
+    glm::vec4(0, -s, s, 0),
+    glm::vec4(0, 0, 1, -1),
+    glm::vec4(0, 0, -1, 100),
+  }};
+  for (auto& plane : result.planes)
+    plane.w -= glm::dot(glm::vec3(plane), apex);
+  return result;
+}
+
+// Smallest signed distance by which the box is inside of a frustum plane
+static float frustum_margin(const Frustum& frustum, const Aabb& box)
+{
+  const glm::vec3 center = (box.min + box.max) * 0.5f;
+  const glm::vec3 extent = (box.max - box.min) * 0.5f;
+  float result = std::numeric_limits<float>::max();
+  for (const auto& plane : frustum.planes)
+  {
+    const glm::vec3 normal{plane};
+    result =
+      std::min(result, glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent));
+  }
+  return result;
+}
+
+static void check_queries(const SceneBvh& bvh, const BoxesSoa& boxes, std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+  std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> size(0.5f, 10.0f);
+
+  std::vector<std::uint32_t> found;
+  std::vector<std::uint32_t> expected;
+
+  for (std::size_t q = 0; q < QUERY_COUNT; ++q)
+  {
+    const glm::vec3 point(position(rng), position(rng), position(rng));
+
+    // Closest hit, including rays that start inside of boxes and rays along an axis
+    glm::vec3 direction(signedUnit(rng), signedUnit(rng), signedUnit(rng));
+    if (q % 8 == 0)
+      direction = glm::vec3(0.0f, 0.0f, q % 16 == 0 ? 1.0f : -1.0f);
+    const glm::vec3 invDirection = 1.0f / direction;
+    float bruteDistance = std::numeric_limits<float>::infinity();
+    for (std::size_t i = 0; i < boxes.count; ++i)
+      if (auto distance = intersect_ray_box(point, invDirection, get_box(boxes, i), bruteDistance))
+        bruteDistance = *distance;
+
+    const auto hit = bvh.raycast(SceneBvh::Ray{.origin = point, .direction = direction});
+    CHECK(hit.has_value() == std::isfinite(bruteDistance));
+    if (hit.has_value())
+    {
+      CHECK(hit->distance == bruteDistance);
+      CHECK(hit->primitive < boxes.count);
+      // Ties may be broken either way, but the reported box has to be hit there
+      if (hit->primitive < boxes.count)
+        CHECK(
+          intersect_ray_box(
+            point,
+            invDirection,
+            get_box(boxes, hit->primitive),
+            std::numeric_limits<float>::infinity()) == hit->distance);
+    }
+
+    // Spheres
+    const float radius = size(rng);
+    expected.clear();
+    for (std::uint32_t i = 0; i < boxes.count; ++i)
+      if (!is_empty(boxes, i) && overlaps_sphere(get_box(boxes, i), point, radius))
+        expected.push_back(i);
+    found.clear();
+    bvh.overlapSphere(point, radius, found);
+    std::ranges::sort(found);
+    CHECK(found == expected);
+
+    // Boxes
+    const Aabb query{.min = point, .max = point + glm::vec3(size(rng), size(rng), size(rng))};
+    expected.clear();
+    for (std::uint32_t i = 0; i < boxes.count; ++i)
+      if (!is_empty(boxes, i) && overlaps_box(get_box(boxes, i), query))
+        expected.push_back(i);
+    found.clear();
+    bvh.overlapBox(query, found);
+    std::ranges::sort(found);
+    CHECK(found == expected);
+  }
+
+  // Frustums from all over the place, every box reported once
+  for (std::size_t q = 0; q < QUERY_COUNT / 4; ++q)
+  {
+    const Frustum frustum = make_frustum(glm::vec3(position(rng), position(rng), -60.0f));
+
+    found.clear();
+    bvh.cullFrustum(frustum, found);
+    std::ranges::sort(found);
+    CHECK(std::ranges::adjacent_find(found) == found.end());
+
+    std::vector<bool> reported(boxes.count, false);
+    for (auto i : found)
+      if (i < boxes.count)
+        reported[i] = true;
+
+    std::size_t misses = 0;
+    for (std::uint32_t i = 0; i < boxes.count; ++i)
+    {
+      if (is_empty(boxes, i))
+      {
+        misses += reported[i];
+        continue;
+      }
+      const float margin = frustum_margin(frustum, get_box(boxes, i));
+      if (margin > PLANE_TOLERANCE)
+        misses += !reported[i];
+      else if (margin < -PLANE_TOLERANCE)
+        misses += reported[i];
+    }
+    CHECK(misses == 0);
+  }
+}
+
+int main()
+{
+  std::mt19937 rng(1234);
+  auto boxes = make_boxes(rng);
+
+  SceneBvh serial;
+  serial.build(boxes, nullptr);
+  CHECK(!serial.empty());
+  check_queries(serial, boxes, rng);
+
+  ThreadPool workers(3);
+  SceneBvh parallel;
+  parallel.build(boxes, &workers);
+  check_queries(parallel, boxes, rng);
+
+  // Everything moves and grows, but the hierarchy only gets refit
+  move_boxes(boxes, rng);
+  serial.refit(boxes);
+  check_queries(serial, boxes, rng);
+
+  // Nothing to find in an empty hierarchy
+  SceneBvh empty;
+  BoxesSoa noBoxes;
+  noBoxes.resize(0);
+  empty.build(noBoxes, nullptr);
+  CHECK(!empty.raycast(SceneBvh::Ray{.origin = glm::vec3(0), .direction = glm::vec3(1, 0, 0)}));
+
+  return checks_result();
+}
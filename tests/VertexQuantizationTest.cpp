@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Check.hpp"
+#include "scene/VertexQuantization.hpp"
+
+
+// Quantizes a thin box and checks that normals survive the trip through the
+// octahedral encoding and the dequantization transform, as the vertex shader does it.
+
+// Mirrors decode_octahedral from unpack_attributes.glsl
+static glm::vec3 decode_octahedral(glm::vec2 enc)
+{
+  glm::vec3 n(enc.x, enc.y, 1.0f - std::abs(enc.x) - std::abs(enc.y));
+  const float t = std::max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return glm::normalize(n);
+}
+
+static glm::vec3 decode_snorm8_octahedral(std::int8_t x, std::int8_t y)
+{
+  const auto decode = [](std::int8_t value) { return std::max(value / 127.0f, -1.0f); };
+  return decode_octahedral({decode(x), decode(y)});
+}
+
+int main()
+{
+  // 10 x 0.2 x 4 box, with normals that are mostly tangent to the long sides,
+  // which is where a non-uniform dequantization scale hurts the most
+  const std::array<glm::vec3, 8> positions{
+    glm::vec3(-5.0f, -0.1f, -2.0f),
+    glm::vec3(5.0f, -0.1f, -2.0f),
+    glm::vec3(-5.0f, 0.1f, -2.0f),
+    glm::vec3(5.0f, 0.1f, -2.0f),
+    glm::vec3(-5.0f, -0.1f, 2.0f),
+    glm::vec3(5.0f, -0.1f, 2.0f),
+    glm::vec3(-5.0f, 0.1f, 2.0f),
+    glm::vec3(5.0f, 0.1f, 2.0f),
+  };
+  const std::array<glm::vec3, 8> normals{
+    glm::normalize(glm::vec3(1.0f, 0.02f, 0.0f)),
+    glm::normalize(glm::vec3(0.0f, 1.0f, 0.0f)),
+    glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f)),
+    glm::normalize(glm::vec3(0.7f, -0.1f, 0.7f)),
+    glm::normalize(glm::vec3(0.0f, 0.05f, -1.0f)),
+    glm::normalize(glm::vec3(-1.0f, -1.0f, -1.0f)),
+    glm::normalize(glm::vec3(0.0f, 0.0f, 1.0f)),
+    glm::normalize(glm::vec3(-0.6f, 0.01f, 0.8f)),
+  };
+
+  std::vector<PackedVertex> vertices;
+  for (std::size_t i = 0; i < positions.size(); ++i)
+  {
+    const glm::vec3 tangent = glm::normalize(glm::cross(normals[i], glm::vec3(0.3f, 0.5f, 0.8f)));
+    vertices.push_back(PackedVertex{
+      .positionAndNormal = glm::vec4(positions[i], std::bit_cast<float>(encode_normal(normals[i]))),
+      .texCoordAndTangentAndPadding =
+        glm::vec4(0.0f, 0.0f, std::bit_cast<float>(encode_normal(tangent)), 0.0f),
+    });
+  }
+
+  const std::vector<std::uint32_t> indices{0, 1, 2, 3, 4, 5, 6, 7};
+  const std::array relems{RenderElement{.vertexOffset = 0, .indexOffset = 0, .indexCount = 8}};
+  const std::array meshes{Mesh{.firstRelem = 0, .relemCount = 1}};
+
+  const auto quantized = quantize_geometry(vertices, indices, relems, meshes);
+  CHECK(quantized.vertices.size() == vertices.size());
+  CHECK(quantized.dequantization.size() == 1);
+
+  const glm::mat4x4& dequantization = quantized.dequantization[0];
+  const glm::mat3x3 normalMatrix = glm::transpose(glm::inverse(glm::mat3x3(dequantization)));
+
+  // Octahedral snorm8 is good to about a degree
+  const float minNormalCos = std::cos(glm::radians(2.0f));
+  const float maxPositionError = 10.0f / 32767.0f;
+
+  for (std::size_t i = 0; i < vertices.size(); ++i)
+  {
+    const auto& vertex = quantized.vertices[i];
+
+    const glm::vec3 position =
+      glm::vec3(dequantization * glm::vec4(dequantize_position(vertex), 1.0f));
+    CHECK(glm::all(
+      glm::lessThanEqual(glm::abs(position - positions[i]), glm::vec3(maxPositionError))));
+
+    // Both are transformed by the normal matrix in static_mesh_quantized.vert
+    const glm::vec3 normal = glm::normalize(
+      normalMatrix *
+      decode_snorm8_octahedral(vertex.normalAndTangent[0], vertex.normalAndTangent[1]));
+    CHECK(glm::dot(normal, normals[i]) >= minNormalCos);
+
+    const glm::vec3 tangent = glm::normalize(
+      normalMatrix *
+      decode_snorm8_octahedral(vertex.normalAndTangent[2], vertex.normalAndTangent[3]));
+    const glm::vec3 expectedTangent = decode_normal(
+      std::bit_cast<std::uint32_t>(vertices[i].texCoordAndTangentAndPadding.z));
+    CHECK(glm::dot(tangent, expectedTangent) >= minNormalCos);
+  }
+
+  return checks_result();
+}